@@ -0,0 +1,142 @@
+#include "AsyncLogging.h"
+#include "LogFile.h"
+#include "Timestamp.h"
+
+#include <chrono>
+#include <stdio.h>
+
+AsyncLogging::AsyncLogging(const std::string &basename, off_t rollSize, int flushInterval)
+    : flushInterval_(flushInterval),
+      basename_(basename),
+      rollSize_(rollSize),
+      running_(false),
+      thread_(std::bind(&AsyncLogging::threadFunc, this), "Logging"),
+      currentBuffer_(new LogBuffer),
+      nextBuffer_(new LogBuffer)
+{
+    buffers_.reserve(16);
+}
+
+AsyncLogging::~AsyncLogging()
+{
+    stop();
+}
+
+void AsyncLogging::append(const char *logline, size_t len)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (currentBuffer_->avail() > len)
+    {
+        currentBuffer_->append(logline, len);
+        return;
+    }
+
+    // 当前缓冲区写满了，交给后台，换上备用的
+    buffers_.push_back(std::move(currentBuffer_));
+    if (nextBuffer_)
+    {
+        currentBuffer_ = std::move(nextBuffer_);
+    }
+    else
+    {
+        currentBuffer_.reset(new LogBuffer); // 前台写得太快，备用的也用掉了，很少发生
+    }
+    currentBuffer_->append(logline, len);
+    cond_.notify_one();
+}
+
+void AsyncLogging::start()
+{
+    running_ = true;
+    thread_.start();
+}
+
+void AsyncLogging::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_); // 在锁里改，后台不会错过这次notify
+        if (!running_.exchange(false))
+        {
+            return;
+        }
+    }
+    cond_.notify_one();
+    thread_.join();
+}
+
+void AsyncLogging::threadFunc()
+{
+    LogFile output(basename_, rollSize_);
+    BufferPtr newBuffer1(new LogBuffer);
+    BufferPtr newBuffer2(new LogBuffer);
+    BufferVector buffersToWrite;
+    buffersToWrite.reserve(16);
+
+    while (running_)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (buffers_.empty() && running_) // 没有写满的缓冲区就最多等flushInterval秒
+            {
+                cond_.wait_for(lock, std::chrono::seconds(flushInterval_));
+            }
+            buffers_.push_back(std::move(currentBuffer_));
+            currentBuffer_ = std::move(newBuffer1);
+            buffersToWrite.swap(buffers_);
+            if (!nextBuffer_)
+            {
+                nextBuffer_ = std::move(newBuffer2);
+            }
+        }
+
+        // 下面都在锁外面，前台可以继续追加
+        if (buffersToWrite.size() > kMaxPendingBuffers)
+        {
+            char note[256];
+            int n = snprintf(note, sizeof note, "[ERROR]%s : dropped log messages, %zu larger buffers\n",
+                             Timestamp::now().toFormattedString().c_str(), buffersToWrite.size() - 2);
+            fputs(note, stderr);
+            output.append(note, n);
+            buffersToWrite.erase(buffersToWrite.begin() + 2, buffersToWrite.end()); // 只留前两块
+        }
+
+        for (const BufferPtr &buffer : buffersToWrite)
+        {
+            output.append(buffer->data.get(), buffer->len);
+        }
+
+        // 留两块还给前台用，多出来的释放掉
+        if (buffersToWrite.size() > 2)
+        {
+            buffersToWrite.resize(2);
+        }
+        if (!newBuffer1)
+        {
+            newBuffer1 = std::move(buffersToWrite.back());
+            buffersToWrite.pop_back();
+            newBuffer1->len = 0;
+        }
+        if (!newBuffer2)
+        {
+            newBuffer2 = std::move(buffersToWrite.back());
+            buffersToWrite.pop_back();
+            newBuffer2->len = 0;
+        }
+        buffersToWrite.clear();
+        output.flush();
+    }
+
+    // stop()之后把还没写的都写进去
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const BufferPtr &buffer : buffers_)
+    {
+        output.append(buffer->data.get(), buffer->len);
+    }
+    buffers_.clear();
+    if (currentBuffer_)
+    {
+        output.append(currentBuffer_->data.get(), currentBuffer_->len);
+        currentBuffer_->len = 0;
+    }
+    output.flush();
+}
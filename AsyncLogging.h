@@ -0,0 +1,72 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <atomic>
+#include <cstring>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * @brief 异步日志，前台线程只往内存里追加，后台线程批量写文件
+ *
+ * 双缓冲：前台往currentBuffer_里追加，写满了就换上备用的nextBuffer_，写满的缓冲区交给后台；
+ * 后台被唤醒（有写满的缓冲区，或者每隔flushInterval秒）时把待写的缓冲区整个换走，
+ * 在锁外面一次写进LogFile，再把两块空缓冲区还给前台。前台临界区里只有一次memcpy，不碰磁盘。
+ *
+ * 用法：
+ *     AsyncLogging log("/var/log/server", 64 * 1024 * 1024);
+ *     log.start();
+ *     Logger::instance().setOutput(std::bind(&AsyncLogging::append, &log, _1, _2));
+ *     Logger::instance().setFlush(std::bind(&AsyncLogging::stop, &log));
+ */
+class AsyncLogging : noncopyable
+{
+public:
+    // basename和rollSize见LogFile，flushInterval是后台最多隔多少秒把日志写到文件里
+    AsyncLogging(const std::string &basename, off_t rollSize, int flushInterval = 3);
+    ~AsyncLogging();
+
+    void append(const char *logline, size_t len); // 线程安全
+
+    void start();
+    void stop(); // 把已经追加的日志都写进文件再退出，可以重复调用
+
+private:
+    static const size_t kBufferSize = 4 * 1024 * 1024;
+    static const size_t kMaxPendingBuffers = 25; // 后台写不过来时最多积压多少块，再多就丢掉
+
+    struct LogBuffer
+    {
+        LogBuffer() : data(new char[kBufferSize]), len(0) {}
+        size_t avail() const { return kBufferSize - len; }
+        void append(const char *buf, size_t n)
+        {
+            memcpy(data.get() + len, buf, n);
+            len += n;
+        }
+        std::unique_ptr<char[]> data;
+        size_t len;
+    };
+    using BufferPtr = std::unique_ptr<LogBuffer>;
+    using BufferVector = std::vector<BufferPtr>;
+
+    void threadFunc();
+
+    const int flushInterval_;
+    const std::string basename_;
+    const off_t rollSize_;
+    std::atomic_bool running_;
+    Thread thread_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    BufferPtr currentBuffer_; // 前台正在写的
+    BufferPtr nextBuffer_;    // 备用的，current写满了直接换上，不用在临界区里分配
+    BufferVector buffers_;    // 写满了、等后台写文件的
+};
@@ -0,0 +1,376 @@
+#include "BinaryLogging.h"
+#include "LogFile.h"
+#include "Logger.h"
+#include "Timestamp.h"
+#include "CurrentThread.h"
+
+#include <algorithm>
+#include <new>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+const char BinaryLogging::kMagic[8] = {'M', 'Y', 'M', 'D', 'B', 'L', 'G', '1'};
+const size_t BinaryLogging::kMaxStringLen;
+
+std::atomic_bool BinaryLogging::active_(false);
+__thread BinaryLogging::StagingBuffer *BinaryLogging::t_stagingBuffer = nullptr;
+std::mutex BinaryLogging::registryMutex_;
+std::vector<BinaryLogging::Site> BinaryLogging::sites_;
+std::vector<BinaryLogging::StagingBuffer *> BinaryLogging::buffers_;
+
+BinaryLogging::StagingBuffer::StagingBuffer(int threadId)
+    : tid(threadId),
+      dropped(0),
+      retired(false),
+      inUse(false),
+      producerPos_(0),
+      endOfRecorded_(kCapacity),
+      minFreeSpace_(kCapacity),
+      consumerPos_(0)
+{
+}
+
+// 生产者看到的空闲空间不够了，重新看一下消费者读到了哪里，必要时绕回开头
+// 生产者和消费者的位置永远不会因为写入而重合（重合表示空），所以空闲空间要严格大于bytes
+char *BinaryLogging::StagingBuffer::reserveSlow(size_t bytes)
+{
+    size_t producer = producerPos_.load(std::memory_order_relaxed);
+    size_t consumer = consumerPos_.load(std::memory_order_acquire);
+    if (consumer <= producer)
+    {
+        minFreeSpace_ = kCapacity - producer;
+        if (minFreeSpace_ > bytes)
+        {
+            return storage_ + producer;
+        }
+        // 尾部放不下，消费者不在开头就绕回去；消费者在开头时绕回去会和它重合
+        if (consumer != 0)
+        {
+            endOfRecorded_.store(producer, std::memory_order_relaxed);
+            producerPos_.store(0, std::memory_order_release);
+            producer = 0;
+            minFreeSpace_ = consumer;
+        }
+    }
+    else
+    {
+        minFreeSpace_ = consumer - producer;
+    }
+    return minFreeSpace_ > bytes ? storage_ + producer : nullptr;
+}
+
+const char *BinaryLogging::StagingBuffer::peek(size_t *bytes)
+{
+    size_t producer = producerPos_.load(std::memory_order_acquire);
+    size_t consumer = consumerPos_.load(std::memory_order_relaxed);
+    if (producer < consumer) // 生产者已经绕回开头了，先把尾部读完
+    {
+        size_t end = endOfRecorded_.load(std::memory_order_relaxed);
+        if (end > consumer)
+        {
+            *bytes = end - consumer;
+            return storage_ + consumer;
+        }
+        consumerPos_.store(0, std::memory_order_release);
+        consumer = 0;
+    }
+    *bytes = producer - consumer;
+    return storage_ + consumer;
+}
+
+// 格式串里用*指定宽度或精度时，宽度本身也是一个参数，站点表里的类型和转换说明就对不上了，解码会把后面的参数全部错开
+static bool hasStarConversion(const char *fmt)
+{
+    for (const char *p = fmt; *p; ++p)
+    {
+        if (*p != '%')
+        {
+            continue;
+        }
+        ++p;
+        if (*p == '%')
+        {
+            continue;
+        }
+        while (*p && strchr("-+ #0123456789.", *p))
+        {
+            ++p;
+        }
+        if (*p == '*')
+        {
+            return true;
+        }
+        if (*p == '\0')
+        {
+            break;
+        }
+    }
+    return false;
+}
+
+int BinaryLogging::registerSite(std::atomic_int &site, int level, const char *file, int line, const char *fmt, const char *types)
+{
+    if (hasStarConversion(fmt))
+    {
+        LOG_FATAL("BinaryLogging: %s:%d \"%s\" uses * width/precision, which cannot be recorded\n", file, line, fmt);
+    }
+    std::lock_guard<std::mutex> lock(registryMutex_);
+    int id = site.load(std::memory_order_relaxed);
+    if (id < 0) // 可能别的线程刚登记过
+    {
+        id = static_cast<int>(sites_.size());
+        Site s = {level, line, file, fmt, types};
+        sites_.push_back(std::move(s));
+        site.store(id, std::memory_order_release);
+    }
+    return id;
+}
+
+namespace
+{
+    // 线程退出时析构，把这个线程的缓冲区标记成可以释放
+    struct StagingBufferRetirer
+    {
+        std::atomic_bool *retired = nullptr;
+        ~StagingBufferRetirer()
+        {
+            if (retired)
+            {
+                retired->store(true, std::memory_order_release);
+            }
+        }
+    };
+}
+
+BinaryLogging::StagingBuffer *BinaryLogging::createStagingBuffer()
+{
+    static thread_local StagingBufferRetirer retirer;
+    // StagingBuffer里有alignas(64)的成员，C++11的operator new不保证这个对齐，自己对齐分配，placement new构造
+    void *memory = nullptr;
+    if (::posix_memalign(&memory, alignof(StagingBuffer), sizeof(StagingBuffer)) != 0)
+    {
+        LOG_FATAL("BinaryLogging: posix_memalign failed\n");
+    }
+    StagingBuffer *buffer = new (memory) StagingBuffer(CurrentThread::tid());
+    retirer.retired = &buffer->retired;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex_);
+        buffers_.push_back(buffer);
+    }
+    t_stagingBuffer = buffer;
+    return buffer;
+}
+
+BinaryLogging::BinaryLogging(const std::string &basename, off_t rollSize, int flushInterval)
+    : basename_(basename),
+      rollSize_(rollSize),
+      flushInterval_(flushInterval),
+      running_(false),
+      thread_(std::bind(&BinaryLogging::threadFunc, this), "BinaryLogging"),
+      startTicks_(0),
+      startMonotonicNs_(0),
+      ticksPerMicro_(1)
+{
+}
+
+BinaryLogging::~BinaryLogging()
+{
+    stop();
+}
+
+static int64_t monotonicNs()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+void BinaryLogging::start()
+{
+    if (active_.load())
+    {
+        fprintf(stderr, "BinaryLogging::start() another BinaryLogging is running\n");
+        return;
+    }
+    // 先粗略校准一次时钟，后台线程运行时再用更长的时间段修正
+    startTicks_ = readTicks();
+    startMonotonicNs_ = monotonicNs();
+    ::usleep(10 * 1000);
+    ticksPerMicro_ = static_cast<double>(readTicks() - startTicks_) * 1000 / (monotonicNs() - startMonotonicNs_);
+
+    running_ = true;
+    thread_.start();
+    active_.store(true);
+}
+
+void BinaryLogging::stop()
+{
+    if (!running_.load())
+    {
+        return;
+    }
+    active_.store(false); // 先让LOG_*改回文本，后台线程再读最后一轮
+    if (!running_.exchange(false))
+    {
+        return;
+    }
+    // 已经过了active()检查的调用可能还在往缓冲区里写，等它们commit完，否则最后一轮读不到，
+    // 下次start()时还会被算到新的时钟换算上。写的过程中不会拿registryMutex_，拿着锁等不会死锁，
+    // 也能防止后台线程这时释放退出线程的缓冲区；这之后才新建的缓冲区一定能看到active_已经是false
+    {
+        std::lock_guard<std::mutex> lock(registryMutex_);
+        for (StagingBuffer *buffer : buffers_)
+        {
+            while (buffer->inUse.load(std::memory_order_acquire))
+            {
+                sched_yield();
+            }
+        }
+    }
+    thread_.join();
+}
+
+template <typename T>
+static void appendPod(std::string &out, T value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof value);
+}
+
+static void appendString16(std::string &out, const std::string &s)
+{
+    uint16_t len = static_cast<uint16_t>(std::min<size_t>(s.size(), UINT16_MAX));
+    appendPod(out, len);
+    out.append(s.data(), len);
+}
+
+// 新文件的开头是魔数，后面紧跟着会把目前所有的站点再写一遍，这样每个文件都能单独解码
+void BinaryLogging::writeHeader(std::string &out)
+{
+    out.append(kMagic, sizeof kMagic);
+}
+
+void BinaryLogging::writeAnchor(std::string &out)
+{
+    uint64_t ticks = readTicks();
+    int64_t micros = Timestamp::now().microSecondsSinceEpoch();
+    int64_t elapsedNs = monotonicNs() - startMonotonicNs_;
+    if (elapsedNs > 100 * 1000 * 1000) // 跑得越久，换算比例越准
+    {
+        ticksPerMicro_ = static_cast<double>(ticks - startTicks_) * 1000 / elapsedNs;
+    }
+    out.push_back(kAnchorRecord);
+    appendPod(out, ticks);
+    appendPod(out, micros);
+    appendPod(out, ticksPerMicro_);
+}
+
+void BinaryLogging::threadFunc()
+{
+    LogFile output(basename_, rollSize_, flushInterval_);
+    std::string currentFile;
+    size_t sitesWritten = 0;
+    std::string records;
+    std::vector<StagingBuffer *> buffers;
+    time_t lastFlush = ::time(NULL);
+
+    bool draining = true; // stop()之后还要再读一轮，把剩下的写完
+    while (draining)
+    {
+        draining = running_;
+
+        {
+            std::lock_guard<std::mutex> lock(registryMutex_);
+            buffers = buffers_;
+        }
+
+        bool wrote = false;
+        for (StagingBuffer *buffer : buffers)
+        {
+            // 每个缓冲区最多读两段（绕回开头的时候是两段），生产者一直在写也不会一直追下去
+            for (int part = 0; part < 2; ++part)
+            {
+                size_t bytes = 0;
+                const char *data = buffer->peek(&bytes);
+                uint64_t dropped = buffer->dropped.exchange(0, std::memory_order_relaxed);
+                if (bytes == 0 && dropped == 0)
+                {
+                    break;
+                }
+
+                records.clear();
+                bool newFile = output.currentFile() != currentFile;
+                if (newFile) // 新文件，重新写文件头和全部站点
+                {
+                    currentFile = output.currentFile();
+                    sitesWritten = 0;
+                    writeHeader(records);
+                }
+                // 先看到了日志再读站点表，日志里用到的站点一定已经登记了
+                {
+                    std::lock_guard<std::mutex> lock(registryMutex_);
+                    for (; sitesWritten < sites_.size(); ++sitesWritten)
+                    {
+                        const Site &site = sites_[sitesWritten];
+                        records.push_back(kSiteRecord);
+                        appendPod(records, static_cast<uint32_t>(sitesWritten));
+                        appendPod(records, static_cast<uint8_t>(site.level));
+                        appendPod(records, static_cast<uint32_t>(site.line));
+                        appendString16(records, site.file);
+                        appendString16(records, site.fmt);
+                        appendPod(records, static_cast<uint8_t>(site.types.size()));
+                        records.append(site.types);
+                    }
+                }
+                if (!wrote || newFile)
+                {
+                    writeAnchor(records); // 这一轮的日志都按这个点换算时间
+                    wrote = true;
+                }
+                if (dropped > 0)
+                {
+                    records.push_back(kDropRecord);
+                    appendPod(records, static_cast<int32_t>(buffer->tid));
+                    appendPod(records, dropped);
+                }
+                if (bytes > 0)
+                {
+                    records.push_back(kChunkRecord);
+                    appendPod(records, static_cast<int32_t>(buffer->tid));
+                    appendPod(records, static_cast<uint32_t>(bytes));
+                }
+                // 记录和日志一次写进去，LogFile只会在两次append之间换文件，不会把一个chunk拆到两个文件里
+                records.append(data, bytes);
+                output.append(records.data(), records.size());
+                buffer->consume(bytes);
+            }
+        }
+
+        // 线程已经退出、缓冲区也读空了的，释放掉
+        for (StagingBuffer *buffer : buffers)
+        {
+            size_t bytes = 0;
+            if (buffer->retired.load(std::memory_order_acquire) && (buffer->peek(&bytes), bytes == 0) &&
+                buffer->dropped.load(std::memory_order_relaxed) == 0)
+            {
+                std::lock_guard<std::mutex> lock(registryMutex_);
+                buffers_.erase(std::find(buffers_.begin(), buffers_.end(), buffer));
+                buffer->~StagingBuffer();
+                ::free(buffer);
+            }
+        }
+
+        time_t now = ::time(NULL);
+        if (!wrote) // 空闲的时候睡一会儿，生产者不会通知后台线程
+        {
+            if (now - lastFlush >= flushInterval_)
+            {
+                output.flush();
+                lastFlush = now;
+            }
+            ::usleep(1000);
+        }
+    }
+    output.flush();
+}
@@ -0,0 +1,285 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @brief 二进制日志（NanoLog的做法），调用线程不做任何格式化
+ *
+ * 每个LOG_*调用点第一次执行时把格式串、文件行号和参数类型登记一次，拿到一个站点id；
+ * 之后每次调用只把 站点id + 时钟计数 + 原始参数 拷进本线程自己的无锁环形缓冲区（单生产者单消费者）。
+ * 后台线程轮询各个线程的缓冲区，把字节原样写进文件，同时写入站点表和时钟的换算关系，
+ * 离线用tools/logdecode把文件还原成和Logger一样的文本。
+ *
+ * start()之后LOG_DEBUG/LOG_INFO/LOG_ERROR自动走这条路，不用改调用的地方；LOG_FATAL仍然是文本。
+ * 缓冲区满了（后台写不过来）时这条日志直接丢掉并计数，不会阻塞IO线程，解码时能看到丢了多少条。
+ * 参数只支持整数、枚举、浮点、指针和C字符串，字符串最多记kMaxStringLen个字节；同一个宏调用也会编出
+ * Logger::logf的变参版本，std::string要自己传.c_str()。格式串里不能用*指定宽度或精度（%*d、%.*s），
+ * 登记站点时会直接LOG_FATAL。
+ * 文件里的数字都是本机字节序，要在同一种机器上解码。
+ *
+ * 用法：
+ *     BinaryLogging log("/var/log/server.blog", 256 * 1024 * 1024);
+ *     log.start();
+ *     ...
+ *     log.stop();
+ */
+class BinaryLogging : noncopyable
+{
+public:
+    // basename和rollSize见LogFile，每个文件开头都会重新写一遍站点表，可以单独解码
+    BinaryLogging(const std::string &basename, off_t rollSize, int flushInterval = 3);
+    ~BinaryLogging();
+
+    void start(); // 同一时间只能有一个BinaryLogging在运行
+    void stop();  // 等正在写的LOG_*写完，再把已经记下的日志写完退出，可以重复调用
+
+    static bool active() { return active_.load(std::memory_order_relaxed); }
+
+    // 由LOG_*宏调用，site是调用点的静态变量，第一次调用时登记。
+    // 返回false表示二进制日志已经停了，这条没有记下来，调用的地方改用文本日志；缓冲区满了丢掉的算记下了
+    template <typename... Args>
+    static bool log(std::atomic_int &site, int level, const char *file, int line, const char *fmt, const Args &...args)
+    {
+        int id = site.load(std::memory_order_acquire);
+        if (__builtin_expect(id < 0, 0))
+        {
+            id = registerSite(site, level, file, line, fmt, argTypes<typename std::decay<Args>::type...>());
+        }
+        StagingBuffer *buffer = t_stagingBuffer;
+        if (__builtin_expect(buffer == nullptr, 0))
+        {
+            buffer = createStagingBuffer();
+        }
+        // 先标记正在写再重新看一眼active_，和stop()里先清active_再等inUse的顺序配对（都是seq_cst）：
+        // 要么这里看到已经停了，要么stop()等到这条commit完，后台线程最后一轮一定能读到
+        buffer->inUse.store(true);
+        if (__builtin_expect(!active_.load(), 0))
+        {
+            buffer->inUse.store(false, std::memory_order_release);
+            return false;
+        }
+        size_t size = sizeof(EntryHeader) + argsSize(args...);
+        char *p = buffer->reserve(size);
+        if (p == nullptr)
+        {
+            buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            EntryHeader header = {static_cast<uint32_t>(size), static_cast<uint32_t>(id), readTicks()};
+            memcpy(p, &header, sizeof header);
+            writeArgs(p + sizeof header, args...);
+            buffer->commit(size);
+        }
+        buffer->inUse.store(false, std::memory_order_release);
+        return true;
+    }
+
+    // 时钟计数：x86上是rdtsc，其它平台是CLOCK_MONOTONIC的纳秒，后台线程会记下它和墙上时间的换算关系
+    static uint64_t readTicks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        struct timespec ts;
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+#endif
+    }
+
+    // 下面是文件格式，tools/logdecode也用它们
+    // 文件开头是kMagic，后面是一条条记录，每条记录第一个字节是类型
+    static const char kMagic[8];
+    enum RecordType : char
+    {
+        kSiteRecord = 'S',   // 站点：uint32 id, uint8 level, uint32 line, uint16+文件名, uint16+格式串, uint8+参数类型
+        kAnchorRecord = 'T', // 时钟换算：uint64 ticks, int64 墙上时间微秒, double 每微秒多少ticks
+        kChunkRecord = 'C',  // 一个线程的一批日志：int32 tid, uint32 字节数, 后面是连续的EntryHeader+参数
+        kDropRecord = 'D',   // int32 tid, uint64 这段时间丢了多少条
+    };
+
+    // 参数类型：i有符号整数 u无符号整数 d浮点 p指针 都是8个字节；s字符串是uint32长度+内容
+    struct EntryHeader
+    {
+        uint32_t size; // 包括EntryHeader在内的总字节数
+        uint32_t site;
+        uint64_t ticks;
+    };
+
+    static const size_t kMaxStringLen = 1024;
+
+private:
+    // 每个线程一个，单生产者（写日志的线程）单消费者（后台线程）的环形缓冲区
+    // 一条日志总是占一段连续的空间，尾部放不下时记下endOfRecorded_，从头开始写
+    struct StagingBuffer
+    {
+        static const size_t kCapacity = 1024 * 1024;
+
+        explicit StagingBuffer(int tid);
+
+        char *reserve(size_t bytes) // 调用线程
+        {
+            if (__builtin_expect(bytes < minFreeSpace_, 1))
+            {
+                return storage_ + producerPos_.load(std::memory_order_relaxed);
+            }
+            return reserveSlow(bytes);
+        }
+        void commit(size_t bytes) // 调用线程
+        {
+            minFreeSpace_ -= bytes;
+            producerPos_.store(producerPos_.load(std::memory_order_relaxed) + bytes, std::memory_order_release);
+        }
+        char *reserveSlow(size_t bytes);
+
+        const char *peek(size_t *bytes); // 后台线程，返回可以读的一段连续字节
+        void consume(size_t bytes) { consumerPos_.store(consumerPos_.load(std::memory_order_relaxed) + bytes, std::memory_order_release); }
+
+        const int tid;
+        std::atomic<uint64_t> dropped;
+        std::atomic_bool retired; // 线程已经退出，读空以后由后台线程释放
+        std::atomic_bool inUse;   // 调用线程正在往里写一条日志，stop()要等它写完
+
+    private:
+        alignas(64) std::atomic<size_t> producerPos_;
+        std::atomic<size_t> endOfRecorded_; // 生产者绕回开头之前写到了哪里
+        size_t minFreeSpace_;               // 生产者确定还能写的字节数，不够了再去看消费者的位置
+        alignas(64) std::atomic<size_t> consumerPos_;
+        char storage_[kCapacity];
+    };
+
+    struct Site
+    {
+        int level;
+        int line;
+        std::string file;
+        std::string fmt;
+        std::string types;
+    };
+
+    static int registerSite(std::atomic_int &site, int level, const char *file, int line, const char *fmt, const char *types);
+    static StagingBuffer *createStagingBuffer();
+
+    // 参数的类型标记，枚举按有符号整数记；不支持的类型（比如std::string）落到这里编译不过
+    template <typename T, typename Enable = void>
+    struct ArgType
+    {
+        static_assert(std::is_same<T, void>::value && !std::is_same<T, void>::value,
+                      "LOG_* only accepts integers, enums, floating point, pointers and C strings; pass std::string as .c_str()");
+    };
+
+    template <typename... Args>
+    static const char *argTypes()
+    {
+        static const char types[] = {ArgType<Args>::value..., '\0'};
+        return types;
+    }
+
+    // 每个参数占多少字节、怎么写进缓冲区
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, size_t>::type argSize(const T &) { return 8; }
+    static size_t argSize(double) { return 8; }
+    static size_t argSize(const char *s) { return 4 + (s ? strnlen(s, kMaxStringLen) : 0); }
+    template <typename T>
+    static size_t argSize(const T *) { return 8; }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, char *>::type writeArg(char *p, const T &v)
+    {
+        typedef typename std::conditional<std::is_signed<T>::value || std::is_enum<T>::value, int64_t, uint64_t>::type Wide;
+        Wide wide = static_cast<Wide>(v);
+        memcpy(p, &wide, 8);
+        return p + 8;
+    }
+    static char *writeArg(char *p, double v)
+    {
+        memcpy(p, &v, 8);
+        return p + 8;
+    }
+    static char *writeString(char *p, const char *s, size_t len)
+    {
+        uint32_t len32 = static_cast<uint32_t>(len);
+        memcpy(p, &len32, 4);
+        memcpy(p + 4, s, len);
+        return p + 4 + len;
+    }
+    static char *writeArg(char *p, const char *s) { return writeString(p, s, s ? strnlen(s, kMaxStringLen) : 0); }
+    template <typename T>
+    static char *writeArg(char *p, const T *ptr)
+    {
+        uint64_t v = reinterpret_cast<uintptr_t>(ptr);
+        memcpy(p, &v, 8);
+        return p + 8;
+    }
+
+    static size_t argsSize() { return 0; }
+    template <typename T, typename... Rest>
+    static size_t argsSize(const T &arg, const Rest &...rest) { return argSize(arg) + argsSize(rest...); }
+
+    static void writeArgs(char *) {}
+    template <typename T, typename... Rest>
+    static void writeArgs(char *p, const T &arg, const Rest &...rest) { writeArgs(writeArg(p, arg), rest...); }
+
+    void threadFunc();
+    void writeHeader(std::string &out);
+    void writeAnchor(std::string &out);
+
+    static std::atomic_bool active_;
+    static __thread StagingBuffer *t_stagingBuffer;
+
+    // 所有站点和所有线程的缓冲区，都由registryMutex_保护
+    static std::mutex registryMutex_;
+    static std::vector<Site> sites_;
+    static std::vector<StagingBuffer *> buffers_;
+
+    const std::string basename_;
+    const off_t rollSize_;
+    const int flushInterval_;
+    std::atomic_bool running_;
+    Thread thread_;
+
+    // 时钟换算：start()时校准一次，后台线程运行过程中不断用更长的时间段修正
+    uint64_t startTicks_;
+    int64_t startMonotonicNs_;
+    double ticksPerMicro_;
+};
+
+template <typename T>
+struct BinaryLogging::ArgType<T, typename std::enable_if<std::is_enum<T>::value || (std::is_integral<T>::value && std::is_signed<T>::value)>::type>
+{
+    static const char value = 'i';
+};
+template <typename T>
+struct BinaryLogging::ArgType<T, typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type>
+{
+    static const char value = 'u';
+};
+template <typename T>
+struct BinaryLogging::ArgType<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+    static const char value = 'd';
+};
+template <typename T>
+struct BinaryLogging::ArgType<T *, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type>
+{
+    static const char value = 'p';
+};
+template <typename T>
+struct BinaryLogging::ArgType<T *, typename std::enable_if<std::is_same<typename std::remove_cv<T>::type, char>::value>::type>
+{
+    static const char value = 's';
+};
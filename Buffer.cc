@@ -8,20 +8,21 @@
  * 从fd上读取数据  Poller工作在LT模式
  * Buffer缓冲区是有大小的！ 但是从fd上读数据的时候，却不知道tcp数据最终的大小
  */ 
-ssize_t Buffer::readFd(int fd, int* saveErrno)
+ssize_t Buffer::readFd(int fd, int* saveErrno, size_t maxBytes)
 {
     char extrabuf[65536] = {0}; // 栈上的内存空间  64K
     
     struct iovec vec[2];
     
-    const size_t writable = writableBytes(); // 这是Buffer底层缓冲区剩余的可写空间大小
+    const size_t writable = writableBytes() < maxBytes ? writableBytes() : maxBytes; // 这是Buffer底层缓冲区剩余的可写空间大小
+    const size_t extra = maxBytes - writable < sizeof extrabuf ? maxBytes - writable : sizeof extrabuf;
     vec[0].iov_base = begin() + writerIndex_;
     vec[0].iov_len = writable;
 
     vec[1].iov_base = extrabuf;
-    vec[1].iov_len = sizeof extrabuf;
+    vec[1].iov_len = extra;
     
-    const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1;
+    const int iovcnt = (writable < sizeof extrabuf && extra > 0) ? 2 : 1;
     const ssize_t n = ::readv(fd, vec, iovcnt);
     if (n < 0)
     {
@@ -40,9 +41,10 @@ ssize_t Buffer::readFd(int fd, int* saveErrno)
     return n;
 }
 
-ssize_t Buffer::writeFd(int fd, int* saveErrno)
+ssize_t Buffer::writeFd(int fd, int* saveErrno, size_t maxBytes)
 {
-    ssize_t n = ::write(fd, peek(), readableBytes());
+    size_t len = readableBytes() < maxBytes ? readableBytes() : maxBytes;
+    ssize_t n = ::write(fd, peek(), len);
     if (n < 0)
     {
         *saveErrno = errno;
@@ -38,6 +38,12 @@ public:
         return begin() + readerIndex_;
     }
 
+    // 原地改写可读数据的时候用，比如WebSocket解掩码
+    char* peek()
+    {
+        return begin() + readerIndex_;
+    }
+
     // onMessage string <- Buffer
     void retrieve(size_t len)
     {
@@ -86,6 +92,21 @@ public:
         writerIndex_ += len;
     }
 
+    // 在可读数据前面插入[data, data+len]，用的是kCheapPrepend留出来的预留区
+    // 编码的时候先append消息体，再把长度头prepend上去，头和消息体在一段连续内存里，一次send发出去
+    void prepend(const void *data, size_t len)
+    {
+        readerIndex_ -= len; // 调用者保证len <= prependableBytes()
+        const char *d = static_cast<const char *>(data);
+        std::copy(d, d + len, begin() + readerIndex_);
+    }
+
+    // 直接往beginWrite()里写了len个字节以后调用
+    void hasWritten(size_t len)
+    {
+        writerIndex_ += len;
+    }
+
     char* beginWrite()
     {
         return begin() + writerIndex_;
@@ -96,10 +117,10 @@ public:
         return begin() + writerIndex_;
     }
 
-    // 从fd上读取数据
-    ssize_t readFd(int fd, int* saveErrno);
-    // 通过fd发送数据
-    ssize_t writeFd(int fd, int* saveErrno);
+    // 从fd上读取数据，最多读取maxBytes字节（读预算用）
+    ssize_t readFd(int fd, int* saveErrno, size_t maxBytes = static_cast<size_t>(-1));
+    // 通过fd发送数据，最多发送maxBytes字节（限速的时候用）
+    ssize_t writeFd(int fd, int* saveErrno, size_t maxBytes = static_cast<size_t>(-1));
 private:
     char* begin()
     {
@@ -2,16 +2,30 @@
 
 #include <memory>
 #include <functional>
+#include <string>
 
 class Buffer;
 class TcpConnection;
 class Timestamp;
 
 using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+// 广播用的不可变数据，所有连接共用一份，最后一个写完的连接释放它
+using SharedPayload = std::shared_ptr<const std::string>;
 using ConnectionCallback = std::function<void (const TcpConnectionPtr&)>;
 using CloseCallback = std::function<void (const TcpConnectionPtr&)>;
 using WriteCompleteCallback = std::function<void (const TcpConnectionPtr&)>;
 using MessageCallback = std::function<void (const TcpConnectionPtr&,
                                         Buffer*,
                                         Timestamp)>;
-using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
\ No newline at end of file
+using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
+
+// 一个连接要用到的全部回调，TcpServer的所有连接共享同一份，不用每个连接都各拷贝一遍std::function
+struct ConnectionCallbacks
+{
+    ConnectionCallback connectionCallback;       // 连接建立/断开时的回调
+    MessageCallback messageCallback;             // 有读写消息时的回调
+    WriteCompleteCallback writeCompleteCallback; // 消息发送完成以后的回调
+    HighWaterMarkCallback highWaterMarkCallback; // 待发送数据超过高水位时的回调
+    CloseCallback closeCallback;                 // 连接关闭时通知连接的所有者（TcpServer）
+};
+using ConnectionCallbacksPtr = std::shared_ptr<const ConnectionCallbacks>;
\ No newline at end of file
@@ -15,6 +15,7 @@ Channel::Channel(EventLoop *loop, int fd)
       events_(0),
       revents_(0),
       index_(-1),
+      queued_(false),
       tied_(false) {}
 
 Channel::~Channel() {}
@@ -73,7 +74,7 @@ void Channel::handleEvent(Timestamp receiveTime)
 // 根据poller通知的channel发生的具体事件， 由channel负责调用具体的回调操作
 void Channel::handleEventWithGuard(Timestamp receiveTime)
 {
-    LOG_INFO("channel handleEvent revents:%d\n", revents_); // 打印channel发生的具体事件
+    LOG_DEBUG("channel handleEvent revents:%d\n", revents_); // 打印channel发生的具体事件
 
     if ((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN)) // 如果发生了EPOLLHUP事件，但是没有发生EPOLLIN事件
     {
@@ -34,6 +34,7 @@ public:
 
     int fd() const { return fd_; }
     int events() const { return events_; }
+    int revents() const { return revents_; }
     int set_revents(int revt) { return revents_ = revt; } // used by pollers
 
     void enableReading() // 用于开启fd的读事件
@@ -68,7 +69,10 @@ public:
 
     int index() { return index_; }            // 获取channel在ChannelList中的索引位置
     void set_index(int idx) { index_ = idx; } // 设置channel在ChannelList中的索引位置
+    bool queued() const { return queued_; }           // 是否在EventLoop留到下一轮处理的队列里
+    void set_queued(bool queued) { queued_ = queued; } // used by EventLoop
     EventLoop *ownerLoop() { return loop_; }  // 用于获取channel所属的EventLoop
+    void setLoop(EventLoop *loop) { loop_ = loop; } // 换一个所属的EventLoop，只能在channel已经从原来的poller里remove掉以后调用（连接迁移）
     void remove();                            // 从EventLoop中移除channel
 
 private:
@@ -86,6 +90,7 @@ private:
     int revents_;     // poller返回的具体发生的事件
 
     int index_; // 表示当前channel在poller中的状态，未添加、已添加、已删除（对应EPollPoller中的kNew、kAdded、kDeleted）
+    bool queued_; // 超出预算，被留到下一轮事件循环再处理
 
     std::weak_ptr<void> tie_; // 保存TcpConnection对象的弱引用，防止TcpConnection对象被手动remove掉，channel还在执行回调操作
     bool tied_;               // 是否绑定了TcpConnection对象
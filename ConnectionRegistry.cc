@@ -0,0 +1,64 @@
+#include "ConnectionRegistry.h"
+#include "TcpConnection.h"
+
+int ConnectionRegistry::add(const TcpConnectionPtr &conn)
+{
+    int slot;
+    if (!freeSlots_.empty())
+    {
+        slot = freeSlots_.back();
+        freeSlots_.pop_back();
+        slots_[slot] = conn;
+    }
+    else
+    {
+        slot = static_cast<int>(slots_.size());
+        slots_.push_back(conn);
+    }
+    conn->setRegistry(this, slot);
+    ++size_;
+    --incoming_; // 先加size_再减incoming_，别的线程不会看到两个都是0
+    if (aggregateCount_)
+    {
+        ++*aggregateCount_;
+    }
+    return slot;
+}
+
+void ConnectionRegistry::remove(const TcpConnectionPtr &conn)
+{
+    int slot = conn->registrySlot();
+    if (slot >= 0 && slot < static_cast<int>(slots_.size()) && slots_[slot] == conn)
+    {
+        slots_[slot].reset();
+        freeSlots_.push_back(slot);
+        conn->setRegistry(nullptr, -1);
+        --size_;
+        if (aggregateCount_)
+        {
+            --*aggregateCount_;
+        }
+    }
+}
+
+std::vector<TcpConnectionPtr> ConnectionRegistry::takeAll()
+{
+    std::vector<TcpConnectionPtr> conns;
+    conns.reserve(size_);
+    for (TcpConnectionPtr &conn : slots_)
+    {
+        if (conn)
+        {
+            conn->setRegistry(nullptr, -1);
+            conns.push_back(std::move(conn));
+        }
+    }
+    slots_.clear();
+    freeSlots_.clear();
+    if (aggregateCount_)
+    {
+        *aggregateCount_ -= static_cast<int>(conns.size());
+    }
+    size_ = 0;
+    return conns;
+}
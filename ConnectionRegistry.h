@@ -0,0 +1,57 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+
+#include <vector>
+#include <atomic>
+
+/**
+ * @brief 按槽位编号保存连接的扁平表，代替以前以连接名字为key的unordered_map
+ *
+ * 添加时优先复用空闲的槽位，删除时根据连接记下的槽位直接清掉，都是O(1)，
+ * 槽位稳定以后增删连接都不再分配内存
+ *
+ * TcpServer给每个subloop各建一个，只在对应的loop线程里增删，不是线程安全的；
+ * 只有size()可以在别的线程里读，aggregateCount可以让多个表共同维护一个总数
+ *
+ * 连接要在别的线程里决定放到哪个表、再投递到表所在的loop里add，这中间表还是空的；
+ * 所以决定的时候先expect()（线程安全），add的时候再抵消掉，idle()才能准确判断loop上是不是真的没有连接了
+ */
+class ConnectionRegistry : noncopyable
+{
+public:
+    explicit ConnectionRegistry(std::atomic<int> *aggregateCount = nullptr)
+        : size_(0), incoming_(0), aggregateCount_(aggregateCount) {}
+
+    void expect() { ++incoming_; }         // 预告有一个连接要add进来，线程安全
+    void cancelExpected() { --incoming_; } // 预告的连接不来了（比如迁移被取消），线程安全
+    int add(const TcpConnectionPtr &conn); // 必须先expect()；返回分配到的槽位，并把槽位和表记到conn里
+    void remove(const TcpConnectionPtr &conn);
+
+    size_t size() const { return size_.load(std::memory_order_relaxed); }
+    bool empty() const { return size() == 0; }
+    bool idle() const { return empty() && incoming_.load() == 0; } // 没有连接，也没有正在路上的连接，线程安全
+
+    std::vector<TcpConnectionPtr> takeAll(); // 取出所有的连接，并清空
+
+    // 遍历表里所有的连接，func里不能增删连接
+    template <typename Func>
+    void forEach(Func func) const
+    {
+        for (const TcpConnectionPtr &conn : slots_)
+        {
+            if (conn)
+            {
+                func(conn);
+            }
+        }
+    }
+
+private:
+    std::vector<TcpConnectionPtr> slots_; // 空闲的槽位是空指针
+    std::vector<int> freeSlots_;          // 空闲槽位的编号
+    std::atomic<size_t> size_;
+    std::atomic<int> incoming_;           // expect()了还没add的连接数
+    std::atomic<int> *aggregateCount_;    // 所有表的连接总数，可以为空
+};
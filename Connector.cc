@@ -0,0 +1,248 @@
+#include "Connector.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+
+static int createNonblocking()
+{
+    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d connect socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+static int getSocketError(int sockfd)
+{
+    int optval;
+    socklen_t optlen = sizeof optval;
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    {
+        return errno;
+    }
+    return optval;
+}
+
+// 本端地址和对端地址完全一样，就是连到了自己身上
+static bool isSelfConnect(int sockfd)
+{
+    sockaddr_in local;
+    sockaddr_in peer;
+    socklen_t len = sizeof local;
+    memset(&local, 0, sizeof local);
+    memset(&peer, 0, sizeof peer);
+    if (::getsockname(sockfd, (sockaddr *)&local, &len) < 0)
+    {
+        return false;
+    }
+    len = sizeof peer;
+    if (::getpeername(sockfd, (sockaddr *)&peer, &len) < 0)
+    {
+        return false;
+    }
+    return local.sin_port == peer.sin_port && local.sin_addr.s_addr == peer.sin_addr.s_addr;
+}
+
+// 在[delay/2, delay]里随机取一个，每个线程一个随机数发生器，不用加锁
+static double jitter(double delay)
+{
+    static thread_local std::mt19937 generator(std::random_device{}());
+    std::uniform_real_distribution<double> distribution(delay / 2, delay);
+    return distribution(generator);
+}
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+    : loop_(loop),
+      serverAddr_(serverAddr),
+      connect_(false),
+      state_(kDisconnected),
+      initRetryDelay_(0.5),
+      maxRetryDelay_(30),
+      retryDelay_(0.5)
+{
+}
+
+Connector::~Connector()
+{
+    // 成员函数里排队的回调都持有shared_ptr，能走到这里说明已经没有回调在用channel_了
+    if (channel_)
+    {
+        LOG_ERROR("Connector::dtor - channel of %s still alive \n", serverAddr_.toIpPort().c_str());
+    }
+}
+
+void Connector::setRetryDelay(double initialSeconds, double maxSeconds)
+{
+    initRetryDelay_ = initialSeconds;
+    maxRetryDelay_ = std::max(initialSeconds, maxSeconds);
+    retryDelay_ = initRetryDelay_;
+}
+
+void Connector::start()
+{
+    connect_ = true;
+    ConnectorPtr self(shared_from_this());
+    loop_->runInLoop([self]() { self->startInLoop(); });
+}
+
+void Connector::restart()
+{
+    setState(kDisconnected);
+    retryDelay_ = initRetryDelay_;
+    connect_ = true;
+    startInLoop();
+}
+
+void Connector::stop()
+{
+    connect_ = false;
+    ConnectorPtr self(shared_from_this());
+    loop_->runInLoop([self]() { self->stopInLoop(); });
+}
+
+void Connector::startInLoop()
+{
+    if (connect_ && state_ == kDisconnected)
+    {
+        connect();
+    }
+}
+
+void Connector::stopInLoop()
+{
+    if (retryTimer_.valid())
+    {
+        loop_->cancel(retryTimer_);
+        retryTimer_ = TimerId();
+    }
+    if (state_ == kConnecting)
+    {
+        setState(kDisconnected);
+        ::close(removeAndResetChannel());
+    }
+}
+
+void Connector::connect()
+{
+    int sockfd = createNonblocking();
+    int ret = ::connect(sockfd, (sockaddr *)serverAddr_.getSockAddr(), sizeof(sockaddr_in));
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch (savedErrno)
+    {
+    case 0:
+    case EINPROGRESS: // 非阻塞connect的正常情况，等可写事件
+    case EINTR:
+    case EISCONN:
+        connecting(sockfd);
+        break;
+
+    case EAGAIN: // 本机的临时端口用完了
+    case EADDRINUSE:
+    case EADDRNOTAVAIL:
+    case ECONNREFUSED:
+    case ENETUNREACH:
+        retry(sockfd);
+        break;
+
+    default: // EACCES、EPERM、EBADF之类的，重试也没用
+        LOG_ERROR("Connector::connect %s error:%d \n", serverAddr_.toIpPort().c_str(), savedErrno);
+        ::close(sockfd);
+        break;
+    }
+}
+
+void Connector::connecting(int sockfd)
+{
+    setState(kConnecting);
+    channel_.reset(new Channel(loop_, sockfd));
+    channel_->setWriteCallback(std::bind(&Connector::handleWrite, this));
+    channel_->setErrorCallback(std::bind(&Connector::handleError, this));
+    channel_->tie(shared_from_this()); // 处理事件的时候Connector不会被析构
+    channel_->enableWriting();         // 连接有结果了（成功或者失败）socket就会变成可写
+}
+
+void Connector::handleWrite()
+{
+    if (state_ != kConnecting)
+    {
+        return;
+    }
+    int sockfd = removeAndResetChannel();
+    int err = getSocketError(sockfd);
+    if (err)
+    {
+        LOG_INFO("Connector::handleWrite %s SO_ERROR:%d \n", serverAddr_.toIpPort().c_str(), err);
+        retry(sockfd);
+    }
+    else if (isSelfConnect(sockfd))
+    {
+        LOG_INFO("Connector::handleWrite %s self connect \n", serverAddr_.toIpPort().c_str());
+        retry(sockfd);
+    }
+    else
+    {
+        setState(kConnected);
+        retryDelay_ = initRetryDelay_;
+        if (connect_ && newConnectionCallback_)
+        {
+            newConnectionCallback_(sockfd);
+        }
+        else
+        {
+            ::close(sockfd);
+        }
+    }
+}
+
+void Connector::handleError()
+{
+    if (state_ == kConnecting)
+    {
+        int sockfd = removeAndResetChannel();
+        LOG_INFO("Connector::handleError %s SO_ERROR:%d \n", serverAddr_.toIpPort().c_str(), getSocketError(sockfd));
+        retry(sockfd);
+    }
+}
+
+void Connector::retry(int sockfd)
+{
+    ::close(sockfd);
+    setState(kDisconnected);
+    if (!connect_)
+    {
+        return;
+    }
+    double delay = jitter(retryDelay_);
+    LOG_INFO("Connector::retry - connecting to %s in %.3f seconds \n", serverAddr_.toIpPort().c_str(), delay);
+    std::weak_ptr<Connector> weak(shared_from_this());
+    retryTimer_ = loop_->runAfter(delay, [weak]()
+                                  {
+                                      if (ConnectorPtr self = weak.lock())
+                                      {
+                                          self->retryTimer_ = TimerId();
+                                          self->startInLoop();
+                                      }
+                                  });
+    retryDelay_ = std::min(retryDelay_ * 2, maxRetryDelay_);
+}
+
+int Connector::removeAndResetChannel()
+{
+    channel_->disableAll();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    // 可能正在channel的handleEvent里，不能马上销毁它，放到本轮的回调里；
+    // 在那之前channel_可能已经换成了下一次连接的channel，所以把这个channel单独交出去
+    std::shared_ptr<Channel> channel(channel_.release());
+    loop_->queueInLoop([channel]() {}); // 回调执行完被销毁的时候channel也跟着销毁
+    return sockfd;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "TimerId.h"
+
+#include <functional>
+#include <memory>
+#include <atomic>
+
+class EventLoop;
+class Channel;
+
+/**
+ * @brief 主动发起连接，TcpClient用它连上游，和Acceptor是对称的
+ *
+ * connect是非阻塞的：返回EINPROGRESS以后把socket注册成一个关注可写事件的Channel，
+ * 可写了再用SO_ERROR看连接到底成没成功，整个过程不会阻塞loop线程。
+ * 连不上就按指数退避重试，每次的间隔加上随机抖动，上游重启时大量客户端不会在同一时刻一起重连。
+ * 本机连本机的临时端口时可能出现自连接（源端口恰好等于目的端口），检测到以后当成失败重试
+ */
+class Connector : noncopyable, public std::enable_shared_from_this<Connector>
+{
+public:
+    // 连接成功以后把sockfd交出去，之后sockfd归回调的使用者管理
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
+    // 重试的初始间隔和最大间隔（秒），每失败一次间隔翻倍，直到最大间隔；要在start()之前设置
+    void setRetryDelay(double initialSeconds, double maxSeconds);
+
+    void start();   // 开始连接，线程安全
+    void restart(); // 连接断开以后重新开始连接，重试间隔回到初始值，只能在loop线程中调用
+    void stop();    // 停止连接和重试，线程安全
+
+    const InetAddress &serverAddress() const { return serverAddr_; }
+
+private:
+    enum States
+    {
+        kDisconnected,
+        kConnecting,
+        kConnected,
+    };
+
+    void setState(States state) { state_ = state; }
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void retry(int sockfd);       // 关掉sockfd，过一段时间再连
+    int removeAndResetChannel(); // 连接有结果了，channel就不要了，返回它的sockfd
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::atomic_bool connect_; // 用户是否还想连
+    States state_;
+    std::unique_ptr<Channel> channel_; // 正在连接的socket，连接有结果以后就销毁
+    NewConnectionCallback newConnectionCallback_;
+
+    double initRetryDelay_;
+    double maxRetryDelay_;
+    double retryDelay_; // 下一次重试的间隔（抖动之前）
+    TimerId retryTimer_;
+};
+
+using ConnectorPtr = std::shared_ptr<Connector>;
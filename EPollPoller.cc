@@ -29,9 +29,8 @@ EPollPoller::~EPollPoller()
 
 Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 {
-    // 实际上应该用LOG_DEBUG输出日志更为合理，因为这个函数会被频繁调用影响性能
-    // 但是为了方便调试，这里用LOG_INFO
-    LOG_INFO("func=%s => fd total count:%lu \n", __FUNCTION__, channels_.size());
+    // 每次poll都会走到这里，用LOG_DEBUG，默认编译时整句都不存在
+    LOG_DEBUG("func=%s => fd total count:%lu \n", __FUNCTION__, channels_.size());
 
     // epoll_wait的第二个参数是epoll_event数组，这里用vector来模拟
     // 好处是可以动态扩容
@@ -44,7 +43,7 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 
     if (numEvents > 0)
     {
-        LOG_INFO("%d events happened \n", numEvents);
+        LOG_DEBUG("%d events happened \n", numEvents);
         fillActiveChannels(numEvents, activeChannels); // 填写活跃的连接
 
         if (numEvents == events_.size()) // 如果发生的事件数等于数组的大小，说明数组不够用了，需要扩容
@@ -81,7 +80,7 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 void EPollPoller::updateChannel(Channel *channel)
 {
     const int index = channel->index(); // 获取channel的状态
-    LOG_INFO("func=%s => fd=%d events=%d index=%d \n", __FUNCTION__, channel->fd(), channel->events(), index);
+    LOG_DEBUG("func=%s => fd=%d events=%d index=%d \n", __FUNCTION__, channel->fd(), channel->events(), index);
 
     if (index == kNew || index == kDeleted) // channel未添加到poller上或者已经从poller上删除了
     {
@@ -116,7 +115,7 @@ void EPollPoller::removeChannel(Channel *channel)
     channels_.erase(fd);    // 从channels_中删除channel
     // 注意：这里只是删除了EPoller监听的map中的元素，并没有删除channel，他还在EventLoop的ChannelList中
 
-    LOG_INFO("func=%s => fd=%d\n", __FUNCTION__, fd);
+    LOG_DEBUG("func=%s => fd=%d\n", __FUNCTION__, fd);
 
     int index = channel->index(); // 获取channel的状态
 
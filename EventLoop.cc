@@ -2,8 +2,11 @@
 #include "Logger.h"
 #include "Poller.h"
 #include "Channel.h"
+#include "TimerQueue.h"
+#include "TokenBucket.h"
 
 #include <sys/eventfd.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -41,7 +44,13 @@ EventLoop::EventLoop()
       threadId_(CurrentThread::tid()),             // 获取当前线程的thread id，存着，以防止该线程继续创建EventLoop对象(实现One Loop Per Thread)
       poller_(Poller::newDefaultPoller(this)),     // 初始化poller_，其实就是初始化一个EPollPoller对象，因为我们只实现了epoll，没有实现select和poll
       wakeupFd_(createEventfd()),                  // 创建eventfd初始化wakeupFd_
-      wakeupChannel_(new Channel(this, wakeupFd_)) // 为wakeupFd_创建对应的channel，每一个fd都有对应的channel，eventfd也不例外
+      wakeupChannel_(new Channel(this, wakeupFd_)), // 为wakeupFd_创建对应的channel，每一个fd都有对应的channel，eventfd也不例外
+      timerQueue_(new TimerQueue(this)),            // 定时器也是通过timerfd接入poller的
+      refillHooks_(nullptr),
+      refillCursor_(nullptr),
+      eventBudget_(0),                              // 默认不限制每轮处理的channel个数
+      iteration_(0),
+      busyTime_(0)
 {
     LOG_DEBUG("EventLoop created %p in thread %d \n", this, threadId_);
 
@@ -89,17 +98,35 @@ void EventLoop::loop()
 
         // 获取当前活跃的事件，返回的是发生事件的fd的个数
         // 这里监听了两类fd：一种是client的fd，一种是wakeupfd
-        pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        // 上一轮有超出预算没处理完的channel，就不能阻塞等待，只是顺便看一眼有没有新事件
+        int timeoutMs = readyChannels_.empty() ? kPollTimeMs : 0;
+        pollReturnTime_ = poller_->poll(timeoutMs, &activeChannels_);
+        ++iteration_;
+        int64_t busyStart = Timer::now(); // 从poll返回开始算忙碌时间
+
+        if (!readyChannels_.empty())
+        {
+            mergeReadyChannels();
+        }
 
         // 挨个取出有活跃事件的channel，进行相应处理
+        size_t handled = 0;
         for (Channel *channel : activeChannels_)
         {
+            if (eventBudget_ > 0 && handled >= eventBudget_)
+            {
+                requeueChannel(channel, channel->revents()); // 本轮的预算用完了，下一轮接着处理
+                continue;
+            }
             // Poller监听哪些channel发生了事件，上报给EventLoop，EventLoop再调用Channel的handleEvent方法
             channel->handleEvent(pollReturnTime_);
+            ++handled;
         }
 
         // 执行当前EventLoop事件循环需要处理的回调操作
         doPendingFunctors();
+
+        busyTime_.fetch_add(Timer::now() - busyStart, std::memory_order_relaxed);
     }
 
     LOG_INFO("EventLoop %p stop looping. \n", this);
@@ -142,6 +169,147 @@ void EventLoop::runInLoop(Functor cb)
     }
 }
 
+TimerId EventLoop::runAfter(double delay, Functor cb)
+{
+    int64_t when = Timer::now() + static_cast<int64_t>(delay * 1000 * 1000);
+    return timerQueue_->addTimer(std::move(cb), when, 0);
+}
+
+TimerId EventLoop::runEvery(double interval, Functor cb)
+{
+    int64_t intervalUs = static_cast<int64_t>(interval * 1000 * 1000);
+    if (intervalUs <= 0)
+    {
+        intervalUs = 1; // 间隔为0会被当成一次性定时器
+    }
+    return timerQueue_->addTimer(std::move(cb), Timer::now() + intervalUs, intervalUs);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
+// 头插，挂上第一个节点时才注册补令牌的定时器，没有限速连接的loop不会多出一个10ms的定时器
+void EventLoop::addRefillHook(RefillHook *hook)
+{
+    if (hook->linked)
+    {
+        return;
+    }
+    hook->prev = nullptr;
+    hook->next = refillHooks_;
+    if (refillHooks_ != nullptr)
+    {
+        refillHooks_->prev = hook;
+    }
+    refillHooks_ = hook;
+    hook->linked = true;
+    if (!refillTimer_.valid())
+    {
+        refillTimer_ = runEvery(TokenBucket::kRefillInterval, std::bind(&EventLoop::runRefillHooks, this));
+    }
+}
+
+// 可以在refill回调里摘自己或者别的节点，refillCursor_跟着挪到下一个
+void EventLoop::removeRefillHook(RefillHook *hook)
+{
+    if (!hook->linked)
+    {
+        return;
+    }
+    if (refillCursor_ == hook)
+    {
+        refillCursor_ = hook->next;
+    }
+    if (hook->prev != nullptr)
+    {
+        hook->prev->next = hook->next;
+    }
+    else
+    {
+        refillHooks_ = hook->next;
+    }
+    if (hook->next != nullptr)
+    {
+        hook->next->prev = hook->prev;
+    }
+    hook->prev = nullptr;
+    hook->next = nullptr;
+    hook->linked = false;
+}
+
+// 一个定时器走一遍所有限速连接，每个tick只有一次定时器的重排，和连接数无关；链表空了就把定时器取消掉
+void EventLoop::runRefillHooks()
+{
+    RefillHook *hook = refillHooks_;
+    while (hook != nullptr)
+    {
+        refillCursor_ = hook->next;
+        hook->refill(hook->owner);
+        hook = refillCursor_;
+    }
+    refillCursor_ = nullptr;
+    if (refillHooks_ == nullptr && refillTimer_.valid())
+    {
+        cancel(refillTimer_);
+        refillTimer_ = TimerId();
+    }
+}
+
+void EventLoop::requeueChannel(Channel *channel, int revents)
+{
+    if (!channel->queued())
+    {
+        channel->set_queued(true);
+        readyChannels_.emplace_back(channel, revents);
+    }
+}
+
+/**
+ * @brief 上一轮留下来的channel排在最前面先处理，它们已经等了一轮了
+ *
+ * 如果这一轮poll又返回了同一个channel，以poll返回的revents为准，不重复处理
+ * 留下来的这段时间里channel可能已经不关注读/写了（stopRead、连接关闭），对应的事件也要去掉
+ */
+void EventLoop::mergeReadyChannels()
+{
+    for (Channel *channel : activeChannels_)
+    {
+        channel->set_queued(false); // poll又返回了它，下面就不用再从readyChannels_里取了
+    }
+
+    ChannelList carried;
+    for (const auto &item : readyChannels_)
+    {
+        Channel *channel = item.first;
+        if (!channel->queued())
+        {
+            continue;
+        }
+        channel->set_queued(false);
+
+        int revents = item.second;
+        if (!channel->isReading())
+        {
+            revents &= ~(EPOLLIN | EPOLLPRI);
+        }
+        if (!channel->isWriting())
+        {
+            revents &= ~EPOLLOUT;
+        }
+        if (channel->isNoneEvent() || revents == 0)
+        {
+            continue;
+        }
+        channel->set_revents(revents);
+        carried.push_back(channel);
+    }
+    readyChannels_.clear();
+
+    activeChannels_.insert(activeChannels_.begin(), carried.begin(), carried.end());
+}
+
 // 把回调函数cb放入待执行队列中，唤醒loop所在的线程，执行cb
 void EventLoop::queueInLoop(Functor cb)
 {
@@ -174,6 +342,12 @@ void EventLoop::handleRead()
     }
 }
 
+// 把cb挂到本轮事件循环的末尾，只在loop线程中调用，所以不需要加锁
+void EventLoop::queueFlush(Functor cb)
+{
+    flushFunctors_.emplace_back(std::move(cb));
+}
+
 // 用来唤醒loop所在的线程的
 void EventLoop::wakeup()
 {
@@ -193,6 +367,18 @@ void EventLoop::updateChannel(Channel *channel)
 
 void EventLoop::removeChannel(Channel *channel)
 {
+    if (channel->queued()) // channel马上就要销毁了，不能再留在下一轮的队列里
+    {
+        channel->set_queued(false);
+        for (auto it = readyChannels_.begin(); it != readyChannels_.end(); ++it)
+        {
+            if (it->first == channel)
+            {
+                readyChannels_.erase(it);
+                break;
+            }
+        }
+    }
     poller_->removeChannel(channel);
 }
 
@@ -216,5 +402,17 @@ void EventLoop::doPendingFunctors() // 执行回调
         functor(); // 执行当前loop需要执行的回调操作
     }
 
+    // 事件处理和上面的回调里攒下来的flush放在最后统一执行，每个连接只写一次
+    // 此时callingPendingFunctors_还是true，flush里queueInLoop的回调会唤醒下一轮循环，不会被耽搁
+    while (!flushFunctors_.empty())
+    {
+        functors.clear();
+        functors.swap(flushFunctors_);
+        for (const Functor &functor : functors)
+        {
+            functor();
+        }
+    }
+
     callingPendingFunctors_ = false;
 }
\ No newline at end of file
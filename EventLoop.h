@@ -9,9 +9,12 @@
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "TimerId.h"
 
 class Channel;
 class Poller;
+class TimerQueue;
+struct RefillHook;
 
 /**
  * @brief 事件循环类，封装了 Channel 和 Poller 模块，使他们两个之间能够相互沟通
@@ -37,6 +40,30 @@ public:
 
     void wakeup(); // 用来唤醒loop所在的线程的（mainReactor唤醒subReactor用的）
 
+    // 定时器，时间单位都是秒，线程安全；回调在loop所在的线程里执行
+    TimerId runAfter(double delay, Functor cb);     // delay秒以后执行一次cb
+    TimerId runEvery(double interval, Functor cb);  // 每隔interval秒执行一次cb
+    void cancel(TimerId timerId);                   // 取消定时器
+
+    // 每轮事件循环最多处理多少个活跃的channel，0表示不限制；剩下的留到下一轮，下一轮不会阻塞在epoll_wait上
+    void setEventBudget(size_t budget) { eventBudget_ = budget; }
+    // 只能在loop线程中调用：channel这一轮超出了自己的预算，把它留到下一轮接着处理
+    void requeueChannel(Channel *channel, int revents);
+    // 当前是第几轮事件循环，连接用它来判断每轮的读预算该不该重置
+    uint64_t iteration() const { return iteration_; }
+    // 累计处理事件和回调花掉的时间（微秒，不含阻塞在epoll_wait上的时间），任意线程都可以读
+    // 隔一段时间采样两次，差值除以时间间隔就是这段时间loop线程的利用率
+    int64_t busyTime() const { return busyTime_.load(std::memory_order_relaxed); }
+
+    // 只能在loop线程中调用：把cb挂到本轮事件循环的末尾执行（doPendingFunctors结束之前）
+    // TcpConnection的cork模式用它把一轮里的多次send合并成一次write
+    void queueFlush(Functor cb);
+
+    // 只能在loop线程中调用：限速连接挂到本loop的补令牌链表上/摘下来。整个loop只有一个定时器，
+    // 第一个节点挂上来时才注册，走到链表为空时取消，每kRefillInterval秒按顺序调用每个节点的refill
+    void addRefillHook(RefillHook *hook);
+    void removeRefillHook(RefillHook *hook);
+
     void updateChannel(Channel *channel); // 更新当前EventLoop所管理Channel对象的状态
     void removeChannel(Channel *channel); // 移除某一个Channel对象
     bool hasChannel(Channel *channel);    // 判断是否有某一个Channel对象
@@ -47,12 +74,15 @@ public:
 private:
     void handleRead();        // wake up
     void doPendingFunctors(); // 执行回调
+    void mergeReadyChannels(); // 把上一轮留下来的channel合并到这一轮的activeChannels_里
+    void runRefillHooks();     // 补令牌的定时器回调
 
     // 标识，都是原子操作，通过CAS实现的（这个CAS是啥？）
     std::atomic_bool looping_;                // 标识是否开启循环
     std::atomic_bool quit_;                   // 标识是否退出loop循环（感觉跟loop_有重叠？）
     std::atomic_bool callingPendingFunctors_; // 标识当前loop是否正在执行的回调操作
     std::vector<Functor> pendingFunctors_;    // 存储loop需要执行的所有的回调操作
+    std::vector<Functor> flushFunctors_;      // 本轮需要flush的连接，只在loop线程中访问，不需要加锁
 
     std::mutex mutex_; // 互斥锁，用来保护上面vector容器的线程安全操作，因为STL容器都不是线程安全的
 
@@ -71,6 +101,18 @@ private:
     int wakeupFd_;
     std::unique_ptr<Channel> wakeupChannel_; // 把wakeupFd_也封装成一个Channel对象，存放在这
 
+    std::unique_ptr<TimerQueue> timerQueue_; // 定时器队列，要在poller_之后构造、之前析构
+
+    RefillHook *refillHooks_;  // 限速连接的侵入式链表，只在loop线程中访问
+    RefillHook *refillCursor_; // 遍历链表时的下一个节点，节点在refill里被摘掉也不会走丢
+    TimerId refillTimer_;
+
     using ChannelList = std::vector<Channel *>; // 定义ChannelList类型
     ChannelList activeChannels_;                // 记录当前EventLoop所管理Channel对象中有活跃事件发生的那些
+
+    size_t eventBudget_;  // 每轮最多处理的活跃channel个数，0表示不限制
+    uint64_t iteration_;  // 事件循环的轮数
+    using ReadyList = std::vector<std::pair<Channel *, int>>; // channel和它还没处理的revents
+    ReadyList readyChannels_; // 超出预算留到下一轮处理的channel，只在loop线程中访问
+    std::atomic<int64_t> busyTime_; // 累计的忙碌时间，微秒
 };
\ No newline at end of file
@@ -23,6 +23,7 @@ public:
     ~EventLoopThread();
 
     EventLoop* startLoop();
+    EventLoop* loop() { std::unique_lock<std::mutex> lock(mutex_); return loop_; } // 线程退出以后是空的
 private:
     void threadFunc();
 
@@ -2,6 +2,8 @@
 #include "EventLoopThread.h"
 
 #include <memory>
+#include <algorithm>
+#include <string>
 
 
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg)
@@ -10,6 +12,7 @@ EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string
     , started_(false)
     , numThreads_(0)
     , next_(0)
+    , nextThreadIndex_(0)
 {}
 
 EventLoopThreadPool::~EventLoopThreadPool()
@@ -21,21 +24,12 @@ EventLoopThreadPool::~EventLoopThreadPool()
 void EventLoopThreadPool::start(const ThreadInitCallback &cb)
 {
     started_ = true;
+    threadInitCallback_ = cb;
 
     // 创建numThreads_个线程及其对应的EventLoop对象
     for (int i = 0; i < numThreads_; ++i)
     {
-        char buf[name_.size() + 32];
-        snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
-        
-        // 创建EventLoopThread对象，里面会创建EventLoop对象和Thread对象
-        EventLoopThread *t = new EventLoopThread(cb, buf); 
-        
-        // 将EventLoopThread对象放入容器中
-        threads_.push_back(std::unique_ptr<EventLoopThread>(t));
-
-        // 将EventLoop对象放入容器中，在startLoop()才会真正创建线程和EventLoop
-        loops_.push_back(t->startLoop()); 
+        addLoop();
     }
 
     // 整个服务端只有一个线程，运行着baseloop（这种情况必须传入有效的ThreadInitCallback对象）
@@ -52,6 +46,10 @@ EventLoop* EventLoopThreadPool::getNextLoop()
 
     if (!loops_.empty()) // 通过轮询获取下一个处理事件的loop
     {
+        if (next_ >= loops_.size()) // 中间可能有loop被retire掉了
+        {
+            next_ = 0;
+        }
         loop = loops_[next_];
         ++next_;
         if (next_ >= loops_.size())
@@ -70,4 +68,51 @@ std::vector<EventLoop*> EventLoopThreadPool::getAllLoops()
         return std::vector<EventLoop*>(1, baseLoop_);
     }
     return loops_; // 返回所有的subloop
-}
\ No newline at end of file
+}
+
+EventLoop* EventLoopThreadPool::addLoop()
+{
+    std::string threadName = name_ + std::to_string(nextThreadIndex_++);
+
+    // 创建EventLoopThread对象，里面会创建EventLoop对象和Thread对象
+    EventLoopThread *t = new EventLoopThread(threadInitCallback_, threadName);
+
+    // 将EventLoopThread对象放入容器中
+    threads_.push_back(std::unique_ptr<EventLoopThread>(t));
+
+    // 将EventLoop对象放入容器中，在startLoop()才会真正创建线程和EventLoop
+    EventLoop *loop = t->startLoop();
+    loops_.push_back(loop);
+    return loop;
+}
+
+bool EventLoopThreadPool::retireLoop(EventLoop *loop)
+{
+    auto it = std::find(loops_.begin(), loops_.end(), loop);
+    if (it == loops_.end())
+    {
+        return false;
+    }
+    loops_.erase(it);
+    retiring_.push_back(loop);
+    return true;
+}
+
+void EventLoopThreadPool::removeLoop(EventLoop *loop)
+{
+    auto it = std::find(retiring_.begin(), retiring_.end(), loop);
+    if (it == retiring_.end())
+    {
+        return;
+    }
+    retiring_.erase(it);
+
+    for (auto t = threads_.begin(); t != threads_.end(); ++t)
+    {
+        if ((*t)->loop() == loop)
+        {
+            threads_.erase(t); // EventLoopThread析构时quit掉loop，等线程退出
+            break;
+        }
+    }
+}
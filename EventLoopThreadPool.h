@@ -24,10 +24,16 @@ public:
 
     void start(const ThreadInitCallback &cb = ThreadInitCallback());
 
-    // 如果工作在多线程中，baseLoop_默认以轮询的方式分配channel给subloop
+    // 如果工作在多线程中，baseLoop_默认以轮询的方式分配channel给subloop，retire掉的loop不再参与
     EventLoop* getNextLoop();
 
-    std::vector<EventLoop*> getAllLoops();
+    std::vector<EventLoop*> getAllLoops(); // 正在工作的subloop，不包括retire掉的
+
+    // 运行时扩缩容，都只能在baseLoop_的线程里调用
+    EventLoop* addLoop();              // 新开一个subloop，马上参与轮询
+    bool retireLoop(EventLoop *loop);  // 不再给loop分配新连接，现有的连接由调用者处理（等它们断开或者迁走）
+    void removeLoop(EventLoop *loop);  // 退出retire掉的loop的线程，调用者要保证上面已经没有连接了
+    const std::vector<EventLoop*> &getRetiringLoops() const { return retiring_; }
 
     bool started() const { return started_; }
     const std::string name() const { return name_; }
@@ -37,8 +43,11 @@ private:
     std::string name_;
     bool started_;
     int numThreads_; // 线程池中的线程数量
-    int next_; // 下一个subloop的索引，轮询的方式安排新连接给subloop
+    size_t next_; // 下一个subloop的索引，轮询的方式安排新连接给subloop
+    int nextThreadIndex_; // 新线程名字的编号，运行时加的线程接着往后编
+    ThreadInitCallback threadInitCallback_; // 运行时加的线程也要执行
 
-    std::vector<std::unique_ptr<EventLoopThread>> threads_; // 存放线程池的容器
-    std::vector<EventLoop*> loops_; // 存放EventLoop的容器，跟threads_一一对应
+    std::vector<std::unique_ptr<EventLoopThread>> threads_; // 存放线程池的容器，包括retire掉还没退出的
+    std::vector<EventLoop*> loops_; // 正在工作的EventLoop，轮询只在这里面选
+    std::vector<EventLoop*> retiring_; // retire掉、等连接走完的EventLoop
 };
\ No newline at end of file
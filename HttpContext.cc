@@ -0,0 +1,492 @@
+#include "HttpContext.h"
+#include "Buffer.h"
+#include "HttpHeaderScanner.h"
+
+#include <string.h>
+
+static const size_t kMaxChunkSizeLine = 1024; // 数据块长度那一行（含扩展）最长多少
+
+HttpContext::HttpContext(size_t maxHeaderBytes, size_t maxBodyBytes)
+    : maxHeaderBytes_(maxHeaderBytes),
+      maxBodyBytes_(maxBodyBytes)
+{
+    reset();
+}
+
+void HttpContext::reset()
+{
+    state_ = kExpectRequestLine;
+    pos_ = 0;
+    scan_ = 0;
+    errorStatus_ = 0;
+    request_.reset();
+    hasContentLength_ = false;
+    contentLength_ = 0;
+    chunked_ = false;
+    transferEncoding_ = false;
+    connectionClose_ = false;
+    connectionKeepAlive_ = false;
+    expectContinue_ = false;
+    bodyOffset_ = 0;
+    chunkRemaining_ = 0;
+    trailerStart_ = 0;
+    chunkedBody_.clear();
+}
+
+bool HttpContext::fail(int status)
+{
+    state_ = kError;
+    errorStatus_ = status;
+    return false;
+}
+
+// 从scan_开始找'\n'，找到了lineEnd是它的偏移；没找到记下扫到了哪里，下次接着找
+bool HttpContext::findLine(const char *begin, size_t readable, size_t *lineEnd)
+{
+    const char *nl = static_cast<const char *>(memchr(begin + scan_, '\n', readable - scan_));
+    if (nl == nullptr)
+    {
+        scan_ = readable;
+        return false;
+    }
+    *lineEnd = nl - begin;
+    return true;
+}
+
+static HttpRequest::Method parseMethod(const StringPiece &m)
+{
+    switch (m.size())
+    {
+    case 3:
+        if (m == "GET") return HttpRequest::kGet;
+        if (m == "PUT") return HttpRequest::kPut;
+        break;
+    case 4:
+        if (m == "POST") return HttpRequest::kPost;
+        if (m == "HEAD") return HttpRequest::kHead;
+        break;
+    case 5:
+        if (m == "PATCH") return HttpRequest::kPatch;
+        break;
+    case 6:
+        if (m == "DELETE") return HttpRequest::kDelete;
+        break;
+    case 7:
+        if (m == "OPTIONS") return HttpRequest::kOptions;
+        break;
+    }
+    return HttpRequest::kInvalid;
+}
+
+// 方法 SP 请求目标 SP 版本
+bool HttpContext::processRequestLine(const char *begin, size_t start, size_t len)
+{
+    const char *line = begin + start;
+    const char *end = line + len;
+    const char *space = static_cast<const char *>(memchr(line, ' ', len));
+    if (space == nullptr)
+    {
+        return fail(400);
+    }
+    request_.method_ = parseMethod(StringPiece(line, space - line));
+    if (request_.method_ == HttpRequest::kInvalid)
+    {
+        return fail(405);
+    }
+
+    const char *target = space + 1;
+    space = static_cast<const char *>(memchr(target, ' ', end - target));
+    if (space == nullptr || space == target)
+    {
+        return fail(400);
+    }
+    const char *question = static_cast<const char *>(memchr(target, '?', space - target));
+    request_.pathOffset_ = target - begin;
+    if (question)
+    {
+        request_.pathLength_ = question - target;
+        request_.queryOffset_ = question + 1 - begin;
+        request_.queryLength_ = space - question - 1;
+    }
+    else
+    {
+        request_.pathLength_ = space - target;
+    }
+
+    StringPiece version(space + 1, end - space - 1);
+    if (version == "HTTP/1.1")
+    {
+        request_.version_ = HttpRequest::kHttp11;
+    }
+    else if (version == "HTTP/1.0")
+    {
+        request_.version_ = HttpRequest::kHttp10;
+    }
+    else if (version.starts_with("HTTP/"))
+    {
+        return fail(505);
+    }
+    else
+    {
+        return fail(400);
+    }
+    return true;
+}
+
+static bool isSpace(char c) { return c == ' ' || c == '\t'; }
+
+// 逗号分隔的列表里有没有token，不区分大小写（Connection: keep-alive, Upgrade）
+static bool hasToken(StringPiece list, const StringPiece &token)
+{
+    while (!list.empty())
+    {
+        const char *comma = static_cast<const char *>(memchr(list.data(), ',', list.size()));
+        StringPiece item(list.data(), comma ? comma - list.data() : list.size());
+        list.remove_prefix(comma ? item.size() + 1 : item.size());
+        while (!item.empty() && isSpace(item[0]))
+        {
+            item.remove_prefix(1);
+        }
+        while (!item.empty() && isSpace(item[item.size() - 1]))
+        {
+            item.remove_suffix(1);
+        }
+        if (item.equalsIgnoreCase(token))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 头部已经由HttpHeaderScanner切好了，这里只看决定消息体怎么收、连接保不保持的几个
+bool HttpContext::processHeader(const char *begin, const HttpRequest::Header &header)
+{
+    StringPiece name(begin + header.nameOffset, header.nameLength);
+    StringPiece v(begin + header.valueOffset, header.valueLength);
+    if (name.equalsIgnoreCase("Content-Length"))
+    {
+        if (v.empty())
+        {
+            return fail(400);
+        }
+        uint64_t n = 0;
+        for (size_t i = 0; i < v.size(); ++i)
+        {
+            if (v[i] < '0' || v[i] > '9' || n > (UINT64_MAX - 9) / 10)
+            {
+                return fail(400);
+            }
+            n = n * 10 + (v[i] - '0');
+        }
+        if (hasContentLength_ && n != contentLength_)
+        {
+            return fail(400);
+        }
+        hasContentLength_ = true;
+        contentLength_ = n;
+    }
+    else if (name.equalsIgnoreCase("Transfer-Encoding"))
+    {
+        // 只认最后一个编码是chunked的，别的编码不支持
+        transferEncoding_ = true;
+        StringPiece last = v;
+        const char *comma = static_cast<const char *>(memrchr(v.data(), ',', v.size()));
+        if (comma)
+        {
+            last.set(comma + 1, v.end() - comma - 1);
+        }
+        while (!last.empty() && isSpace(last[0]))
+        {
+            last.remove_prefix(1);
+        }
+        chunked_ = last.equalsIgnoreCase("chunked");
+    }
+    else if (name.equalsIgnoreCase("Connection"))
+    {
+        connectionClose_ = connectionClose_ || hasToken(v, "close");
+        connectionKeepAlive_ = connectionKeepAlive_ || hasToken(v, "keep-alive");
+    }
+    else if (name.equalsIgnoreCase("Expect"))
+    {
+        expectContinue_ = v.equalsIgnoreCase("100-continue");
+    }
+    return true;
+}
+
+bool HttpContext::headersDone()
+{
+    if (request_.version_ == HttpRequest::kHttp11)
+    {
+        request_.keepAlive_ = !connectionClose_;
+    }
+    else
+    {
+        request_.keepAlive_ = connectionKeepAlive_ && !connectionClose_;
+    }
+
+    if (transferEncoding_)
+    {
+        if (hasContentLength_)
+        {
+            return fail(400); // 两个都有的请求是走私的常见手法，不猜，直接拒绝
+        }
+        if (!chunked_)
+        {
+            return fail(501);
+        }
+        state_ = kExpectChunkSize;
+    }
+    else if (contentLength_ > 0)
+    {
+        if (contentLength_ > maxBodyBytes_)
+        {
+            return fail(413);
+        }
+        bodyOffset_ = pos_;
+        state_ = kExpectBody;
+    }
+    else
+    {
+        state_ = kGotAll;
+    }
+    expectContinue_ = expectContinue_ && state_ != kGotAll && request_.version_ == HttpRequest::kHttp11;
+    return true;
+}
+
+// 十六进制的长度，后面可能跟着;扩展，忽略
+bool HttpContext::processChunkSize(const char *line, size_t len)
+{
+    uint64_t n = 0;
+    size_t i = 0;
+    for (; i < len; ++i)
+    {
+        char c = line[i];
+        int digit;
+        if (c >= '0' && c <= '9')
+        {
+            digit = c - '0';
+        }
+        else if (c >= 'a' && c <= 'f')
+        {
+            digit = c - 'a' + 10;
+        }
+        else if (c >= 'A' && c <= 'F')
+        {
+            digit = c - 'A' + 10;
+        }
+        else
+        {
+            break;
+        }
+        if (n >> 60)
+        {
+            return fail(413);
+        }
+        n = n * 16 + digit;
+    }
+    if (i == 0 || (i < len && line[i] != ';' && !isSpace(line[i])))
+    {
+        return fail(400);
+    }
+    if (n > maxBodyBytes_ - chunkedBody_.size())
+    {
+        return fail(413);
+    }
+    chunkRemaining_ = n;
+    if (n == 0)
+    {
+        trailerStart_ = pos_;
+        state_ = kExpectTrailers;
+    }
+    else
+    {
+        state_ = kExpectChunkData;
+    }
+    return true;
+}
+
+bool HttpContext::parseRequest(Buffer *buf, Timestamp receiveTime)
+{
+    const char *begin = buf->peek();
+    const size_t readable = buf->readableBytes();
+    bool more = state_ != kGotAll && state_ != kError;
+    while (more)
+    {
+        switch (state_)
+        {
+        case kExpectHeaders:
+        {
+            // 最后一行没收全的时候先只找'\n'，收全了再整块切，一个字节一个字节来的时候不用反复切同一行
+            if (scan_ > pos_ && memchr(begin + scan_, '\n', readable - scan_) == nullptr)
+            {
+                scan_ = readable;
+                if (readable > maxHeaderBytes_)
+                {
+                    return fail(431);
+                }
+                more = false;
+                break;
+            }
+            size_t first = request_.headers_.size();
+            size_t next;
+            HttpHeaderScanner::Result result = HttpHeaderScanner::scan(begin, pos_, readable, &request_.headers_, &next);
+            for (size_t i = first; i < request_.headers_.size(); ++i)
+            {
+                if (!processHeader(begin, request_.headers_[i]))
+                {
+                    return false;
+                }
+            }
+            if (result == HttpHeaderScanner::kInvalid)
+            {
+                return fail(400);
+            }
+            pos_ = next;
+            if (result == HttpHeaderScanner::kNeedMore)
+            {
+                scan_ = readable;
+                if (readable > maxHeaderBytes_)
+                {
+                    return fail(431);
+                }
+                more = false;
+                break;
+            }
+            scan_ = pos_;
+            if (pos_ > maxHeaderBytes_)
+            {
+                return fail(431);
+            }
+            if (!headersDone())
+            {
+                return false;
+            }
+            break;
+        }
+        case kExpectRequestLine:
+        case kExpectChunkSize:
+        case kExpectTrailers:
+        {
+            size_t lineEnd;
+            if (!findLine(begin, readable, &lineEnd))
+            {
+                // 一行还没收全，看看是不是已经超长了
+                if (state_ == kExpectRequestLine && readable > maxHeaderBytes_)
+                {
+                    return fail(414);
+                }
+                if (state_ == kExpectChunkSize && readable - pos_ > kMaxChunkSizeLine)
+                {
+                    return fail(400);
+                }
+                if (state_ == kExpectTrailers && readable - trailerStart_ > maxHeaderBytes_)
+                {
+                    return fail(431);
+                }
+                more = false;
+                break;
+            }
+            size_t start = pos_;
+            size_t len = lineEnd - start;
+            if (len > 0 && begin[lineEnd - 1] == '\r')
+            {
+                --len;
+            }
+            pos_ = lineEnd + 1;
+            scan_ = pos_;
+
+            if (state_ == kExpectRequestLine)
+            {
+                if (len == 0 && request_.headers_.empty())
+                {
+                    // 请求之间多出来的空行（有的客户端POST完会多发一个\r\n），跳过去，算在这个请求里一起retrieve
+                    continue;
+                }
+                if (lineEnd > maxHeaderBytes_)
+                {
+                    return fail(414);
+                }
+                request_.receiveTime_ = receiveTime;
+                if (!processRequestLine(begin, start, len))
+                {
+                    return false;
+                }
+                state_ = kExpectHeaders;
+            }
+            else if (state_ == kExpectChunkSize)
+            {
+                if (!processChunkSize(begin + start, len))
+                {
+                    return false;
+                }
+            }
+            else if (len == 0) // kExpectTrailers，trailer的内容不要
+            {
+                state_ = kGotAll;
+            }
+            else if (pos_ - trailerStart_ > maxHeaderBytes_)
+            {
+                return fail(431);
+            }
+            break;
+        }
+        case kExpectBody:
+            if (readable - pos_ < contentLength_)
+            {
+                more = false;
+                break;
+            }
+            pos_ += contentLength_;
+            scan_ = pos_;
+            state_ = kGotAll;
+            break;
+        case kExpectChunkData:
+            if (readable - pos_ < chunkRemaining_ + 2)
+            {
+                more = false;
+                break;
+            }
+            if (begin[pos_ + chunkRemaining_] != '\r' || begin[pos_ + chunkRemaining_ + 1] != '\n')
+            {
+                return fail(400);
+            }
+            chunkedBody_.append(begin + pos_, chunkRemaining_);
+            pos_ += chunkRemaining_ + 2;
+            scan_ = pos_;
+            state_ = kExpectChunkSize;
+            break;
+        default:
+            more = false;
+            break;
+        }
+        more = more && state_ != kGotAll;
+    }
+
+    if (state_ == kGotAll)
+    {
+        // 收全了，Buffer不会再搬家，把偏移换成指针
+        request_.base_ = begin;
+        if (chunked_)
+        {
+            request_.body_ = chunkedBody_.data();
+            request_.bodyLength_ = chunkedBody_.size();
+        }
+        else
+        {
+            request_.body_ = begin + bodyOffset_;
+            request_.bodyLength_ = contentLength_;
+        }
+    }
+    return true;
+}
+
+bool HttpContext::takeExpectContinue()
+{
+    if (expectContinue_ && state_ != kGotAll && state_ != kError)
+    {
+        expectContinue_ = false;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "HttpRequest.h"
+#include "Timestamp.h"
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+class Buffer;
+
+/**
+ * @brief 每个HTTP连接一个的增量解析器
+ *
+ * 请求报文收全之前不从Buffer里取走任何数据，只记下解析到了哪里（相对peek()的偏移），
+ * 下一次onMessage从上次停下的地方接着找，不会把已经看过的字节再扫一遍；头部整块交给HttpHeaderScanner切。
+ * 收全以后request()里的字段都指向Buffer，处理完由调用者retrieve(requestBytes())，再reset()解析下一个
+ *
+ * 消息体支持Content-Length和Transfer-Encoding: chunked两种，chunked的数据块拼到chunkedBody_里，
+ * 它的容量和头部数组一样留着给后面的请求复用
+ */
+class HttpContext : noncopyable
+{
+public:
+    enum ParseState
+    {
+        kExpectRequestLine,
+        kExpectHeaders,
+        kExpectBody,      // Content-Length的消息体
+        kExpectChunkSize, // chunked：数据块长度那一行
+        kExpectChunkData, // chunked：数据块和后面的\r\n
+        kExpectTrailers,  // chunked：最后一个空数据块后面的trailer，直到空行
+        kGotAll,
+        kError,
+    };
+
+    HttpContext(size_t maxHeaderBytes, size_t maxBodyBytes);
+
+    // 接着上次的位置解析buf里的数据，请求有错时返回false，errorStatus()是应该回复的状态码
+    bool parseRequest(Buffer *buf, Timestamp receiveTime);
+
+    bool gotAll() const { return state_ == kGotAll; }
+    const HttpRequest &request() const { return request_; }
+    size_t requestBytes() const { return pos_; } // 收全以后，这个请求在Buffer里一共占了多少字节
+    int errorStatus() const { return errorStatus_; }
+
+    // 头部带了Expect: 100-continue，而消息体还没收到，需要先回一个100；每个请求只返回一次true
+    bool takeExpectContinue();
+
+    // 当前请求处理完了，准备解析下一个
+    void reset();
+
+private:
+    bool findLine(const char *begin, size_t readable, size_t *lineEnd);
+    bool processRequestLine(const char *begin, size_t start, size_t len);
+    bool processHeader(const char *begin, const HttpRequest::Header &header);
+    bool headersDone();
+    bool processChunkSize(const char *line, size_t len);
+    bool fail(int status);
+
+    const size_t maxHeaderBytes_;
+    const size_t maxBodyBytes_;
+
+    ParseState state_;
+    size_t pos_;  // 下一个要解析的字节，相对请求开头
+    size_t scan_; // 找行尾时已经扫过的位置，行没收全时下次从这里接着找
+    int errorStatus_;
+    HttpRequest request_;
+
+    // 解析头部时顺带记下的、决定消息体怎么收的字段
+    bool hasContentLength_;
+    uint64_t contentLength_;
+    bool chunked_;
+    bool transferEncoding_;
+    bool connectionClose_;
+    bool connectionKeepAlive_;
+    bool expectContinue_;
+
+    size_t bodyOffset_;     // Content-Length的消息体在请求里的偏移
+    uint64_t chunkRemaining_;
+    size_t trailerStart_;
+    std::string chunkedBody_;
+};
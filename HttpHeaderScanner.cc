@@ -0,0 +1,387 @@
+#include "HttpHeaderScanner.h"
+
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+using Header = HttpRequest::Header;
+
+/**
+ * 一次分类32个字节，每种字节一个位掩码：
+ * nonToken：不能出现在头部名字里的字节（RFC 7230 tchar以外的），名字后面第一个nonToken必须是':'，
+ *           行首第一个就是nonToken只能是空行；这样找冒号和检查名字是同一件事
+ * lf：'\n'，值在下一个lf处结束
+ * cr：'\r'，只能出现在'\n'前面
+ * ctl：值里不允许出现的控制字符（HT、CR、LF以外的）和DEL
+ * 每行只看两个位置（名字后面第一个nonToken、值后面第一个lf），中间的字节都不用一个一个看
+ */
+struct Masks
+{
+    uint32_t nonToken;
+    uint32_t lf;
+    uint32_t cr;
+    uint32_t ctl;
+};
+
+static const size_t kBlock = 32;
+
+// tchar按高4位、低4位各查一次表，两个结果按位与不为0就是tchar（高4位是2~7的才可能是，每个一位）
+struct TokenTables
+{
+    unsigned char lo[16];
+    unsigned char hi[16];
+    bool token[256];
+    bool ctl[256];
+
+    TokenTables()
+    {
+        memset(this, 0, sizeof *this);
+        for (int c = 0; c < 256; ++c)
+        {
+            token[c] = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                       (c != 0 && c < 0x80 && strchr("!#$%&'*+-.^_`|~", c) != nullptr);
+            ctl[c] = (c < 0x20 && c != '\t' && c != '\r' && c != '\n') || c == 0x7f;
+            if (token[c])
+            {
+                lo[c & 0x0f] |= 1 << ((c >> 4) - 2);
+            }
+        }
+        for (int h = 2; h < 8; ++h)
+        {
+            hi[h] = 1 << (h - 2);
+        }
+    }
+};
+
+static const TokenTables kTables;
+
+#if defined(__x86_64__)
+// 16字节的pshufb查表（SSSE3，有SSE4.2的CPU都有），两次拼成32位的掩码
+__attribute__((target("sse4.2"))) static inline uint32_t classify16(const char *p, uint32_t *lf, uint32_t *cr, uint32_t *ctl)
+{
+    const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(kTables.lo));
+    const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(kTables.hi));
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i ctlMax = _mm_set1_epi8(0x1f);
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i tok = _mm_and_si128(_mm_shuffle_epi8(lo, _mm_and_si128(v, nibble)),
+                                _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nibble)));
+    __m128i isLf = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    __m128i isCr = _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'));
+    __m128i isCtl = _mm_cmpeq_epi8(_mm_max_epu8(v, ctlMax), ctlMax);
+    __m128i allowed = _mm_or_si128(_mm_or_si128(isLf, isCr), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    isCtl = _mm_or_si128(_mm_andnot_si128(allowed, isCtl), _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+    *lf = static_cast<uint32_t>(_mm_movemask_epi8(isLf));
+    *cr = static_cast<uint32_t>(_mm_movemask_epi8(isCr));
+    *ctl = static_cast<uint32_t>(_mm_movemask_epi8(isCtl));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(tok, _mm_setzero_si128())));
+}
+
+__attribute__((target("sse4.2"))) static inline Masks classifySse42(const char *p)
+{
+    Masks m;
+    uint32_t lf, cr, ctl;
+    m.nonToken = classify16(p, &m.lf, &m.cr, &m.ctl);
+    m.nonToken |= classify16(p + 16, &lf, &cr, &ctl) << 16;
+    m.lf |= lf << 16;
+    m.cr |= cr << 16;
+    m.ctl |= ctl << 16;
+    return m;
+}
+
+// 一次32字节，pshufb在两个128位的半边里各查各的，表要复制到两边
+__attribute__((target("avx2"))) static inline Masks classifyAvx2(const char *p)
+{
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(kTables.lo)));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(kTables.hi)));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i ctlMax = _mm256_set1_epi8(0x1f);
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i tok = _mm256_and_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(v, nibble)),
+                                   _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+    __m256i isLf = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+    __m256i isCr = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'));
+    __m256i isCtl = _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctlMax), ctlMax);
+    __m256i allowed = _mm256_or_si256(_mm256_or_si256(isLf, isCr), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    isCtl = _mm256_or_si256(_mm256_andnot_si256(allowed, isCtl), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f)));
+    Masks m;
+    m.nonToken = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(tok, _mm256_setzero_si256())));
+    m.lf = static_cast<uint32_t>(_mm256_movemask_epi8(isLf));
+    m.cr = static_cast<uint32_t>(_mm256_movemask_epi8(isCr));
+    m.ctl = static_cast<uint32_t>(_mm256_movemask_epi8(isCtl));
+    return m;
+}
+#endif
+
+static inline void trimValue(const char *data, size_t *value, size_t *end)
+{
+    while (*value < *end && (data[*value] == ' ' || data[*value] == '\t'))
+    {
+        ++*value;
+    }
+    while (*end > *value && (data[*end - 1] == ' ' || data[*end - 1] == '\t'))
+    {
+        --*end;
+    }
+}
+
+// 所有实现共用的切法，Classify决定一块怎么分类；各个实现带着自己的target把它内联进去
+template <Masks (*Classify)(const char *)>
+static inline __attribute__((always_inline)) HttpHeaderScanner::Result
+scanBlocks(const char *data, size_t start, size_t end, std::vector<Header> *headers, size_t *next)
+{
+    size_t lineStart = start;
+    size_t colon = 0;
+    bool inValue = false; // false：在名字里找第一个nonToken；true：在值里找lf
+    char tail[kBlock];
+
+    for (size_t base = start; base < end; base += kBlock)
+    {
+        Masks m;
+        size_t avail = end - base;
+        if (avail >= kBlock)
+        {
+            m = Classify(data + base);
+        }
+        else
+        {
+            // 最后不满一块的，补上tchar，补的部分不会产生任何事件
+            memcpy(tail, data + base, avail);
+            memset(tail + avail, 'a', kBlock - avail);
+            m = Classify(tail);
+        }
+        // 单独的'\r'：后面不是'\n'。块里最后一个字节要看下一块的第一个字节，数据到头了就等后面的数据
+        uint32_t loneCr = m.cr & ~(m.lf >> 1);
+        if (loneCr >> 31)
+        {
+            if (base + kBlock >= end || data[base + kBlock] == '\n')
+            {
+                loneCr &= ~(1u << 31);
+            }
+        }
+        if (avail < kBlock && avail > 0)
+        {
+            loneCr &= ~(1u << (avail - 1)); // 最后一个字节是'\r'，这一行本来就没收全
+        }
+        uint32_t bad = m.ctl | loneCr;
+
+        uint32_t off = base < lineStart ? static_cast<uint32_t>(lineStart - base) : 0; // 块里从哪一位开始看
+        while (off < kBlock)
+        {
+            uint32_t from = ~0u << off;
+            if (!inValue)
+            {
+                uint32_t hit = m.nonToken & from;
+                if (hit == 0)
+                {
+                    break;
+                }
+                uint32_t bit = __builtin_ctz(hit);
+                size_t pos = base + bit;
+                char c = data[pos];
+                if (pos == lineStart && (c == '\n' || c == '\r'))
+                {
+                    // 空行，'\r'后面必须紧跟着'\n'
+                    if (c == '\r')
+                    {
+                        if (pos + 1 >= end)
+                        {
+                            break;
+                        }
+                        if (data[pos + 1] != '\n')
+                        {
+                            return HttpHeaderScanner::kInvalid;
+                        }
+                        ++pos;
+                    }
+                    *next = pos + 1;
+                    return HttpHeaderScanner::kEndOfHeaders;
+                }
+                if (c != ':' || pos == lineStart)
+                {
+                    return HttpHeaderScanner::kInvalid; // 名字里有别的字符（空白、折行、控制字符……），或者名字是空的
+                }
+                colon = pos;
+                inValue = true;
+                off = bit + 1;
+            }
+            else
+            {
+                uint32_t hit = m.lf & from;
+                uint32_t upto = hit ? (2u << __builtin_ctz(hit)) - 1 : ~0u; // 这一行在这一块里的部分
+                if (bad & from & upto)
+                {
+                    return HttpHeaderScanner::kInvalid;
+                }
+                if (hit == 0)
+                {
+                    break;
+                }
+                uint32_t bit = __builtin_ctz(hit);
+                size_t lineEnd = base + bit;
+                if (data[lineEnd - 1] == '\r')
+                {
+                    --lineEnd;
+                }
+                size_t value = colon + 1;
+                trimValue(data, &value, &lineEnd);
+                Header header = {lineStart, colon - lineStart, value, lineEnd - value};
+                headers->push_back(header);
+                lineStart = base + bit + 1;
+                inValue = false;
+                off = bit + 1;
+            }
+        }
+    }
+    *next = lineStart;
+    return HttpHeaderScanner::kNeedMore;
+}
+
+// 没有SIMD时拼掩码反而比逐字节看慢，直接按行走：名字查token表走到冒号，值走到'\n'
+static HttpHeaderScanner::Result scanScalar(const char *data, size_t start, size_t end,
+                                            std::vector<Header> *headers, size_t *next)
+{
+    size_t lineStart = start;
+    for (;;)
+    {
+        size_t pos = lineStart;
+        while (pos < end && kTables.token[static_cast<unsigned char>(data[pos])])
+        {
+            ++pos;
+        }
+        if (pos == end)
+        {
+            break;
+        }
+        if (pos == lineStart && (data[pos] == '\n' || data[pos] == '\r'))
+        {
+            if (data[pos] == '\r')
+            {
+                if (pos + 1 == end)
+                {
+                    break;
+                }
+                if (data[pos + 1] != '\n')
+                {
+                    return HttpHeaderScanner::kInvalid;
+                }
+                ++pos;
+            }
+            *next = pos + 1;
+            return HttpHeaderScanner::kEndOfHeaders;
+        }
+        if (data[pos] != ':' || pos == lineStart)
+        {
+            return HttpHeaderScanner::kInvalid;
+        }
+        size_t colon = pos;
+        for (++pos; pos < end && data[pos] != '\n'; ++pos)
+        {
+            unsigned char c = static_cast<unsigned char>(data[pos]);
+            if (kTables.ctl[c] || (c == '\r' && pos + 1 < end && data[pos + 1] != '\n'))
+            {
+                return HttpHeaderScanner::kInvalid;
+            }
+        }
+        if (pos == end)
+        {
+            break;
+        }
+        size_t lineEnd = data[pos - 1] == '\r' ? pos - 1 : pos;
+        size_t value = colon + 1;
+        trimValue(data, &value, &lineEnd);
+        Header header = {lineStart, colon - lineStart, value, lineEnd - value};
+        headers->push_back(header);
+        lineStart = pos + 1;
+    }
+    *next = lineStart;
+    return HttpHeaderScanner::kNeedMore;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static HttpHeaderScanner::Result scanSse42(const char *data, size_t start, size_t end,
+                                                                             std::vector<Header> *headers, size_t *next)
+{
+    return scanBlocks<classifySse42>(data, start, end, headers, next);
+}
+
+__attribute__((target("avx2"))) static HttpHeaderScanner::Result scanAvx2(const char *data, size_t start, size_t end,
+                                                                          std::vector<Header> *headers, size_t *next)
+{
+    return scanBlocks<classifyAvx2>(data, start, end, headers, next);
+}
+#endif
+
+using ScanFunc = HttpHeaderScanner::Result (*)(const char *, size_t, size_t, std::vector<Header> *, size_t *);
+
+struct Implementation
+{
+    const char *name;
+    ScanFunc func;
+};
+
+static bool supported(const char *name)
+{
+#if defined(__x86_64__)
+    if (strcmp(name, "avx2") == 0)
+    {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (strcmp(name, "sse4.2") == 0)
+    {
+        return __builtin_cpu_supports("sse4.2");
+    }
+#endif
+    return strcmp(name, "scalar") == 0;
+}
+
+static const Implementation kImplementations[] = {
+#if defined(__x86_64__)
+    {"avx2", scanAvx2},
+    {"sse4.2", scanSse42},
+#endif
+    {"scalar", scanScalar},
+};
+
+// 按优先级挑CPU支持的第一个
+static const Implementation *chooseImplementation()
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init(); // 静态初始化的时候就要用，不能指望libgcc的构造函数已经跑过了
+#endif
+    for (const Implementation &impl : kImplementations)
+    {
+        if (supported(impl.name))
+        {
+            return &impl;
+        }
+    }
+    return &kImplementations[sizeof kImplementations / sizeof kImplementations[0] - 1];
+}
+
+static const Implementation *g_implementation = chooseImplementation();
+
+HttpHeaderScanner::Result HttpHeaderScanner::scan(const char *data, size_t start, size_t end,
+                                                  std::vector<Header> *headers, size_t *next)
+{
+    return g_implementation->func(data, start, end, headers, next);
+}
+
+const char *HttpHeaderScanner::implementation()
+{
+    return g_implementation->name;
+}
+
+bool HttpHeaderScanner::setImplementation(const char *name)
+{
+    for (const Implementation &impl : kImplementations)
+    {
+        if (strcmp(impl.name, name) == 0 && supported(name))
+        {
+            g_implementation = &impl;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "HttpRequest.h"
+
+#include <vector>
+#include <stddef.h>
+
+/**
+ * @brief 把HTTP头部切成一个个名字/值，一次看16或32个字节
+ *
+ * 一次把一块字节（32个）分成几类，每类得到一个位掩码：不是token的字节、'\n'、'\r'、控制字符。
+ * 名字后面第一个不是token的字节必须是':'，值在下一个'\n'结束，每行只按掩码跳到这两个位置，
+ * 中间的普通字符不用一个一个看；找冒号和检查名字是不是token是同一件事。
+ *
+ * 三种实现，第一次用的时候按CPU挑一个：avx2（一条pshufb分类32字节），sse4.2（pshufb，16字节两次），
+ * scalar（查表，一次一个字节，非x86或者老CPU用）
+ */
+class HttpHeaderScanner
+{
+public:
+    enum Result
+    {
+        kNeedMore,     // 数据到头了，最后一行还没收全
+        kEndOfHeaders, // 碰到了空行
+        kInvalid,      // 格式不对：没有冒号、名字不是token、折行、值里有控制字符、单独的'\r'
+    };
+
+    // 从data+start开始，到data+end为止，每一个完整的头部行追加一个Header到headers，偏移都相对data。
+    // kEndOfHeaders时*next是空行后面的位置；kNeedMore时*next是还没收全的那一行的开头，下次从那里接着切
+    static Result scan(const char *data, size_t start, size_t end,
+                       std::vector<HttpRequest::Header> *headers, size_t *next);
+
+    // 当前用的实现："avx2"、"sse4.2"或"scalar"
+    static const char *implementation();
+    // 压测用：换成指定的实现，CPU不支持或者名字不对时返回false；要在没有线程在解析的时候调用
+    static bool setImplementation(const char *name);
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "StringPiece.h"
+#include "Timestamp.h"
+
+#include <vector>
+#include <stddef.h>
+
+/**
+ * @brief 一个解析好的HTTP请求，由HttpContext填充
+ *
+ * 方法以外的字段都不拷贝，直接指向连接inputBuffer_里的请求报文（chunked的消息体指向HttpContext里拼好的那一份），
+ * 只在HttpServer的回调里有效，回调返回以后请求就从Buffer里retrieve掉了，要留着得自己as_string()。
+ * 解析的时候Buffer可能扩容搬家，所以先按相对请求开头的偏移记下来，收全了再bind到Buffer的当前地址上
+ */
+class HttpRequest
+{
+public:
+    enum Method
+    {
+        kInvalid,
+        kGet,
+        kPost,
+        kHead,
+        kPut,
+        kDelete,
+        kOptions,
+        kPatch,
+    };
+    enum Version
+    {
+        kUnknown,
+        kHttp10,
+        kHttp11,
+    };
+
+    // 一个头部字段在请求报文里的位置
+    struct Header
+    {
+        size_t nameOffset;
+        size_t nameLength;
+        size_t valueOffset;
+        size_t valueLength;
+    };
+
+    HttpRequest() : method_(kInvalid), version_(kUnknown), base_(nullptr),
+                    pathOffset_(0), pathLength_(0), queryOffset_(0), queryLength_(0),
+                    body_(nullptr), bodyLength_(0), keepAlive_(false) {}
+
+    Method method() const { return method_; }
+    const char *methodString() const
+    {
+        switch (method_)
+        {
+        case kGet: return "GET";
+        case kPost: return "POST";
+        case kHead: return "HEAD";
+        case kPut: return "PUT";
+        case kDelete: return "DELETE";
+        case kOptions: return "OPTIONS";
+        case kPatch: return "PATCH";
+        default: return "UNKNOWN";
+        }
+    }
+    Version version() const { return version_; }
+
+    StringPiece path() const { return StringPiece(base_ + pathOffset_, pathLength_); }
+    StringPiece query() const { return StringPiece(base_ + queryOffset_, queryLength_); } // 不含'?'，没有就是空的
+
+    // 按名字找头部字段，不区分大小写，找不到返回空；同名的有多个时返回第一个
+    StringPiece getHeader(const StringPiece &field) const
+    {
+        for (const Header &h : headers_)
+        {
+            if (StringPiece(base_ + h.nameOffset, h.nameLength).equalsIgnoreCase(field))
+            {
+                return StringPiece(base_ + h.valueOffset, h.valueLength);
+            }
+        }
+        return StringPiece();
+    }
+    size_t numHeaders() const { return headers_.size(); }
+    StringPiece headerName(size_t i) const { return StringPiece(base_ + headers_[i].nameOffset, headers_[i].nameLength); }
+    StringPiece headerValue(size_t i) const { return StringPiece(base_ + headers_[i].valueOffset, headers_[i].valueLength); }
+
+    StringPiece body() const { return StringPiece(body_, bodyLength_); }
+
+    Timestamp receiveTime() const { return receiveTime_; }
+    // HTTP/1.1默认保持连接，除非Connection: close；HTTP/1.0要显式Connection: keep-alive
+    bool keepAlive() const { return keepAlive_; }
+
+private:
+    friend class HttpContext;
+
+    // 开始解析下一个请求，headers_的容量留着复用
+    void reset()
+    {
+        method_ = kInvalid;
+        version_ = kUnknown;
+        base_ = nullptr;
+        pathOffset_ = pathLength_ = queryOffset_ = queryLength_ = 0;
+        headers_.clear();
+        body_ = nullptr;
+        bodyLength_ = 0;
+        keepAlive_ = false;
+    }
+
+    Method method_;
+    Version version_;
+    const char *base_; // 请求报文的开头，收全以后才设置
+    size_t pathOffset_;
+    size_t pathLength_;
+    size_t queryOffset_;
+    size_t queryLength_;
+    std::vector<Header> headers_;
+    const char *body_;
+    size_t bodyLength_;
+    bool keepAlive_;
+    Timestamp receiveTime_;
+};
@@ -0,0 +1,113 @@
+#include "HttpResponse.h"
+
+#include <string.h>
+
+// 无符号数转成十进制或十六进制，写在buf的末尾，返回开头
+static char *formatUnsigned(char *end, size_t value, unsigned base)
+{
+    static const char digits[] = "0123456789abcdef";
+    char *p = end;
+    do
+    {
+        *--p = digits[value % base];
+        value /= base;
+    } while (value != 0);
+    return p;
+}
+
+const char *HttpResponse::statusMessage(int code)
+{
+    switch (code)
+    {
+    case 100: return "Continue";
+    case 101: return "Switching Protocols";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 204: return "No Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 414: return "URI Too Long";
+    case 426: return "Upgrade Required";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    case 505: return "HTTP Version Not Supported";
+    default: return "Unknown";
+    }
+}
+
+void HttpResponse::appendToBuffer(Buffer *output) const
+{
+    char buf[32];
+    char *end = buf + sizeof buf;
+
+    // 状态行：HTTP/1.1 200 OK
+    int code = statusCode_ == kUnknown ? k200Ok : statusCode_;
+    output->append("HTTP/1.1 ", 9);
+    char *p = formatUnsigned(end, code, 10);
+    output->append(p, end - p);
+    output->append(" ", 1);
+    if (statusMessage_.empty())
+    {
+        const char *message = statusMessage(code);
+        output->append(message, strlen(message));
+    }
+    else
+    {
+        output->append(statusMessage_.data(), statusMessage_.size());
+    }
+    output->append("\r\n", 2);
+
+    output->append(headers_.peek(), headers_.readableBytes());
+    if (closeConnection_)
+    {
+        output->append("Connection: close\r\n", 19);
+    }
+    else
+    {
+        output->append("Connection: Keep-Alive\r\n", 24);
+    }
+    // 1xx、204、304没有消息体
+    bool noBody = code < 200 || code == k204NoContent || code == k304NotModified;
+    if (noBody)
+    {
+        output->append("\r\n", 2);
+        return;
+    }
+    if (chunked_)
+    {
+        output->append("Transfer-Encoding: chunked\r\n\r\n", 30);
+        if (!omitBody_)
+        {
+            // 消息体是整个攒好了才发的，编码成一个数据块加上结束块
+            size_t len = body_.readableBytes();
+            if (len > 0)
+            {
+                p = formatUnsigned(end - 2, len, 16);
+                memcpy(end - 2, "\r\n", 2);
+                output->append(p, end - p);
+                output->append(body_.peek(), len);
+                output->append("\r\n", 2);
+            }
+            output->append("0\r\n\r\n", 5);
+        }
+    }
+    else
+    {
+        output->append("Content-Length: ", 16);
+        p = formatUnsigned(end - 4, body_.readableBytes(), 10);
+        memcpy(end - 4, "\r\n\r\n", 4);
+        output->append(p, end - p);
+        if (!omitBody_)
+        {
+            output->append(body_.peek(), body_.readableBytes());
+        }
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Buffer.h"
+#include "StringPiece.h"
+
+#include <string>
+#include <stddef.h>
+
+/**
+ * @brief 构造HTTP响应
+ *
+ * 头部和消息体在调用addHeader/appendBody的时候就直接写进Buffer，不经过map<string, string>之类的临时对象，
+ * appendToBuffer再把状态行、头部、Content-Length和消息体依次拷到连接的输出Buffer里。
+ * HttpServer每个线程只有一个HttpResponse，处理每个请求前reset，Buffer的容量一直复用
+ *
+ * setChunked(true)以后用Transfer-Encoding: chunked代替Content-Length；HTTP/1.0的客户端不认识chunked，
+ * HttpServer会把它改回Content-Length
+ */
+class HttpResponse : noncopyable
+{
+public:
+    enum HttpStatusCode
+    {
+        kUnknown,
+        k100Continue = 100,
+        k101SwitchingProtocols = 101,
+        k200Ok = 200,
+        k201Created = 201,
+        k204NoContent = 204,
+        k301MovedPermanently = 301,
+        k302Found = 302,
+        k304NotModified = 304,
+        k400BadRequest = 400,
+        k403Forbidden = 403,
+        k404NotFound = 404,
+        k405MethodNotAllowed = 405,
+        k413PayloadTooLarge = 413,
+        k414UriTooLong = 414,
+        k426UpgradeRequired = 426,
+        k431RequestHeaderFieldsTooLarge = 431,
+        k500InternalServerError = 500,
+        k501NotImplemented = 501,
+        k503ServiceUnavailable = 503,
+        k505HttpVersionNotSupported = 505,
+    };
+
+    explicit HttpResponse(bool close) { reset(close); }
+
+    // 开始构造一个新的响应，保留Buffer的容量
+    void reset(bool close)
+    {
+        statusCode_ = kUnknown;
+        statusMessage_.clear();
+        closeConnection_ = close;
+        chunked_ = false;
+        omitBody_ = false;
+        headers_.retrieveAll();
+        body_.retrieveAll();
+    }
+
+    void setStatusCode(HttpStatusCode code) { statusCode_ = code; }
+    // 不设置就用状态码的标准描述
+    void setStatusMessage(const std::string &message) { statusMessage_ = message; }
+
+    void setCloseConnection(bool on) { closeConnection_ = on; }
+    bool closeConnection() const { return closeConnection_; }
+
+    void setContentType(const StringPiece &contentType) { addHeader("Content-Type", contentType); }
+    // Content-Length、Transfer-Encoding和Connection由appendToBuffer自己写，不要加
+    void addHeader(const StringPiece &field, const StringPiece &value)
+    {
+        headers_.append(field.data(), field.size());
+        headers_.append(": ", 2);
+        headers_.append(value.data(), value.size());
+        headers_.append("\r\n", 2);
+    }
+
+    void setChunked(bool on) { chunked_ = on; }
+    bool chunked() const { return chunked_; }
+    void setBody(const StringPiece &body)
+    {
+        body_.retrieveAll();
+        body_.append(body.data(), body.size());
+    }
+    void appendBody(const char *data, size_t len) { body_.append(data, len); }
+
+    // HEAD请求：头部照常（包括Content-Length），不发消息体
+    void setOmitBody(bool on) { omitBody_ = on; }
+
+    void appendToBuffer(Buffer *output) const;
+
+    // 状态码的标准描述，不认识的返回"Unknown"
+    static const char *statusMessage(int code);
+
+private:
+    HttpStatusCode statusCode_;
+    std::string statusMessage_;
+    bool closeConnection_;
+    bool chunked_;
+    bool omitBody_;
+    Buffer headers_; // 已经编码好的"名字: 值\r\n"
+    Buffer body_;
+};
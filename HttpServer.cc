@@ -0,0 +1,128 @@
+#include "HttpServer.h"
+#include "HttpContext.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "Logger.h"
+
+#include <time.h>
+
+static void defaultHttpCallback(const HttpRequest &, HttpResponse *resp)
+{
+    resp->setStatusCode(HttpResponse::k404NotFound);
+    resp->setCloseConnection(true);
+}
+
+// Date头部的值，例如"Sun, 06 Nov 1994 08:49:37 GMT"，每个线程缓存一份，秒数变了才重新格式化
+static StringPiece httpDate(Timestamp now)
+{
+    static __thread time_t t_lastSecond;
+    static __thread char t_date[32];
+    time_t seconds = now.secondsSinceEpoch();
+    if (seconds != t_lastSecond || t_date[0] == '\0')
+    {
+        struct tm tm;
+        gmtime_r(&seconds, &tm);
+        strftime(t_date, sizeof t_date, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        t_lastSecond = seconds;
+    }
+    return StringPiece(t_date);
+}
+
+HttpServer::HttpServer(EventLoop *loop,
+                       const InetAddress &listenAddr,
+                       const std::string &name,
+                       TcpServer::Option option)
+    : loop_(loop),
+      server_(loop, listenAddr, name, option),
+      httpCallback_(defaultHttpCallback),
+      maxHeaderBytes_(64 * 1024),
+      maxBodyBytes_(8 * 1024 * 1024)
+{
+    server_.setConnectionCallback(std::bind(&HttpServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(std::bind(&HttpServer::onMessage, this,
+                                         std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void HttpServer::start()
+{
+    LOG_INFO("HttpServer starts listening\n");
+    server_.start();
+}
+
+void HttpServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        conn->setContext(std::make_shared<HttpContext>(maxHeaderBytes_, maxBodyBytes_));
+    }
+    else
+    {
+        conn->setContext(std::shared_ptr<void>());
+    }
+}
+
+void HttpServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    HttpContext *context = static_cast<HttpContext *>(conn->getContext().get());
+    if (context == nullptr || !conn->connected())
+    {
+        buf->retrieveAll(); // 已经决定关闭了，后面再来的请求不处理
+        return;
+    }
+
+    // 这一批请求的响应都写在这里，最后一次send；loop线程里send(Buffer*)会把它清空，每个线程一个一直复用
+    static thread_local Buffer t_output;
+    static thread_local HttpResponse t_response(false);
+    t_output.retrieveAll();
+
+    bool close = false;
+    for (;;)
+    {
+        if (!context->parseRequest(buf, receiveTime))
+        {
+            t_response.reset(true);
+            t_response.setStatusCode(static_cast<HttpResponse::HttpStatusCode>(context->errorStatus()));
+            t_response.appendToBuffer(&t_output);
+            buf->retrieveAll();
+            close = true;
+            break;
+        }
+        if (context->takeExpectContinue())
+        {
+            t_output.append("HTTP/1.1 100 Continue\r\n\r\n", 25);
+        }
+        if (!context->gotAll())
+        {
+            break; // 剩下的半个请求留在buf里，下次接着解析
+        }
+
+        const HttpRequest &req = context->request();
+        t_response.reset(!req.keepAlive());
+        t_response.addHeader("Date", httpDate(req.receiveTime()));
+        t_response.setOmitBody(req.method() == HttpRequest::kHead);
+        httpCallback_(req, &t_response);
+        if (req.version() == HttpRequest::kHttp10)
+        {
+            t_response.setChunked(false);
+        }
+        t_response.appendToBuffer(&t_output);
+        close = t_response.closeConnection();
+
+        buf->retrieve(context->requestBytes());
+        context->reset();
+        if (close)
+        {
+            buf->retrieveAll();
+            break;
+        }
+    }
+
+    if (t_output.readableBytes() > 0)
+    {
+        conn->send(&t_output);
+    }
+    if (close)
+    {
+        conn->shutdown();
+    }
+}
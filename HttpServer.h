@@ -0,0 +1,56 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpServer.h"
+
+#include <functional>
+#include <string>
+
+class HttpRequest;
+class HttpResponse;
+
+/**
+ * @brief 基于TcpServer的HTTP/1.1服务器
+ *
+ * 每个连接一个HttpContext做增量解析，挂在TcpConnection的context上。
+ * 一次onMessage里收全了几个请求就连着处理几个（pipelining），响应按请求的顺序写进同一个Buffer，
+ * 最后一次send出去；HTTP/1.1默认keep-alive，请求或者回调要求关闭时，发完这批响应就shutdown。
+ * 请求有错（格式不对、头部或消息体超过上限）时回复对应的4xx/5xx并关闭连接
+ *
+ * httpCallback在连接所在的loop线程里同步执行，返回时响应就构造好了；
+ * request里的字段都指向inputBuffer_，回调返回以后就失效了
+ */
+class HttpServer : noncopyable
+{
+public:
+    using HttpCallback = std::function<void(const HttpRequest &, HttpResponse *)>;
+
+    HttpServer(EventLoop *loop,
+               const InetAddress &listenAddr,
+               const std::string &name,
+               TcpServer::Option option = TcpServer::kNoReusePort);
+
+    EventLoop *getLoop() const { return loop_; }
+    // 线程数、socket选项、限速之类的直接在底下的TcpServer上设置
+    TcpServer *tcpServer() { return &server_; }
+
+    // 默认回复404
+    void setHttpCallback(const HttpCallback &cb) { httpCallback_ = cb; }
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+
+    // 请求行加头部最多多少字节（默认64K），消息体最多多少字节（默认8M），在start()之前设置
+    void setMaxHeaderBytes(size_t bytes) { maxHeaderBytes_ = bytes; }
+    void setMaxBodyBytes(size_t bytes) { maxBodyBytes_ = bytes; }
+
+    void start();
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    EventLoop *loop_;
+    TcpServer server_;
+    HttpCallback httpCallback_;
+    size_t maxHeaderBytes_;
+    size_t maxBodyBytes_;
+};
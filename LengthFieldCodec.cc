@@ -0,0 +1,190 @@
+#include "LengthFieldCodec.h"
+#include "Buffer.h"
+#include "TcpConnection.h"
+#include "Logger.h"
+
+#include <string.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+static void defaultErrorCallback(const TcpConnectionPtr &conn, LengthFieldCodec::Error error)
+{
+    LOG_ERROR("LengthFieldCodec [%s] %s, closing\n", conn->name().c_str(),
+              error == LengthFieldCodec::kFrameTooLarge ? "frame too large" : "checksum mismatch");
+    // 分帧已经错位了，shutdown只是半关闭，还会接着读，对端后面的数据又会被当成新的帧头；直接关掉
+    conn->forceClose();
+}
+
+LengthFieldCodec::LengthFieldCodec(FrameCallback cb, const Options &options)
+    : options_(options),
+      headerBytes_(options.lengthFieldBytes + (options.checksum ? 4 : 0)),
+      frameCallback_(std::move(cb)),
+      errorCallback_(defaultErrorCallback)
+{
+    int n = options.lengthFieldBytes;
+    if (n != 1 && n != 2 && n != 4 && n != 8)
+    {
+        LOG_FATAL("LengthFieldCodec lengthFieldBytes must be 1, 2, 4 or 8, got %d\n", n);
+    }
+}
+
+uint64_t LengthFieldCodec::readField(const char *p, int bytes) const
+{
+    const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+    {
+        int shift = options_.bigEndian ? (bytes - 1 - i) * 8 : i * 8;
+        value |= static_cast<uint64_t>(u[i]) << shift;
+    }
+    return value;
+}
+
+void LengthFieldCodec::writeField(char *p, uint64_t value, int bytes) const
+{
+    for (int i = 0; i < bytes; ++i)
+    {
+        int shift = options_.bigEndian ? (bytes - 1 - i) * 8 : i * 8;
+        p[i] = static_cast<char>((value >> shift) & 0xff);
+    }
+}
+
+// 一次把buf里所有完整的帧都分发出去，帧的内容直接指向buf，回调返回以后再retrieve
+void LengthFieldCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    const int lengthBytes = options_.lengthFieldBytes;
+    while (buf->readableBytes() >= headerBytes_)
+    {
+        const char *header = buf->peek();
+        uint64_t len = readField(header, lengthBytes);
+        if (len > options_.maxFrameSize)
+        {
+            buf->retrieveAll(); // 后面的数据已经没法分帧了
+            errorCallback_(conn, kFrameTooLarge);
+            return;
+        }
+        if (buf->readableBytes() < headerBytes_ + len)
+        {
+            break; // 帧还没收全
+        }
+        const char *payload = header + headerBytes_;
+        if (options_.checksum &&
+            static_cast<uint32_t>(readField(header + lengthBytes, 4)) != crc32c(payload, len))
+        {
+            buf->retrieveAll();
+            errorCallback_(conn, kChecksumMismatch);
+            return;
+        }
+        frameCallback_(conn, payload, len, receiveTime);
+        buf->retrieve(headerBytes_ + len);
+    }
+}
+
+bool LengthFieldCodec::encode(Buffer *buf) const
+{
+    size_t len = buf->readableBytes();
+    int lengthBytes = options_.lengthFieldBytes;
+    if (len > options_.maxFrameSize || (lengthBytes < 8 && len >> (lengthBytes * 8) != 0))
+    {
+        return false; // 长度字段放不下，或者对端也会当成错误
+    }
+    char header[12];
+    writeField(header, len, lengthBytes);
+    if (options_.checksum)
+    {
+        writeField(header + lengthBytes, crc32c(buf->peek(), len), 4);
+    }
+    if (buf->prependableBytes() >= headerBytes_)
+    {
+        buf->prepend(header, headerBytes_);
+    }
+    else // 预留区不够（8字节长度+CRC），重新拼一个
+    {
+        Buffer framed(headerBytes_ + len);
+        framed.append(header, headerBytes_);
+        framed.append(buf->peek(), len);
+        std::swap(*buf, framed);
+    }
+    return true;
+}
+
+void LengthFieldCodec::send(const TcpConnectionPtr &conn, const char *data, size_t len) const
+{
+    // 每个线程一个编码用的Buffer，loop线程里send(Buffer*)同步写完或者拷进outputBuffer_以后就清空了，可以一直复用
+    static thread_local Buffer t_buffer;
+    t_buffer.retrieveAll();
+    t_buffer.append(data, len);
+    if (!encode(&t_buffer))
+    {
+        LOG_ERROR("LengthFieldCodec [%s] frame of %lu bytes is too large, dropped\n", conn->name().c_str(), len);
+        return;
+    }
+    conn->send(&t_buffer);
+}
+
+// 软件实现，一次处理一个字节，查表
+static uint32_t crc32cTable[256];
+
+static bool initCrc32cTable()
+{
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; ++j)
+        {
+            crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+        }
+        crc32cTable[i] = crc;
+    }
+    return true;
+}
+
+static uint32_t crc32cSoftware(const unsigned char *p, size_t len, uint32_t crc)
+{
+    static bool tableReady = initCrc32cTable();
+    (void)tableReady;
+    for (size_t i = 0; i < len; ++i)
+    {
+        crc = crc32cTable[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+// SSE4.2的crc32指令，一次8个字节；库是按通用x86-64编译的，只有这个函数打开sse4.2
+__attribute__((target("sse4.2"))) static uint32_t crc32cHardware(const unsigned char *p, size_t len, uint32_t crc)
+{
+    uint64_t crc64 = crc;
+    while (len >= 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        crc64 = _mm_crc32_u64(crc64, v);
+        p += 8;
+        len -= 8;
+    }
+    uint32_t crc32 = static_cast<uint32_t>(crc64);
+    while (len > 0)
+    {
+        crc32 = _mm_crc32_u8(crc32, *p);
+        ++p;
+        --len;
+    }
+    return crc32;
+}
+#endif
+
+uint32_t LengthFieldCodec::crc32c(const void *data, size_t len, uint32_t crc)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    crc = ~crc;
+#if defined(__x86_64__)
+    static const bool hasSse42 = __builtin_cpu_supports("sse4.2");
+    if (hasSse42)
+    {
+        return ~crc32cHardware(p, len, crc);
+    }
+#endif
+    return ~crc32cSoftware(p, len, crc);
+}
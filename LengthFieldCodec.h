@@ -0,0 +1,77 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+class Buffer;
+
+/**
+ * @brief 长度前缀的分帧编解码：[长度][CRC32C，可选][消息体]
+ *
+ * 收：把onMessage设成连接的MessageCallback，凑齐一个完整的帧就回调一次frameCallback，
+ * 给的是inputBuffer_里消息体的指针和长度，不拷贝，回调返回以后这段内存就被回收了，要留着得自己拷。
+ * 发：消息体先append到Buffer里，encode把头prepend到Buffer的预留区，conn->send(buf)一次发出去。
+ *
+ * 长度字段可以是1/2/4/8个字节，大端或小端，不包括头本身；带校验时长度后面是4个字节的CRC32C（按长度字段的字节序），
+ * 只覆盖消息体，有SSE4.2就用硬件指令算。Buffer的预留区是8个字节，头超过8个字节（8字节长度+CRC）时encode要多拷贝一次
+ *
+ * 用法：
+ *     LengthFieldCodec codec(std::bind(&Server::onFrame, this, _1, _2, _3, _4));
+ *     server.setMessageCallback(std::bind(&LengthFieldCodec::onMessage, &codec, _1, _2, _3));
+ *     codec.send(conn, data, len);
+ */
+class LengthFieldCodec : noncopyable
+{
+public:
+    using FrameCallback = std::function<void(const TcpConnectionPtr &, const char *data, size_t len, Timestamp)>;
+
+    enum Error
+    {
+        kFrameTooLarge,    // 长度超过maxFrameSize
+        kChecksumMismatch, // CRC32C对不上
+    };
+    // 默认：打一条错误日志，丢掉inputBuffer_里剩下的数据，forceClose连接；自己设置的回调也应该关掉连接，后面的数据已经没法分帧了
+    using ErrorCallback = std::function<void(const TcpConnectionPtr &, Error)>;
+
+    struct Options
+    {
+        Options() : lengthFieldBytes(4), bigEndian(true), maxFrameSize(64 * 1024 * 1024), checksum(false) {}
+
+        int lengthFieldBytes;
+        bool bigEndian;
+        size_t maxFrameSize;
+        bool checksum;
+    };
+
+    explicit LengthFieldCodec(FrameCallback cb, const Options &options = Options());
+
+    void setErrorCallback(ErrorCallback cb) { errorCallback_ = std::move(cb); }
+
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    // buf里的可读数据是一个消息体，在它前面加上头；消息体超过maxFrameSize或者长度字段放不下时返回false，buf不变
+    bool encode(Buffer *buf) const;
+    // 把[data, data+len]编码成一个帧发出去，在loop线程里调用时头和消息体在同一段内存里，一次send
+    void send(const TcpConnectionPtr &conn, const char *data, size_t len) const;
+    void send(const TcpConnectionPtr &conn, const std::string &message) const { send(conn, message.data(), message.size()); }
+
+    size_t headerBytes() const { return headerBytes_; }
+
+    // CRC32C（Castagnoli），crc是上一段的结果，可以分段算
+    static uint32_t crc32c(const void *data, size_t len, uint32_t crc = 0);
+
+private:
+    uint64_t readField(const char *p, int bytes) const;
+    void writeField(char *p, uint64_t value, int bytes) const;
+
+    const Options options_;
+    const size_t headerBytes_;
+    FrameCallback frameCallback_;
+    ErrorCallback errorCallback_;
+};
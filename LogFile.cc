@@ -0,0 +1,118 @@
+#include "LogFile.h"
+
+#include <unistd.h>
+
+LogFile::LogFile(const std::string &basename, off_t rollSize, int flushInterval, int rollInterval)
+    : basename_(basename),
+      rollSize_(rollSize),
+      flushInterval_(flushInterval),
+      rollInterval_(rollInterval > 0 ? rollInterval : 60 * 60 * 24),
+      fp_(nullptr),
+      writtenBytes_(0),
+      count_(0),
+      startOfPeriod_(0),
+      lastRoll_(0),
+      lastFlush_(0)
+{
+    rollFile();
+}
+
+LogFile::~LogFile()
+{
+    if (fp_)
+    {
+        ::fclose(fp_);
+    }
+}
+
+void LogFile::append(const char *logline, size_t len)
+{
+    if (fp_ == nullptr)
+    {
+        return;
+    }
+    size_t written = 0;
+    while (written < len)
+    {
+        size_t n = ::fwrite_unlocked(logline + written, 1, len - written, fp_);
+        if (n == 0)
+        {
+            fprintf(stderr, "LogFile::append() failed %s\n", filename_.c_str());
+            break;
+        }
+        written += n;
+    }
+    writtenBytes_ += written;
+
+    if (writtenBytes_ > rollSize_)
+    {
+        rollFile();
+    }
+    else if (++count_ >= kCheckTimeRoll)
+    {
+        count_ = 0;
+        time_t now = ::time(NULL);
+        if (now / rollInterval_ * rollInterval_ != startOfPeriod_)
+        {
+            rollFile();
+        }
+        else if (now - lastFlush_ > flushInterval_)
+        {
+            lastFlush_ = now;
+            flush();
+        }
+    }
+}
+
+void LogFile::flush()
+{
+    if (fp_)
+    {
+        ::fflush(fp_);
+    }
+}
+
+bool LogFile::rollFile()
+{
+    time_t now = ::time(NULL);
+    if (now <= lastRoll_)
+    {
+        return false;
+    }
+    std::string filename = makeFilename(now);
+    FILE *fp = ::fopen(filename.c_str(), "ae"); // e表示O_CLOEXEC
+    if (fp == nullptr)
+    {
+        fprintf(stderr, "LogFile::rollFile() open %s failed\n", filename.c_str());
+        return false;
+    }
+    if (fp_)
+    {
+        ::fclose(fp_);
+    }
+    fp_ = fp;
+    ::setbuffer(fp_, buffer_, sizeof buffer_);
+    filename_ = filename;
+    writtenBytes_ = 0;
+    count_ = 0;
+    lastRoll_ = now;
+    lastFlush_ = now;
+    startOfPeriod_ = now / rollInterval_ * rollInterval_;
+    return true;
+}
+
+std::string LogFile::makeFilename(time_t now) const
+{
+    char timebuf[32];
+    tm tmBuf;
+    localtime_r(&now, &tmBuf);
+    strftime(timebuf, sizeof timebuf, ".%Y%m%d-%H%M%S.", &tmBuf);
+
+    char hostname[256] = "unknownhost";
+    ::gethostname(hostname, sizeof hostname - 1);
+
+    char pidbuf[32];
+    snprintf(pidbuf, sizeof pidbuf, ".%d.log", ::getpid());
+
+    return basename_ + timebuf + hostname + pidbuf;
+}
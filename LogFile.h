@@ -0,0 +1,51 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <string>
+#include <time.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/**
+ * @brief 滚动的日志文件，AsyncLogging的后台线程用它写文件，不加锁，只能在一个线程里用
+ *
+ * 写满rollSize字节，或者跨过了一个rollInterval（默认一天）的整点，就换一个新文件，
+ * 文件名是 basename.年月日-时分秒.主机名.pid.log。
+ * 写文件用的是带大缓冲区的fwrite_unlocked，每隔flushInterval秒才flush一次
+ */
+class LogFile : noncopyable
+{
+public:
+    LogFile(const std::string &basename,
+            off_t rollSize,
+            int flushInterval = 3,
+            int rollInterval = 60 * 60 * 24);
+    ~LogFile();
+
+    void append(const char *logline, size_t len);
+    void flush();
+    bool rollFile(); // 换一个新文件，一秒之内不会重复换（文件名精确到秒）
+
+    const std::string &currentFile() const { return filename_; }
+
+private:
+    static const int kCheckTimeRoll = 1024; // 每写多少次检查一下是不是该按时间滚动、该flush了
+
+    std::string makeFilename(time_t now) const;
+
+    const std::string basename_;
+    const off_t rollSize_;
+    const int flushInterval_;
+    const int rollInterval_;
+
+    FILE *fp_;
+    std::string filename_;
+    char buffer_[64 * 1024]; // 给FILE用的缓冲区
+    off_t writtenBytes_;     // 当前文件写了多少字节
+    int count_;              // 上次检查以来写了几次
+
+    time_t startOfPeriod_; // 当前文件属于哪个滚动周期（周期开始的时间）
+    time_t lastRoll_;
+    time_t lastFlush_;
+};
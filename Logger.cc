@@ -1,7 +1,27 @@
 #include "Logger.h"
 #include "Timestamp.h"
 
-#include <iostream>
+#include <stdio.h>
+#include <string.h>
+
+// 默认的输出：写到标准输出，由stdio自己缓冲（终端上是行缓冲），不再每一行都flush一次
+static void defaultOutput(const char *line, size_t len)
+{
+    fwrite(line, 1, len, stdout);
+}
+
+static void defaultFlush()
+{
+    fflush(stdout);
+}
+
+std::atomic_int Logger::logLevel_(MYMUDUO_MIN_LOG_LEVEL); // 默认和编译期的最低级别一样，MUDEBUG编译时能直接看到DEBUG
+
+Logger::Logger()
+    : output_(defaultOutput),
+      flush_(defaultFlush)
+{
+}
 
 // 获取日志唯一的实例对象
 Logger &Logger::instance()
@@ -10,34 +30,66 @@ Logger &Logger::instance()
     return logger;        // 返回日志对象
 }
 
-// 设置日志级别
-void Logger::setLogLevel(int level)
+void Logger::log(int level, const char *msg)
+{
+    logf(level, "%s", msg);
+}
+
+void Logger::logf(int level, const char *fmt, ...)
 {
-    logLevel_ = level; // 设置日志级别
+    va_list args;
+    va_start(args, fmt);
+    formatAndOutput(level, fmt, args);
+    va_end(args);
 }
 
-// 2023-10-22突然想到，这里的case是不是应该不能break，因为如果是INFO级别的日志，那么ERROR和FATAL级别的日志也应该打印出来
 // 写日志  [级别信息] time : msg
-void Logger::log(std::string msg)
+// 整行在调用者自己的栈上拼好，一次交给输出函数，多个线程同时写日志也不会交错
+void Logger::formatAndOutput(int level, const char *fmt, va_list args)
 {
-    switch (logLevel_)
+    const char *levelName = "";
+    switch (level)
     {
+    case DEBUG:
+        levelName = "[DEBUG]";
+        break;
     case INFO:
-        std::cout << "[INFO]";
+        levelName = "[INFO]";
         break;
     case ERROR:
-        std::cout << "[ERROR]";
+        levelName = "[ERROR]";
         break;
     case FATAL:
-        std::cout << "[FATAL]";
-        break;
-    case DEBUG:
-        std::cout << "[DEBUG]";
+        levelName = "[FATAL]";
         break;
     default:
         break;
     }
 
-    // 打印时间和msg
-    std::cout << Timestamp::now().toString() << " : " << msg << std::endl;
-}
\ No newline at end of file
+    // 先打印级别和时间，msg直接格式化到后面，栈上的缓冲区不用清零
+    // 时间直接渲染到这一行里，同一秒内只重写微秒部分
+    char line[1152];
+    size_t nameLen = strlen(levelName);
+    memcpy(line, levelName, nameLen);
+    int len = static_cast<int>(nameLen);
+    len += Timestamp::now().format(line + len, sizeof line - len);
+    memcpy(line + len, " : ", 3);
+    len += 3;
+    int n = vsnprintf(line + len, sizeof line - len, fmt, args);
+    if (n < 0)
+    {
+        return;
+    }
+    len += n;
+    if (static_cast<size_t>(len) >= sizeof line - 1) // 太长被截断了，保证最后还是一个换行
+    {
+        len = sizeof line - 2;
+    }
+    line[len++] = '\n';
+    output_(line, len);
+
+    if (level == FATAL)
+    {
+        flush_(); // 马上就要exit了，缓冲区里的日志不能丢
+    }
+}
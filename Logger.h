@@ -1,75 +1,129 @@
 #pragma once
 
 #include <string>
+#include <functional>
+#include <atomic>
+#include <stdarg.h>
+#include <stdlib.h>
 
 #include "noncopyable.h"
+#include "BinaryLogging.h"
+
+// 定义日志的级别，从低到高  DEBUG  INFO  ERROR  FATAL
+// 只有不低于门槛的日志才会输出
+enum LogLevel
+{
+    DEBUG, // 调试信息
+    INFO,  // 普通信息
+    ERROR, // 错误信息
+    FATAL, // core信息
+};
+
+// 编译期的最低级别：低于它的宏直接展开成空语句，参数不会被求值，也不会生成任何代码
+// 0=DEBUG 1=INFO 2=ERROR，编译时用 -DMYMUDUO_MIN_LOG_LEVEL=2 可以把INFO也去掉，FATAL永远保留
+// 没有单独指定时，定义了MUDEBUG就保留DEBUG，否则从INFO开始
+#ifndef MYMUDUO_MIN_LOG_LEVEL
+#ifdef MUDEBUG
+#define MYMUDUO_MIN_LOG_LEVEL 0
+#else
+#define MYMUDUO_MIN_LOG_LEVEL 1
+#endif
+#endif
+
+#if defined(__GNUC__)
+#define MYMUDUO_LOG_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define MYMUDUO_LOG_UNLIKELY(x) (x)
+#endif
+
+// 运行期的门槛：一次relaxed原子读，不到门槛就直接跳过，不格式化、不取时间，参数也不会被求值
+// 要先准备一些开销比较大的参数时，可以自己先判断：if (LOG_ENABLED(INFO)) { ... LOG_INFO(...); }
+#define LOG_ENABLED(level) (!MYMUDUO_LOG_UNLIKELY(Logger::logLevel() > (level)))
 
 // LOG_INFO("%s %d", arg1, arg2)
 // 如果忘了这一段代码的含义可以丢到GPT里面去
 // do_while(0)防止宏定义的时候出现一些问题
 // \的作用是换行，后面不能跟空格
-#define LOG_INFO(logmsgFormat, ...)                       \
-    do                                                    \
-    {                                                     \
-        Logger &logger = Logger::instance();              \
-        logger.setLogLevel(INFO);                         \
-        char buf[1024] = {0};                             \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf);                                  \
+// 级别作为参数传给log，不再先setLogLevel再log（多个线程同时写日志时级别会串）
+// BinaryLogging启动以后走二进制日志，调用点的静态变量记着这个调用点登记的站点id；刚好碰上stop()时退回文本
+#define MYMUDUO_LOG(level, logmsgFormat, ...)                                                          \
+    do                                                                                                \
+    {                                                                                                 \
+        if (LOG_ENABLED(level))                                                                       \
+        {                                                                                             \
+            static std::atomic_int logSite(-1);                                                       \
+            if (!BinaryLogging::active() ||                                                           \
+                !BinaryLogging::log(logSite, level, __FILE__, __LINE__, logmsgFormat, ##__VA_ARGS__)) \
+            {                                                                                         \
+                Logger::instance().logf(level, logmsgFormat, ##__VA_ARGS__);                          \
+            }                                                                                         \
+        }                                                                                             \
     } while (0)
 
-#define LOG_ERROR(logmsgFormat, ...)                      \
-    do                                                    \
-    {                                                     \
-        Logger &logger = Logger::instance();              \
-        logger.setLogLevel(ERROR);                        \
-        char buf[1024] = {0};                             \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf);                                  \
+#if MYMUDUO_MIN_LOG_LEVEL <= 0
+#define LOG_DEBUG(logmsgFormat, ...) MYMUDUO_LOG(DEBUG, logmsgFormat, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(logmsgFormat, ...) \
+    do                               \
+    {                                \
     } while (0)
+#endif
 
-#define LOG_FATAL(logmsgFormat, ...)                      \
-    do                                                    \
-    {                                                     \
-        Logger &logger = Logger::instance();              \
-        logger.setLogLevel(FATAL);                        \
-        char buf[1024] = {0};                             \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf);                                  \
-        exit(-1);                                         \
+#if MYMUDUO_MIN_LOG_LEVEL <= 1
+#define LOG_INFO(logmsgFormat, ...) MYMUDUO_LOG(INFO, logmsgFormat, ##__VA_ARGS__)
+#else
+#define LOG_INFO(logmsgFormat, ...) \
+    do                              \
+    {                               \
     } while (0)
+#endif
 
-#ifdef MUDEBUG
-#define LOG_DEBUG(logmsgFormat, ...)                      \
-    do                                                    \
-    {                                                     \
-        Logger &logger = Logger::instance();              \
-        logger.setLogLevel(DEBUG);                        \
-        char buf[1024] = {0};                             \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf);                                  \
-    } while (0)
+#if MYMUDUO_MIN_LOG_LEVEL <= 2
+#define LOG_ERROR(logmsgFormat, ...) MYMUDUO_LOG(ERROR, logmsgFormat, ##__VA_ARGS__)
 #else
-#define LOG_DEBUG(logmsgFormat, ...)
+#define LOG_ERROR(logmsgFormat, ...) \
+    do                               \
+    {                                \
+    } while (0)
 #endif
 
-// 定义日志的级别  INFO  ERROR  FATAL  DEBUG
-enum LogLevel
-{
-    INFO,  // 普通信息
-    ERROR, // 错误信息
-    FATAL, // core信息
-    DEBUG, // 调试信息
-};
+// FATAL不受门槛限制，写完就退出
+#define LOG_FATAL(logmsgFormat, ...)                                 \
+    do                                                               \
+    {                                                                \
+        Logger::instance().logf(FATAL, logmsgFormat, ##__VA_ARGS__); \
+        exit(-1);                                                    \
+    } while (0)
 
 // 输出一个日志类
+// 每条日志在调用的线程里拼成完整的一行，再交给输出函数；默认写到标准输出，
+// 服务器一般用setOutput换成AsyncLogging::append，IO线程只是把日志拷到内存里，写文件由后台线程做
 class Logger : noncopyable
 {
 public:
-    static Logger &instance();   // 获取日志唯一的实例对象
-    void setLogLevel(int level); // 设置日志级别
-    void log(std::string msg);   // 写日志
+    using OutputFunc = std::function<void(const char *line, size_t len)>;
+    using FlushFunc = std::function<void()>;
+
+    static Logger &instance(); // 获取日志唯一的实例对象
+
+    // 运行期的门槛，默认INFO，随时可以在任何线程里改
+    static void setLogLevel(int level) { logLevel_.store(level, std::memory_order_relaxed); }
+    static int logLevel() { return logLevel_.load(std::memory_order_relaxed); }
+
+    void log(int level, const char *msg); // 写一条level级别的日志，线程安全，不再检查门槛
+    // 按printf格式直接拼到这一行里，不经过中间的缓冲区
+    void logf(int level, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+    // 要在启动任何线程之前设置，运行过程中不能再改
+    void setOutput(OutputFunc output) { output_ = std::move(output); }
+    void setFlush(FlushFunc flush) { flush_ = std::move(flush); } // FATAL退出之前会调用
 
 private:
-    int logLevel_; // 日志级别，高于该级别的日志才会被输出
-};
\ No newline at end of file
+    Logger();
+
+    void formatAndOutput(int level, const char *fmt, va_list args);
+
+    static std::atomic_int logLevel_; // 不低于该级别的日志才会被输出
+    OutputFunc output_;
+    FlushFunc flush_;
+};
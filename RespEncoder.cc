@@ -0,0 +1,167 @@
+#include "RespEncoder.h"
+#include "Buffer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// 有符号数转成十进制，写在end前面，返回开头
+static char *formatInteger(char *end, int64_t value)
+{
+    uint64_t v = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    char *p = end;
+    do
+    {
+        *--p = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    if (value < 0)
+    {
+        *--p = '-';
+    }
+    return p;
+}
+
+// 类型字符 + 十进制数 + \r\n，长度头和整数都是这个格式
+void RespEncoder::header(char type, int64_t n)
+{
+    char text[24];
+    char *end = text + sizeof text;
+    char *p = formatInteger(end, n);
+    size_t len = end - p;
+    buf_->ensureWriteableBytes(len + 3);
+    char *out = buf_->beginWrite();
+    out[0] = type;
+    memcpy(out + 1, p, len);
+    out[len + 1] = '\r';
+    out[len + 2] = '\n';
+    buf_->hasWritten(len + 3);
+}
+
+void RespEncoder::simpleString(const StringPiece &s)
+{
+    buf_->ensureWriteableBytes(s.size() + 3);
+    char *out = buf_->beginWrite();
+    out[0] = '+';
+    memcpy(out + 1, s.data(), s.size());
+    out[s.size() + 1] = '\r';
+    out[s.size() + 2] = '\n';
+    buf_->hasWritten(s.size() + 3);
+}
+
+void RespEncoder::error(const StringPiece &message)
+{
+    buf_->ensureWriteableBytes(message.size() + 3);
+    char *out = buf_->beginWrite();
+    out[0] = '-';
+    memcpy(out + 1, message.data(), message.size());
+    out[message.size() + 1] = '\r';
+    out[message.size() + 2] = '\n';
+    buf_->hasWritten(message.size() + 3);
+}
+
+void RespEncoder::integer(int64_t value)
+{
+    header(':', value);
+}
+
+void RespEncoder::bulkString(const StringPiece &s)
+{
+    // 头、内容和结尾的\r\n一次扩容，一起写
+    buf_->ensureWriteableBytes(s.size() + 24);
+    header('$', static_cast<int64_t>(s.size()));
+    char *out = buf_->beginWrite();
+    memcpy(out, s.data(), s.size());
+    out[s.size()] = '\r';
+    out[s.size() + 1] = '\n';
+    buf_->hasWritten(s.size() + 2);
+}
+
+void RespEncoder::null()
+{
+    if (protocol_ >= 3)
+    {
+        buf_->append("_\r\n", 3);
+    }
+    else
+    {
+        buf_->append("$-1\r\n", 5);
+    }
+}
+
+void RespEncoder::nullArray()
+{
+    if (protocol_ >= 3)
+    {
+        buf_->append("_\r\n", 3);
+    }
+    else
+    {
+        buf_->append("*-1\r\n", 5);
+    }
+}
+
+void RespEncoder::boolean(bool value)
+{
+    if (protocol_ >= 3)
+    {
+        buf_->append(value ? "#t\r\n" : "#f\r\n", 4);
+    }
+    else
+    {
+        buf_->append(value ? ":1\r\n" : ":0\r\n", 4);
+    }
+}
+
+void RespEncoder::doubleValue(double value)
+{
+    char text[32];
+    int len = snprintf(text, sizeof text, "%.17g", value);
+    if (protocol_ >= 3)
+    {
+        buf_->ensureWriteableBytes(len + 3);
+        buf_->append(",", 1);
+        buf_->append(text, len);
+        buf_->append("\r\n", 2);
+    }
+    else
+    {
+        bulkString(StringPiece(text, len));
+    }
+}
+
+void RespEncoder::arrayHeader(size_t n)
+{
+    header('*', static_cast<int64_t>(n));
+}
+
+void RespEncoder::mapHeader(size_t n)
+{
+    if (protocol_ >= 3)
+    {
+        header('%', static_cast<int64_t>(n));
+    }
+    else
+    {
+        header('*', static_cast<int64_t>(n * 2));
+    }
+}
+
+void RespEncoder::setHeader(size_t n)
+{
+    header(protocol_ >= 3 ? '~' : '*', static_cast<int64_t>(n));
+}
+
+void RespEncoder::pushHeader(size_t n)
+{
+    header(protocol_ >= 3 ? '>' : '*', static_cast<int64_t>(n));
+}
+
+void RespEncoder::command(Buffer *buf, const StringPiece *args, size_t argc)
+{
+    RespEncoder encoder(buf);
+    encoder.arrayHeader(argc);
+    for (size_t i = 0; i < argc; ++i)
+    {
+        encoder.bulkString(args[i]);
+    }
+}
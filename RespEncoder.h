@@ -0,0 +1,55 @@
+#pragma once
+
+#include "StringPiece.h"
+
+#include <initializer_list>
+#include <stddef.h>
+#include <stdint.h>
+
+class Buffer;
+
+/**
+ * @brief 把RESP回复（或者命令）直接追加到Buffer里
+ *
+ * 一个编码器只是Buffer指针加协议版本，用的时候在栈上建一个就行。一批流水线命令的回复依次编进同一个Buffer，
+ * 最后conn->send(buf)一次发出去。protocol是2或3，客户端发了HELLO 3以后按RESP3编，
+ * RESP3新加的类型在RESP2下退化成最接近的表示：null是$-1，map是2n个元素的数组，set、push是数组，
+ * 布尔是:0/:1，double是bulk string。
+ * 聚合类型只写头，后面的元素由调用者依次追加
+ */
+class RespEncoder
+{
+public:
+    explicit RespEncoder(Buffer *buf, int protocol = 2) : buf_(buf), protocol_(protocol) {}
+
+    Buffer *buffer() const { return buf_; }
+    int protocol() const { return protocol_; }
+
+    void simpleString(const StringPiece &s);   // s里不能有\r\n
+    void error(const StringPiece &message);    // message以错误类型开头，比如"ERR unknown command"
+    void integer(int64_t value);
+    void bulkString(const StringPiece &s);
+    void null();                               // 不存在的值，RESP2是$-1
+    void nullArray();                          // RESP2是*-1，RESP3和null()一样
+    void boolean(bool value);
+    void doubleValue(double value);
+    void arrayHeader(size_t n);
+    void mapHeader(size_t n);                  // n是键值对数
+    void setHeader(size_t n);
+    void pushHeader(size_t n);
+
+    void ok() { simpleString("OK"); }
+
+    // 客户端发的命令：一个元素全是bulk string的数组
+    static void command(Buffer *buf, const StringPiece *args, size_t argc);
+    static void command(Buffer *buf, std::initializer_list<StringPiece> args)
+    {
+        command(buf, args.begin(), args.size());
+    }
+
+private:
+    void header(char type, int64_t n);
+
+    Buffer *buf_;
+    int protocol_;
+};
@@ -0,0 +1,386 @@
+#include "RespParser.h"
+#include "Buffer.h"
+
+#include <string.h>
+
+RespParser::RespParser(const Limits &limits)
+    : limits_(limits)
+{
+    reset();
+}
+
+void RespParser::reset()
+{
+    state_ = kNeedMore;
+    pos_ = 0;
+    scan_ = 0;
+    bulkPending_ = false;
+    error_ = nullptr;
+    base_ = nullptr;
+    root_ = 0;
+    values_.clear();
+    stack_.clear();
+}
+
+RespParser::Result RespParser::fail(const char *message)
+{
+    state_ = kProtocolError;
+    error_ = message;
+    return kProtocolError;
+}
+
+bool RespParser::parseInteger(const char *data, size_t len, int64_t *value)
+{
+    if (len == 0 || len > 20)
+    {
+        return false;
+    }
+    bool negative = data[0] == '-';
+    size_t i = negative ? 1 : 0;
+    if (i == len)
+    {
+        return false;
+    }
+    uint64_t limit = negative ? static_cast<uint64_t>(INT64_MAX) + 1 : static_cast<uint64_t>(INT64_MAX);
+    uint64_t v = 0;
+    for (; i < len; ++i)
+    {
+        unsigned d = static_cast<unsigned char>(data[i]) - '0';
+        if (d > 9 || v > (limit - d) / 10)
+        {
+            return false;
+        }
+        v = v * 10 + d;
+    }
+    *value = negative ? static_cast<int64_t>(0 - v) : static_cast<int64_t>(v);
+    return true;
+}
+
+static bool isTypeByte(char c)
+{
+    switch (c)
+    {
+    case '+': case '-': case ':': case '$': case '*':
+    case '_': case '#': case ',': case '(': case '!': case '=':
+    case '%': case '~': case '|': case '>':
+        return true;
+    default:
+        return false;
+    }
+}
+
+// 一个元素解析完了，往上逐层减掉聚合类型还差的个数；返回整个消息是不是收全了
+bool RespParser::elementDone()
+{
+    while (!stack_.empty())
+    {
+        Frame &frame = stack_.back();
+        if (--frame.remaining > 0)
+        {
+            return false;
+        }
+        bool attribute = frame.attribute;
+        stack_.pop_back();
+        if (attribute)
+        {
+            // 属性修饰的是后面那个元素，它本身不算父元素的一个元素
+            if (stack_.empty())
+            {
+                root_ = values_.size();
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+RespParser::Result RespParser::parse(const Buffer *buf)
+{
+    if (state_ != kNeedMore)
+    {
+        return state_;
+    }
+    const char *begin = buf->peek();
+    const size_t readable = buf->readableBytes();
+
+    for (;;)
+    {
+        if (bulkPending_)
+        {
+            const Value &value = values_.back();
+            size_t end = value.offset + value.length;
+            if (readable < end + 2)
+            {
+                return kNeedMore;
+            }
+            if (begin[end] != '\r' || begin[end + 1] != '\n')
+            {
+                return fail("expected CRLF after bulk string");
+            }
+            pos_ = scan_ = end + 2;
+            bulkPending_ = false;
+            if (elementDone())
+            {
+                break;
+            }
+            continue;
+        }
+
+        if (pos_ >= readable)
+        {
+            return kNeedMore;
+        }
+        if (values_.empty() && !isTypeByte(begin[pos_]))
+        {
+            Result result = parseInline(begin, readable);
+            if (result != kComplete)
+            {
+                return result;
+            }
+            if (values_.empty())
+            {
+                continue; // 空行，跳过
+            }
+            break;
+        }
+
+        const char *nl = static_cast<const char *>(memchr(begin + scan_, '\n', readable - scan_));
+        if (nl == nullptr)
+        {
+            scan_ = readable;
+            if (readable - pos_ > limits_.maxInlineBytes)
+            {
+                return fail("line too long");
+            }
+            return kNeedMore;
+        }
+        size_t lineEnd = nl - begin;
+        if (lineEnd - pos_ < 2 || begin[lineEnd - 1] != '\r')
+        {
+            return fail("expected CRLF");
+        }
+        const char type = begin[pos_];
+        const char *line = begin + pos_ + 1;
+        const size_t len = lineEnd - 1 - (pos_ + 1);
+        pos_ = scan_ = lineEnd + 1;
+
+        if (values_.size() >= limits_.maxElements)
+        {
+            return fail("too many elements");
+        }
+        values_.push_back(Value());
+        Value &value = values_.back();
+        value.type = static_cast<Type>(type);
+        value.null = false;
+        value.count = 0;
+        value.offset = line - begin;
+        value.length = len;
+        value.integer = 0;
+
+        switch (type)
+        {
+        case kSimpleString:
+        case kError:
+        case kBigNumber:
+        case kDouble:
+            break;
+        case kInteger:
+            if (!parseInteger(line, len, &value.integer))
+            {
+                return fail("invalid integer");
+            }
+            break;
+        case kNull:
+            if (len != 0)
+            {
+                return fail("invalid null");
+            }
+            value.null = true;
+            break;
+        case kBoolean:
+            if (len != 1 || (line[0] != 't' && line[0] != 'f'))
+            {
+                return fail("invalid boolean");
+            }
+            value.integer = line[0] == 't';
+            break;
+        case kBulkString:
+        case kBulkError:
+        case kVerbatim:
+        {
+            int64_t n = 0;
+            if (!parseInteger(line, len, &n) || n < -1)
+            {
+                return fail("invalid bulk length");
+            }
+            if (n == -1)
+            {
+                if (type != kBulkString)
+                {
+                    return fail("invalid bulk length");
+                }
+                value.null = true;
+                value.length = 0;
+                break;
+            }
+            if (static_cast<uint64_t>(n) > limits_.maxBulkBytes)
+            {
+                return fail("bulk string too long");
+            }
+            value.offset = pos_;
+            value.length = static_cast<size_t>(n);
+            bulkPending_ = true;
+            continue;
+        }
+        case kArray:
+        case kMap:
+        case kSet:
+        case kAttribute:
+        case kPush:
+        {
+            int64_t n = 0;
+            if (!parseInteger(line, len, &n) || n < -1)
+            {
+                return fail("invalid aggregate length");
+            }
+            value.length = 0;
+            if (n == -1)
+            {
+                if (type != kArray)
+                {
+                    return fail("invalid aggregate length");
+                }
+                value.null = true;
+                break;
+            }
+            uint64_t elements = static_cast<uint64_t>(n) * (type == kMap || type == kAttribute ? 2 : 1);
+            if (static_cast<uint64_t>(n) > limits_.maxElements || elements > limits_.maxElements - values_.size())
+            {
+                return fail("too many elements");
+            }
+            value.count = static_cast<uint32_t>(elements);
+            if (elements == 0)
+            {
+                if (type == kAttribute)
+                {
+                    return fail("empty attribute");
+                }
+                break;
+            }
+            if (stack_.size() >= limits_.maxDepth)
+            {
+                return fail("nesting too deep");
+            }
+            Frame frame;
+            frame.remaining = elements;
+            frame.attribute = type == kAttribute;
+            stack_.push_back(frame);
+            continue;
+        }
+        default:
+            return fail("unknown type byte");
+        }
+
+        if (elementDone())
+        {
+            break;
+        }
+    }
+
+    base_ = begin;
+    state_ = kComplete;
+    return kComplete;
+}
+
+// 一行inline命令，按空格和制表符切开，每个参数记成一个bulk string，外面套一个数组
+RespParser::Result RespParser::parseInline(const char *begin, size_t readable)
+{
+    const char *nl = static_cast<const char *>(memchr(begin + scan_, '\n', readable - scan_));
+    if (nl == nullptr)
+    {
+        scan_ = readable;
+        if (readable - pos_ > limits_.maxInlineBytes)
+        {
+            return fail("inline command too long");
+        }
+        return kNeedMore;
+    }
+    size_t start = pos_;
+    size_t end = nl - begin;
+    pos_ = scan_ = end + 1;
+    if (end > start && begin[end - 1] == '\r')
+    {
+        --end;
+    }
+
+    Value root;
+    root.type = kArray;
+    root.null = false;
+    root.count = 0;
+    root.offset = start;
+    root.length = 0;
+    root.integer = 0;
+    values_.push_back(root);
+    size_t i = start;
+    while (i < end)
+    {
+        if (begin[i] == ' ' || begin[i] == '\t')
+        {
+            ++i;
+            continue;
+        }
+        size_t j = i;
+        while (j < end && begin[j] != ' ' && begin[j] != '\t')
+        {
+            ++j;
+        }
+        Value arg;
+        arg.type = kBulkString;
+        arg.null = false;
+        arg.count = 0;
+        arg.offset = i;
+        arg.length = j - i;
+        arg.integer = 0;
+        values_.push_back(arg);
+        ++values_[0].count;
+        i = j;
+    }
+    if (values_[0].count == 0)
+    {
+        values_.clear();
+    }
+    return kComplete;
+}
+
+size_t RespParser::next(size_t index) const
+{
+    size_t remaining = 1;
+    while (remaining > 0)
+    {
+        const Value &value = values_[index++];
+        --remaining;
+        if (value.type == kAttribute)
+        {
+            ++remaining; // 属性后面还跟着它修饰的元素
+        }
+        remaining += value.count;
+    }
+    return index;
+}
+
+bool RespParser::isCommand() const
+{
+    const Value &root = values_[root_];
+    if (root.type != kArray || root.null || root.count == 0 || values_.size() != root_ + 1 + root.count)
+    {
+        return false;
+    }
+    for (size_t i = root_ + 1; i < values_.size(); ++i)
+    {
+        if (values_[i].type != kBulkString || values_[i].null)
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "StringPiece.h"
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+class Buffer;
+
+/**
+ * @brief RESP（Redis序列化协议）的增量解析器，RESP2和RESP3的类型都认，每个连接一个
+ *
+ * 和HttpContext一样，消息收全之前不从Buffer里取走数据，只记下解析到了哪里（相对peek()的偏移），
+ * 下一次接着解析，已经解析完的元素不会再看一遍。收全以后所有元素按先序排在values()里，
+ * 字符串类的内容直接指向Buffer，不拷贝；处理完由调用者retrieve(messageBytes())，再reset()解析下一个。
+ * 一次onMessage里可以循环解析，流水线发来的一批命令不用等下一次读：
+ *
+ *     while (parser.parse(buf) == RespParser::kComplete)
+ *     {
+ *         handle(parser.arg(0), ...);
+ *         buf->retrieve(parser.messageBytes());
+ *         parser.reset();
+ *     }
+ *
+ * 不以RESP类型字符开头的一行按inline命令（telnet直接敲的那种）解析，按空白切成参数，不支持引号。
+ * RESP3的属性（|）会解析，但不算它后面那个元素的兄弟；流式的字符串和聚合类型（$?、*?）不支持，按协议错误处理
+ */
+class RespParser : noncopyable
+{
+public:
+    enum Type
+    {
+        kSimpleString = '+',
+        kError = '-',
+        kInteger = ':',
+        kBulkString = '$',
+        kArray = '*',
+        kNull = '_',       // RESP3
+        kBoolean = '#',    // RESP3
+        kDouble = ',',     // RESP3，内容是原文
+        kBigNumber = '(',  // RESP3，内容是原文
+        kBulkError = '!',  // RESP3
+        kVerbatim = '=',   // RESP3，内容包括前面的"txt:"
+        kMap = '%',        // RESP3
+        kSet = '~',        // RESP3
+        kAttribute = '|',  // RESP3
+        kPush = '>',       // RESP3
+    };
+
+    enum Result
+    {
+        kNeedMore, // 消息还没收全
+        kComplete, // 收全了一个消息
+        kProtocolError, // 协议错误，errorMessage()是原因，这个连接应该回一个错误然后关掉
+    };
+
+    // 解析出来的一个元素
+    struct Value
+    {
+        Type type;
+        bool null;       // RESP2的$-1和*-1、RESP3的_
+        uint32_t count;  // 聚合类型直接包含的元素个数，map和属性是键值对数×2
+        size_t offset;   // 字符串类型的内容，相对消息开头的偏移
+        size_t length;
+        int64_t integer; // 整数；布尔是0或1
+    };
+
+    struct Limits
+    {
+        Limits() : maxBulkBytes(512 * 1024 * 1024), maxElements(1024 * 1024), maxInlineBytes(64 * 1024), maxDepth(64) {}
+
+        size_t maxBulkBytes;   // 一个bulk string最长多少（Redis的proto-max-bulk-len）
+        size_t maxElements;    // 一个消息最多多少个元素，聚合类型里声明的个数超过了直接报错，不等数据来
+        size_t maxInlineBytes; // 类型、长度那一行和inline命令一行最长多少
+        size_t maxDepth;       // 聚合类型最多嵌套几层
+    };
+
+    explicit RespParser(const Limits &limits = Limits());
+
+    // 接着上次的位置解析buf里的数据，buf在收全之前不能retrieve
+    Result parse(const Buffer *buf);
+
+    bool complete() const { return state_ == kComplete; }
+    const char *errorMessage() const { return error_; }
+    size_t messageBytes() const { return pos_; } // 收全以后，这个消息在Buffer里一共占了多少字节
+
+    // 下面这些在收全以后、retrieve之前有效
+    const std::vector<Value> &values() const { return values_; }
+    const Value &root() const { return values_[root_]; } // 前面有属性的话跳过属性
+    StringPiece string(const Value &value) const { return StringPiece(base_ + value.offset, value.length); }
+    size_t next(size_t index) const; // 先序里跳过values()[index]和它的所有子元素以后的下标
+
+    // 命令：顶层是一个元素全是bulk string的非空数组，或者一行inline命令
+    bool isCommand() const;
+    size_t argc() const { return values_[root_].count; }
+    StringPiece arg(size_t i) const { return string(values_[root_ + 1 + i]); }
+
+    // 准备解析下一个消息
+    void reset();
+
+    // 严格的十进制整数，不允许空白、前导+和溢出，INCR之类的命令也用它
+    static bool parseInteger(const char *data, size_t len, int64_t *value);
+
+private:
+    struct Frame
+    {
+        size_t remaining; // 这个聚合类型还差几个元素
+        bool attribute;
+    };
+
+    Result parseInline(const char *begin, size_t readable);
+    bool elementDone();
+    Result fail(const char *message);
+
+    const Limits limits_;
+    Result state_; // kNeedMore表示还在解析
+    size_t pos_;  // 下一个要解析的字节，相对消息开头
+    size_t scan_; // 找行尾时已经扫过的位置
+    bool bulkPending_; // values_.back()是一个等数据的bulk string
+    const char *error_;
+    const char *base_;
+    size_t root_; // 顶层元素的下标，前面只可能是属性
+    std::vector<Value> values_;
+    std::vector<Frame> stack_; // 还没收全的聚合类型
+};
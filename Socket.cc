@@ -1,6 +1,7 @@
 #include "Socket.h"
 #include "Logger.h"
 #include "InetAddress.h"
+#include "SocketOptions.h"
 
 #include <unistd.h>
 #include <sys/types.h>         
@@ -91,4 +92,92 @@ void Socket::setKeepAlive(bool on)
     // TCP心跳
     int optval = on ? 1 : 0;
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof optval);
+}
+
+void Socket::setKeepAliveParams(int idleSeconds, int intervalSeconds, int count)
+{
+    if (idleSeconds > 0)
+    {
+        ::setsockopt(sockfd_, IPPROTO_TCP, TCP_KEEPIDLE, &idleSeconds, sizeof idleSeconds);
+    }
+    if (intervalSeconds > 0)
+    {
+        ::setsockopt(sockfd_, IPPROTO_TCP, TCP_KEEPINTVL, &intervalSeconds, sizeof intervalSeconds);
+    }
+    if (count > 0)
+    {
+        ::setsockopt(sockfd_, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof count);
+    }
+}
+
+void Socket::setSendBufferSize(int bytes)
+{
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_SNDBUF, &bytes, sizeof bytes) < 0)
+    {
+        LOG_ERROR("setsockopt SO_SNDBUF sockfd:%d fail \n", sockfd_);
+    }
+}
+
+void Socket::setRecvBufferSize(int bytes)
+{
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof bytes) < 0)
+    {
+        LOG_ERROR("setsockopt SO_RCVBUF sockfd:%d fail \n", sockfd_);
+    }
+}
+
+void Socket::setNotSentLowat(int bytes)
+{
+    // 内核里没发出去的数据少于bytes才报告可写，让数据尽量留在用户态的outputBuffer_里
+    if (::setsockopt(sockfd_, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &bytes, sizeof bytes) < 0)
+    {
+        LOG_ERROR("setsockopt TCP_NOTSENT_LOWAT sockfd:%d fail \n", sockfd_);
+    }
+}
+
+void Socket::setQuickAck(bool on)
+{
+    int optval = on ? 1 : 0;
+    ::setsockopt(sockfd_, IPPROTO_TCP, TCP_QUICKACK, &optval, sizeof optval);
+}
+
+void Socket::setUserTimeout(int ms)
+{
+    if (::setsockopt(sockfd_, IPPROTO_TCP, TCP_USER_TIMEOUT, &ms, sizeof ms) < 0)
+    {
+        LOG_ERROR("setsockopt TCP_USER_TIMEOUT sockfd:%d fail \n", sockfd_);
+    }
+}
+
+void Socket::applyOptions(const SocketOptions &options)
+{
+    if (options.tcpNoDelay >= 0)
+    {
+        setTcpNoDelay(options.tcpNoDelay != 0);
+    }
+    if (options.keepAlive >= 0)
+    {
+        setKeepAlive(options.keepAlive != 0);
+    }
+    setKeepAliveParams(options.keepIdle, options.keepInterval, options.keepCount);
+    if (options.sendBuffer > 0)
+    {
+        setSendBufferSize(options.sendBuffer);
+    }
+    if (options.recvBuffer > 0)
+    {
+        setRecvBufferSize(options.recvBuffer);
+    }
+    if (options.notSentLowat >= 0) // 0也要设下去：清掉之前设置的值，回到系统默认
+    {
+        setNotSentLowat(options.notSentLowat);
+    }
+    if (options.quickAck >= 0)
+    {
+        setQuickAck(options.quickAck != 0);
+    }
+    if (options.userTimeoutMs >= 0)
+    {
+        setUserTimeout(options.userTimeoutMs);
+    }
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "noncopyable.h"
 
 class InetAddress;
+struct SocketOptions;
 
 // 封装sockfd + 修改sockfd状态的方法
 class Socket : noncopyable
@@ -25,6 +26,14 @@ public:
     void setReuseAddr(bool on); // 
     void setReusePort(bool on); // TIME_WAIT状态下的重用
     void setKeepAlive(bool on); // TCP心跳
+    void setKeepAliveParams(int idleSeconds, int intervalSeconds, int count); // 心跳的空闲时间、间隔和次数，-1表示不设置
+    void setSendBufferSize(int bytes); // SO_SNDBUF
+    void setRecvBufferSize(int bytes); // SO_RCVBUF
+    void setNotSentLowat(int bytes);   // TCP_NOTSENT_LOWAT
+    void setQuickAck(bool on);         // TCP_QUICKACK
+    void setUserTimeout(int ms);       // TCP_USER_TIMEOUT
+
+    void applyOptions(const SocketOptions &options); // 把options里设置了的选项都设置上
 private:
     const int sockfd_; // 文件描述符
 };
\ No newline at end of file
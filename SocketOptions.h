@@ -0,0 +1,21 @@
+#pragma once
+
+/**
+ * @brief 一组socket选项，TcpServer把它统一设置到每个accept上来的连接上
+ *
+ * 所有字段都是-1表示不设置，保持内核默认值
+ * 除了keepAlive默认打开（以前TcpConnection的构造函数里就是强制打开的），其余都默认不设置
+ */
+struct SocketOptions
+{
+    int tcpNoDelay = -1;     // TCP_NODELAY，1关闭Nagle算法
+    int keepAlive = 1;       // SO_KEEPALIVE，TCP心跳
+    int keepIdle = -1;       // TCP_KEEPIDLE，连接空闲多少秒后开始发心跳
+    int keepInterval = -1;   // TCP_KEEPINTVL，心跳间隔（秒）
+    int keepCount = -1;      // TCP_KEEPCNT，心跳失败多少次认为连接断了
+    int sendBuffer = -1;     // SO_SNDBUF，字节
+    int recvBuffer = -1;     // SO_RCVBUF，字节
+    int notSentLowat = -1;   // TCP_NOTSENT_LOWAT，内核里没发出去的数据低于这个值才通知可写，字节；0清掉之前的设置，回到net.ipv4.tcp_notsent_lowat
+    int quickAck = -1;       // TCP_QUICKACK，注意内核会自己把它清掉，这里只在连接建立时设置一次
+    int userTimeoutMs = -1;  // TCP_USER_TIMEOUT，发出去的数据多久没被确认就断开连接，毫秒
+};
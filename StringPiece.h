@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <string.h>
+#include <strings.h>
+#include <stddef.h>
+
+/**
+ * @brief 一段不属于自己的字符串：指针+长度，不拷贝也不以'\0'结尾
+ *
+ * 协议解析出来的字段（HTTP的路径、头部等）直接指向Buffer里的数据，
+ * 指向的内存由别人管理，Buffer一retrieve就失效了，要留着用as_string()拷一份
+ */
+class StringPiece
+{
+public:
+    StringPiece() : ptr_(nullptr), length_(0) {}
+    StringPiece(const char *str) : ptr_(str), length_(strlen(str)) {}
+    StringPiece(const char *offset, size_t len) : ptr_(offset), length_(len) {}
+    StringPiece(const std::string &str) : ptr_(str.data()), length_(str.size()) {}
+
+    const char *data() const { return ptr_; }
+    size_t size() const { return length_; }
+    bool empty() const { return length_ == 0; }
+    const char *begin() const { return ptr_; }
+    const char *end() const { return ptr_ + length_; }
+    char operator[](size_t i) const { return ptr_[i]; }
+
+    void set(const char *offset, size_t len) { ptr_ = offset; length_ = len; }
+    void clear() { ptr_ = nullptr; length_ = 0; }
+    void remove_prefix(size_t n) { ptr_ += n; length_ -= n; }
+    void remove_suffix(size_t n) { length_ -= n; }
+
+    bool operator==(const StringPiece &x) const
+    {
+        return length_ == x.length_ && memcmp(ptr_, x.ptr_, length_) == 0;
+    }
+    bool operator!=(const StringPiece &x) const { return !(*this == x); }
+
+    // 忽略大小写比较，HTTP头部的名字、Connection之类的取值都不区分大小写
+    bool equalsIgnoreCase(const StringPiece &x) const
+    {
+        return length_ == x.length_ && strncasecmp(ptr_, x.ptr_, length_) == 0;
+    }
+
+    bool starts_with(const StringPiece &x) const
+    {
+        return length_ >= x.length_ && memcmp(ptr_, x.ptr_, x.length_) == 0;
+    }
+
+    std::string as_string() const { return std::string(ptr_, length_); }
+
+private:
+    const char *ptr_;
+    size_t length_;
+};
@@ -0,0 +1,131 @@
+#include "TcpClient.h"
+#include "Logger.h"
+
+#include <functional>
+
+static EventLoop *CheckLoopNotNull(EventLoop *loop)
+{
+    if (loop == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d client loop is null! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+}
+
+TcpClient::TcpClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop)),
+      connector_(std::make_shared<Connector>(loop, serverAddr)),
+      name_(nameArg),
+      retry_(false),
+      connect_(false),
+      nextConnId_(1),
+      namePrefix_(std::make_shared<std::string>(nameArg + "-" + serverAddr.toIpPort()))
+{
+    connector_->setNewConnectionCallback(std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+}
+
+TcpClient::~TcpClient()
+{
+    TcpConnectionPtr conn;
+    bool unique = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unique = connection_.use_count() == 1;
+        conn = connection_;
+    }
+    if (conn)
+    {
+        // 连接可能比TcpClient活得久（用户还拿着它），断开的时候不能再回调到已经析构的TcpClient，
+        // 把closeCallback换成只做善后工作的版本；没有别人拿着的话就直接关掉
+        CloseCallback cb = [](const TcpConnectionPtr &c)
+        {
+            c->getLoop()->queueInLoop(std::bind(&TcpConnection::connectDestroyed, c));
+        };
+        conn->getLoop()->runInLoop([conn, cb, unique]()
+                                   {
+                                       conn->setCloseCallback(cb);
+                                       if (unique)
+                                       {
+                                           conn->forceClose();
+                                       }
+                                   });
+    }
+    // 还在连接或者等待重试的话停掉，Connector由排队的回调持有，等它在loop里停下来以后才析构
+    connector_->stop();
+}
+
+void TcpClient::connect()
+{
+    LOG_INFO("TcpClient::connect [%s] - connecting to %s \n",
+             name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect()
+{
+    connect_ = false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (connection_)
+    {
+        connection_->shutdown();
+    }
+}
+
+void TcpClient::stop()
+{
+    connect_ = false;
+    connector_->stop();
+}
+
+TcpConnectionPtr TcpClient::connection() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return connection_;
+}
+
+void TcpClient::newConnection(int sockfd)
+{
+    // 每次连上都生成一张新的回调表，连接之间不会共享，用户修改单个连接的回调也不用写时复制
+    std::shared_ptr<ConnectionCallbacks> table = std::make_shared<ConnectionCallbacks>();
+    table->connectionCallback = connectionCallback_;
+    table->messageCallback = messageCallback_;
+    table->writeCompleteCallback = writeCompleteCallback_;
+    table->closeCallback = std::bind(&TcpClient::removeConnection, this, std::placeholders::_1);
+
+    TcpConnectionPtr conn = std::make_shared<TcpConnection>(
+        loop_,
+        nextConnId_++,
+        sockfd,
+        connector_->serverAddress(),
+        table,
+        namePrefix_);
+    conn->setSocketOptions(socketOptions_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (connection_ == conn)
+        {
+            connection_.reset();
+        }
+    }
+    // 放到本轮的回调里执行，handleClose还没返回，channel还在用
+    conn->getLoop()->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+
+    if (retry_ && connect_)
+    {
+        LOG_INFO("TcpClient::removeConnection [%s] - reconnecting to %s \n",
+                 name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+        // 连接可能已经迁移到了别的loop上，Connector只能在loop_里用
+        ConnectorPtr connector = connector_;
+        loop_->runInLoop([connector]() { connector->restart(); });
+    }
+}
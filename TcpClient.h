@@ -0,0 +1,75 @@
+#pragma once
+
+/**
+ * 用户使用muduo编写客户端程序（比如服务器连自己的上游）
+ */
+#include "EventLoop.h"
+#include "Connector.h"
+#include "InetAddress.h"
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "TcpConnection.h"
+#include "Buffer.h"
+#include "SocketOptions.h"
+
+#include <functional>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+/**
+ * @brief 对外的客户端编程使用的类，一个TcpClient管一条到serverAddr的连接
+ *
+ * 连上以后得到的就是TcpServer用的那种TcpConnection，回调、Buffer、cork、背压、限速、迁移都一样。
+ * loop可以直接传TcpServer的某个subloop（比如入站连接的conn->getLoop()），
+ * 这样上游连接和入站连接在同一个线程里，代理转发不用跨线程，linkBackpressure也能直接用
+ */
+class TcpClient : noncopyable
+{
+public:
+    TcpClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg);
+    ~TcpClient(); // 要在loop线程里析构，或者loop已经不再运行
+
+    void connect();    // 开始连接，连不上会一直按退避间隔重试，线程安全
+    void disconnect(); // 关掉已经建立的连接（发完outputBuffer里的数据再关），线程安全
+    void stop();       // 停止还没成功的连接和重试，线程安全
+
+    EventLoop *getLoop() const { return loop_; }
+    const std::string &name() const { return name_; }
+    TcpConnectionPtr connection() const; // 当前的连接，没有连上时为空，线程安全
+
+    // 连接断开以后是否自动重连，默认不重连
+    void enableRetry() { retry_ = true; }
+    bool retry() const { return retry_; }
+    // 连不上时重试的初始间隔和最大间隔（秒），见Connector::setRetryDelay；要在connect()之前设置
+    void setRetryDelay(double initialSeconds, double maxSeconds) { connector_->setRetryDelay(initialSeconds, maxSeconds); }
+
+    // 回调只对之后建立的连接生效，要在connect()之前设置
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+    // 连接建立时设置的socket选项，默认和TcpServer一样只打开keepalive
+    void setSocketOptions(const SocketOptions &options) { socketOptions_ = options; }
+
+private:
+    void newConnection(int sockfd);                      // Connector连上了，在loop线程里调用
+    void removeConnection(const TcpConnectionPtr &conn); // 连接断开了，在连接所属的loop线程里调用
+
+    EventLoop *loop_;
+    ConnectorPtr connector_;
+    const std::string name_;
+
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+    SocketOptions socketOptions_;
+
+    std::atomic_bool retry_;   // 断开以后是否重连
+    std::atomic_bool connect_; // 用户是否想连着
+    int64_t nextConnId_;       // 只在loop线程中访问
+    std::shared_ptr<const std::string> namePrefix_; // 连接名字的前缀"名字-ip:port"
+
+    mutable std::mutex mutex_;
+    TcpConnectionPtr connection_; // 由mutex_保护
+};
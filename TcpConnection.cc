@@ -3,16 +3,25 @@
 #include "Socket.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "TokenBucket.h"
+#include "SocketOptions.h"
+#include "ConnectionRegistry.h"
+#include "WorkStealingPool.h"
 
 #include <functional>
 #include <errno.h>
 #include <sys/types.h>         
 #include <sys/socket.h>
 #include <strings.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <string>
 
+// 共享payload剩下没写的部分小于这个数时直接拷进outputBuffer_，不排引用
+static const size_t kMinQueuedPayload = 2048;
+
 static EventLoop* CheckLoopNotNull(EventLoop *loop)
 {
     if (loop == nullptr)
@@ -22,62 +31,197 @@ static EventLoop* CheckLoopNotNull(EventLoop *loop)
     return loop;
 }
 
-TcpConnection::TcpConnection(EventLoop *loop, 
-                const std::string &nameArg, 
+TcpConnection::TcpConnection(EventLoop *loop,
+                int64_t id,
                 int sockfd,
-                const InetAddress& localAddr,
-                const InetAddress& peerAddr)
+                const InetAddress& peerAddr,
+                const ConnectionCallbacksPtr &callbacks,
+                const std::shared_ptr<const std::string> &namePrefix)
     : loop_(CheckLoopNotNull(loop))
-    , name_(nameArg)
+    , id_(id)
+    , namePrefix_(namePrefix)
+    , registry_(nullptr)
+    , registrySlot_(-1)
     , state_(kConnecting)
     , reading_(true)
-    , socket_(new Socket(sockfd))
-    , channel_(new Channel(loop, sockfd))
-    , localAddr_(localAddr)
+    , readPauses_(0)
+    , socket_(sockfd)
+    , channel_(loop, sockfd)
     , peerAddr_(peerAddr)
+    , callbacks_(callbacks ? callbacks : std::make_shared<ConnectionCallbacks>())
+    , ownCallbacks_(!callbacks)
     , highWaterMark_(64*1024*1024) // 64M
+    , autoCork_(false)
+    , corked_(false)
+    , flushQueued_(false)
+    , backpressureHigh_(0)
+    , backpressureLow_(0)
+    , backpressureActive_(false)
+    , writeThrottled_(false)
+    , notSentLowat_(0)
+    , migrating_(false)
+    , trafficBytes_(0)
+    , trafficMark_(0)
+    , offloadSeq_(0)
+    , offloadNext_(0)
+    , readBudgetBytes_(0)
+    , readBudgetMessages_(0)
+    , budgetIteration_(0)
+    , bytesThisIteration_(0)
+    , messagesThisIteration_(0)
+    , queuedPayloadBytes_(0)
+    , queuedGapBytes_(0)
 {
     // 下面给channel设置相应的回调函数，poller给channel通知感兴趣的事件发生了，channel会回调相应的操作函数
-    channel_->setReadCallback(
-        std::bind(&TcpConnection::handleRead, this, std::placeholders::_1)
-    );
-    channel_->setWriteCallback(
-        std::bind(&TcpConnection::handleWrite, this)
-    );
-    channel_->setCloseCallback(
-        std::bind(&TcpConnection::handleClose, this)
-    );
-    channel_->setErrorCallback(
-        std::bind(&TcpConnection::handleError, this)
-    );
+    // 只捕获this的lambda能放进std::function内部的小缓冲区里，不像std::bind那样还要再分配一次内存
+    channel_.setReadCallback([this](Timestamp receiveTime) { handleRead(receiveTime); });
+    channel_.setWriteCallback([this]() { handleWrite(); });
+    channel_.setCloseCallback([this]() { handleClose(); });
+    channel_.setErrorCallback([this]() { handleError(); });
+    rateHook_.owner = this;
+    rateHook_.refill = [](void *owner) { static_cast<TcpConnection *>(owner)->onRateTick(); };
 
-    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
-    socket_->setKeepAlive(true);
+    LOG_DEBUG("TcpConnection::ctor[%ld] at fd=%d\n", id_, sockfd);
+    // socket选项（包括以前这里强制打开的keepalive）统一由TcpServer在newConnection里设置
 }
 
 
 TcpConnection::~TcpConnection()
 {
-    LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d \n", 
-        name_.c_str(), channel_->fd(), (int)state_);
+    LOG_DEBUG("TcpConnection::dtor[%ld] at fd=%d state=%d \n", 
+        id_, channel_.fd(), (int)state_);
+}
+
+const std::string& TcpConnection::name() const
+{
+    std::call_once(nameOnce_, [this]()
+                   {
+                       char buf[32] = {0};
+                       snprintf(buf, sizeof buf, "#%ld", id_);
+                       name_ = namePrefix_ ? *namePrefix_ + buf : std::string("TcpConnection") + buf;
+                   });
+    return name_;
+}
+
+const InetAddress& TcpConnection::localAddress() const
+{
+    std::call_once(localAddrOnce_, [this]()
+                   {
+                       // 通过sockfd获取其绑定的本机的ip地址和端口信息
+                       sockaddr_in local;
+                       ::bzero(&local, sizeof local);
+                       socklen_t addrlen = sizeof local;
+                       if (::getsockname(socket_.fd(), (sockaddr *)&local, &addrlen) < 0)
+                       {
+                           LOG_ERROR("sockets::getLocalAddr");
+                       }
+                       localAddr_.setSockAddr(local);
+                   });
+    return localAddr_;
+}
+
+ConnectionCallbacks &TcpConnection::mutableCallbacks()
+{
+    if (!ownCallbacks_)
+    {
+        callbacks_ = std::make_shared<ConnectionCallbacks>(*callbacks_);
+        ownCallbacks_ = true;
+    }
+    // 只有自己持有这一份，可以放心修改
+    return const_cast<ConnectionCallbacks &>(*callbacks_);
 }
 
 void TcpConnection::send(const std::string &buf)
 {
     if (state_ == kConnected)
     {
-        if (loop_->isInLoopThread())
+        if (!migrating_ && getLoop()->isInLoopThread())
         {
             sendInLoop(buf.c_str(), buf.size());
         }
         else
         {
-            loop_->runInLoop(std::bind(
-                &TcpConnection::sendInLoop,
-                this,
-                buf.c_str(),
-                buf.size()
-            ));
+            // 要跨线程（或者等迁移完成）才发送，buf不一定还活着，拷贝一份
+            TcpConnectionPtr self(shared_from_this());
+            std::string data(buf);
+            runInOwnerLoop([self, data]() { self->sendInLoop(data.data(), data.size()); });
+        }
+    }
+}
+
+void TcpConnection::send(Buffer *buf)
+{
+    if (state_ == kConnected)
+    {
+        if (!migrating_ && getLoop()->isInLoopThread())
+        {
+            sendInLoop(buf->peek(), buf->readableBytes());
+            buf->retrieveAll();
+        }
+        else
+        {
+            TcpConnectionPtr self(shared_from_this());
+            std::string data(buf->retrieveAllAsString());
+            runInOwnerLoop([self, data]() { self->sendInLoop(data.data(), data.size()); });
+        }
+    }
+}
+
+void TcpConnection::send(const SharedPayload &payload)
+{
+    if (state_ == kConnected)
+    {
+        if (!migrating_ && getLoop()->isInLoopThread())
+        {
+            sendPayloadInLoop(payload);
+        }
+        else
+        {
+            TcpConnectionPtr self(shared_from_this());
+            runInOwnerLoop([self, payload]() { self->sendPayloadInLoop(payload); });
+        }
+    }
+}
+
+void TcpConnection::broadcast(const std::vector<TcpConnectionPtr> &conns, const SharedPayload &payload)
+{
+    // 按loop分组，一般只有几个loop，线性找就行
+    std::vector<std::pair<EventLoop *, std::vector<TcpConnectionPtr>>> groups;
+    for (const TcpConnectionPtr &conn : conns)
+    {
+        EventLoop *loop = conn->getLoop();
+        size_t i = 0;
+        while (i < groups.size() && groups[i].first != loop)
+        {
+            ++i;
+        }
+        if (i == groups.size())
+        {
+            groups.emplace_back(loop, std::vector<TcpConnectionPtr>());
+        }
+        groups[i].second.push_back(conn);
+    }
+    for (auto &group : groups)
+    {
+        if (group.first->isInLoopThread())
+        {
+            for (const TcpConnectionPtr &conn : group.second)
+            {
+                conn->send(payload);
+            }
+        }
+        else
+        {
+            // 每个loop一个任务；执行时连接要是已经迁走了，send会转给它现在的loop
+            std::shared_ptr<std::vector<TcpConnectionPtr>> members =
+                std::make_shared<std::vector<TcpConnectionPtr>>(std::move(group.second));
+            group.first->queueInLoop([members, payload]()
+                                     {
+                                         for (const TcpConnectionPtr &conn : *members)
+                                         {
+                                             conn->send(payload);
+                                         }
+                                     });
         }
     }
 }
@@ -87,10 +231,6 @@ void TcpConnection::send(const std::string &buf)
  */ 
 void TcpConnection::sendInLoop(const void* data, size_t len)
 {
-    ssize_t nwrote = 0;
-    size_t remaining = len;
-    bool faultError = false;
-
     // 之前调用过该connection的shutdown，不能再进行发送了
     if (state_ == kDisconnected)
     {
@@ -98,75 +238,854 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
         return;
     }
 
+    // cork模式下只追加到outputBuffer_，等本轮事件循环末尾（或者uncork的时候）再统一写
+    bool deferred = autoCork_ || corked_;
+    bool faultError = false;
+    size_t nwrote = 0;
+
     // 表示channel_第一次开始写数据，而且缓冲区没有待发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    if (!deferred && !writeThrottled_ && !channel_.isWriting() && pendingOutputBytes() == 0)
     {
-        nwrote = ::write(channel_->fd(), data, len);
-        if (nwrote >= 0)
-        {
-            remaining = len - nwrote;
-            if (remaining == 0 && writeCompleteCallback_)
-            {
-                // 既然在这里数据全部发送完成，就不用再给channel设置epollout事件了
-                loop_->queueInLoop(
-                    std::bind(writeCompleteCallback_, shared_from_this())
-                );
-            }
-        }
-        else // nwrote < 0
-        {
-            nwrote = 0;
-            if (errno != EWOULDBLOCK)
-            {
-                LOG_ERROR("TcpConnection::sendInLoop");
-                if (errno == EPIPE || errno == ECONNRESET) // SIGPIPE  RESET
-                {
-                    faultError = true;
-                }
-            }
-        }
+        nwrote = writeDirectly(data, len, &faultError);
     }
 
     // 说明当前这一次write，并没有把数据全部发送出去，剩余的数据需要保存到缓冲区当中，然后给channel
     // 注册epollout事件，poller发现tcp的发送缓冲区有空间，会通知相应的sock-channel，调用writeCallback_回调方法
     // 也就是调用TcpConnection::handleWrite方法，把发送缓冲区中的数据全部发送完成
+    size_t remaining = len - nwrote;
     if (!faultError && remaining > 0) 
     {
-        // 目前发送缓冲区剩余的待发送数据的长度
-        size_t oldLen = outputBuffer_.readableBytes();
-        if (oldLen + remaining >= highWaterMark_
-            && oldLen < highWaterMark_
-            && highWaterMarkCallback_)
+        size_t oldLen = pendingOutputBytes();
+        outputBuffer_.append(static_cast<const char *>(data) + nwrote, remaining);
+        outputQueued(oldLen, deferred);
+    }
+}
+
+// 和sendInLoop一样，只是写不完的部分不拷贝，在payloadQueue_里留一个引用
+void TcpConnection::sendPayloadInLoop(const SharedPayload &payload)
+{
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing!");
+        return;
+    }
+    if (!payload || payload->empty())
+    {
+        return;
+    }
+
+    bool deferred = autoCork_ || corked_;
+    bool faultError = false;
+    size_t nwrote = 0;
+    if (!deferred && !writeThrottled_ && !channel_.isWriting() && pendingOutputBytes() == 0)
+    {
+        nwrote = writeDirectly(payload->data(), payload->size(), &faultError);
+    }
+
+    size_t remaining = payload->size() - nwrote;
+    if (!faultError && remaining > 0 && remaining < kMinQueuedPayload)
+    {
+        size_t oldLen = pendingOutputBytes();
+        outputBuffer_.append(payload->data() + nwrote, remaining); // 小的拷一下比writev里多一段更便宜
+        outputQueued(oldLen, deferred);
+    }
+    else if (!faultError && remaining > 0)
+    {
+        size_t oldLen = pendingOutputBytes();
+        QueuedPayload queued;
+        queued.data = payload;
+        queued.offset = nwrote;
+        queued.gap = outputBuffer_.readableBytes() - queuedGapBytes_; // 前一个payload之后追加进outputBuffer_的
+        queuedGapBytes_ += queued.gap;
+        queuedPayloadBytes_ += remaining;
+        payloadQueue_.push_back(std::move(queued));
+        outputQueued(oldLen, deferred);
+    }
+}
+
+size_t TcpConnection::writeDirectly(const void *data, size_t len, bool *faultError)
+{
+    size_t quota = sendQuota(len);
+    if (quota == 0 && len > 0)
+    {
+        writeThrottled_ = true; // 令牌用完了，数据先放到outputBuffer_里
+    }
+    ssize_t nwrote = quota > 0 ? ::write(channel_.fd(), data, quota) : 0;
+    if (nwrote >= 0)
+    {
+        chargeSend(nwrote);
+        if (static_cast<size_t>(nwrote) == len && callbacks_->writeCompleteCallback)
         {
-            loop_->queueInLoop(
-                std::bind(highWaterMarkCallback_, shared_from_this(), oldLen+remaining)
+            // 既然在这里数据全部发送完成，就不用再给channel设置epollout事件了
+            getLoop()->queueInLoop(
+                std::bind(callbacks_->writeCompleteCallback, shared_from_this())
             );
         }
-        outputBuffer_.append((char*)data + nwrote, remaining);
-        if (!channel_->isWriting())
+        return nwrote;
+    }
+    if (errno != EWOULDBLOCK)
+    {
+        LOG_ERROR("TcpConnection::sendInLoop");
+        if (errno == EPIPE || errno == ECONNRESET) // SIGPIPE  RESET
+        {
+            *faultError = true;
+        }
+    }
+    return 0;
+}
+
+void TcpConnection::outputQueued(size_t oldLen, bool deferred)
+{
+    size_t pending = pendingOutputBytes();
+    if (pending >= highWaterMark_
+        && oldLen < highWaterMark_
+        && callbacks_->highWaterMarkCallback)
+    {
+        getLoop()->queueInLoop(
+            std::bind(callbacks_->highWaterMarkCallback, shared_from_this(), pending)
+        );
+    }
+    checkBackpressure();
+    if (deferred)
+    {
+        if (!corked_)
+        {
+            scheduleFlush();
+        }
+    }
+    else if (!channel_.isWriting() && !writeThrottled_)
+    {
+        channel_.enableWriting(); // 这里一定要注册channel的写事件，否则poller不会给channel通知epollout
+    }
+}
+
+/**
+ * 没有排队的payload时就是outputBuffer_.writeFd；有的话按顺序把outputBuffer_的片段和payload拼成iovec，一次writev
+ */
+ssize_t TcpConnection::writeOutput(size_t maxBytes, int *savedErrno)
+{
+    if (payloadQueue_.empty())
+    {
+        return outputBuffer_.writeFd(channel_.fd(), savedErrno, maxBytes);
+    }
+
+    static const int kMaxIov = 64;
+    struct iovec vec[kMaxIov];
+    int count = 0;
+    size_t total = 0;
+    const char *buffered = outputBuffer_.peek();
+    auto add = [&](const char *base, size_t len)
+    {
+        len = len < maxBytes - total ? len : maxBytes - total;
+        vec[count].iov_base = const_cast<char *>(base);
+        vec[count].iov_len = len;
+        ++count;
+        total += len;
+    };
+    size_t i = 0;
+    for (; i < payloadQueue_.size() && count + 2 <= kMaxIov && total < maxBytes; ++i)
+    {
+        const QueuedPayload &queued = payloadQueue_[i];
+        if (queued.gap > 0)
+        {
+            add(buffered, queued.gap);
+            buffered += queued.gap;
+        }
+        if (total < maxBytes)
+        {
+            add(queued.data->data() + queued.offset, queued.data->size() - queued.offset);
+        }
+    }
+    size_t tail = outputBuffer_.readableBytes() - queuedGapBytes_;
+    if (i == payloadQueue_.size() && tail > 0 && count < kMaxIov && total < maxBytes)
+    {
+        add(buffered, tail);
+    }
+
+    ssize_t n = ::writev(channel_.fd(), vec, count);
+    if (n < 0)
+    {
+        *savedErrno = errno;
+    }
+    return n;
+}
+
+void TcpConnection::consumeOutput(size_t n)
+{
+    while (n > 0 && !payloadQueue_.empty())
+    {
+        QueuedPayload &front = payloadQueue_.front();
+        size_t fromBuffer = n < front.gap ? n : front.gap;
+        outputBuffer_.retrieve(fromBuffer);
+        front.gap -= fromBuffer;
+        queuedGapBytes_ -= fromBuffer;
+        n -= fromBuffer;
+        if (front.gap > 0)
+        {
+            return;
+        }
+        size_t left = front.data->size() - front.offset;
+        size_t fromPayload = n < left ? n : left;
+        front.offset += fromPayload;
+        queuedPayloadBytes_ -= fromPayload;
+        n -= fromPayload;
+        if (front.offset < front.data->size())
+        {
+            return;
+        }
+        payloadQueue_.pop_front(); // 这个连接用完了，最后一个引用释放时payload就没了
+    }
+    outputBuffer_.retrieve(n);
+}
+
+void TcpConnection::setAutoCork(bool on)
+{
+    runInOwnerLoop(
+        std::bind(&TcpConnection::setAutoCorkInLoop, shared_from_this(), on)
+    );
+}
+
+void TcpConnection::setAutoCorkInLoop(bool on)
+{
+    autoCork_ = on;
+    if (!on && !corked_ && pendingOutputBytes() > 0)
+    {
+        scheduleFlush(); // 关掉自动cork时，之前攒下的数据还是要在本轮写出去
+    }
+}
+
+void TcpConnection::cork()
+{
+    runInOwnerLoop(
+        std::bind(&TcpConnection::corkInLoop, shared_from_this())
+    );
+}
+
+void TcpConnection::corkInLoop()
+{
+    corked_ = true;
+}
+
+void TcpConnection::uncork()
+{
+    runInOwnerLoop(
+        std::bind(&TcpConnection::uncorkInLoop, shared_from_this())
+    );
+}
+
+void TcpConnection::uncorkInLoop()
+{
+    if (corked_)
+    {
+        corked_ = false;
+        flushOutput(); // uncork时立即写，不用等到本轮末尾
+    }
+}
+
+void TcpConnection::scheduleFlush()
+{
+    if (!flushQueued_)
+    {
+        flushQueued_ = true;
+        // 绑定shared_ptr，防止flush之前连接已经被销毁
+        // 执行之前连接可能已经迁移到别的loop上了，那就不归这个loop管了，迁移时会在新的loop里重新flush
+        TcpConnectionPtr self(shared_from_this());
+        EventLoop *loop = getLoop();
+        loop->queueFlush([self, loop]()
+                         {
+                             if (self->getLoop() == loop)
+                             {
+                                 self->flushOutput();
+                             }
+                         });
+    }
+}
+
+/**
+ * 把outputBuffer_里攒下来的数据（连同排队的payload）用一次write写出去
+ * 写不完的部分照旧注册epollout，交给handleWrite继续发送
+ */
+void TcpConnection::flushOutput()
+{
+    flushQueued_ = false;
+    if (corked_ || writeThrottled_ || state_ == kDisconnected || channel_.isWriting())
+    {
+        return; // 还cork着，或者已经在等epollout/补充令牌了，之后会把数据发完
+    }
+    if (pendingOutputBytes() == 0)
+    {
+        return;
+    }
+
+    size_t quota = sendQuota(pendingOutputBytes());
+    if (quota == 0)
+    {
+        throttleWrite();
+        return;
+    }
+
+    int savedErrno = 0;
+    ssize_t n = writeOutput(quota, &savedErrno);
+    if (n > 0)
+    {
+        chargeSend(n);
+        consumeOutput(n);
+        checkBackpressure();
+    }
+    else if (savedErrno != EWOULDBLOCK)
+    {
+        errno = savedErrno;
+        LOG_ERROR("TcpConnection::flushOutput");
+        if (savedErrno == EPIPE || savedErrno == ECONNRESET)
+        {
+            return;
+        }
+    }
+
+    if (pendingOutputBytes() > 0)
+    {
+        if (!writeThrottled_)
+        {
+            channel_.enableWriting(); // 没写完的交给handleWrite
+        }
+    }
+    else
+    {
+        if (callbacks_->writeCompleteCallback)
+        {
+            getLoop()->queueInLoop(
+                std::bind(callbacks_->writeCompleteCallback, shared_from_this())
+            );
+        }
+        if (state_ == kDisconnecting)
+        {
+            shutdownInLoop();
+        }
+    }
+}
+
+void TcpConnection::startRead()
+{
+    runInOwnerLoop(
+        std::bind(&TcpConnection::startReadInLoop, shared_from_this())
+    );
+}
+
+void TcpConnection::startReadInLoop()
+{
+    reading_ = true;
+    updateReading();
+}
+
+void TcpConnection::stopRead()
+{
+    runInOwnerLoop(
+        std::bind(&TcpConnection::stopReadInLoop, shared_from_this())
+    );
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    reading_ = false;
+    updateReading();
+}
+
+// 背压的暂停/恢复可能来自别的loop里的连接，所以绑定shared_ptr保证执行的时候连接还活着
+void TcpConnection::pauseRead(int reason)
+{
+    runInOwnerLoop(
+        std::bind(&TcpConnection::pauseReadInLoop, shared_from_this(), reason)
+    );
+}
+
+void TcpConnection::resumeRead(int reason)
+{
+    runInOwnerLoop(
+        std::bind(&TcpConnection::resumeReadInLoop, shared_from_this(), reason)
+    );
+}
+
+void TcpConnection::pauseReadInLoop(int reason)
+{
+    readPauses_ |= reason;
+    updateReading();
+}
+
+void TcpConnection::resumeReadInLoop(int reason)
+{
+    readPauses_ &= ~reason;
+    updateReading();
+}
+
+// 根据用户意愿和暂停原因，决定channel要不要关注读事件
+void TcpConnection::updateReading()
+{
+    if (state_ != kConnected && state_ != kDisconnecting)
+    {
+        return; // 还没建立或者已经断开，connectEstablished/handleClose会处理channel
+    }
+    bool wantRead = reading_ && readPauses_ == 0;
+    if (wantRead && !channel_.isReading())
+    {
+        channel_.enableReading();
+    }
+    else if (!wantRead && channel_.isReading())
+    {
+        channel_.disableReading();
+    }
+}
+
+void TcpConnection::setBackpressure(size_t highWaterMark, size_t lowWaterMark)
+{
+    runInOwnerLoop(
+        std::bind(&TcpConnection::setBackpressureInLoop, shared_from_this(), highWaterMark, lowWaterMark)
+    );
+}
+
+void TcpConnection::setBackpressureInLoop(size_t highWaterMark, size_t lowWaterMark)
+{
+    // 低水位必须比高水位低，否则会在两个状态之间来回抖
+    backpressureHigh_ = highWaterMark;
+    backpressureLow_ = lowWaterMark < highWaterMark ? lowWaterMark : highWaterMark / 2;
+}
+
+void TcpConnection::linkBackpressure(const TcpConnectionPtr &peer)
+{
+    runInOwnerLoop(
+        std::bind(&TcpConnection::linkBackpressureInLoop, shared_from_this(), peer)
+    );
+}
+
+void TcpConnection::linkBackpressureInLoop(const TcpConnectionPtr &peer)
+{
+    backpressurePeer_ = peer;
+}
+
+void TcpConnection::checkBackpressure()
+{
+    if (backpressureHigh_ == 0)
+    {
+        return;
+    }
+
+    size_t pending = pendingOutputBytes();
+    bool overHigh = pending > backpressureHigh_;
+    bool underLow = pending <= backpressureLow_;
+    if (backpressureActive_ ? !underLow : !overHigh)
+    {
+        return; // 没有越过水位，状态不变
+    }
+    backpressureActive_ = !backpressureActive_;
+
+    TcpConnectionPtr peer = backpressurePeer_.lock();
+    if (!peer)
+    {
+        peer = shared_from_this();
+    }
+    if (backpressureActive_)
+    {
+        peer->pauseRead(kPauseBackpressure);
+    }
+    else
+    {
+        peer->resumeRead(kPauseBackpressure);
+    }
+}
+
+void TcpConnection::releaseBackpressure()
+{
+    if (backpressureActive_)
+    {
+        backpressureActive_ = false;
+        TcpConnectionPtr peer = backpressurePeer_.lock();
+        if (peer)
+        {
+            peer->resumeRead(kPauseBackpressure);
+        }
+    }
+}
+
+void TcpConnection::setSocketOptions(const SocketOptions &options)
+{
+    if (state_ == kConnecting)
+    {
+        // 还没交给subloop（TcpServer::newConnection里），直接设置，省一次跨线程的回调
+        setSocketOptionsInLoop(options);
+        return;
+    }
+    runInOwnerLoop(
+        std::bind(&TcpConnection::setSocketOptionsInLoop, shared_from_this(), options)
+    );
+}
+
+void TcpConnection::setSocketOptionsInLoop(const SocketOptions &options)
+{
+    socket_.applyOptions(options);
+    if (options.notSentLowat >= 0) // 和Socket::applyOptions一样，-1不动，0把内核和这里的上限一起清掉
+    {
+        notSentLowat_ = options.notSentLowat;
+    }
+}
+
+void TcpConnection::setTcpNoDelay(bool on)
+{
+    SocketOptions options;
+    options.keepAlive = -1; // 只改TCP_NODELAY，其他的不动
+    options.tcpNoDelay = on ? 1 : 0;
+    setSocketOptions(options);
+}
+
+void TcpConnection::setReadBudget(size_t maxBytes, int maxMessages)
+{
+    readBudgetBytes_ = maxBytes;
+    readBudgetMessages_ = maxMessages;
+}
+
+void TcpConnection::setRateLimit(int64_t sendBytesPerSecond, int64_t recvBytesPerSecond)
+{
+    sendBucket_.reset(sendBytesPerSecond > 0 ? new TokenBucket(sendBytesPerSecond) : nullptr);
+    recvBucket_.reset(recvBytesPerSecond > 0 ? new TokenBucket(recvBytesPerSecond) : nullptr);
+    if (state_ == kConnected)
+    {
+        linkRateHook();
+    }
+}
+
+void TcpConnection::setSharedRateLimit(const std::shared_ptr<TokenBucket> &sendBucket,
+                                       const std::shared_ptr<TokenBucket> &recvBucket)
+{
+    sharedSendBucket_ = sendBucket;
+    sharedRecvBucket_ = recvBucket;
+    if (state_ == kConnected)
+    {
+        linkRateHook();
+    }
+}
+
+// 不限速的时候直接返回len，限速的时候取几个桶里剩余令牌的最小值
+// 设置了TCP_NOTSENT_LOWAT时，每次最多写notSentLowat_字节，剩下的等内核发得差不多了（EPOLLOUT）再写，
+// 这样内核的发送队列一直很短，突发的数据由outputBuffer_吸收，多路交错的数据延迟更低
+size_t TcpConnection::sendQuota(size_t len) const
+{
+    int64_t quota = static_cast<int64_t>(len);
+    if (notSentLowat_ > 0 && len > notSentLowat_)
+    {
+        quota = static_cast<int64_t>(notSentLowat_);
+    }
+    if (sendBucket_ && sendBucket_->tokens() < quota)
+    {
+        quota = sendBucket_->tokens();
+    }
+    if (sharedSendBucket_ && sharedSendBucket_->tokens() < quota)
+    {
+        quota = sharedSendBucket_->tokens();
+    }
+    return quota > 0 ? static_cast<size_t>(quota) : 0;
+}
+
+void TcpConnection::chargeSend(size_t n)
+{
+    trafficBytes_ += n;
+    if (sendBucket_)
+    {
+        sendBucket_->consume(n);
+    }
+    if (sharedSendBucket_)
+    {
+        sharedSendBucket_->consume(n);
+    }
+}
+
+void TcpConnection::chargeRecv(size_t n)
+{
+    bool exhausted = false;
+    if (recvBucket_)
+    {
+        recvBucket_->consume(n);
+        exhausted = recvBucket_->exhausted();
+    }
+    if (sharedRecvBucket_)
+    {
+        sharedRecvBucket_->consume(n);
+        exhausted = exhausted || sharedRecvBucket_->exhausted();
+    }
+    if (exhausted)
+    {
+        pauseReadInLoop(kPauseRateLimit);
+    }
+}
+
+void TcpConnection::throttleWrite()
+{
+    writeThrottled_ = true;
+    if (channel_.isWriting())
+    {
+        channel_.disableWriting(); // 令牌没补上之前，epollout来了也写不了，先别关注
+    }
+}
+
+// 链表节点只存裸指针，离开loop（handleClose、connectDestroyed、迁移走）之前一定要摘下来
+void TcpConnection::linkRateHook()
+{
+    if (rateLimited())
+    {
+        getLoop()->addRefillHook(&rateHook_);
+    }
+}
+
+void TcpConnection::unlinkRateHook()
+{
+    getLoop()->removeRefillHook(&rateHook_);
+}
+
+void TcpConnection::onRateTick()
+{
+    // 共享的桶由所有者（TcpServer）补充，这里只补充自己的
+    if (sendBucket_)
+    {
+        sendBucket_->refill();
+    }
+    if (recvBucket_)
+    {
+        recvBucket_->refill();
+    }
+
+    if (writeThrottled_ && sendQuota(1) > 0)
+    {
+        writeThrottled_ = false;
+        if (!corked_ && !channel_.isWriting() && pendingOutputBytes() > 0)
+        {
+            channel_.enableWriting(); // 有令牌了，交给handleWrite继续发
+        }
+    }
+
+    if (readPauses_ & kPauseRateLimit)
+    {
+        bool exhausted = (recvBucket_ && recvBucket_->exhausted())
+                      || (sharedRecvBucket_ && sharedRecvBucket_->exhausted());
+        if (!exhausted)
         {
-            channel_->enableWriting(); // 这里一定要注册channel的写事件，否则poller不会给channel通知epollout
+            resumeReadInLoop(kPauseRateLimit);
         }
     }
 }
 
+/**
+ * 跨线程调用的入口（send、shutdown、startRead等）都经过这里
+ *
+ * 平时就是runInLoop；迁移过程中连接不属于任何一个loop，操作先按顺序攒到migrationQueue_里，
+ * 在目标loop注册好channel以后再依次执行。入队和切换loop_都在migrateMutex_里完成，
+ * 所以在切换之前投递到源loop的操作一定排在handoffInLoop之前执行，之后的操作一定在目标loop上执行
+ */
+void TcpConnection::runInOwnerLoop(std::function<void()> cb)
+{
+    // migrating_只由连接所属的loop线程修改，所属loop线程自己读它不需要加锁
+    if (!migrating_ && getLoop()->isInLoopThread())
+    {
+        cb();
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(migrateMutex_);
+    if (migrating_)
+    {
+        migrationQueue_.push_back(std::move(cb));
+        return;
+    }
+    EventLoop *loop = getLoop();
+    if (loop->isInLoopThread())
+    {
+        lock.unlock();
+        cb();
+    }
+    else
+    {
+        loop->queueInLoop(std::move(cb)); // 在锁里入队，保证不会和迁移交错
+    }
+}
+
+void TcpConnection::migrateTo(EventLoop *target, ConnectionRegistry *targetRegistry)
+{
+    runInOwnerLoop(
+        std::bind(&TcpConnection::migrateInLoop, shared_from_this(), target, targetRegistry)
+    );
+}
+
+void TcpConnection::migrateInLoop(EventLoop *target, ConnectionRegistry *targetRegistry)
+{
+    if (migrating_)
+    {
+        // 同一批回调里前面已经开始了一次迁移，这一次排到它后面，等到了新的loop再说
+        runInOwnerLoop(
+            std::bind(&TcpConnection::migrateInLoop, shared_from_this(), target, targetRegistry)
+        );
+        return;
+    }
+    EventLoop *source = getLoop();
+    if (target == nullptr || target == source || state_ != kConnected)
+    {
+        if (targetRegistry)
+        {
+            targetRegistry->cancelExpected();
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(migrateMutex_);
+        migrating_ = true;
+    }
+    // 从现在起新的操作都进migrationQueue_，已经投递到源loop的操作排在handoffInLoop前面，在源loop里执行完
+    source->queueInLoop(
+        std::bind(&TcpConnection::handoffInLoop, shared_from_this(), target, targetRegistry)
+    );
+}
+
+void TcpConnection::handoffInLoop(EventLoop *target, ConnectionRegistry *targetRegistry)
+{
+    if (state_ != kConnected && state_ != kDisconnecting)
+    {
+        if (targetRegistry)
+        {
+            targetRegistry->cancelExpected();
+        }
+        runMigrationQueue(); // 等待迁移的时候连接断开了，取消迁移，攒下的操作就在这里执行
+        return;
+    }
+
+    TcpConnectionPtr self(shared_from_this());
+    if (registry_)
+    {
+        registry_->remove(self); // 连接表只能在自己的loop里访问，不能带着走
+    }
+    unlinkRateHook();
+
+    // 把channel从源loop的poller里摘下来（包括留到下一轮处理的队列），之后源loop不会再碰这个连接
+    bool writing = channel_.isWriting();
+    channel_.disableAll();
+    channel_.remove();
+    channel_.setLoop(target);
+    flushQueued_ = false;  // 源loop里已经排队的flush会发现连接不归它管了
+    budgetIteration_ = 0;  // 轮数是每个loop自己的，到了目标loop重新算
+
+    std::lock_guard<std::mutex> lock(migrateMutex_);
+    loop_ = target;
+    target->queueInLoop(
+        std::bind(&TcpConnection::attachInLoop, self, targetRegistry, writing)
+    );
+}
+
+void TcpConnection::attachInLoop(ConnectionRegistry *targetRegistry, bool writing)
+{
+    if (targetRegistry)
+    {
+        targetRegistry->add(shared_from_this());
+    }
+
+    // 在目标loop的poller里重新注册；水平触发，socket里还没读的数据马上就会报上来
+    updateReading();
+    if (writing && !writeThrottled_)
+    {
+        channel_.enableWriting();
+    }
+    linkRateHook();
+    if (!corked_ && !channel_.isWriting() && pendingOutputBytes() > 0)
+    {
+        scheduleFlush(); // 源loop里还没来得及flush的数据
+    }
+
+    runMigrationQueue();
+}
+
+void TcpConnection::runMigrationQueue()
+{
+    std::vector<std::function<void()>> functors;
+    {
+        std::lock_guard<std::mutex> lock(migrateMutex_);
+        functors.swap(migrationQueue_);
+        migrating_ = false;
+    }
+    // 此时已经在连接所属的loop线程里了，按入队的顺序执行；执行过程中新来的操作走正常的路径，排在后面
+    for (const auto &functor : functors)
+    {
+        functor();
+    }
+}
+
+void TcpConnection::offloadTask(WorkStealingPool *pool, std::function<void()> job, std::function<void()> done)
+{
+    uint64_t seq = offloadSeq_++;
+    TcpConnectionPtr self(shared_from_this());
+    pool->submit([self, seq, job, done]()
+                 {
+                     job();
+                     // 连接可能在job执行期间被迁移了，交给它现在所属的loop
+                     self->runInOwnerLoop(std::bind(&TcpConnection::deliverOffload, self, seq, done));
+                 });
+}
+
+void TcpConnection::deliverOffload(uint64_t seq, const std::function<void()> &done)
+{
+    if (seq != offloadNext_)
+    {
+        offloadDone_[seq] = done; // 前面还有没做完的，先存起来
+        return;
+    }
+
+    done();
+    ++offloadNext_;
+    while (!offloadDone_.empty() && offloadDone_.begin()->first == offloadNext_)
+    {
+        std::function<void()> next = std::move(offloadDone_.begin()->second);
+        offloadDone_.erase(offloadDone_.begin());
+        next();
+        ++offloadNext_;
+    }
+}
+
+uint64_t TcpConnection::takeRecentTraffic()
+{
+    uint64_t recent = trafficBytes_ - trafficMark_;
+    trafficMark_ = trafficBytes_;
+    return recent;
+}
+
 // 关闭连接
 void TcpConnection::shutdown()
 {
     if (state_ == kConnected)
     {
         setState(kDisconnecting);
-        loop_->runInLoop(
-            std::bind(&TcpConnection::shutdownInLoop, this)
+        runInOwnerLoop(
+            std::bind(&TcpConnection::shutdownInLoop, shared_from_this())
         );
     }
 }
 
 void TcpConnection::shutdownInLoop()
 {
-    if (!channel_->isWriting()) // 说明outputBuffer中的数据已经全部发送完成
+    // 说明outputBuffer中的数据已经全部发送完成（cork住的数据也要等flush完再关）
+    if (!channel_.isWriting() && pendingOutputBytes() == 0)
     {
-        socket_->shutdownWrite(); // 关闭写端
+        socket_.shutdownWrite(); // 关闭写端
+    }
+}
+
+void TcpConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        TcpConnectionPtr self(shared_from_this());
+        runInOwnerLoop([self]() { self->forceCloseInLoop(); });
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose(); // 和对端关闭走同一条路径，连接的所有者会收到closeCallback
     }
 }
 
@@ -174,11 +1093,18 @@ void TcpConnection::shutdownInLoop()
 void TcpConnection::connectEstablished()
 {
     setState(kConnected);
-    channel_->tie(shared_from_this());
-    channel_->enableReading(); // 向poller注册channel的epollin事件
+    channel_.tie(shared_from_this());
+    if (reading_ && readPauses_ == 0)
+    {
+        channel_.enableReading(); // 向poller注册channel的epollin事件
+    }
+    linkRateHook();
 
     // 新连接建立，执行回调
-    connectionCallback_(shared_from_this());
+    if (callbacks_->connectionCallback)
+    {
+        callbacks_->connectionCallback(shared_from_this());
+    }
 }
 
 // 连接销毁
@@ -187,20 +1113,36 @@ void TcpConnection::connectDestroyed()
     if (state_ == kConnected)
     {
         setState(kDisconnected);
-        channel_->disableAll(); // 把channel的所有感兴趣的事件，从poller中del掉
-        connectionCallback_(shared_from_this());
+        channel_.disableAll(); // 把channel的所有感兴趣的事件，从poller中del掉
+        releaseBackpressure();
+        if (callbacks_->connectionCallback)
+        {
+            callbacks_->connectionCallback(shared_from_this());
+        }
     }
-    channel_->remove(); // 把channel从poller中删除掉
+    unlinkRateHook(); // 不管是从哪个状态销毁的，链表里都不能留着悬空的节点
+    channel_.remove(); // 把channel从poller中删除掉
 }
 
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
+    if (readBudgetBytes_ > 0 || readBudgetMessages_ > 0)
+    {
+        handleBudgetedRead(receiveTime);
+        return;
+    }
+
     int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+    ssize_t n = inputBuffer_.readFd(channel_.fd(), &savedErrno);
     if (n > 0)
     {
+        trafficBytes_ += n;
+        if (recvBucket_ || sharedRecvBucket_)
+        {
+            chargeRecv(n);
+        }
         // 已建立连接的用户，有可读事件发生了，调用用户传入的回调操作onMessage
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        callbacks_->messageCallback(shared_from_this(), &inputBuffer_, receiveTime);
     }
     else if (n == 0)
     {
@@ -214,23 +1156,87 @@ void TcpConnection::handleRead(Timestamp receiveTime)
     }
 }
 
+/**
+ * 有读预算的读：一直读到EAGAIN或者预算用完为止
+ * 预算用完了socket里可能还有数据，让loop下一轮接着调用handleRead，而不是等下一次epoll_wait，
+ * 这样一个话多的连接不会把同一个loop上其他安静的连接饿着
+ */
+void TcpConnection::handleBudgetedRead(Timestamp receiveTime)
+{
+    if (budgetIteration_ != getLoop()->iteration()) // 新的一轮，预算重置
+    {
+        budgetIteration_ = getLoop()->iteration();
+        bytesThisIteration_ = 0;
+        messagesThisIteration_ = 0;
+    }
+
+    TcpConnectionPtr guard(shared_from_this());
+    while (channel_.isReading()) // 回调里可能stopRead了，或者因为背压、限速暂停了读
+    {
+        if ((readBudgetBytes_ > 0 && bytesThisIteration_ >= readBudgetBytes_)
+            || (readBudgetMessages_ > 0 && messagesThisIteration_ >= readBudgetMessages_))
+        {
+            getLoop()->requeueChannel(&channel_, EPOLLIN); // 预算用完了，下一轮接着读
+            break;
+        }
+
+        size_t maxBytes = readBudgetBytes_ > 0 ? readBudgetBytes_ - bytesThisIteration_ : static_cast<size_t>(-1);
+        int savedErrno = 0;
+        ssize_t n = inputBuffer_.readFd(channel_.fd(), &savedErrno, maxBytes);
+        if (n > 0)
+        {
+            bytesThisIteration_ += n;
+            trafficBytes_ += n;
+            ++messagesThisIteration_;
+            if (recvBucket_ || sharedRecvBucket_)
+            {
+                chargeRecv(n);
+            }
+            callbacks_->messageCallback(guard, &inputBuffer_, receiveTime);
+        }
+        else if (n == 0)
+        {
+            handleClose();
+            break;
+        }
+        else
+        {
+            if (savedErrno != EAGAIN && savedErrno != EWOULDBLOCK) // EAGAIN说明已经读空了
+            {
+                errno = savedErrno;
+                LOG_ERROR("TcpConnection::handleRead");
+                handleError();
+            }
+            break;
+        }
+    }
+}
+
 void TcpConnection::handleWrite()
 {
-    if (channel_->isWriting())
+    if (channel_.isWriting())
     {
+        size_t quota = sendQuota(pendingOutputBytes());
+        if (quota == 0)
+        {
+            throttleWrite();
+            return;
+        }
         int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
+        ssize_t n = writeOutput(quota, &savedErrno);
         if (n > 0)
         {
-            outputBuffer_.retrieve(n);
-            if (outputBuffer_.readableBytes() == 0)
+            chargeSend(n);
+            consumeOutput(n);
+            checkBackpressure();
+            if (pendingOutputBytes() == 0)
             {
-                channel_->disableWriting();
-                if (writeCompleteCallback_)
+                channel_.disableWriting();
+                if (callbacks_->writeCompleteCallback)
                 {
                     // 唤醒loop_对应的thread线程，执行回调
-                    loop_->queueInLoop(
-                        std::bind(writeCompleteCallback_, shared_from_this())
+                    getLoop()->queueInLoop(
+                        std::bind(callbacks_->writeCompleteCallback, shared_from_this())
                     );
                 }
                 if (state_ == kDisconnecting)
@@ -246,20 +1252,32 @@ void TcpConnection::handleWrite()
     }
     else
     {
-        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_->fd());
+        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_.fd());
     }
 }
 
 // poller => channel::closeCallback => TcpConnection::handleClose
 void TcpConnection::handleClose()
 {
-    LOG_INFO("TcpConnection::handleClose fd=%d state=%d \n", channel_->fd(), (int)state_);
+    LOG_DEBUG("TcpConnection::handleClose fd=%d state=%d \n", channel_.fd(), (int)state_);
     setState(kDisconnected);
-    channel_->disableAll();
+    channel_.disableAll();
+    releaseBackpressure();
+    // 不会再写了，排队的payload早点把引用还回去
+    payloadQueue_.clear();
+    queuedPayloadBytes_ = 0;
+    queuedGapBytes_ = 0;
+    unlinkRateHook();
 
     TcpConnectionPtr connPtr(shared_from_this());
-    connectionCallback_(connPtr); // 执行连接关闭的回调
-    closeCallback_(connPtr); // 关闭连接的回调  执行的是TcpServer::removeConnection回调方法
+    if (callbacks_->connectionCallback)
+    {
+        callbacks_->connectionCallback(connPtr); // 执行连接关闭的回调
+    }
+    if (callbacks_->closeCallback)
+    {
+        callbacks_->closeCallback(connPtr); // 关闭连接的回调  执行的是TcpServer::removeConnection回调方法
+    }
 }
 
 void TcpConnection::handleError()
@@ -267,7 +1285,7 @@ void TcpConnection::handleError()
     int optval;
     socklen_t optlen = sizeof optval;
     int err = 0;
-    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    if (::getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
     {
         err = errno;
     }
@@ -275,5 +1293,5 @@ void TcpConnection::handleError()
     {
         err = optval;
     }
-    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name_.c_str(), err);
+    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name().c_str(), err);
 }
\ No newline at end of file
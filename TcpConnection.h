@@ -5,56 +5,160 @@
 #include "Callbacks.h"
 #include "Buffer.h"
 #include "Timestamp.h"
+#include "TokenBucket.h"
+#include "Socket.h"
+#include "Channel.h"
 
 #include <memory>
 #include <string>
 #include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <map>
 
-class Channel;
 class EventLoop;
-class Socket;
+class ConnectionRegistry;
+class WorkStealingPool;
+struct SocketOptions;
 
 /**
  * TcpServer => Acceptor => 有一个新用户连接，通过accept函数拿到connfd
  * =》 TcpConnection 设置回调 =》 Channel =》 Poller =》 Channel的回调操作
  * 
+ * 建立连接的路径上尽量少分配内存：Socket和Channel直接嵌在对象里，配合make_shared只分配一次；
+ * 回调用的是所有连接共享的ConnectionCallbacks；名字和本端地址用到的时候才生成
  */ 
 class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection>
 {
 public:
-    TcpConnection(EventLoop *loop, 
-                const std::string &name, 
+    // namePrefix是连接名字的前缀（比如TcpServer的"名字-ip:port"），连接名字为"前缀#id"
+    TcpConnection(EventLoop *loop,
+                int64_t id,
                 int sockfd,
-                const InetAddress& localAddr,
-                const InetAddress& peerAddr);
+                const InetAddress& peerAddr,
+                const ConnectionCallbacksPtr &callbacks,
+                const std::shared_ptr<const std::string> &namePrefix);
     ~TcpConnection();
 
-    EventLoop* getLoop() const { return loop_; }
-    const std::string& name() const { return name_; }
-    const InetAddress& localAddress() const { return localAddr_; }
+    EventLoop* getLoop() const { return loop_.load(); } // 连接可能被迁移到别的loop上，别的线程读到的是最新的
+    int64_t id() const { return id_; }
+    const std::string& name() const;          // 第一次调用时才拼出来
+    const InetAddress& localAddress() const;  // 第一次调用时才getsockname
     const InetAddress& peerAddress() const { return peerAddr_; }
 
+    // 连接登记在哪个ConnectionRegistry的哪个槽位里，删除的时候O(1)，由ConnectionRegistry维护
+    ConnectionRegistry *registry() const { return registry_; }
+    int registrySlot() const { return registrySlot_; }
+    void setRegistry(ConnectionRegistry *registry, int slot) { registry_ = registry; registrySlot_ = slot; }
+
     bool connected() const { return state_ == kConnected; }
 
+    // 只能在loop线程里访问
+    Buffer *inputBuffer() { return &inputBuffer_; }
+    Buffer *outputBuffer() { return &outputBuffer_; }
+    // 还没写到内核里的字节数：outputBuffer_加上排队的共享payload，水位判断都用它
+    size_t pendingOutputBytes() const { return outputBuffer_.readableBytes() + queuedPayloadBytes_; }
+    const ConnectionCallbacks &callbacks() const { return *callbacks_; } // 当前用的回调，想在原来的回调上再加点东西时用
+
+    // 上层协议挂在连接上的状态（比如HttpServer每个连接的解析器），只能在loop线程里访问
+    void setContext(const std::shared_ptr<void> &context) { context_ = context; }
+    const std::shared_ptr<void> &getContext() const { return context_; }
+
     // 发送数据
     void send(const std::string &buf);
+    // 发送buf里全部可读的数据并清空buf；在loop线程里调用时不拷贝，跨线程时拷贝一份
+    void send(Buffer *buf);
+    // 发送一份共享的、发出去以后不会再改的数据：写不完的部分只在输出队列里留一个引用，不拷进outputBuffer_，
+    // 跨线程也只传引用；所有连接都写完（或者断开）以后payload才释放。线程安全
+    void send(const SharedPayload &payload);
+    // 同一份payload发给一组连接：按连接所属的loop分组，每个loop只投递一个任务，每个连接只多一个引用
+    static void broadcast(const std::vector<TcpConnectionPtr> &conns, const SharedPayload &payload);
     // 关闭连接
     void shutdown();
+    // 不等outputBuffer_里的数据发完，也不等对端，直接关闭连接，线程安全
+    void forceClose();
+
+    // 自动cork：同一轮事件循环里的多次send只追加到outputBuffer_，本轮末尾统一flush一次
+    void setAutoCork(bool on);
+    // 显式cork：uncork之前send只追加不写，uncork时一次性写出去
+    void cork();
+    void uncork();
+
+    // 暂停/恢复从socket读数据，暂停期间对端的数据留在内核的接收缓冲区里，靠tcp自己的流控限速
+    void startRead();
+    void stopRead();
+    bool isReading() const { return reading_; }
+
+    // 自动背压：outputBuffer_待发送数据超过highWaterMark时停止读，降到lowWaterMark以下再恢复
+    // 默认停的是自己的读，linkBackpressure以后停的是peer的读（比如代理里下游写不动就别再读上游）
+    // 水位和peer都是loop线程里的状态，在别的线程调用会转到连接所在的loop里去设置
+    void setBackpressure(size_t highWaterMark, size_t lowWaterMark);
+    void linkBackpressure(const TcpConnectionPtr &peer);
+
+    // 令牌桶限速，单位字节/秒，0表示不限速；在连接建立之前或者loop线程里调用
+    // 令牌用完以后暂停读（关掉EPOLLIN），写的数据留在outputBuffer_里，等定时器补充令牌后再继续
+    void setRateLimit(int64_t sendBytesPerSecond, int64_t recvBytesPerSecond);
+    // 和其他连接共享的令牌桶（TcpServer的总限速），由桶的所有者负责补充令牌
+    void setSharedRateLimit(const std::shared_ptr<TokenBucket> &sendBucket,
+                            const std::shared_ptr<TokenBucket> &recvBucket);
 
+    // 单独给这个连接设置socket选项，覆盖TcpServer统一设置的那一套，线程安全
+    void setSocketOptions(const SocketOptions &options);
+    void setTcpNoDelay(bool on);
+
+    // 每轮事件循环里最多读maxBytes字节、回调maxMessages次onMessage，0表示不限制
+    // 开启以后每次可读事件会一直读到EAGAIN（ET模式下也能排空）或者预算用完，用完了就留到下一轮接着读
+    void setReadBudget(size_t maxBytes, int maxMessages);
+
+    // 单独修改某个连接的回调时，先把共享的回调表拷贝一份（写时复制），不影响其他连接
     void setConnectionCallback(const ConnectionCallback& cb)
-    { connectionCallback_ = cb; }
+    { mutableCallbacks().connectionCallback = cb; }
 
     void setMessageCallback(const MessageCallback& cb)
-    { messageCallback_ = cb; }
+    { mutableCallbacks().messageCallback = cb; }
 
     void setWriteCompleteCallback(const WriteCompleteCallback& cb)
-    { writeCompleteCallback_ = cb; }
+    { mutableCallbacks().writeCompleteCallback = cb; }
 
     void setHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t highWaterMark)
-    { highWaterMarkCallback_ = cb; highWaterMark_ = highWaterMark; }
+    { mutableCallbacks().highWaterMarkCallback = cb; highWaterMark_ = highWaterMark; }
 
     void setCloseCallback(const CloseCallback& cb)
-    { closeCallback_ = cb; }
+    { mutableCallbacks().closeCallback = cb; }
+
+    // 把连接迁移到target这个loop上，线程安全
+    // 源loop把channel从自己的poller里摘下来，连同缓冲区和各种状态一起交给target，target再注册到自己的poller上；
+    // 迁移过程中别的线程调用的send等操作按调用顺序留到target上执行，不丢数据也不乱序。
+    // 迁移之前已经排队的writeComplete之类的用户回调可能还在源loop里执行。
+    // 连接会从源loop的连接表里删掉，targetRegistry不为空时迁移完成后登记到它里面（TcpServer用，要事先expect()，
+    // 迁移取消时由这里cancelExpected()）
+    void migrateTo(EventLoop *target, ConnectionRegistry *targetRegistry = nullptr);
+    bool migrating() const { return migrating_; }
+
+    // 在连接当前所属的loop里执行cb，线程安全；迁移过程中先攒起来，迁移完成后在目标loop里按顺序执行。
+    // 连接随时可能迁走，别的线程要访问只属于loop线程的状态时用它，不要自己getLoop()->runInLoop；cb里要自己持有连接
+    void runInOwnerLoop(std::function<void()> cb);
+
+    // 上一次调用以来收发的字节数，只能在loop线程中调用，rebalancer用它挑出最忙的连接
+    uint64_t takeRecentTraffic();
+
+    // 把耗CPU的job放到计算线程池里执行，做完以后在连接所属的loop里调用done(conn, job的返回值)，线程安全
+    // 同一个连接的done严格按照offload的调用顺序执行，后提交的job先做完也要等前面的，回给对端的响应不会乱序；
+    // 连接断开了done照样会被调用，需要的话自己用connected()判断
+    template <typename Job, typename Done>
+    void offload(WorkStealingPool *pool, Job job, Done done)
+    {
+        using Result = decltype(job());
+        std::shared_ptr<Result> result = std::make_shared<Result>();
+        TcpConnectionPtr self(shared_from_this());
+        offloadTask(pool,
+                    [job, result]() mutable { *result = job(); },
+                    [done, result, self]() mutable { done(self, *result); });
+    }
+    // 不带返回值的版本，job在计算线程池里执行，done在loop里按顺序执行
+    void offloadTask(WorkStealingPool *pool, std::function<void()> job, std::function<void()> done);
 
     // 连接建立
     void connectEstablished();
@@ -64,33 +168,134 @@ private:
     enum StateE {kDisconnected, kConnecting, kConnected, kDisconnecting};
     void setState(StateE state) { state_ = state; }
 
+    ConnectionCallbacks &mutableCallbacks();
+
     void handleRead(Timestamp receiveTime);
+    void handleBudgetedRead(Timestamp receiveTime);
+    void setSocketOptionsInLoop(const SocketOptions &options);
     void handleWrite();
     void handleClose();
     void handleError();
 
+    void migrateInLoop(EventLoop *target, ConnectionRegistry *targetRegistry);
+    void handoffInLoop(EventLoop *target, ConnectionRegistry *targetRegistry); // 源loop：摘下channel，切换loop_
+    void attachInLoop(ConnectionRegistry *targetRegistry, bool writing);       // 目标loop：重新注册channel
+    void runMigrationQueue(); // 结束迁移，执行迁移期间攒下来的操作
+    void deliverOffload(uint64_t seq, const std::function<void()> &done); // 按序号依次执行offload的done
+
     void sendInLoop(const void* message, size_t len);
+    void sendPayloadInLoop(const SharedPayload &payload);
+    size_t writeDirectly(const void *data, size_t len, bool *faultError); // 没有待发送的数据时直接write
+    void outputQueued(size_t oldLen, bool deferred);    // 有数据排进了输出队列：高水位、背压、安排写
+    ssize_t writeOutput(size_t maxBytes, int *savedErrno); // outputBuffer_和排队的payload按顺序一次writev
+    void consumeOutput(size_t n);                          // 去掉已经写出去的n个字节
     void shutdownInLoop();
+    void forceCloseInLoop();
+    void setAutoCorkInLoop(bool on);
+    void corkInLoop();
+    void uncorkInLoop();
+    void scheduleFlush(); // 把当前连接挂到本轮事件循环末尾的flush队列里
+    void flushOutput();   // 把outputBuffer_里攒下来的数据一次写出去
+
+    // 暂停读的原因，按位记录，只有用户想读并且没有任何暂停原因时才向poller注册读事件
+    enum ReadPauseReason
+    {
+        kPauseBackpressure = 1 << 0,
+        kPauseRateLimit = 1 << 1,
+    };
+    void startReadInLoop();
+    void stopReadInLoop();
+    void setBackpressureInLoop(size_t highWaterMark, size_t lowWaterMark);
+    void linkBackpressureInLoop(const TcpConnectionPtr &peer);
+    void pauseRead(int reason);  // 线程安全，可以由别的loop里的连接调用
+    void resumeRead(int reason);
+    void pauseReadInLoop(int reason);
+    void resumeReadInLoop(int reason);
+    void updateReading();
+    void checkBackpressure();    // outputBuffer_变化以后检查一下是否越过了高/低水位
+    void releaseBackpressure();  // 连接断开时把暂停的读恢复掉，否则peer会一直停着
 
-    EventLoop *loop_; // 这里绝对不是baseLoop， 因为TcpConnection都是在subLoop里面管理的
-    const std::string name_;
+    bool rateLimited() const { return sendBucket_ || recvBucket_ || sharedSendBucket_ || sharedRecvBucket_; }
+    size_t sendQuota(size_t len) const; // 令牌桶允许本次发送的字节数
+    void chargeSend(size_t n);
+    void chargeRecv(size_t n);          // 扣掉读到的字节，令牌用完了就暂停读
+    void throttleWrite();               // 发送令牌用完了，先不关注EPOLLOUT，等补充令牌
+    void linkRateHook();                // 挂到所在loop的补令牌链表上
+    void unlinkRateHook();
+    void onRateTick();                  // 定时补充令牌，恢复被暂停的读写
+
+    std::atomic<EventLoop *> loop_; // 这里绝对不是baseLoop， 因为TcpConnection都是在subLoop里面管理的；迁移时会被换掉
+    const int64_t id_;
+    std::shared_ptr<const std::string> namePrefix_;
+    mutable std::string name_;      // 用到的时候才拼出来
+    mutable std::once_flag nameOnce_;
+    ConnectionRegistry *registry_;
+    int registrySlot_;
     std::atomic_int state_;
-    bool reading_;
+    bool reading_;   // 用户是否想读，由startRead/stopRead控制
+    int readPauses_; // 暂停读的原因，见ReadPauseReason
 
     // 这里和Acceptor类似   Acceptor=》mainLoop    TcpConenction=》subLoop
-    std::unique_ptr<Socket> socket_;
-    std::unique_ptr<Channel> channel_;
+    // 直接嵌在TcpConnection里，不用再单独new
+    Socket socket_;
+    Channel channel_;
 
-    const InetAddress localAddr_;
+    mutable InetAddress localAddr_;       // 用到的时候才getsockname
+    mutable std::once_flag localAddrOnce_;
     const InetAddress peerAddr_;
 
-    ConnectionCallback connectionCallback_; // 有新连接时的回调
-    MessageCallback messageCallback_; // 有读写消息时的回调
-    WriteCompleteCallback writeCompleteCallback_; // 消息发送完成以后的回调
-    HighWaterMarkCallback highWaterMarkCallback_;
-    CloseCallback closeCallback_;
+    ConnectionCallbacksPtr callbacks_; // 回调表，默认和同一个TcpServer的其他连接共享
+    bool ownCallbacks_;                // callbacks_是不是自己独占的那一份
     size_t highWaterMark_;
 
+    bool autoCork_;     // 是否开启了自动cork
+    bool corked_;       // 是否被显式cork住了
+    bool flushQueued_;  // 本轮是否已经挂到loop的flush队列里了，保证每轮只flush一次
+
+    size_t backpressureHigh_; // 0表示没开自动背压
+    size_t backpressureLow_;
+    bool backpressureActive_;                     // 当前是否因为背压暂停了读
+    std::weak_ptr<TcpConnection> backpressurePeer_; // 背压要暂停谁的读，为空就是自己
+
+    std::unique_ptr<TokenBucket> sendBucket_;       // 本连接自己的限速
+    std::unique_ptr<TokenBucket> recvBucket_;
+    std::shared_ptr<TokenBucket> sharedSendBucket_; // 和其他连接共享的限速
+    std::shared_ptr<TokenBucket> sharedRecvBucket_;
+    bool writeThrottled_; // 发送令牌用完了，写被推迟到下一次补充令牌
+    RefillHook rateHook_; // 挂在所在loop的补令牌链表上，由loop唯一的定时器驱动
+
+    size_t notSentLowat_; // 设置了TCP_NOTSENT_LOWAT时，每次最多往内核写这么多，剩下的留在outputBuffer_里
+
+    // 迁移相关，migrating_只由连接所属的loop线程修改；migrationQueue_由mutex保护
+    std::atomic_bool migrating_;
+    std::mutex migrateMutex_;
+    std::vector<std::function<void()>> migrationQueue_; // 迁移期间攒下来的跨线程操作
+    uint64_t trafficBytes_; // 收发的总字节数
+    uint64_t trafficMark_;  // 上一次takeRecentTraffic时的trafficBytes_
+
+    std::atomic<uint64_t> offloadSeq_;  // 下一个offload的序号
+    uint64_t offloadNext_;              // 下一个该执行done的序号，只在loop线程中访问
+    std::map<uint64_t, std::function<void()>> offloadDone_; // 提前做完、在等前面的done
+
+    size_t readBudgetBytes_;      // 每轮最多读的字节数
+    int readBudgetMessages_;      // 每轮最多回调onMessage的次数
+    uint64_t budgetIteration_;    // 下面两个计数属于第几轮事件循环
+    size_t bytesThisIteration_;
+    int messagesThisIteration_;
+
     Buffer inputBuffer_;  // 接收数据的缓冲区
     Buffer outputBuffer_; // 发送数据的缓冲区
+
+    // 排队的共享payload，和outputBuffer_里的数据按发送顺序交错：
+    // gap是排在它前面、还在outputBuffer_里的字节数，所有gap之外的outputBuffer_数据排在最后一个payload后面
+    struct QueuedPayload
+    {
+        SharedPayload data;
+        size_t offset; // 已经写出去的字节数
+        size_t gap;
+    };
+    std::deque<QueuedPayload> payloadQueue_;
+    size_t queuedPayloadBytes_; // payloadQueue_里还没写的字节数
+    size_t queuedGapBytes_;     // 所有gap之和
+    std::shared_ptr<void> context_; // 上层协议的状态
 };
\ No newline at end of file
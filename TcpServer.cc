@@ -1,9 +1,12 @@
 #include "TcpServer.h"
 #include "Logger.h"
 #include "TcpConnection.h"
+#include "TokenBucket.h"
+#include "Timer.h"
 
 #include <strings.h>
 #include <functional>
+#include <future>
 
 static EventLoop *CheckLoopNotNull(EventLoop *loop)
 {
@@ -23,7 +26,20 @@ TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr, const std::
       connectionCallback_(),                                           // ！这个为啥要在初始化列表出现？我觉得没有意义，并且没传入参数，不知道为啥还能正常运行
       messageCallback_(),                                              // ！这个为啥要在初始化列表出现？我觉得没有意义(2023-10-23，确实没意义，只是用来检测一下的其实，可以问GPT)
       nextConnId_(1),                                                  // 下一个连接的编号就要从1开始算了
-      started_(0)                                                      // 建立TcpServer时还没启动，还需要后续调用start()
+      namePrefix_(std::make_shared<std::string>(nameArg + "-" + ipPort_)), // 所有连接共享一个名字前缀
+      started_(0),                                                     // 建立TcpServer时还没启动，还需要后续调用start()
+      connSendRate_(0),                                                // 默认不限速
+      connRecvRate_(0),
+      readBudgetBytes_(0),                                             // 默认不限制读预算
+      readBudgetMessages_(0),
+      numConnections_(0),
+      rebalanceInterval_(0),                                           // 默认不开启重新均衡
+      rebalanceImbalance_(0),
+      autoscaleMin_(0),                                                // 默认不开启自动扩缩容
+      autoscaleMax_(0),
+      autoscaleLow_(0),
+      autoscaleHigh_(0),
+      autoscaleInterval_(0)
 {
     // 当有新用户连接时，会执行TcpServer::newConnection回调
     acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this, std::placeholders::_1, std::placeholders::_2));
@@ -31,27 +47,37 @@ TcpServer::TcpServer(EventLoop *loop, const InetAddress &listenAddr, const std::
 
 TcpServer::~TcpServer()
 {
-    for (auto &item : connections_)
+    if (refillTimer_.valid())
     {
-        /**
-         * 先用一个TcpConnectionPtr增加一下item.second（待销毁的TcpConnection对象）的引用计数
-         * 
-         * 然后item.second.reset()，这样待销毁的TcpConnection对象引用计数就剩下刚刚的conn智能指针了，它下一次「赋值」或「出了for循环」就会释放所指向的TcpConnection对象的堆内存了
-         * 
-         * 为什么要先暂存一下而不是直接销毁呢？因为还需要执行一下TcpConnection::connectDestroyed完成善后工作，这样才能正确安全的析构TcpConnection对象
-         */
-        TcpConnectionPtr conn(item.second);
-        item.second.reset();
+        loop_->cancel(refillTimer_);
+    }
+    if (rebalanceTimer_.valid())
+    {
+        loop_->cancel(rebalanceTimer_);
+    }
+    if (autoscaleTimer_.valid())
+    {
+        loop_->cancel(autoscaleTimer_);
+    }
+    if (reapTimer_.valid())
+    {
+        loop_->cancel(reapTimer_);
+    }
 
-        /**
-         * 这条语句的执行路径是怎样的呢？首先 conn->getLoop() 可以获取conn对应的 EventLoop 的指针
-         * 
-         * 进入runInLoop的线程是baseloop，而conn对应的是clientloop，显然两者不是在一个线程中的，所以会执行queueInLoop(cb)
-         * 
-         * 注意执行的是this->queueInLoop哦，所以对应的EventLoop对象会在queueInLoop中执行this->wakeup后被唤醒，这样就达到了线程间通信的目的
-         * 
-         */
-        conn->getLoop()->runInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    // 每张表只能在自己的subloop里访问，所以到每个subloop里去销毁它的连接，等它做完再处理下一个
+    for (auto &item : registries_)
+    {
+        ConnectionRegistry *registry = item.second.get();
+        std::promise<void> done;
+        item.first->runInLoop([registry, &done]()
+                              {
+                                  for (TcpConnectionPtr &conn : registry->takeAll())
+                                  {
+                                      conn->connectDestroyed(); // 完成善后工作，这样才能正确安全的析构TcpConnection对象
+                                  }
+                                  done.set_value();
+                              });
+        done.get_future().wait();
     }
 }
 
@@ -70,6 +96,31 @@ void TcpServer::setThreadNum(int numThreads)
 }
 
 
+void TcpServer::setConnectionRateLimit(int64_t sendBytesPerSecond, int64_t recvBytesPerSecond)
+{
+    connSendRate_ = sendBytesPerSecond;
+    connRecvRate_ = recvBytesPerSecond;
+}
+
+void TcpServer::setRateLimit(int64_t sendBytesPerSecond, int64_t recvBytesPerSecond)
+{
+    sendBucket_.reset(sendBytesPerSecond > 0 ? new TokenBucket(sendBytesPerSecond) : nullptr);
+    recvBucket_.reset(recvBytesPerSecond > 0 ? new TokenBucket(recvBytesPerSecond) : nullptr);
+}
+
+// 总限速的桶被多个subloop里的连接共享，统一由baseloop的定时器来补充令牌
+void TcpServer::refillRateLimit()
+{
+    if (sendBucket_)
+    {
+        sendBucket_->refill();
+    }
+    if (recvBucket_)
+    {
+        recvBucket_->refill();
+    }
+}
+
 /**
  * @brief 启动TcpServer服务。
  * 
@@ -85,65 +136,406 @@ void TcpServer::start()
     if (started_++ == 0) // 防止一个TcpServer对象被start多次
     {
         threadPool_->start(threadInitCallback_); // 启动底层的loop线程池
+        if (sendBucket_ || recvBucket_)
+        {
+            refillTimer_ = loop_->runEvery(TokenBucket::kRefillInterval, std::bind(&TcpServer::refillRateLimit, this));
+        }
+        if (rebalanceInterval_ > 0)
+        {
+            rebalanceTimer_ = loop_->runEvery(rebalanceInterval_, std::bind(&TcpServer::rebalance, this));
+        }
+        if (autoscaleMax_ > 0)
+        {
+            autoscaleTimer_ = loop_->runEvery(autoscaleInterval_, std::bind(&TcpServer::autoscale, this));
+        }
         loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
     }
 }
 
-// 有一个新的客户端的连接，acceptor会执行这个回调操作
+const ConnectionCallbacksPtr &TcpServer::callbackTable()
+{
+    if (!callbackTable_)
+    {
+        std::shared_ptr<ConnectionCallbacks> table = std::make_shared<ConnectionCallbacks>();
+        table->connectionCallback = connectionCallback_;
+        table->messageCallback = messageCallback_;
+        table->writeCompleteCallback = writeCompleteCallback_;
+        // 设置了如何关闭连接的回调   conn->shutDown()
+        table->closeCallback = std::bind(&TcpServer::removeConnection, this, std::placeholders::_1);
+        callbackTable_ = table;
+    }
+    return callbackTable_;
+}
+
+/**
+ * 有一个新的客户端的连接，acceptor会执行这个回调操作
+ *
+ * 这条路径每个连接都要走一遍，所以尽量不做多余的事：
+ * 连接用整数编号，名字用到的时候才拼；本端地址用到的时候才getsockname；
+ * make_shared一次分配出连接对象（Socket和Channel都嵌在里面）；回调共享同一张表，不用逐个拷贝
+ */
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
     // 轮询算法，选择一个subLoop，来管理channel
     EventLoop *ioLoop = threadPool_->getNextLoop();
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;
-    std::string connName = name_ + buf;
+    int64_t connId = nextConnId_++;
 
-    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s \n",
-             name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
-
-    // 通过sockfd获取其绑定的本机的ip地址和端口信息
-    sockaddr_in local;
-    ::bzero(&local, sizeof local);
-    socklen_t addrlen = sizeof local;
-    if (::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
-    {
-        LOG_ERROR("sockets::getLocalAddr");
-    }
-    InetAddress localAddr(local);
+    LOG_DEBUG("TcpServer::newConnection [%s] - new connection #%ld from %s \n",
+              name_.c_str(), connId, peerAddr.toIpPort().c_str());
 
     // 根据连接成功的sockfd，创建TcpConnection连接对象
-    TcpConnectionPtr conn(new TcpConnection(
+    TcpConnectionPtr conn = std::make_shared<TcpConnection>(
         ioLoop,
-        connName,
+        connId,
         sockfd, // Socket Channel
-        localAddr,
-        peerAddr));
-    connections_[connName] = conn;
-    // 下面的回调都是用户设置给TcpServer=>TcpConnection=>Channel=>Poller=>notify channel调用回调
-    conn->setConnectionCallback(connectionCallback_);
-    conn->setMessageCallback(messageCallback_);
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
+        peerAddr,
+        callbackTable(), // 下面的回调都是用户设置给TcpServer=>TcpConnection=>Channel=>Poller=>notify channel调用回调
+        namePrefix_);
+    conn->setSocketOptions(socketOptions_); // 所有的socket选项都在这一个地方统一设置
+    if (connSendRate_ > 0 || connRecvRate_ > 0)
+    {
+        conn->setRateLimit(connSendRate_, connRecvRate_);
+    }
+    if (sendBucket_ || recvBucket_)
+    {
+        conn->setSharedRateLimit(sendBucket_, recvBucket_);
+    }
+    if (readBudgetBytes_ > 0 || readBudgetMessages_ > 0)
+    {
+        conn->setReadBudget(readBudgetBytes_, readBudgetMessages_);
+    }
 
-    // 设置了如何关闭连接的回调   conn->shutDown()
-    conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
+    // 在subloop里登记到它自己的连接表，再调用TcpConnection::connectEstablished
+    ConnectionRegistry *registry = registryFor(ioLoop);
+    registry->expect();
+    ioLoop->runInLoop([registry, conn]()
+                      {
+                          registry->add(conn);
+                          conn->connectEstablished();
+                      });
+}
 
-    // 直接调用TcpConnection::connectEstablished
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+ConnectionRegistry *TcpServer::registryFor(EventLoop *ioLoop)
+{
+    std::unique_ptr<ConnectionRegistry> &registry = registries_[ioLoop];
+    if (!registry)
+    {
+        registry.reset(new ConnectionRegistry(&numConnections_));
+    }
+    return registry.get();
 }
 
+/**
+ * 连接关闭时在它自己的subloop里被调用（TcpConnection::handleClose）
+ *
+ * 以前要先runInLoop到baseloop里从connections_删掉，再queueInLoop回subloop执行connectDestroyed，
+ * 每关一个连接就要两次跨线程唤醒，并且全都挤在baseloop一个线程里；现在连接表是每个subloop自己的，就地删除
+ */
 void TcpServer::removeConnection(const TcpConnectionPtr &conn)
 {
-    loop_->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+    LOG_DEBUG("TcpServer::removeConnection [%s] - connection #%ld\n",
+              name_.c_str(), conn->id());
+
+    if (conn->registry())
+    {
+        conn->registry()->remove(conn);
+    }
+    // 放到本轮的回调里执行，handleClose还没返回，channel还在用
+    conn->getLoop()->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+}
+
+
+void TcpServer::migrateConnection(const TcpConnectionPtr &conn, EventLoop *target)
+{
+    // 目标loop的连接表要在baseloop里查
+    loop_->runInLoop([this, conn, target]()
+                     {
+                         ConnectionRegistry *registry = registryFor(target);
+                         registry->expect();
+                         conn->migrateTo(target, registry);
+                     });
+}
+
+void TcpServer::enableRebalance(double interval, double imbalance)
+{
+    rebalanceInterval_ = interval;
+    rebalanceImbalance_ = imbalance;
+}
+
+/**
+ * 连接在accept的时候就固定分给了某个subloop，长连接的负载不均匀时，可能一个subloop一直100%，别的却闲着
+ *
+ * 用两次采样之间各个subloop的忙碌时间算出利用率，差距够大就从最忙的loop迁走一个连接。
+ * 每次只迁一个，连接在最忙的loop里挑（连接表只能在那里访问）：按上次采样以来收发的字节数估算每个连接的负载，
+ * 挑迁走以后两个loop最平均的那个
+ */
+void TcpServer::rebalance()
+{
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    std::vector<double> utils;
+    if (!sampleUtilization(loops, &rebalanceSampler_, &utils) || loops.size() < 2)
+    {
+        return; // 只有一个loop，没有可以迁的地方
+    }
+
+    EventLoop *busiest = nullptr;
+    EventLoop *idlest = nullptr;
+    double maxUtil = -1;
+    double minUtil = 2;
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+        if (utils[i] > maxUtil)
+        {
+            maxUtil = utils[i];
+            busiest = loops[i];
+        }
+        if (utils[i] < minUtil)
+        {
+            minUtil = utils[i];
+            idlest = loops[i];
+        }
+    }
+    if (busiest == idlest || maxUtil - minUtil < rebalanceImbalance_)
+    {
+        return;
+    }
+
+    auto it = registries_.find(busiest);
+    if (it == registries_.end() || it->second->size() < 2)
+    {
+        return; // 只有一个连接，迁走了也只是把热点换个地方
+    }
+    ConnectionRegistry *from = it->second.get();
+    // 在baseloop里先expect()占住目标：回调在busiest里执行之前，reapRetiredLoops看到idle就可能把目标的表和loop都删掉
+    ConnectionRegistry *to = registryFor(idlest);
+    to->expect();
+    double busyUtil = maxUtil;
+    double gap = maxUtil - minUtil;
+
+    busiest->queueInLoop([this, from, to, idlest, busyUtil, gap]()
+                         {
+                             // 按流量占比估算每个连接占了多少利用率，迁走x以后两边分别是busy-x和idle+x，
+                             // x越接近gap/2两边越平均；x超过gap的话只是把热点换了个地方，不迁
+                             std::vector<std::pair<TcpConnectionPtr, uint64_t>> traffic;
+                             uint64_t total = 0;
+                             from->forEach([&](const TcpConnectionPtr &conn)
+                                           {
+                                               uint64_t recent = conn->takeRecentTraffic();
+                                               total += recent;
+                                               traffic.emplace_back(conn, recent);
+                                           });
+                             if (total == 0)
+                             {
+                                 to->cancelExpected();
+                                 return;
+                             }
+                             TcpConnectionPtr best;
+                             double bestDistance = gap / 2;
+                             for (const auto &item : traffic)
+                             {
+                                 double load = busyUtil * item.second / total;
+                                 double distance = load > gap / 2 ? load - gap / 2 : gap / 2 - load;
+                                 if (load > 0 && load < gap && distance < bestDistance && !item.first->migrating())
+                                 {
+                                     bestDistance = distance;
+                                     best = item.first;
+                                 }
+                             }
+                             if (!best)
+                             {
+                                 to->cancelExpected();
+                                 return;
+                             }
+                             LOG_INFO("TcpServer::rebalance [%s] - migrate connection #%ld to loop %p\n",
+                                      name_.c_str(), best->id(), idlest);
+                             best->migrateTo(idlest, to);
+                         });
+}
+
+bool TcpServer::sampleUtilization(const std::vector<EventLoop *> &loops, UtilizationSampler *sampler, std::vector<double> *utils)
+{
+    int64_t now = Timer::now();
+    int64_t elapsed = now - sampler->lastTime;
+    bool firstSample = sampler->lastTime == 0;
+    sampler->lastTime = now;
+
+    std::unordered_map<EventLoop *, int64_t> busyTimes;
+    utils->clear();
+    for (EventLoop *loop : loops)
+    {
+        int64_t busy = loop->busyTime();
+        auto it = sampler->lastBusy.find(loop);
+        double util = 0;
+        if (it != sampler->lastBusy.end() && elapsed > 0)
+        {
+            util = static_cast<double>(busy - it->second) / elapsed;
+        }
+        utils->push_back(util);
+        busyTimes[loop] = busy;
+    }
+    sampler->lastBusy.swap(busyTimes); // 已经退出的loop顺便就清掉了
+    return !firstSample;
+}
+
+void TcpServer::addLoop()
+{
+    loop_->runInLoop([this]()
+                     {
+                         EventLoop *ioLoop = threadPool_->addLoop();
+                         LOG_INFO("TcpServer::addLoop [%s] - loop %p\n", name_.c_str(), ioLoop);
+                     });
+}
+
+void TcpServer::retireLoop(EventLoop *loop, RetireMode mode)
+{
+    loop_->runInLoop(std::bind(&TcpServer::retireLoopInLoop, this, loop, mode));
+}
+
+void TcpServer::retireLoopInLoop(EventLoop *loop, RetireMode mode)
+{
+    if (loop == nullptr) // 挑连接最少的，迁移或者等待的代价最小
+    {
+        size_t fewest = static_cast<size_t>(-1);
+        for (EventLoop *candidate : threadPool_->getAllLoops())
+        {
+            auto it = registries_.find(candidate);
+            size_t size = it == registries_.end() ? 0 : it->second->size();
+            if (candidate != loop_ && size < fewest)
+            {
+                fewest = size;
+                loop = candidate;
+            }
+        }
+    }
+    if (loop == nullptr || !threadPool_->retireLoop(loop))
+    {
+        return; // baseloop或者不是正在工作的subloop
+    }
+
+    LOG_INFO("TcpServer::retireLoop [%s] - loop %p\n", name_.c_str(), loop);
+    retiring_[loop] = mode;
+    if (mode == kMigrateConnections)
+    {
+        migrateAll(loop);
+    }
+    if (!reapTimer_.valid())
+    {
+        reapTimer_ = loop_->runEvery(0.1, std::bind(&TcpServer::reapRetiredLoops, this));
+    }
 }
 
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
+void TcpServer::migrateAll(EventLoop *from)
 {
-    LOG_INFO("TcpServer::removeConnectionInLoop [%s] - connection %s\n",
-             name_.c_str(), conn->name().c_str());
+    auto it = registries_.find(from);
+    if (it == registries_.end() || it->second->empty())
+    {
+        return;
+    }
 
-    connections_.erase(conn->name());
-    EventLoop *ioLoop = conn->getLoop();
-    ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
-}
\ No newline at end of file
+    // 目标loop和它们的连接表要在baseloop里准备好，连接表只能在from里遍历。
+    // 按现在的连接数轮流给目标expect()占位，否则回调执行之前目标可能被reapRetiredLoops当成idle删掉；
+    // 回调里用不完的（连接先断了）再cancelExpected()，这期间新来的连接留给下一次reapRetiredLoops再迁
+    std::vector<EventLoop *> targets = threadPool_->getAllLoops();
+    std::vector<ConnectionRegistry *> registries;
+    for (EventLoop *target : targets)
+    {
+        registries.push_back(registryFor(target));
+    }
+    size_t reserved = it->second->size();
+    for (size_t i = 0; i < reserved; ++i)
+    {
+        registries[i % registries.size()]->expect();
+    }
+    ConnectionRegistry *registry = it->second.get();
+    from->queueInLoop([registry, targets, registries, reserved]()
+                      {
+                          size_t used = 0;
+                          registry->forEach([&](const TcpConnectionPtr &conn)
+                                            {
+                                                if (used < reserved && !conn->migrating())
+                                                {
+                                                    size_t next = used++ % targets.size();
+                                                    conn->migrateTo(targets[next], registries[next]);
+                                                }
+                                            });
+                          for (; used < reserved; ++used)
+                          {
+                              registries[used % registries.size()]->cancelExpected();
+                          }
+                      });
+}
+
+/**
+ * 连接表里没有连接、也没有正在登记进来的连接（idle），才能让loop的线程退出
+ * 迁移模式下，retire之前已经在路上的新连接到了以后再迁一次
+ */
+void TcpServer::reapRetiredLoops()
+{
+    for (auto it = retiring_.begin(); it != retiring_.end();)
+    {
+        EventLoop *loop = it->first;
+        auto registry = registries_.find(loop);
+        if (registry == registries_.end() || registry->second->idle())
+        {
+            LOG_INFO("TcpServer::reapRetiredLoops [%s] - loop %p exits\n", name_.c_str(), loop);
+            if (registry != registries_.end())
+            {
+                registries_.erase(registry);
+            }
+            threadPool_->removeLoop(loop); // 等线程退出
+            it = retiring_.erase(it);
+            continue;
+        }
+        if (it->second == kMigrateConnections)
+        {
+            migrateAll(loop);
+        }
+        ++it;
+    }
+
+    if (retiring_.empty())
+    {
+        loop_->cancel(reapTimer_);
+        reapTimer_ = TimerId();
+    }
+}
+
+void TcpServer::enableAutoscale(int minLoops, int maxLoops, double low, double high, double interval)
+{
+    autoscaleMin_ = minLoops > 0 ? minLoops : 1;
+    autoscaleMax_ = maxLoops > autoscaleMin_ ? maxLoops : autoscaleMin_;
+    autoscaleLow_ = low;
+    autoscaleHigh_ = high;
+    autoscaleInterval_ = interval;
+}
+
+// 每次最多加或者减一个subloop，新加的loop下一次采样才有数据，不会连着加
+void TcpServer::autoscale()
+{
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    std::vector<double> utils;
+    if (!sampleUtilization(loops, &autoscaleSampler_, &utils))
+    {
+        return;
+    }
+
+    int numLoops = loops.size() == 1 && loops[0] == loop_ ? 0 : static_cast<int>(loops.size());
+    double total = 0;
+    for (double util : utils)
+    {
+        total += util;
+    }
+    double average = numLoops > 0 ? total / numLoops : 1;
+
+    if ((average > autoscaleHigh_ || numLoops < autoscaleMin_) && numLoops < autoscaleMax_)
+    {
+        LOG_INFO("TcpServer::autoscale [%s] - %d loops at %.0f%%, add one\n", name_.c_str(), numLoops, average * 100);
+        threadPool_->addLoop();
+    }
+    else if (average < autoscaleLow_ && numLoops > autoscaleMin_
+             && total / (numLoops - 1) < autoscaleHigh_)
+    {
+        LOG_INFO("TcpServer::autoscale [%s] - %d loops at %.0f%%, retire one\n", name_.c_str(), numLoops, average * 100);
+        retireLoopInLoop(nullptr, kMigrateConnections);
+    }
+}
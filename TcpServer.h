@@ -11,6 +11,9 @@
 #include "Callbacks.h"
 #include "TcpConnection.h"
 #include "Buffer.h"
+#include "TimerId.h"
+#include "ConnectionRegistry.h"
+#include "SocketOptions.h"
 
 #include <functional>
 #include <string>
@@ -18,6 +21,8 @@
 #include <atomic>
 #include <unordered_map>
 
+class TokenBucket;
+
 // 对外的服务器编程使用的类
 class TcpServer : noncopyable
 {
@@ -37,16 +42,66 @@ public:
     ~TcpServer();
 
     void setThreadInitcallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
-    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
-    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
-    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+    // 回调改了以后，之后的新连接会用一张新的回调表，已经建立的连接不受影响
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; callbackTable_.reset(); }
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; callbackTable_.reset(); }
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; callbackTable_.reset(); }
     void setThreadNum(int numThreads); // 设置底层subloop的个数
+
+    // 限速，单位字节/秒，0表示不限速，要在start()之前设置
+    void setConnectionRateLimit(int64_t sendBytesPerSecond, int64_t recvBytesPerSecond); // 每个连接各自的限速
+    void setRateLimit(int64_t sendBytesPerSecond, int64_t recvBytesPerSecond);           // 所有连接加起来的总限速
+    // 每个accept上来的连接都会设置的socket选项，默认只打开keepalive
+    void setSocketOptions(const SocketOptions &options) { socketOptions_ = options; }
+
+    // 每个连接每轮事件循环的读预算，见TcpConnection::setReadBudget
+    void setReadBudget(size_t maxBytes, int maxMessages) { readBudgetBytes_ = maxBytes; readBudgetMessages_ = maxMessages; }
+
     void start();                      // 开启服务器监听进程
 
+    int numConnections() const { return numConnections_; } // 所有subloop上的连接总数，任意线程都可以读
+
+    // 把连接迁移到另一个subloop上，线程安全，见TcpConnection::migrateTo
+    void migrateConnection(const TcpConnectionPtr &conn, EventLoop *target);
+    // 后台重新均衡：每隔interval秒采样一次各个subloop的忙碌时间，最忙和最闲的loop利用率相差超过imbalance（0~1）时，
+    // 从最忙的loop上挑一个连接迁到最闲的loop上（按流量估算负载，挑迁完以后最平均的那个）；要在start()之前设置
+    void enableRebalance(double interval, double imbalance = 0.3);
+
+    enum RetireMode
+    {
+        kDrainConnections,   // 等现有的连接自己断开
+        kMigrateConnections, // 把现有的连接迁到其他subloop上
+    };
+    // 运行时增减subloop，要在start()之后调用，线程安全（都转到baseloop里执行）
+    void addLoop();
+    // retire以后不再给它分配新连接，上面的连接都走了以后线程退出；loop为空时挑连接最少的那个
+    void retireLoop(EventLoop *loop = nullptr, RetireMode mode = kMigrateConnections);
+    // 按subloop的平均利用率自动扩缩容，每隔interval秒检查一次：高于high就加一个subloop；
+    // 低于low，并且去掉一个以后估计也不会超过high，就退掉连接最少的那个（连接迁走）。
+    // subloop的个数保持在[minLoops, maxLoops]之间；要在start()之前设置
+    void enableAutoscale(int minLoops, int maxLoops, double low = 0.2, double high = 0.8, double interval = 1.0);
+
 private:
     void newConnection(int sockfd, const InetAddress &peerAddr);
     void removeConnection(const TcpConnectionPtr &conn);
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    ConnectionRegistry *registryFor(EventLoop *ioLoop); // 只在baseloop里调用
+    void refillRateLimit(); // 定时给总限速的令牌桶补充令牌
+    void rebalance();       // 定时检查各个subloop的负载，在baseloop里执行
+    void autoscale();       // 定时按利用率增减subloop，在baseloop里执行
+    void retireLoopInLoop(EventLoop *loop, RetireMode mode);
+    void migrateAll(EventLoop *from); // 把from上的连接分散迁到正在工作的loop上
+    void reapRetiredLoops();          // 定时检查retire掉的loop，连接都走了就退出它的线程
+
+    // 两次采样之间每个loop的忙碌时间占比
+    struct UtilizationSampler
+    {
+        UtilizationSampler() : lastTime(0) {}
+        int64_t lastTime;                                 // 上一次采样的时间，单调时钟微秒
+        std::unordered_map<EventLoop *, int64_t> lastBusy; // 上一次采样时每个loop的忙碌时间
+    };
+    // 第一次采样（或者loop是新加的）没有可比的数据，返回false / 利用率记为0
+    bool sampleUtilization(const std::vector<EventLoop *> &loops, UtilizationSampler *sampler, std::vector<double> *utils);
+    const ConnectionCallbacksPtr &callbackTable(); // 所有连接共享的回调表，用到的时候才生成
 
     EventLoop *loop_;                                 // 传给TcpServer的EventLoop是baseloop
     const std::string ipPort_;                        // IP地址和端口号（服务器端）
@@ -58,10 +113,43 @@ private:
     MessageCallback messageCallback_;             // 有读写消息时的回调
     WriteCompleteCallback writeCompleteCallback_; // 消息发送完成以后的回调
     ThreadInitCallback threadInitCallback_;       // loop线程初始化的回调（好像没用上，如果我没理解错的话）
+    ConnectionCallbacksPtr callbackTable_;        // 上面几个回调打包成的回调表，所有连接共享同一份
 
     std::atomic_int started_; // TcpServer服务是否启动？注意这是atomic_int
 
-    int nextConnId_;                                                         // 我们会给每个连接进行编号，baseloop占了编号0，所以接下去的新连接会从1开始
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>; // 每一个TcpConnection也有名字，并且我们用一个无序map保存它们
-    ConnectionMap connections_;                                              // 保存所有的连接
+    int64_t connSendRate_; // 每个连接的发送限速
+    int64_t connRecvRate_; // 每个连接的接收限速
+    std::shared_ptr<TokenBucket> sendBucket_; // 所有连接共享的发送令牌桶，由baseloop的定时器补充
+    std::shared_ptr<TokenBucket> recvBucket_; // 所有连接共享的接收令牌桶
+    TimerId refillTimer_;
+
+    SocketOptions socketOptions_; // 统一设置到每个新连接上的socket选项
+
+    size_t readBudgetBytes_; // 每个连接每轮的读预算，0表示不限制
+    int readBudgetMessages_;
+
+    int64_t nextConnId_;                             // 我们会给每个连接进行编号，baseloop占了编号0，所以接下去的新连接会从1开始
+    std::shared_ptr<const std::string> namePrefix_;  // 连接名字的前缀"名字-ip:port"，连接名字是"前缀#编号"
+
+    // 每个subloop一张连接表，连接的登记和销毁都在自己的subloop里完成，不用再绕到baseloop
+    // map本身只在baseloop里访问（新连接时查找），表里的内容只在对应的subloop里访问
+    using RegistryMap = std::unordered_map<EventLoop *, std::unique_ptr<ConnectionRegistry>>;
+    RegistryMap registries_;
+    std::atomic<int> numConnections_; // 所有表加起来的连接数，是唯一和baseloop共享的状态
+
+    double rebalanceInterval_;  // 0表示不开启重新均衡
+    double rebalanceImbalance_;
+    TimerId rebalanceTimer_;
+    UtilizationSampler rebalanceSampler_;
+
+    int autoscaleMin_; // 自动扩缩容时subloop个数的范围，autoscaleMax_为0表示不开启
+    int autoscaleMax_;
+    double autoscaleLow_;
+    double autoscaleHigh_;
+    double autoscaleInterval_;
+    TimerId autoscaleTimer_;
+    UtilizationSampler autoscaleSampler_;
+
+    std::unordered_map<EventLoop *, RetireMode> retiring_; // retire掉还没退出的loop
+    TimerId reapTimer_; // 有loop在retire的时候才开着
 };
\ No newline at end of file
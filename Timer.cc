@@ -0,0 +1,9 @@
+#include "Timer.h"
+#include "Timestamp.h"
+
+std::atomic<int64_t> Timer::numCreated_(0);
+
+int64_t Timer::now()
+{
+    return Timestamp::monotonicNow().microSecondsSinceEpoch();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <functional>
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * @brief 定时器，记录到期时间、回调以及是否重复
+ *
+ * 到期时间用的是单调时钟的微秒数，不受系统改时间的影响
+ */
+class Timer : noncopyable
+{
+public:
+    using TimerCallback = std::function<void()>;
+
+    Timer(TimerCallback cb, int64_t when, int64_t intervalMicroSeconds)
+        : callback_(std::move(cb)),
+          expiration_(when),
+          interval_(intervalMicroSeconds),
+          repeat_(intervalMicroSeconds > 0),
+          sequence_(++numCreated_)
+    {
+    }
+
+    void run() const { callback_(); }
+
+    int64_t expiration() const { return expiration_; }
+    bool repeat() const { return repeat_; }
+    int64_t sequence() const { return sequence_; }
+
+    void restart(int64_t now) { expiration_ = now + interval_; } // 重复定时器到期后重新计算下一次到期时间
+
+    static int64_t now(); // 当前单调时钟的微秒数
+
+private:
+    const TimerCallback callback_; // 定时器到期后执行的回调
+    int64_t expiration_;           // 到期时间（单调时钟，微秒）
+    const int64_t interval_;       // 重复间隔，0表示只执行一次
+    const bool repeat_;            // 是否重复
+    const int64_t sequence_;       // 全局唯一的序号，用来区分地址被复用的Timer对象
+
+    static std::atomic<int64_t> numCreated_;
+};
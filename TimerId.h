@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+class Timer;
+
+// 给用户用来取消定时器的句柄，Timer*加上序号，防止取消了一个地址被复用的新定时器
+class TimerId
+{
+public:
+    TimerId() : timer_(nullptr), sequence_(0) {}
+    TimerId(Timer *timer, int64_t seq) : timer_(timer), sequence_(seq) {}
+
+    bool valid() const { return timer_ != nullptr; }
+
+    friend class TimerQueue;
+
+private:
+    Timer *timer_;
+    int64_t sequence_;
+};
@@ -0,0 +1,173 @@
+#include "TimerQueue.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <algorithm>
+#include <iterator>
+
+static int createTimerfd()
+{
+    // 用单调时钟，系统时间被修改也不影响定时器
+    int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerfd < 0)
+    {
+        LOG_FATAL("timerfd_create error:%d \n", errno);
+    }
+    return timerfd;
+}
+
+// 把timerfd设置成在when（单调时钟微秒数）的时候到期
+static void resetTimerfd(int timerfd, int64_t when)
+{
+    int64_t microseconds = when - Timer::now();
+    if (microseconds < 100) // 已经过期或者马上过期的，也至少等100微秒，不能设置为0，0表示停止定时器
+    {
+        microseconds = 100;
+    }
+
+    struct itimerspec newValue;
+    memset(&newValue, 0, sizeof newValue);
+    newValue.it_value.tv_sec = static_cast<time_t>(microseconds / (1000 * 1000));
+    newValue.it_value.tv_nsec = static_cast<long>((microseconds % (1000 * 1000)) * 1000);
+    if (::timerfd_settime(timerfd, 0, &newValue, nullptr) < 0)
+    {
+        LOG_ERROR("timerfd_settime error:%d \n", errno);
+    }
+}
+
+TimerQueue::TimerQueue(EventLoop *loop)
+    : loop_(loop),
+      timerfd_(createTimerfd()),
+      timerfdChannel_(loop, timerfd_),
+      callingExpiredTimers_(false)
+{
+    timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
+    timerfdChannel_.enableReading();
+}
+
+TimerQueue::~TimerQueue()
+{
+    timerfdChannel_.disableAll();
+    timerfdChannel_.remove();
+    ::close(timerfd_);
+    for (const Entry &timer : timers_)
+    {
+        delete timer.second;
+    }
+}
+
+TimerId TimerQueue::addTimer(Timer::TimerCallback cb, int64_t when, int64_t intervalMicroSeconds)
+{
+    Timer *timer = new Timer(std::move(cb), when, intervalMicroSeconds);
+    loop_->runInLoop(std::bind(&TimerQueue::addTimerInLoop, this, timer));
+    return TimerId(timer, timer->sequence());
+}
+
+void TimerQueue::cancel(TimerId timerId)
+{
+    loop_->runInLoop(std::bind(&TimerQueue::cancelInLoop, this, timerId));
+}
+
+void TimerQueue::addTimerInLoop(Timer *timer)
+{
+    bool earliestChanged = insert(timer);
+    if (earliestChanged) // 新定时器比之前所有的都早，要重新设置timerfd
+    {
+        resetTimerfd(timerfd_, timer->expiration());
+    }
+}
+
+void TimerQueue::cancelInLoop(TimerId timerId)
+{
+    ActiveTimer timer(timerId.timer_, timerId.sequence_);
+    ActiveTimerSet::iterator it = activeTimers_.find(timer);
+    if (it != activeTimers_.end())
+    {
+        timers_.erase(Entry(it->first->expiration(), it->first));
+        delete it->first;
+        activeTimers_.erase(it);
+    }
+    else if (callingExpiredTimers_)
+    {
+        // 定时器正在执行（比如在自己的回调里取消自己），等执行完再处理，不能放回队列
+        cancelingTimers_.insert(timer);
+    }
+}
+
+void TimerQueue::handleRead()
+{
+    int64_t now = Timer::now();
+    uint64_t howmany;
+    ssize_t n = ::read(timerfd_, &howmany, sizeof howmany);
+    if (n != sizeof howmany)
+    {
+        LOG_ERROR("TimerQueue::handleRead() reads %ld bytes instead of 8 \n", n);
+    }
+
+    std::vector<Entry> expired = getExpired(now);
+
+    callingExpiredTimers_ = true;
+    cancelingTimers_.clear();
+    for (const Entry &it : expired)
+    {
+        it.second->run();
+    }
+    callingExpiredTimers_ = false;
+
+    reset(expired, now);
+}
+
+std::vector<TimerQueue::Entry> TimerQueue::getExpired(int64_t now)
+{
+    std::vector<Entry> expired;
+    Entry sentry(now, reinterpret_cast<Timer *>(UINTPTR_MAX));
+    TimerList::iterator end = timers_.lower_bound(sentry); // 第一个还没到期的定时器
+    std::copy(timers_.begin(), end, std::back_inserter(expired));
+    timers_.erase(timers_.begin(), end);
+
+    for (const Entry &it : expired)
+    {
+        activeTimers_.erase(ActiveTimer(it.second, it.second->sequence()));
+    }
+    return expired;
+}
+
+void TimerQueue::reset(const std::vector<Entry> &expired, int64_t now)
+{
+    for (const Entry &it : expired)
+    {
+        ActiveTimer timer(it.second, it.second->sequence());
+        if (it.second->repeat() && cancelingTimers_.find(timer) == cancelingTimers_.end())
+        {
+            it.second->restart(now);
+            insert(it.second);
+        }
+        else
+        {
+            delete it.second; // 一次性的或者已经被取消的定时器，执行完就释放
+        }
+    }
+
+    if (!timers_.empty())
+    {
+        resetTimerfd(timerfd_, timers_.begin()->second->expiration());
+    }
+}
+
+bool TimerQueue::insert(Timer *timer)
+{
+    bool earliestChanged = false;
+    int64_t when = timer->expiration();
+    if (timers_.empty() || when < timers_.begin()->first)
+    {
+        earliestChanged = true;
+    }
+    timers_.insert(Entry(when, timer));
+    activeTimers_.insert(ActiveTimer(timer, timer->sequence()));
+    return earliestChanged;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Channel.h"
+#include "Timer.h"
+#include "TimerId.h"
+
+#include <set>
+#include <vector>
+#include <utility>
+
+class EventLoop;
+
+/**
+ * @brief 定时器队列，用一个timerfd把所有定时器接入到EventLoop里
+ *
+ * timerfd总是设置成最早到期的那个定时器的时间，到期以后timerfd可读，
+ * 和普通的channel一样由poller通知，在handleRead里把到期的定时器都执行掉
+ */
+class TimerQueue : noncopyable
+{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // 线程安全，可以在别的线程里添加/取消定时器
+    TimerId addTimer(Timer::TimerCallback cb, int64_t when, int64_t intervalMicroSeconds);
+    void cancel(TimerId timerId);
+
+private:
+    using Entry = std::pair<int64_t, Timer *>;       // 按到期时间排序，时间相同再按地址
+    using TimerList = std::set<Entry>;
+    using ActiveTimer = std::pair<Timer *, int64_t>; // 按地址+序号查找，用于取消
+    using ActiveTimerSet = std::set<ActiveTimer>;
+
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+    void handleRead(); // timerfd可读，说明有定时器到期了
+
+    std::vector<Entry> getExpired(int64_t now); // 把到期的定时器从timers_里摘出来
+    void reset(const std::vector<Entry> &expired, int64_t now); // 重复的定时器重新放回去
+    bool insert(Timer *timer); // 返回插入的定时器是否成了最早到期的那个
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+
+    TimerList timers_;        // 按到期时间排序的定时器
+    ActiveTimerSet activeTimers_; // 和timers_保存的是同一批定时器
+
+    bool callingExpiredTimers_;     // 是否正在执行到期定时器的回调
+    ActiveTimerSet cancelingTimers_; // 在回调里被取消掉的重复定时器，不能再放回去
+};
@@ -1,6 +1,8 @@
 #include "Timestamp.h"
 
 #include <time.h>
+#include <stdio.h>
+#include <string.h>
 
 Timestamp::Timestamp() : microSecondsSinceEpoch_(0) {}
 
@@ -9,28 +11,77 @@ Timestamp::Timestamp(int64_t microSecondsSinceEpoch)
 {
 }
 
+static int64_t clockMicroSeconds(clockid_t clock)
+{
+    struct timespec ts;
+    ::clock_gettime(clock, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * Timestamp::kMicroSecondsPerSecond + ts.tv_nsec / 1000;
+}
+
 Timestamp Timestamp::now()
 {
-    return Timestamp(time(NULL)); // time(NULL)返回当前时间的秒数
+    return Timestamp(clockMicroSeconds(CLOCK_REALTIME));
+}
+
+Timestamp Timestamp::monotonicNow()
+{
+    return Timestamp(clockMicroSeconds(CLOCK_MONOTONIC));
+}
+
+// 每个线程上一次渲染的秒数和"2023/10/22 12:34:56"这19个字符；
+// 缓冲区按6个int都取最长（各11个字符）再加5个分隔符和结尾的0来留，编译器才不会报截断
+static thread_local time_t t_lastSecond = -1;
+static thread_local char t_secondsText[6 * 11 + 5 + 1];
+
+static const int kSecondsTextLen = 19;
+
+int Timestamp::format(char *buf, size_t len, bool showMicroseconds) const
+{
+    if (len < kFormattedSize)
+    {
+        return 0;
+    }
+    time_t seconds = secondsSinceEpoch();
+    if (seconds != t_lastSecond) // 换了一秒才重新算年月日时分秒
+    {
+        tm tmBuf;
+        localtime_r(&seconds, &tmBuf); // localtime不是线程安全的
+        snprintf(t_secondsText, sizeof t_secondsText, "%4d/%02d/%02d %02d:%02d:%02d",
+                 tmBuf.tm_year + 1900,
+                 tmBuf.tm_mon + 1,
+                 tmBuf.tm_mday,
+                 tmBuf.tm_hour,
+                 tmBuf.tm_min,
+                 tmBuf.tm_sec);
+        t_lastSecond = seconds;
+    }
+    memcpy(buf, t_secondsText, kSecondsTextLen);
+    int n = kSecondsTextLen;
+    if (showMicroseconds)
+    {
+        int micro = static_cast<int>(microSecondsSinceEpoch_ % kMicroSecondsPerSecond);
+        buf[n++] = '.';
+        for (int i = 5; i >= 0; --i) // 固定6位，从后往前填
+        {
+            buf[n + i] = static_cast<char>('0' + micro % 10);
+            micro /= 10;
+        }
+        n += 6;
+    }
+    buf[n] = '\0';
+    return n;
 }
 
 std::string Timestamp::toString() const
 {
-    char buf[128] = {0}; // 用来存储时间的字符串
-    tm *tm_time = localtime(&microSecondsSinceEpoch_); // 将时间戳转换为tm结构体
-    snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d", // 将tm结构体转换为字符串
-             tm_time->tm_year + 1900,
-             tm_time->tm_mon + 1,
-             tm_time->tm_mday,
-             tm_time->tm_hour,
-             tm_time->tm_min,
-             tm_time->tm_sec);
-    return buf;
+    char buf[kFormattedSize];
+    int n = format(buf, sizeof buf, false);
+    return std::string(buf, n);
 }
 
-// #include <iostream>
-// int main()
-// {
-//     std::cout << Timestamp::now().toString() << std::endl;
-//     return 0;
-// }
\ No newline at end of file
+std::string Timestamp::toFormattedString(bool showMicroseconds) const
+{
+    char buf[kFormattedSize];
+    int n = format(buf, sizeof buf, showMicroseconds);
+    return std::string(buf, n);
+}
@@ -2,15 +2,59 @@
 
 #include <iostream>
 #include <string>
+#include <stdint.h>
+#include <time.h>
 
-// 时间类
+// 时间类，微秒精度
+// now()是墙上时间，receiveTime、日志里用的都是它；算耗时请用monotonicNow()，不受改系统时间的影响，
+// 两种时间不能互相比较，monotonicNow()得到的值只有两个相减才有意义
 class Timestamp
 {
 public:
     Timestamp();
     explicit Timestamp(int64_t microSecondsSinceEpoch); // explicit防止隐式转换
-    static Timestamp now();
-    std::string toString() const;
+
+    static Timestamp now();          // clock_gettime(CLOCK_REALTIME)，走vDSO，不进内核
+    static Timestamp monotonicNow(); // clock_gettime(CLOCK_MONOTONIC)，同样走vDSO
+    static Timestamp invalid() { return Timestamp(); }
+
+    int64_t microSecondsSinceEpoch() const { return microSecondsSinceEpoch_; }
+    time_t secondsSinceEpoch() const { return static_cast<time_t>(microSecondsSinceEpoch_ / kMicroSecondsPerSecond); }
+    bool valid() const { return microSecondsSinceEpoch_ > 0; }
+
+    std::string toString() const; // 2023/10/22 12:34:56，精确到秒
+    std::string toFormattedString(bool showMicroseconds = true) const; // 2023/10/22 12:34:56.123456
+
+    // 格式化到buf里，返回写了多少字节（不含结尾的'\0'），buf至少要kFormattedSize个字节
+    // 每个线程缓存上一次渲染的年月日时分秒，同一秒内只重写后面的微秒数字，不调localtime_r也不分配内存
+    int format(char *buf, size_t len, bool showMicroseconds = true) const;
+
+    static const int kMicroSecondsPerSecond = 1000 * 1000;
+    static const size_t kFormattedSize = 32;
+
 private:
     int64_t microSecondsSinceEpoch_; // 时间戳
-};
\ No newline at end of file
+};
+
+inline bool operator<(Timestamp lhs, Timestamp rhs) { return lhs.microSecondsSinceEpoch() < rhs.microSecondsSinceEpoch(); }
+inline bool operator>(Timestamp lhs, Timestamp rhs) { return rhs < lhs; }
+inline bool operator<=(Timestamp lhs, Timestamp rhs) { return !(rhs < lhs); }
+inline bool operator>=(Timestamp lhs, Timestamp rhs) { return !(lhs < rhs); }
+inline bool operator==(Timestamp lhs, Timestamp rhs) { return lhs.microSecondsSinceEpoch() == rhs.microSecondsSinceEpoch(); }
+inline bool operator!=(Timestamp lhs, Timestamp rhs) { return !(lhs == rhs); }
+
+// 两个时间相差多少微秒
+inline int64_t operator-(Timestamp high, Timestamp low) { return high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch(); }
+
+// 两个时间相差多少秒
+inline double timeDifference(Timestamp high, Timestamp low)
+{
+    return static_cast<double>(high - low) / Timestamp::kMicroSecondsPerSecond;
+}
+
+// 在timestamp上加seconds秒
+inline Timestamp addTime(Timestamp timestamp, double seconds)
+{
+    int64_t delta = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
+    return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
+}
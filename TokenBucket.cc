@@ -0,0 +1,29 @@
+#include "TokenBucket.h"
+
+constexpr double TokenBucket::kRefillInterval;
+
+TokenBucket::TokenBucket(int64_t bytesPerSecond, int64_t burstBytes)
+    : bytesPerSecond_(bytesPerSecond),
+      burst_(burstBytes > 0 ? burstBytes : static_cast<int64_t>(bytesPerSecond * kRefillInterval * 10) + 1),
+      refillPerTick_(static_cast<int64_t>(bytesPerSecond * kRefillInterval) + 1),
+      tokens_(burst_)
+{
+}
+
+void TokenBucket::refill()
+{
+    int64_t current = tokens_.load(std::memory_order_relaxed);
+    int64_t next;
+    do
+    {
+        if (current >= burst_)
+        {
+            return; // 桶已经满了
+        }
+        next = current + refillPerTick_;
+        if (next > burst_)
+        {
+            next = burst_;
+        }
+    } while (!tokens_.compare_exchange_weak(current, next, std::memory_order_relaxed));
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * @brief 令牌桶，用来给连接/服务器的收发限速
+ *
+ * 收发路径上只做一次原子减法（consume），允许透支，令牌数变成负的以后暂停读写，
+ * 由loop上的定时器每隔kRefillInterval秒往桶里补一次令牌，不用每个字节都去读时钟
+ *
+ * 桶可以被多个loop里的连接共享（TcpServer的总限速），所以令牌数用的是atomic
+ */
+class TokenBucket : noncopyable
+{
+public:
+    static constexpr double kRefillInterval = 0.01; // 补充令牌的间隔，10ms
+
+    // burstBytes为0时，默认允许突发kRefillInterval*10的流量（即100ms的量）
+    explicit TokenBucket(int64_t bytesPerSecond, int64_t burstBytes = 0);
+
+    int64_t bytesPerSecond() const { return bytesPerSecond_; }
+    int64_t tokens() const { return tokens_.load(std::memory_order_relaxed); }
+    bool exhausted() const { return tokens() <= 0; }
+
+    void consume(int64_t bytes) { tokens_.fetch_sub(bytes, std::memory_order_relaxed); }
+
+    void refill(); // 补充一次令牌，由定时器每隔kRefillInterval调用
+
+private:
+    const int64_t bytesPerSecond_;
+    const int64_t burst_;         // 桶的容量
+    const int64_t refillPerTick_; // 每次补充的令牌数
+    std::atomic<int64_t> tokens_;
+};
+
+/**
+ * @brief 限速连接挂到所在EventLoop上的侵入式链表节点，嵌在连接对象里，挂上、摘下都不分配内存
+ *
+ * 每个loop只有一个补充令牌的定时器，每隔kRefillInterval秒把挂着的节点走一遍，调用refill(owner)，
+ * 见EventLoop::addRefillHook
+ */
+struct RefillHook
+{
+    RefillHook() : prev(nullptr), next(nullptr), linked(false), refill(nullptr), owner(nullptr) {}
+
+    RefillHook *prev;
+    RefillHook *next;
+    bool linked;
+    void (*refill)(void *owner);
+    void *owner;
+};
@@ -0,0 +1,208 @@
+#include "UpstreamPool.h"
+#include "TcpClient.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Buffer.h"
+#include "SocketOptions.h"
+#include "Logger.h"
+
+#include <endian.h>
+#include <string.h>
+#include <algorithm>
+
+static const size_t kHeaderLen = sizeof(uint32_t) + sizeof(uint64_t);
+const size_t UpstreamPool::kMaxFrameSize;
+
+void UpstreamPool::encodeFrame(uint64_t id, const std::string &payload, std::string *frame)
+{
+    uint32_t len = htobe32(static_cast<uint32_t>(sizeof(uint64_t) + payload.size()));
+    uint64_t beId = htobe64(id);
+    frame->reserve(frame->size() + kHeaderLen + payload.size());
+    frame->append(reinterpret_cast<const char *>(&len), sizeof len);
+    frame->append(reinterpret_cast<const char *>(&beId), sizeof beId);
+    frame->append(payload);
+}
+
+UpstreamPool::DecodeResult UpstreamPool::decodeFrame(Buffer *buf, uint64_t *id, std::string *payload)
+{
+    if (buf->readableBytes() < kHeaderLen)
+    {
+        return kNeedMore;
+    }
+    uint32_t len;
+    memcpy(&len, buf->peek(), sizeof len);
+    len = be32toh(len);
+    // 长度连id都放不下，或者大得离谱，再等多少数据也解不出来，不能让inputBuffer一直涨下去
+    if (len < sizeof(uint64_t) || len > kMaxFrameSize)
+    {
+        return kProtocolError;
+    }
+    if (buf->readableBytes() < sizeof len + len)
+    {
+        return kNeedMore;
+    }
+    uint64_t beId;
+    memcpy(&beId, buf->peek() + sizeof len, sizeof beId);
+    *id = be64toh(beId);
+    buf->retrieve(kHeaderLen);
+    *payload = buf->retrieveAsString(len - sizeof(uint64_t));
+    return kComplete;
+}
+
+UpstreamPool::UpstreamPool(EventLoop *loop,
+                           const std::vector<InetAddress> &backends,
+                           int connectionsPerBackend,
+                           const std::string &nameArg)
+    : loop_(loop),
+      name_(nameArg),
+      nextId_(1),
+      outstanding_(0),
+      closing_(false),
+      random_(static_cast<unsigned>(reinterpret_cast<uintptr_t>(loop))) // 每个loop的池子挑的顺序不一样
+{
+    codec_.encode = &UpstreamPool::encodeFrame;
+    codec_.decode = &UpstreamPool::decodeFrame;
+
+    SocketOptions options;
+    options.tcpNoDelay = 1; // 请求都很小，不能被Nagle攒着
+    for (const InetAddress &backend : backends)
+    {
+        for (int i = 0; i < connectionsPerBackend; ++i)
+        {
+            std::unique_ptr<Upstream> upstream(new Upstream);
+            Upstream *raw = upstream.get();
+            upstream->client.reset(new TcpClient(loop, backend, name_));
+            upstream->client->enableRetry();
+            upstream->client->setSocketOptions(options);
+            upstream->client->setConnectionCallback([this, raw](const TcpConnectionPtr &conn)
+                                                    { onConnection(raw, conn); });
+            upstream->client->setMessageCallback([this, raw](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                                 { onMessage(raw, conn, buf); });
+            upstreams_.push_back(std::move(upstream));
+        }
+    }
+}
+
+UpstreamPool::~UpstreamPool()
+{
+    closing_ = true;
+    for (std::unique_ptr<Upstream> &upstream : upstreams_)
+    {
+        failPending(upstream.get());
+        upstream->conn.reset(); // 只剩TcpClient拿着连接，它析构的时候才会直接关掉连接
+    }
+    live_.clear();
+    upstreams_.clear();
+}
+
+void UpstreamPool::start()
+{
+    for (std::unique_ptr<Upstream> &upstream : upstreams_)
+    {
+        upstream->client->connect();
+    }
+}
+
+void UpstreamPool::onConnection(Upstream *upstream, const TcpConnectionPtr &conn)
+{
+    if (closing_)
+    {
+        return;
+    }
+    if (conn->connected())
+    {
+        conn->setAutoCork(true); // 同一轮里发给这条连接的多个请求合成一次write
+        upstream->conn = conn;
+        live_.push_back(upstream);
+    }
+    else if (upstream->conn == conn)
+    {
+        upstream->conn.reset();
+        live_.erase(std::find(live_.begin(), live_.end(), upstream));
+        failPending(upstream);
+    }
+}
+
+void UpstreamPool::onMessage(Upstream *upstream, const TcpConnectionPtr &conn, Buffer *buf)
+{
+    uint64_t id;
+    std::string payload;
+    DecodeResult result;
+    while ((result = codec_.decode(buf, &id, &payload)) == kComplete)
+    {
+        auto it = upstream->pending.find(id);
+        if (it == upstream->pending.end())
+        {
+            LOG_ERROR("UpstreamPool::onMessage [%s] - unknown response id %lu \n", name_.c_str(), id);
+            continue;
+        }
+        ResponseCallback cb(std::move(it->second));
+        upstream->pending.erase(it);
+        --outstanding_;
+        cb(true, payload);
+    }
+    if (result == kProtocolError)
+    {
+        // 流已经错位了，后面的数据都没法信，关掉连接；还在等的请求在onConnection里以失败回调，TcpClient会重连
+        LOG_ERROR("UpstreamPool::onMessage [%s] - malformed frame from %s, closing \n",
+                  name_.c_str(), conn->peerAddress().toIpPort().c_str());
+        buf->retrieveAll();
+        conn->forceClose();
+    }
+}
+
+void UpstreamPool::failPending(Upstream *upstream)
+{
+    std::unordered_map<uint64_t, ResponseCallback> pending;
+    pending.swap(upstream->pending); // 回调里可能又发新的请求
+    outstanding_ -= pending.size();
+    for (auto &item : pending)
+    {
+        item.second(false, std::string());
+    }
+}
+
+UpstreamPool::Upstream *UpstreamPool::pick()
+{
+    size_t n = live_.size();
+    if (n == 0)
+    {
+        return nullptr;
+    }
+    if (n == 1)
+    {
+        return live_[0];
+    }
+    // 随机挑两条不同的连接，选未完成请求少的那条
+    size_t first = random_() % n;
+    size_t second = random_() % (n - 1);
+    if (second >= first)
+    {
+        ++second;
+    }
+    Upstream *a = live_[first];
+    Upstream *b = live_[second];
+    return a->pending.size() <= b->pending.size() ? a : b;
+}
+
+void UpstreamPool::request(const std::string &payload, const ResponseCallback &cb)
+{
+    if (!loop_->isInLoopThread())
+    {
+        loop_->runInLoop([this, payload, cb]() { request(payload, cb); });
+        return;
+    }
+
+    Upstream *upstream = pick();
+    if (upstream == nullptr)
+    {
+        cb(false, std::string());
+        return;
+    }
+    uint64_t id = nextId_++;
+    std::string frame;
+    codec_.encode(id, payload, &frame);
+    upstream->pending[id] = cb;
+    ++outstanding_;
+    upstream->conn->send(frame);
+}
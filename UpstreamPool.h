@@ -0,0 +1,94 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "Callbacks.h"
+
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+class EventLoop;
+class TcpClient;
+class Buffer;
+
+/**
+ * @brief 一个EventLoop自己的上游长连接池，连到若干个后端，每个后端若干条连接
+ *
+ * 请求带一个id流水线地发出去，不用等上一个响应回来；后端按什么顺序回都行，响应按id找回对应的回调。
+ * 每个请求用power-of-two-choices选连接：随机挑两条连着的连接，选未完成请求少的那条，
+ * 比轮询更能避开慢的后端，又不用每次扫一遍所有连接。
+ *
+ * 池子只属于一个loop，所有连接都在这个loop上，选连接、发请求、回调都在loop线程里进行，不加锁也不跨线程。
+ * 一般给TcpServer的每个subloop各建一个，处理入站请求时直接用当前loop的池子
+ */
+class UpstreamPool : noncopyable
+{
+public:
+    // ok为false表示请求没有发出去，或者连接在响应回来之前断开了
+    using ResponseCallback = std::function<void(bool ok, const std::string &response)>;
+
+    enum DecodeResult
+    {
+        kNeedMore,      // 帧还没收全，buf不动
+        kComplete,      // 取出了一个完整的帧
+        kProtocolError, // 帧头不对（长度太短、超过kMaxFrameSize），连接会被关掉
+    };
+
+    // 请求/响应帧的编解码，默认见encodeFrame/decodeFrame
+    struct Codec
+    {
+        std::function<void(uint64_t id, const std::string &payload, std::string *frame)> encode;
+        std::function<DecodeResult(Buffer *buf, uint64_t *id, std::string *payload)> decode;
+    };
+
+    // 默认的帧格式："4字节长度 + 8字节id + 内容"，长度和id都是网络字节序，长度包括id的8个字节
+    // 后端也可以直接用这两个函数解请求、回响应
+    static const size_t kMaxFrameSize = 64 * 1024 * 1024; // 和LengthFieldCodec默认的maxFrameSize一样
+    static void encodeFrame(uint64_t id, const std::string &payload, std::string *frame);
+    static DecodeResult decodeFrame(Buffer *buf, uint64_t *id, std::string *payload);
+
+    UpstreamPool(EventLoop *loop,
+                 const std::vector<InetAddress> &backends,
+                 int connectionsPerBackend,
+                 const std::string &nameArg);
+    ~UpstreamPool(); // 要在loop线程里析构，还没回来的请求以ok=false回调
+
+    void setCodec(const Codec &codec) { codec_ = codec; } // 要在start()之前设置
+    void start(); // 开始连接所有后端，断开的连接会自动重连
+
+    // 只能在loop线程中调用（在别的线程调用会转到loop线程里去）；
+    // 当前没有连着的连接时马上以ok=false回调
+    void request(const std::string &payload, const ResponseCallback &cb);
+
+    EventLoop *getLoop() const { return loop_; }
+    int numConnected() const { return static_cast<int>(live_.size()); } // 只能在loop线程中调用
+    size_t outstanding() const { return outstanding_; }                 // 所有连接上还没回来的请求数，只能在loop线程中调用
+
+private:
+    struct Upstream
+    {
+        std::unique_ptr<TcpClient> client;
+        TcpConnectionPtr conn; // 连着的时候不为空
+        std::unordered_map<uint64_t, ResponseCallback> pending; // 已经发出去、在等响应的请求
+    };
+
+    void onConnection(Upstream *upstream, const TcpConnectionPtr &conn);
+    void onMessage(Upstream *upstream, const TcpConnectionPtr &conn, Buffer *buf);
+    void failPending(Upstream *upstream); // 连接断开了，它上面的请求都以失败回调
+    Upstream *pick();                     // power-of-two-choices
+
+    EventLoop *loop_;
+    const std::string name_;
+    Codec codec_;
+    std::vector<std::unique_ptr<Upstream>> upstreams_;
+    std::vector<Upstream *> live_; // 连着的连接，选连接只在这里面选
+    uint64_t nextId_;
+    size_t outstanding_;
+    bool closing_; // 析构过程中连接断开的回调不再处理
+    std::minstd_rand random_;
+};
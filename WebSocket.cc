@@ -0,0 +1,420 @@
+#include "WebSocket.h"
+#include "Buffer.h"
+
+#include <algorithm>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// 握手只算一次，用不着快，照着FIPS 180-4一个块一个块地算
+static void sha1(const unsigned char *data, size_t len, unsigned char digest[20])
+{
+    uint32_t h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+    // 补位：0x80，若干个0，最后8个字节是比特数，总长度凑成64的倍数
+    size_t total = (len + 8) / 64 * 64 + 64;
+    std::string message(reinterpret_cast<const char *>(data), len);
+    message.resize(total, '\0');
+    message[len] = static_cast<char>(0x80);
+    uint64_t bits = static_cast<uint64_t>(len) * 8;
+    for (int i = 0; i < 8; ++i)
+    {
+        message[total - 1 - i] = static_cast<char>((bits >> (i * 8)) & 0xff);
+    }
+
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(message.data());
+    for (size_t block = 0; block < total; block += 64)
+    {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i)
+        {
+            const unsigned char *q = p + block + i * 4;
+            w[i] = (static_cast<uint32_t>(q[0]) << 24) | (static_cast<uint32_t>(q[1]) << 16) |
+                   (static_cast<uint32_t>(q[2]) << 8) | q[3];
+        }
+        for (int i = 16; i < 80; ++i)
+        {
+            uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = (x << 1) | (x >> 31);
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i)
+        {
+            uint32_t f, k;
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+            uint32_t temp = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = (b << 30) | (b >> 2);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (int i = 0; i < 5; ++i)
+    {
+        digest[i * 4] = static_cast<unsigned char>(h[i] >> 24);
+        digest[i * 4 + 1] = static_cast<unsigned char>(h[i] >> 16);
+        digest[i * 4 + 2] = static_cast<unsigned char>(h[i] >> 8);
+        digest[i * 4 + 3] = static_cast<unsigned char>(h[i]);
+    }
+}
+
+static std::string base64(const unsigned char *data, size_t len)
+{
+    static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string result;
+    result.reserve((len + 2) / 3 * 4);
+    for (size_t i = 0; i < len; i += 3)
+    {
+        uint32_t v = static_cast<uint32_t>(data[i]) << 16;
+        if (i + 1 < len)
+        {
+            v |= static_cast<uint32_t>(data[i + 1]) << 8;
+        }
+        if (i + 2 < len)
+        {
+            v |= data[i + 2];
+        }
+        result += kAlphabet[(v >> 18) & 0x3f];
+        result += kAlphabet[(v >> 12) & 0x3f];
+        result += i + 1 < len ? kAlphabet[(v >> 6) & 0x3f] : '=';
+        result += i + 2 < len ? kAlphabet[v & 0x3f] : '=';
+    }
+    return result;
+}
+
+std::string WebSocket::acceptKey(StringPiece key)
+{
+    static const char kGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    std::string input(key.data(), key.size());
+    input.append(kGuid, sizeof kGuid - 1);
+    unsigned char digest[20];
+    sha1(reinterpret_cast<const unsigned char *>(input.data()), input.size(), digest);
+    return base64(digest, sizeof digest);
+}
+
+void WebSocket::encode(Buffer *buf, Opcode opcode, bool fin)
+{
+    size_t len = buf->readableBytes();
+    char header[kMaxServerHeaderBytes];
+    size_t headerBytes = 2;
+    header[0] = static_cast<char>((fin ? 0x80 : 0) | opcode);
+    if (len < 126)
+    {
+        header[1] = static_cast<char>(len);
+    }
+    else if (len <= 0xffff)
+    {
+        header[1] = 126;
+        header[2] = static_cast<char>(len >> 8);
+        header[3] = static_cast<char>(len & 0xff);
+        headerBytes = 4;
+    }
+    else
+    {
+        header[1] = 127;
+        for (int i = 0; i < 8; ++i)
+        {
+            header[2 + i] = static_cast<char>((static_cast<uint64_t>(len) >> (56 - i * 8)) & 0xff);
+        }
+        headerBytes = 10;
+    }
+
+    if (buf->prependableBytes() >= headerBytes)
+    {
+        buf->prepend(header, headerBytes);
+    }
+    else // 预留区只有8个字节，放不下64位长度的头，重新拼一个；负载至少64K，多拷一次不显眼
+    {
+        Buffer framed(headerBytes + len);
+        framed.append(header, headerBytes);
+        framed.append(buf->peek(), len);
+        std::swap(*buf, framed);
+    }
+}
+
+void WebSocket::encodeClose(Buffer *buf, uint16_t code, StringPiece reason)
+{
+    char payload[2] = {static_cast<char>(code >> 8), static_cast<char>(code & 0xff)};
+    buf->append(payload, 2);
+    buf->append(reason.data(), std::min(reason.size(), kMaxControlPayload - 2));
+    encode(buf, kClose);
+}
+
+// 解掩码：key按字节序铺满一个字，块的起点都是4的倍数，key不用转
+static void unmaskTail(char *data, size_t i, size_t len, const char key[4])
+{
+    for (; i < len; ++i)
+    {
+        data[i] ^= key[i & 3];
+    }
+}
+
+static void unmaskScalar(char *data, size_t len, const char key[4])
+{
+    uint32_t k32;
+    memcpy(&k32, key, 4);
+    uint64_t k64 = (static_cast<uint64_t>(k32) << 32) | k32;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t v;
+        memcpy(&v, data + i, 8);
+        v ^= k64;
+        memcpy(data + i, &v, 8);
+    }
+    unmaskTail(data, i, len, key);
+}
+
+// UTF-8：从p[i]开始检查一个字符，返回它后面的位置，不合法时返回0
+static size_t checkUtf8Sequence(const unsigned char *p, size_t i, size_t len)
+{
+    unsigned char c = p[i];
+    if (c < 0x80)
+    {
+        return i + 1;
+    }
+    size_t trailing;
+    unsigned char lo = 0x80, hi = 0xbf; // 第二个字节的范围，排除过长编码、代理区和超过U+10FFFF的
+    if (c >= 0xc2 && c <= 0xdf)
+    {
+        trailing = 1;
+    }
+    else if (c >= 0xe0 && c <= 0xef)
+    {
+        trailing = 2;
+        if (c == 0xe0)
+        {
+            lo = 0xa0;
+        }
+        else if (c == 0xed)
+        {
+            hi = 0x9f;
+        }
+    }
+    else if (c >= 0xf0 && c <= 0xf4)
+    {
+        trailing = 3;
+        if (c == 0xf0)
+        {
+            lo = 0x90;
+        }
+        else if (c == 0xf4)
+        {
+            hi = 0x8f;
+        }
+    }
+    else
+    {
+        return 0;
+    }
+    if (len - i - 1 < trailing || p[i + 1] < lo || p[i + 1] > hi)
+    {
+        return 0;
+    }
+    for (size_t k = 2; k <= trailing; ++k)
+    {
+        if ((p[i + k] & 0xc0) != 0x80)
+        {
+            return 0;
+        }
+    }
+    return i + 1 + trailing;
+}
+
+// 所有实现共用的走法：整块是ASCII就跳过，不是就把这一块逐个字符查完（最后一个字符可以跨到下一块）
+template <size_t Width, bool (*IsAsciiBlock)(const unsigned char *)>
+static inline __attribute__((always_inline)) bool validUtf8Blocks(const char *data, size_t len)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    size_t i = 0;
+    while (i < len)
+    {
+        if (len - i >= Width && IsAsciiBlock(p + i))
+        {
+            i += Width;
+            continue;
+        }
+        size_t stop = std::min(len, i + Width);
+        while (i < stop)
+        {
+            i = checkUtf8Sequence(p, i, len);
+            if (i == 0)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static inline bool isAscii8(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return (v & 0x8080808080808080ull) == 0;
+}
+
+static bool validUtf8Scalar(const char *data, size_t len)
+{
+    return validUtf8Blocks<8, isAscii8>(data, len);
+}
+
+#if defined(__x86_64__)
+// SSE2是x86-64的基线，不用target
+static void unmaskSse2(char *data, size_t len, const char key[4])
+{
+    uint32_t k32;
+    memcpy(&k32, key, 4);
+    const __m128i k = _mm_set1_epi32(static_cast<int>(k32));
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i *q = reinterpret_cast<__m128i *>(data + i);
+        _mm_storeu_si128(q, _mm_xor_si128(_mm_loadu_si128(q), k));
+    }
+    unmaskTail(data, i, len, key);
+}
+
+static inline bool isAscii16(const unsigned char *p)
+{
+    return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))) == 0;
+}
+
+static bool validUtf8Sse2(const char *data, size_t len)
+{
+    return validUtf8Blocks<16, isAscii16>(data, len);
+}
+
+__attribute__((target("avx2"))) static void unmaskAvx2(char *data, size_t len, const char key[4])
+{
+    uint32_t k32;
+    memcpy(&k32, key, 4);
+    const __m256i k = _mm256_set1_epi32(static_cast<int>(k32));
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) // 一次两个寄存器，load和xor能并行起来
+    {
+        __m256i *q = reinterpret_cast<__m256i *>(data + i);
+        __m256i a = _mm256_xor_si256(_mm256_loadu_si256(q), k);
+        __m256i b = _mm256_xor_si256(_mm256_loadu_si256(q + 1), k);
+        _mm256_storeu_si256(q, a);
+        _mm256_storeu_si256(q + 1, b);
+    }
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i *q = reinterpret_cast<__m256i *>(data + i);
+        _mm256_storeu_si256(q, _mm256_xor_si256(_mm256_loadu_si256(q), k));
+    }
+    unmaskTail(data, i, len, key);
+}
+
+__attribute__((target("avx2"))) static inline bool isAscii32(const unsigned char *p)
+{
+    return _mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p))) == 0;
+}
+
+__attribute__((target("avx2"))) static bool validUtf8Avx2(const char *data, size_t len)
+{
+    return validUtf8Blocks<32, isAscii32>(data, len);
+}
+#endif
+
+struct Implementation
+{
+    const char *name;
+    void (*unmask)(char *, size_t, const char *);
+    bool (*validUtf8)(const char *, size_t);
+};
+
+static bool supported(const char *name)
+{
+#if defined(__x86_64__)
+    if (strcmp(name, "avx2") == 0)
+    {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (strcmp(name, "sse2") == 0)
+    {
+        return true;
+    }
+#endif
+    return strcmp(name, "scalar") == 0;
+}
+
+static const Implementation kImplementations[] = {
+#if defined(__x86_64__)
+    {"avx2", unmaskAvx2, validUtf8Avx2},
+    {"sse2", unmaskSse2, validUtf8Sse2},
+#endif
+    {"scalar", unmaskScalar, validUtf8Scalar},
+};
+
+// 按优先级挑CPU支持的第一个
+static const Implementation *chooseImplementation()
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init(); // 静态初始化的时候就要用，不能指望libgcc的构造函数已经跑过了
+#endif
+    for (const Implementation &impl : kImplementations)
+    {
+        if (supported(impl.name))
+        {
+            return &impl;
+        }
+    }
+    return &kImplementations[sizeof kImplementations / sizeof kImplementations[0] - 1];
+}
+
+static const Implementation *g_implementation = chooseImplementation();
+
+void WebSocket::unmask(char *data, size_t len, const char key[4])
+{
+    g_implementation->unmask(data, len, key);
+}
+
+bool WebSocket::validUtf8(const char *data, size_t len)
+{
+    return g_implementation->validUtf8(data, len);
+}
+
+const char *WebSocket::implementation()
+{
+    return g_implementation->name;
+}
+
+bool WebSocket::setImplementation(const char *name)
+{
+    for (const Implementation &impl : kImplementations)
+    {
+        if (strcmp(impl.name, name) == 0 && supported(name))
+        {
+            g_implementation = &impl;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "StringPiece.h"
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+class Buffer;
+
+/**
+ * @brief WebSocket（RFC 6455）协议本身用到的函数：握手的Sec-WebSocket-Accept、帧头编码、解掩码、UTF-8校验
+ *
+ * 连接管理在WebSocketServer里，这里只有不带状态的计算，压测和以后的客户端也能直接用。
+ *
+ * 解掩码和UTF-8校验按CPU挑实现：avx2（32字节一块），sse2（16字节一块，x86-64都有），scalar（8字节一块）。
+ * 解掩码是把4字节的key铺满一个寄存器，整块异或；UTF-8校验先整块看有没有最高位是1的字节，
+ * 纯ASCII的块直接跳过，碰到非ASCII的块再逐个字符检查（过长编码、代理区、超过U+10FFFF的都不行）
+ */
+class WebSocket
+{
+public:
+    enum Opcode
+    {
+        kContinuation = 0x0,
+        kText = 0x1,
+        kBinary = 0x2,
+        kClose = 0x8,
+        kPing = 0x9,
+        kPong = 0xa,
+    };
+
+    enum CloseCode
+    {
+        kNormalClosure = 1000,
+        kGoingAway = 1001,
+        kProtocolError = 1002,
+        kUnsupportedData = 1003,
+        kNoStatus = 1005, // 只在本地表示对方的关闭帧里没有状态码，不能发出去
+        kInvalidPayload = 1007,
+        kPolicyViolation = 1008,
+        kMessageTooBig = 1009,
+        kInternalError = 1011,
+    };
+
+    // 服务端发的帧不带掩码，头最多10个字节
+    static const size_t kMaxServerHeaderBytes = 10;
+    // 控制帧（close/ping/pong）的负载不能超过125字节
+    static const size_t kMaxControlPayload = 125;
+
+    // 握手回复里的Sec-WebSocket-Accept：base64(SHA-1(key + 固定的GUID))
+    static std::string acceptKey(StringPiece key);
+
+    // buf里的可读数据是一个负载，在它前面加上不带掩码的帧头。
+    // 负载小于64K时头不超过4个字节，直接prepend到Buffer的预留区；更大的头有10个字节，要重新拼一次
+    static void encode(Buffer *buf, Opcode opcode, bool fin = true);
+    // 关闭帧的负载：2字节的状态码加原因
+    static void encodeClose(Buffer *buf, uint16_t code, StringPiece reason);
+
+    // 用4字节的key原地解掩码，data的第0个字节对应key[0]
+    static void unmask(char *data, size_t len, const char key[4]);
+    static bool validUtf8(const char *data, size_t len);
+
+    // 当前用的实现："avx2"、"sse2"或"scalar"
+    static const char *implementation();
+    // 压测用：换成指定的实现，CPU不支持或者名字不对时返回false；要在没有线程在收发的时候调用
+    static bool setImplementation(const char *name);
+};
@@ -0,0 +1,476 @@
+#include "WebSocketServer.h"
+#include "HttpContext.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "Logger.h"
+
+#include <string.h>
+
+// 握手用的HttpContext：请求行加头部最多8K，握手请求不该有消息体
+static const size_t kMaxHandshakeBytes = 8 * 1024;
+
+// 每个连接一个，挂在TcpConnection的context上，只在loop线程里访问
+struct WebSocketContext
+{
+    WebSocketContext()
+        : http(new HttpContext(kMaxHandshakeBytes, 0)),
+          closing(false),
+          fragmentOpcode(WebSocket::kContinuation),
+          receivedSincePing(true)
+    {
+    }
+
+    std::unique_ptr<HttpContext> http; // 握手完成以后释放
+    bool closing;                      // 已经发了关闭帧，后面收到的都丢掉
+    WebSocket::Opcode fragmentOpcode;  // 正在拼的分片消息的类型，kContinuation表示没有
+    std::string fragments;
+    bool receivedSincePing;
+    TimerId pingTimer; // 在WebSocketServer的loop（baseloop）上
+};
+
+static WebSocketContext *contextOf(const TcpConnectionPtr &conn)
+{
+    return static_cast<WebSocketContext *>(conn->getContext().get());
+}
+
+// Connection之类的头部的值是逗号分隔的token列表，不区分大小写
+static bool hasToken(StringPiece value, const char *token)
+{
+    size_t tokenLength = strlen(token);
+    while (!value.empty())
+    {
+        const char *comma = static_cast<const char *>(memchr(value.data(), ',', value.size()));
+        size_t len = comma ? static_cast<size_t>(comma - value.data()) : value.size();
+        StringPiece item(value.data(), len);
+        while (!item.empty() && (item[0] == ' ' || item[0] == '\t'))
+        {
+            item.remove_prefix(1);
+        }
+        while (!item.empty() && (item[item.size() - 1] == ' ' || item[item.size() - 1] == '\t'))
+        {
+            item.remove_suffix(1);
+        }
+        if (item.equalsIgnoreCase(StringPiece(token, tokenLength)))
+        {
+            return true;
+        }
+        value.remove_prefix(comma ? len + 1 : len);
+    }
+    return false;
+}
+
+// 握手请求的协议检查，返回0表示可以升级，否则是应该回复的状态码
+static int checkHandshake(const HttpRequest &req)
+{
+    if (req.method() != HttpRequest::kGet || req.version() != HttpRequest::kHttp11)
+    {
+        return HttpResponse::k400BadRequest;
+    }
+    if (!hasToken(req.getHeader("Upgrade"), "websocket") || !hasToken(req.getHeader("Connection"), "upgrade"))
+    {
+        return HttpResponse::k426UpgradeRequired; // 普通的HTTP请求
+    }
+    if (req.getHeader("Sec-WebSocket-Version") != StringPiece("13"))
+    {
+        return HttpResponse::k426UpgradeRequired;
+    }
+    if (req.getHeader("Sec-WebSocket-Key").size() != 24) // 16个随机字节的base64
+    {
+        return HttpResponse::k400BadRequest;
+    }
+    return 0;
+}
+
+static void rejectHandshake(const TcpConnectionPtr &conn, int status)
+{
+    static thread_local Buffer t_output;
+    t_output.retrieveAll();
+    HttpResponse resp(true);
+    resp.setStatusCode(static_cast<HttpResponse::HttpStatusCode>(status));
+    if (status == HttpResponse::k426UpgradeRequired)
+    {
+        resp.addHeader("Upgrade", "websocket");
+        resp.addHeader("Sec-WebSocket-Version", "13");
+    }
+    resp.appendToBuffer(&t_output);
+    conn->send(&t_output);
+    conn->shutdown();
+}
+
+// loop线程里调用：发关闭帧，之后不再处理收到的数据
+static void closeInLoop(const TcpConnectionPtr &conn, uint16_t code, StringPiece reason)
+{
+    WebSocketContext *context = contextOf(conn);
+    if (context == nullptr || context->closing)
+    {
+        return;
+    }
+    context->closing = true;
+    static thread_local Buffer t_buffer;
+    t_buffer.retrieveAll();
+    if (code == WebSocket::kNoStatus)
+    {
+        WebSocket::encode(&t_buffer, WebSocket::kClose); // 对方没带状态码，回一个空的关闭帧
+    }
+    else
+    {
+        WebSocket::encodeClose(&t_buffer, code, reason);
+    }
+    conn->send(&t_buffer);
+    conn->shutdown();
+}
+
+// 关闭帧里允许出现的状态码
+static bool validCloseCode(uint16_t code)
+{
+    return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011) || (code >= 3000 && code <= 4999);
+}
+
+// 在连接所在的loop里执行
+static void checkPing(const TcpConnectionPtr &conn)
+{
+    WebSocketContext *context = contextOf(conn);
+    if (context == nullptr || context->closing)
+    {
+        return;
+    }
+    if (!context->receivedSincePing)
+    {
+        LOG_INFO("WebSocketServer [%s] no data since last ping, closing\n", conn->name().c_str());
+        conn->forceClose();
+        return;
+    }
+    context->receivedSincePing = false;
+    WebSocketServer::send(conn, nullptr, 0, WebSocket::kPing);
+}
+
+// ping定时器都在baseloop上：连接会被迁到别的subloop，原来的loop还可能被retire掉，定时器不能跟着连接的loop走。
+// 到点以后把检查转到连接现在所在的loop里做，context只在那里访问
+static void onPingTimer(const std::weak_ptr<TcpConnection> &weakConn)
+{
+    TcpConnectionPtr conn = weakConn.lock();
+    if (conn)
+    {
+        conn->runInOwnerLoop([conn]() { checkPing(conn); });
+    }
+}
+
+WebSocketFrame::WebSocketFrame(const char *data, size_t len, WebSocket::Opcode opcode)
+{
+    Buffer buf(len);
+    buf.append(data, len);
+    WebSocket::encode(&buf, opcode);
+    frame_ = std::make_shared<const std::string>(buf.peek(), buf.readableBytes());
+}
+
+WebSocketServer::WebSocketServer(EventLoop *loop,
+                                 const InetAddress &listenAddr,
+                                 const std::string &name,
+                                 TcpServer::Option option)
+    : loop_(loop),
+      server_(loop, listenAddr, name, option),
+      maxMessageBytes_(8 * 1024 * 1024),
+      pingInterval_(0)
+{
+    server_.setConnectionCallback(std::bind(&WebSocketServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(std::bind(&WebSocketServer::onMessage, this,
+                                         std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+void WebSocketServer::start()
+{
+    LOG_INFO("WebSocketServer starts listening\n");
+    server_.start();
+}
+
+void WebSocketServer::send(const TcpConnectionPtr &conn, const char *data, size_t len, WebSocket::Opcode opcode)
+{
+    // 每个线程一个编码用的Buffer，loop线程里send(Buffer*)同步写完或者拷进outputBuffer_以后就清空了，可以一直复用
+    static thread_local Buffer t_buffer;
+    t_buffer.retrieveAll();
+    t_buffer.append(data, len);
+    WebSocket::encode(&t_buffer, opcode);
+    conn->send(&t_buffer);
+}
+
+void WebSocketServer::close(const TcpConnectionPtr &conn, uint16_t code, const std::string &reason)
+{
+    EventLoop *loop = conn->getLoop();
+    if (loop->isInLoopThread())
+    {
+        closeInLoop(conn, code, reason);
+    }
+    else
+    {
+        loop->queueInLoop([conn, code, reason]() { closeInLoop(conn, code, reason); });
+    }
+}
+
+void WebSocketServer::broadcast(const std::vector<TcpConnectionPtr> &conns, const char *data, size_t len,
+                                WebSocket::Opcode opcode)
+{
+    WebSocketFrame frame(data, len, opcode);
+    frame.sendTo(conns);
+}
+
+void WebSocketServer::onConnection(const TcpConnectionPtr &conn)
+{
+    if (conn->connected())
+    {
+        conn->setContext(std::make_shared<WebSocketContext>());
+        return;
+    }
+    WebSocketContext *context = contextOf(conn);
+    if (context != nullptr && !context->http) // 握手成功过
+    {
+        if (context->pingTimer.valid())
+        {
+            loop_->cancel(context->pingTimer);
+        }
+        if (connectionCallback_)
+        {
+            connectionCallback_(conn);
+        }
+    }
+    conn->setContext(std::shared_ptr<void>());
+}
+
+// 握手完成时返回true，buf里剩下的是WebSocket帧
+bool WebSocketServer::handshake(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    WebSocketContext *context = contextOf(conn);
+    HttpContext *http = context->http.get();
+    if (!http->parseRequest(buf, receiveTime))
+    {
+        buf->retrieveAll();
+        context->closing = true;
+        rejectHandshake(conn, http->errorStatus());
+        return false;
+    }
+    if (!http->gotAll())
+    {
+        return false;
+    }
+
+    const HttpRequest &req = http->request();
+    int status = checkHandshake(req);
+    if (status == 0 && handshakeCallback_ && !handshakeCallback_(conn, req))
+    {
+        status = HttpResponse::k403Forbidden;
+    }
+    if (status != 0)
+    {
+        buf->retrieveAll();
+        context->closing = true;
+        rejectHandshake(conn, status);
+        return false;
+    }
+
+    static thread_local Buffer t_output;
+    t_output.retrieveAll();
+    static const char kResponse[] = "HTTP/1.1 101 Switching Protocols\r\n"
+                                    "Upgrade: websocket\r\n"
+                                    "Connection: Upgrade\r\n"
+                                    "Sec-WebSocket-Accept: ";
+    t_output.append(kResponse, sizeof kResponse - 1);
+    std::string accept = WebSocket::acceptKey(req.getHeader("Sec-WebSocket-Key"));
+    t_output.append(accept.data(), accept.size());
+    t_output.append("\r\n\r\n", 4);
+    conn->send(&t_output);
+
+    buf->retrieve(http->requestBytes());
+    context->http.reset();
+
+    if (pingInterval_ > 0)
+    {
+        std::weak_ptr<TcpConnection> weakConn(conn);
+        context->pingTimer = loop_->runEvery(pingInterval_, [weakConn]() { onPingTimer(weakConn); });
+    }
+    if (connectionCallback_)
+    {
+        connectionCallback_(conn);
+    }
+    return true;
+}
+
+/**
+ * 一次把buf里所有完整的帧都处理完，帧没收全就留着等下次。
+ * 客户端发来的帧必须带掩码，不能用RSV位（没有协商任何扩展），控制帧不能分片、负载不超过125字节
+ */
+void WebSocketServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    // 回调里forceClose会在这里同步走完断开流程、清掉连接的context，先拿住它
+    std::shared_ptr<void> holder(conn->getContext());
+    WebSocketContext *context = static_cast<WebSocketContext *>(holder.get());
+    if (context == nullptr || context->closing)
+    {
+        buf->retrieveAll();
+        return;
+    }
+    context->receivedSincePing = true;
+    if (context->http && !handshake(conn, buf, receiveTime))
+    {
+        return;
+    }
+
+    while (!context->closing && buf->readableBytes() >= 2)
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(buf->peek());
+        size_t readable = buf->readableBytes();
+        bool fin = (p[0] & 0x80) != 0;
+        WebSocket::Opcode opcode = static_cast<WebSocket::Opcode>(p[0] & 0x0f);
+        bool control = (opcode & 0x8) != 0;
+        uint64_t len = p[1] & 0x7f;
+        size_t headerBytes = 2;
+
+        uint16_t error = 0;
+        if ((p[0] & 0x70) != 0 || (p[1] & 0x80) == 0)
+        {
+            error = WebSocket::kProtocolError; // 用了RSV位，或者没有掩码
+        }
+        else if (opcode != WebSocket::kContinuation && opcode != WebSocket::kText && opcode != WebSocket::kBinary &&
+                 opcode != WebSocket::kClose && opcode != WebSocket::kPing && opcode != WebSocket::kPong)
+        {
+            error = WebSocket::kProtocolError;
+        }
+        else if (control && (!fin || len > WebSocket::kMaxControlPayload))
+        {
+            error = WebSocket::kProtocolError;
+        }
+        if (error != 0)
+        {
+            buf->retrieveAll();
+            closeInLoop(conn, error, StringPiece());
+            return;
+        }
+
+        if (len == 126)
+        {
+            if (readable < 4)
+            {
+                break;
+            }
+            len = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+            headerBytes = 4;
+        }
+        else if (len == 127)
+        {
+            if (readable < 10)
+            {
+                break;
+            }
+            len = 0;
+            for (int i = 0; i < 8; ++i)
+            {
+                len = (len << 8) | p[2 + i];
+            }
+            headerBytes = 10;
+        }
+        headerBytes += 4; // 掩码
+        size_t pending = opcode == WebSocket::kContinuation ? context->fragments.size() : 0;
+        if (len > maxMessageBytes_ || pending + len > maxMessageBytes_)
+        {
+            buf->retrieveAll();
+            closeInLoop(conn, WebSocket::kMessageTooBig, StringPiece());
+            return;
+        }
+        if (readable < headerBytes + len)
+        {
+            break; // 帧还没收全
+        }
+
+        char *payload = buf->peek() + headerBytes;
+        WebSocket::unmask(payload, len, buf->peek() + headerBytes - 4);
+
+        switch (opcode)
+        {
+        case WebSocket::kText:
+        case WebSocket::kBinary:
+            if (context->fragmentOpcode != WebSocket::kContinuation)
+            {
+                error = WebSocket::kProtocolError; // 上一个分片消息还没结束
+            }
+            else if (!fin)
+            {
+                context->fragmentOpcode = opcode;
+                context->fragments.assign(payload, len);
+            }
+            else if (opcode == WebSocket::kText && !WebSocket::validUtf8(payload, len))
+            {
+                error = WebSocket::kInvalidPayload;
+            }
+            else if (messageCallback_)
+            {
+                messageCallback_(conn, payload, len, opcode, receiveTime);
+            }
+            break;
+        case WebSocket::kContinuation:
+            if (context->fragmentOpcode == WebSocket::kContinuation)
+            {
+                error = WebSocket::kProtocolError; // 没有开头的分片
+                break;
+            }
+            context->fragments.append(payload, len);
+            if (fin)
+            {
+                WebSocket::Opcode messageOpcode = context->fragmentOpcode;
+                context->fragmentOpcode = WebSocket::kContinuation;
+                const std::string &message = context->fragments;
+                if (messageOpcode == WebSocket::kText && !WebSocket::validUtf8(message.data(), message.size()))
+                {
+                    error = WebSocket::kInvalidPayload;
+                }
+                else if (messageCallback_)
+                {
+                    messageCallback_(conn, message.data(), message.size(), messageOpcode, receiveTime);
+                }
+                context->fragments.clear();
+            }
+            break;
+        case WebSocket::kPing:
+            send(conn, payload, len, WebSocket::kPong);
+            break;
+        case WebSocket::kPong:
+            break;
+        case WebSocket::kClose:
+        {
+            uint16_t code = WebSocket::kNoStatus;
+            if (len == 1)
+            {
+                error = WebSocket::kProtocolError;
+                break;
+            }
+            if (len >= 2)
+            {
+                code = static_cast<uint16_t>((static_cast<unsigned char>(payload[0]) << 8) |
+                                             static_cast<unsigned char>(payload[1]));
+                if (!validCloseCode(code))
+                {
+                    error = WebSocket::kProtocolError;
+                    break;
+                }
+                if (!WebSocket::validUtf8(payload + 2, len - 2))
+                {
+                    error = WebSocket::kInvalidPayload;
+                    break;
+                }
+            }
+            buf->retrieveAll();
+            closeInLoop(conn, code, StringPiece()); // 回一个同样状态码的关闭帧
+            return;
+        }
+        }
+
+        if (error != 0)
+        {
+            buf->retrieveAll();
+            closeInLoop(conn, error, StringPiece());
+            return;
+        }
+        buf->retrieve(headerBytes + len);
+    }
+    if (context->closing)
+    {
+        buf->retrieveAll(); // 回调里调用了close
+    }
+}
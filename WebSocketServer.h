@@ -0,0 +1,106 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TcpServer.h"
+#include "WebSocket.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class HttpRequest;
+
+/**
+ * @brief 编码好的一帧，原样发给任意多个连接
+ *
+ * 广播的时候帧头只编码一次。编码好的帧是一份SharedPayload，每个连接写不完的部分只在输出队列里留一个引用，
+ * 不拷进各自的outputBuffer_，按loop分组投递（TcpConnection::broadcast），最后一个连接写完才释放
+ */
+class WebSocketFrame : noncopyable
+{
+public:
+    WebSocketFrame(const char *data, size_t len, WebSocket::Opcode opcode = WebSocket::kText);
+
+    const std::string &bytes() const { return *frame_; }
+    const SharedPayload &payload() const { return frame_; }
+
+    void sendTo(const TcpConnectionPtr &conn) const { conn->send(frame_); }
+    void sendTo(const std::vector<TcpConnectionPtr> &conns) const { TcpConnection::broadcast(conns, frame_); }
+
+private:
+    SharedPayload frame_;
+};
+
+/**
+ * @brief 基于TcpServer的WebSocket服务器（RFC 6455）
+ *
+ * 连接先按HTTP/1.1解析握手请求（HttpContext），合法的升级请求回101，之后这条连接上都是WebSocket帧。
+ * 收到的帧在inputBuffer_里原地解掩码；没有分片的消息直接把inputBuffer_里的负载交给messageCallback，不拷贝，
+ * 分片的消息拼好了再交。文本消息交出去之前检查过UTF-8。
+ *
+ * ping由loop自己回pong，不经过回调；setPingInterval以后定时发ping，两个间隔里什么都没收到就断开。
+ * ping的定时器在baseloop上，到点以后转到连接所在的loop里检查、发ping，连接迁移到别的subloop也照样工作。
+ * 对端发来关闭帧时回一个关闭帧再shutdown；协议错误时发对应状态码的关闭帧再shutdown。
+ *
+ * 所有回调都在连接所在的loop线程里执行；send、close、WebSocketFrame::sendTo在哪个线程调用都行
+ */
+class WebSocketServer : noncopyable
+{
+public:
+    // 握手成功时（conn->connected()为true）和握手成功过的连接断开时各调用一次
+    using ConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
+    // 一个完整的消息，opcode是kText或kBinary；data指向inputBuffer_或者拼分片用的缓冲，回调返回以后就失效了
+    using MessageCallback = std::function<void(const TcpConnectionPtr &, const char *data, size_t len,
+                                               WebSocket::Opcode opcode, Timestamp receiveTime)>;
+    // 握手请求通过了协议检查以后调用，可以看path、Origin、Cookie，返回false回403不升级
+    using HandshakeCallback = std::function<bool(const TcpConnectionPtr &, const HttpRequest &)>;
+
+    WebSocketServer(EventLoop *loop,
+                    const InetAddress &listenAddr,
+                    const std::string &name,
+                    TcpServer::Option option = TcpServer::kNoReusePort);
+
+    EventLoop *getLoop() const { return loop_; }
+    // 线程数、socket选项、限速之类的直接在底下的TcpServer上设置
+    TcpServer *tcpServer() { return &server_; }
+
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+    void setHandshakeCallback(const HandshakeCallback &cb) { handshakeCallback_ = cb; }
+    void setThreadNum(int numThreads) { server_.setThreadNum(numThreads); }
+
+    // 一个消息（分片拼起来以后）最多多少字节，默认8M，超过了用1009关闭；在start()之前设置
+    void setMaxMessageBytes(size_t bytes) { maxMessageBytes_ = bytes; }
+    // 每隔多少秒发一个ping，0表示不发（默认）；在start()之前设置
+    void setPingInterval(double seconds) { pingInterval_ = seconds; }
+
+    void start();
+
+    // 把一个消息编码成一帧发出去
+    static void send(const TcpConnectionPtr &conn, const char *data, size_t len,
+                     WebSocket::Opcode opcode = WebSocket::kText);
+    static void send(const TcpConnectionPtr &conn, const std::string &message,
+                     WebSocket::Opcode opcode = WebSocket::kText)
+    {
+        send(conn, message.data(), message.size(), opcode);
+    }
+    // 发关闭帧然后shutdown，之后收到的数据都丢掉
+    static void close(const TcpConnectionPtr &conn, uint16_t code = WebSocket::kNormalClosure,
+                      const std::string &reason = std::string());
+    // 同一个消息发给一组连接，帧只编码一次
+    static void broadcast(const std::vector<TcpConnectionPtr> &conns, const char *data, size_t len,
+                          WebSocket::Opcode opcode = WebSocket::kText);
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    bool handshake(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    EventLoop *loop_;
+    TcpServer server_;
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    HandshakeCallback handshakeCallback_;
+    size_t maxMessageBytes_;
+    double pingInterval_;
+};
@@ -0,0 +1,156 @@
+#include "WorkStealingPool.h"
+#include "Logger.h"
+
+// 当前线程是哪个线程池的第几个工作线程，工作线程里提交的任务直接放进自己的队列
+static __thread WorkStealingPool *t_pool = nullptr;
+static __thread int t_workerIndex = -1;
+
+WorkStealingPool::WorkStealingPool(const std::string &name)
+    : name_(name),
+      numThreads_(0),
+      running_(false),
+      next_(0),
+      pending_(0),
+      sleepers_(0)
+{
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    if (running_)
+    {
+        stop();
+    }
+}
+
+void WorkStealingPool::start()
+{
+    running_ = true;
+    for (int i = 0; i < numThreads_; ++i)
+    {
+        workers_.push_back(std::unique_ptr<Worker>(new Worker));
+    }
+    // 队列都建好了再启动线程，偷的时候要遍历所有队列
+    for (int i = 0; i < numThreads_; ++i)
+    {
+        std::string threadName = name_ + std::to_string(i);
+        threads_.push_back(std::unique_ptr<Thread>(new Thread(std::bind(&WorkStealingPool::workerFunc, this, i), threadName)));
+        threads_.back()->start();
+    }
+}
+
+void WorkStealingPool::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        running_ = false;
+    }
+    sleepCond_.notify_all();
+    for (auto &thread : threads_)
+    {
+        thread->join();
+    }
+    threads_.clear();
+}
+
+void WorkStealingPool::submit(Task task)
+{
+    if (workers_.empty())
+    {
+        task(); // 没有工作线程，只能就地执行
+        return;
+    }
+    // 先pending_++再看running_，工作线程是先看到!running_再看pending_ == 0才退出的，都是顺序一致的原子操作：
+    // 这里看到running_还是true的话，退出的线程一定能看到这个计数，会等这个任务入队、做完再走；
+    // 看到false就撤回计数就地执行。这样stop()夹在中间也不会有任务留在没人管的队列里，又不用每次提交都拿sleepMutex_
+    ++pending_; // 先加计数再入队，计数不会因为任务被先取走而减成负的
+    if (!running_)
+    {
+        --pending_;
+        task();
+        return;
+    }
+
+    size_t index;
+    if (t_pool == this)
+    {
+        index = t_workerIndex;
+    }
+    else
+    {
+        index = next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    }
+    {
+        std::unique_lock<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+
+    // 工作线程睡觉之前先sleepers_++再看pending_，这里先pending_++再看sleepers_，
+    // 两边都是顺序一致的原子操作，至少有一边能看到对方，不会出现有任务却都在睡觉
+    if (sleepers_.load() > 0)
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        sleepCond_.notify_one();
+    }
+}
+
+bool WorkStealingPool::popLocal(int index, Task *task)
+{
+    Worker &worker = *workers_[index];
+    std::unique_lock<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty())
+    {
+        return false;
+    }
+    *task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(int index, Task *task)
+{
+    // 从下一个开始转一圈，免得大家都去偷同一个队列
+    int n = static_cast<int>(workers_.size());
+    for (int i = 1; i < n; ++i)
+    {
+        Worker &victim = *workers_[(index + i) % n];
+        std::unique_lock<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            *task = std::move(victim.tasks.front()); // 偷最早放进去的，它已经等了最久了
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::workerFunc(int index)
+{
+    t_pool = this;
+    t_workerIndex = index;
+
+    Task task;
+    while (true)
+    {
+        if (popLocal(index, &task) || steal(index, &task))
+        {
+            --pending_;
+            task();
+            task = nullptr; // 尽早释放任务里捕获的对象（比如TcpConnectionPtr）
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        ++sleepers_;
+        sleepCond_.wait(lock, [this]() { return pending_.load() > 0 || !running_; });
+        --sleepers_;
+        if (!running_ && pending_.load() == 0)
+        {
+            break; // stop()以后把剩下的任务做完再退出
+        }
+    }
+
+    t_pool = nullptr;
+    t_workerIndex = -1;
+}
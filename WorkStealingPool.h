@@ -0,0 +1,63 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+#include <functional>
+#include <deque>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/**
+ * @brief 计算线程池，把onMessage里耗CPU的活（解析、压缩、加解密）从IO线程上挪走
+ *
+ * 每个工作线程一个双端队列：自己从队尾取（刚放进去的任务数据还在cache里），
+ * 别的线程闲下来就从队头偷，忙的线程积压的任务会被分摊掉，不会出现一个线程排长队、别的线程闲着的情况。
+ * 工作线程里提交的任务放进自己的队列，别的线程（比如IO线程）提交的任务轮流放进各个工作线程的队列。
+ * 每个队列各有一把锁，提交和偷取只会碰到一两个队列，不会所有线程都抢同一把锁
+ */
+class WorkStealingPool : noncopyable
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(const std::string &name = std::string("WorkStealingPool"));
+    ~WorkStealingPool();
+
+    void setThreadNum(int numThreads) { numThreads_ = numThreads; } // start()之前设置
+    void start();
+    void stop(); // 等队列里已经提交的任务都执行完再退出
+
+    // 线程安全；没有start()或者已经stop()的时候，直接在调用者的线程里执行
+    void submit(Task task);
+
+    int numThreads() const { return numThreads_; }
+    size_t pendingTasks() const { return pending_.load(std::memory_order_relaxed); }
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerFunc(int index);
+    bool popLocal(int index, Task *task); // 从自己队列的队尾取
+    bool steal(int index, Task *task);    // 从别的队列的队头偷
+
+    std::string name_;
+    int numThreads_;
+    std::atomic_bool running_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::unique_ptr<Thread>> threads_;
+    std::atomic<size_t> next_;    // 外部提交的任务轮流放进哪个队列
+    std::atomic<size_t> pending_; // 所有队列里还没执行的任务数
+
+    std::mutex sleepMutex_; // 没有活干的线程在这里睡觉
+    std::condition_variable sleepCond_;
+    std::atomic<int> sleepers_; // 正在睡觉的线程数，提交任务时没人睡就不用去碰sleepMutex_
+};
@@ -28,4 +28,11 @@ done
 
 cp `pwd`/lib/libmymuduo.so /usr/lib
 
+# 协程接口（C++20）的头文件和库，编译器不支持C++20时不会生成；头文件放在mymuduo/coro下面
+if [ -f `pwd`/lib/libmymuduo_coro.so ]; then
+    mkdir -p /usr/include/mymuduo/coro
+    cp coro/*.h /usr/include/mymuduo/coro
+    cp `pwd`/lib/libmymuduo_coro.so /usr/lib
+fi
+
 ldconfig
\ No newline at end of file
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <math.h>
+#include <stdint.h>
+
+/**
+ * @brief 压测用的HDR直方图（High Dynamic Range），记录延迟分布
+ *
+ * 值按2的幂分成若干段，每段里再等分成固定个数的小桶，整个范围内的相对误差都不超过10^-significantDigits，
+ * 几纳秒和几十秒可以放在同一个直方图里，占用的内存和记录的个数无关，record只是算下标加一。
+ * 每个线程各记各的，最后merge到一起再算百分位
+ */
+class HdrHistogram
+{
+public:
+    explicit HdrHistogram(int64_t highestTrackableValue = 60LL * 1000 * 1000 * 1000, int significantDigits = 3)
+        : highest_(highestTrackableValue),
+          totalCount_(0),
+          min_(INT64_MAX),
+          max_(0),
+          sum_(0)
+    {
+        int64_t largestSingleUnitResolution = 2 * static_cast<int64_t>(pow(10, significantDigits));
+        int subBucketCountMagnitude = static_cast<int>(ceil(log2(static_cast<double>(largestSingleUnitResolution))));
+        subBucketHalfCountMagnitude_ = subBucketCountMagnitude - 1;
+        subBucketCount_ = 1 << subBucketCountMagnitude;
+        subBucketHalfCount_ = subBucketCount_ / 2;
+        subBucketMask_ = subBucketCount_ - 1;
+
+        int bucketsNeeded = 1;
+        int64_t smallestUntrackable = subBucketCount_;
+        while (smallestUntrackable <= highest_)
+        {
+            smallestUntrackable <<= 1;
+            ++bucketsNeeded;
+        }
+        counts_.assign((bucketsNeeded + 1) * subBucketHalfCount_, 0);
+    }
+
+    // 超过highestTrackableValue的值按最大值记
+    void record(int64_t value)
+    {
+        value = std::max<int64_t>(0, std::min(value, highest_));
+        ++counts_[countsIndex(value)];
+        ++totalCount_;
+        sum_ += value;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    void merge(const HdrHistogram &other)
+    {
+        for (size_t i = 0; i < counts_.size() && i < other.counts_.size(); ++i)
+        {
+            counts_[i] += other.counts_[i];
+        }
+        totalCount_ += other.totalCount_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    // percentile取0~100，返回至少有percentile%的值不超过它的那个值（所在小桶的上界）
+    int64_t valueAtPercentile(double percentile) const
+    {
+        if (totalCount_ == 0)
+        {
+            return 0;
+        }
+        int64_t target = static_cast<int64_t>(ceil(percentile / 100 * totalCount_));
+        target = std::max<int64_t>(1, std::min(target, totalCount_));
+        int64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i)
+        {
+            seen += counts_[i];
+            if (seen >= target)
+            {
+                return std::min(highestEquivalentValue(static_cast<int>(i)), max_);
+            }
+        }
+        return max_;
+    }
+
+    int64_t count() const { return totalCount_; }
+    int64_t min() const { return totalCount_ == 0 ? 0 : min_; }
+    int64_t max() const { return max_; }
+    double mean() const { return totalCount_ == 0 ? 0 : static_cast<double>(sum_) / totalCount_; }
+
+private:
+    int countsIndex(int64_t value) const
+    {
+        int pow2Ceiling = 64 - __builtin_clzll(static_cast<uint64_t>(value | subBucketMask_));
+        int bucketIndex = pow2Ceiling - (subBucketHalfCountMagnitude_ + 1);
+        int subBucketIndex = static_cast<int>(value >> bucketIndex);
+        return ((bucketIndex + 1) << subBucketHalfCountMagnitude_) + (subBucketIndex - subBucketHalfCount_);
+    }
+
+    int64_t highestEquivalentValue(int index) const
+    {
+        int bucketIndex = (index >> subBucketHalfCountMagnitude_) - 1;
+        int subBucketIndex = (index & (subBucketHalfCount_ - 1)) + subBucketHalfCount_;
+        if (bucketIndex < 0)
+        {
+            subBucketIndex -= subBucketHalfCount_;
+            bucketIndex = 0;
+        }
+        int64_t lowest = static_cast<int64_t>(subBucketIndex) << bucketIndex;
+        return lowest + (static_cast<int64_t>(1) << bucketIndex) - 1;
+    }
+
+    int64_t highest_;
+    int subBucketHalfCountMagnitude_;
+    int subBucketCount_;
+    int subBucketHalfCount_;
+    int64_t subBucketMask_;
+    std::vector<int64_t> counts_;
+    int64_t totalCount_;
+    int64_t min_;
+    int64_t max_;
+    int64_t sum_;
+};
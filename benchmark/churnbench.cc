@@ -0,0 +1,272 @@
+#include "../TcpServer.h"
+#include "../TcpClient.h"
+#include "../EventLoopThread.h"
+#include "../Logger.h"
+#include "HdrHistogram.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/**
+ * @brief 短连接压测：客户端不停地建立/关闭连接，统计服务端每秒建立和销毁的连接数
+ *
+ * raw：客户端线程直接用阻塞的connect/close，只压服务端；
+ *      close前设置SO_LINGER为0，直接发RST，避免本机的端口都耗在TIME_WAIT上
+ * client：客户端也用这个库，每个客户端loop上同时有若干个TcpClient在连，
+ *      连上以后服务端主动关连接（TIME_WAIT留在服务端），客户端再开下一个；另外统计connect的延迟
+ *
+ * 用法：./churnbench [客户端线程数] [服务端subloop数] [秒数] [raw|client|all]
+ */
+
+static const uint16_t kPort = 8003;
+static const uint16_t kClientPort = 8022;
+static const int kConcurrentPerLoop = 8; // client模式下每个客户端loop同时在连的连接数
+
+using Clock = std::chrono::steady_clock;
+
+template <typename Func>
+static void runInLoopAndWait(EventLoop *loop, Func func)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]()
+                    {
+                        func();
+                        done.set_value();
+                    });
+    done.get_future().wait();
+}
+
+static void runRawRound(int clients, int ioThreads, double seconds)
+{
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(kPort), "churn");
+    std::atomic<long> opened(0);
+    std::atomic<long> closed(0);
+    server.setConnectionCallback([&](const TcpConnectionPtr &conn)
+                                 {
+                                     if (conn->connected())
+                                     {
+                                         ++opened;
+                                     }
+                                     else
+                                     {
+                                         ++closed;
+                                     }
+                                 });
+    server.setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp)
+                              { buf->retrieveAll(); });
+    server.setThreadNum(ioThreads);
+    server.start();
+
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i)
+    {
+        threads.emplace_back([&]()
+                             {
+                                 sockaddr_in addr;
+                                 memset(&addr, 0, sizeof addr);
+                                 addr.sin_family = AF_INET;
+                                 addr.sin_port = htons(kPort);
+                                 addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+                                 struct linger lg = {1, 0};
+                                 while (!stop)
+                                 {
+                                     int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+                                     if (::connect(fd, (sockaddr *)&addr, sizeof addr) == 0)
+                                     {
+                                         ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof lg);
+                                     }
+                                     ::close(fd);
+                                 }
+                             });
+    }
+
+    std::thread timer([&]()
+                      {
+                          usleep(200 * 1000); // 预热
+                          long open0 = opened, close0 = closed;
+                          auto start = std::chrono::steady_clock::now();
+                          usleep(static_cast<useconds_t>(seconds * 1000 * 1000));
+                          double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                          long opens = opened - open0, closes = closed - close0;
+                          stop = true;
+                          printf("bench=churn mode=raw clients=%d io_threads=%d seconds=%.2f opened=%ld closed=%ld conn_per_sec=%.0f\n",
+                                 clients, ioThreads, secs, opens, closes, closes / secs);
+                          fflush(stdout);
+                          loop.quit();
+                      });
+    loop.loop();
+    timer.join();
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+}
+
+// client模式下一个客户端loop上的状态，除了closed以外只在loop线程里访问
+struct ChurnLoop
+{
+    EventLoop *loop;
+    bool stopping = false;
+    bool measuring = false;
+    int live = 0;           // 还没删掉的TcpClient
+    HdrHistogram histogram; // connect延迟，纳秒
+    std::atomic<long> closed{0};
+
+    void startOne()
+    {
+        ++live;
+        Clock::time_point start = Clock::now();
+        TcpClient *client = new TcpClient(loop, InetAddress(kClientPort), "churn");
+        client->setConnectionCallback([this, client, start](const TcpConnectionPtr &conn)
+                                      {
+                                          if (conn->connected())
+                                          {
+                                              if (measuring)
+                                              {
+                                                  histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+                                              }
+                                              return;
+                                          }
+                                          ++closed;
+                                          // 还在client自己的回调里，放到本轮的回调里再删
+                                          loop->queueInLoop([this, client]()
+                                                            {
+                                                                delete client;
+                                                                --live;
+                                                                if (!stopping)
+                                                                {
+                                                                    startOne();
+                                                                }
+                                                            });
+                                      });
+        client->connect();
+    }
+};
+
+static void runClientRound(int clients, int ioThreads, double seconds)
+{
+    std::promise<EventLoop *> serverReady;
+    std::atomic<long> opened(0);
+    std::thread serverThread([&]()
+                             {
+                                 EventLoop loop;
+                                 TcpServer server(&loop, InetAddress(kClientPort), "churn");
+                                 server.setConnectionCallback([&](const TcpConnectionPtr &conn)
+                                                              {
+                                                                  if (conn->connected())
+                                                                  {
+                                                                      ++opened;
+                                                                      conn->shutdown(); // 服务端先关
+                                                                  }
+                                                              });
+                                 server.setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp)
+                                                           { buf->retrieveAll(); });
+                                 server.setThreadNum(ioThreads);
+                                 server.start();
+                                 serverReady.set_value(&loop);
+                                 loop.loop();
+                             });
+    EventLoop *serverLoop = serverReady.get_future().get();
+
+    std::vector<std::unique_ptr<EventLoopThread>> threads;
+    std::vector<std::unique_ptr<ChurnLoop>> churnLoops;
+    for (int i = 0; i < clients; ++i)
+    {
+        threads.emplace_back(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "churn-client"));
+        churnLoops.emplace_back(new ChurnLoop);
+        ChurnLoop *cl = churnLoops.back().get();
+        cl->loop = threads.back()->startLoop();
+        cl->loop->runInLoop([cl]()
+                            {
+                                for (int k = 0; k < kConcurrentPerLoop; ++k)
+                                {
+                                    cl->startOne();
+                                }
+                            });
+    }
+
+    usleep(200 * 1000); // 预热
+    long closed0 = 0;
+    for (auto &cl : churnLoops)
+    {
+        ChurnLoop *raw = cl.get();
+        runInLoopAndWait(raw->loop, [raw, &closed0]()
+                         {
+                             raw->measuring = true;
+                             closed0 += raw->closed;
+                         });
+    }
+    long opened0 = opened;
+    Clock::time_point start = Clock::now();
+    usleep(static_cast<useconds_t>(seconds * 1000 * 1000));
+    double secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+    long closed1 = 0;
+    HdrHistogram merged;
+    for (auto &cl : churnLoops)
+    {
+        ChurnLoop *raw = cl.get();
+        runInLoopAndWait(raw->loop, [raw, &closed1, &merged]()
+                         {
+                             raw->stopping = true;
+                             raw->measuring = false;
+                             closed1 += raw->closed;
+                             merged.merge(raw->histogram);
+                         });
+    }
+    long opens = opened - opened0;
+    for (auto &cl : churnLoops)
+    {
+        // 回调里用着ChurnLoop，等所有TcpClient都删掉
+        ChurnLoop *raw = cl.get();
+        bool idle = false;
+        while (!idle)
+        {
+            usleep(10 * 1000);
+            runInLoopAndWait(raw->loop, [raw, &idle]() { idle = raw->live == 0; });
+        }
+    }
+    threads.clear();
+    serverLoop->quit();
+    serverThread.join();
+
+    long closes = closed1 - closed0;
+    printf("bench=churn mode=client clients=%d io_threads=%d seconds=%.2f opened=%ld closed=%ld conn_per_sec=%.0f "
+           "connect_p50_us=%.1f connect_p99_us=%.1f connect_p999_us=%.1f\n",
+           clients, ioThreads, secs, opens, closes, closes / secs,
+           merged.valueAtPercentile(50) / 1000.0, merged.valueAtPercentile(99) / 1000.0,
+           merged.valueAtPercentile(99.9) / 1000.0);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int clients = argc > 1 ? atoi(argv[1]) : 4;
+    int ioThreads = argc > 2 ? atoi(argv[2]) : 2;
+    double seconds = argc > 3 ? atof(argv[3]) : 5;
+    std::string mode = argc > 4 ? argv[4] : "all";
+
+    if (mode == "raw" || mode == "all")
+    {
+        runRawRound(clients, ioThreads, seconds);
+    }
+    if (mode == "client" || mode == "all")
+    {
+        runClientRound(clients, ioThreads, seconds);
+    }
+    return 0;
+}
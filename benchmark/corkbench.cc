@@ -0,0 +1,168 @@
+#include "../TcpServer.h"
+#include "../SocketOptions.h"
+#include "../Logger.h"
+#include "../CurrentThread.h"
+
+#include <string>
+#include <functional>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/**
+ * @brief 流水线小请求下，对比cork开关前后服务端每个请求的write系统调用次数
+ *
+ * 服务端每收到一个16字节的请求，分5次send回复（模拟一个逻辑回复被拆成好几段）
+ * 客户端一次write发出kPipeline个请求，再把所有回复读完
+ * write次数从/proc/self/task/<loop tid>/io的syscw读，只统计服务端loop线程
+ * 两边都开TCP_NODELAY，否则不cork时一个请求的几段小回复会被Nagle和延迟ACK卡住，测的就成了ACK的时机
+ */
+
+static const size_t kRequestSize = 16;
+static const int kPipeline = 32;
+static const int kRounds = 2000;
+static const char *kParts[] = {"HTTP/1.1 200 OK\r\n", "Content-Length: 2\r\n", "Server: cork\r\n", "\r\n", "ok"};
+
+class ReplyServer
+{
+public:
+    ReplyServer(EventLoop *loop, uint16_t port, bool autoCork)
+        : server_(loop, InetAddress(port), autoCork ? "cork" : "nocork"),
+          autoCork_(autoCork)
+    {
+        server_.setConnectionCallback(std::bind(&ReplyServer::onConnection, this, std::placeholders::_1));
+        server_.setMessageCallback(std::bind(&ReplyServer::onMessage, this,
+                                             std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        SocketOptions options;
+        options.tcpNoDelay = 1;
+        server_.setSocketOptions(options);
+    }
+
+    void start() { server_.start(); }
+
+private:
+    void onConnection(const TcpConnectionPtr &conn)
+    {
+        if (conn->connected())
+        {
+            conn->setAutoCork(autoCork_);
+        }
+    }
+
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+    {
+        while (buf->readableBytes() >= kRequestSize)
+        {
+            buf->retrieve(kRequestSize);
+            for (const char *part : kParts)
+            {
+                conn->send(part);
+            }
+        }
+    }
+
+    TcpServer server_;
+    bool autoCork_;
+};
+
+static size_t replySize()
+{
+    size_t n = 0;
+    for (const char *part : kParts)
+    {
+        n += strlen(part);
+    }
+    return n;
+}
+
+static long threadWriteSyscalls(pid_t tid)
+{
+    char path[64];
+    snprintf(path, sizeof path, "/proc/self/task/%d/io", tid);
+    FILE *fp = fopen(path, "r");
+    if (fp == nullptr)
+    {
+        return -1;
+    }
+    char line[128];
+    long syscw = -1;
+    while (fgets(line, sizeof line, fp))
+    {
+        if (sscanf(line, "syscw: %ld", &syscw) == 1)
+        {
+            break;
+        }
+    }
+    fclose(fp);
+    return syscw;
+}
+
+static void runClient(uint16_t port, pid_t loopTid, const char *mode)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    while (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+    {
+        usleep(1000);
+    }
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+
+    std::string batch(kRequestSize * kPipeline, 'q');
+    std::string reply(replySize() * kPipeline, '\0');
+
+    long before = threadWriteSyscalls(loopTid);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kRounds; ++i)
+    {
+        ::write(fd, batch.data(), batch.size());
+        size_t got = 0;
+        while (got < reply.size())
+        {
+            ssize_t n = ::read(fd, &reply[got], reply.size() - got);
+            if (n <= 0)
+            {
+                break;
+            }
+            got += n;
+        }
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    long writes = threadWriteSyscalls(loopTid) - before;
+    ::close(fd);
+
+    long requests = (long)kRounds * kPipeline;
+    printf("mode=%s requests=%ld server_writes=%ld writes_per_request=%.3f req_per_sec=%.0f\n",
+           mode, requests, writes, (double)writes / requests, requests / secs);
+}
+
+int main()
+{
+    EventLoop loop;
+    ReplyServer plain(&loop, 8001, false);
+    ReplyServer corked(&loop, 8002, true);
+    plain.start();
+    corked.start();
+
+    pid_t loopTid = CurrentThread::tid();
+    std::thread client([&]()
+                       {
+                           runClient(8001, loopTid, "nocork");
+                           runClient(8002, loopTid, "autocork");
+                           loop.quit();
+                       });
+    loop.loop();
+    client.join();
+    return 0;
+}
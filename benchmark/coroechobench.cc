@@ -0,0 +1,147 @@
+#include "../TcpServer.h"
+#include "../coro/CoConnection.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/**
+ * @brief 协程echo和回调echo的对比
+ *
+ * 同样的客户端（每个连接发一块数据、等回完再发下一块）分别压回调写的echo和协程写的echo，
+ * 比较每秒的往返次数和吞吐，两者应该差不多
+ *
+ * 用法：./coroechobench [连接数] [每块字节数] [subloop数] [每轮秒数]
+ */
+
+static const uint16_t kPortCallback = 8006;
+static const uint16_t kPortCoroutine = 8007;
+
+static Task<> echoSession(CoConnectionPtr conn)
+{
+    while (true)
+    {
+        std::string data = co_await conn->readSome();
+        if (data.empty() || !co_await conn->write(std::move(data)))
+        {
+            break; // 对端关闭了
+        }
+    }
+}
+
+static int connectTo(uint16_t port)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    while (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+    {
+        usleep(1000);
+    }
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    return fd;
+}
+
+static void runRound(bool coroutine, int connections, size_t blockSize, int ioThreads, double seconds)
+{
+    uint16_t port = coroutine ? kPortCoroutine : kPortCallback;
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), coroutine ? "coroutine" : "callback");
+    server.setThreadNum(ioThreads);
+    if (coroutine)
+    {
+        server.setConnectionCallback([](const TcpConnectionPtr &conn)
+                                     {
+                                         if (conn->connected())
+                                         {
+                                             spawn(echoSession(CoConnection::attach(conn)));
+                                         }
+                                     });
+    }
+    else
+    {
+        server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                  { conn->send(buf->retrieveAllAsString()); });
+    }
+    server.start();
+
+    std::atomic<bool> stop(false);
+    std::atomic<long> roundTrips(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < connections; ++i)
+    {
+        threads.emplace_back([&]()
+                             {
+                                 int fd = connectTo(port);
+                                 std::string block(blockSize, 'x');
+                                 std::vector<char> buf(blockSize);
+                                 while (!stop)
+                                 {
+                                     if (::write(fd, block.data(), block.size()) != static_cast<ssize_t>(block.size()))
+                                     {
+                                         break;
+                                     }
+                                     size_t got = 0;
+                                     while (got < blockSize)
+                                     {
+                                         ssize_t n = ::read(fd, buf.data(), blockSize - got);
+                                         if (n <= 0)
+                                         {
+                                             stop = true;
+                                             break;
+                                         }
+                                         got += n;
+                                     }
+                                     ++roundTrips;
+                                 }
+                                 ::close(fd);
+                             });
+    }
+
+    long trips = 0;
+    std::thread timer([&]()
+                      {
+                          usleep(200 * 1000); // 预热
+                          long start = roundTrips;
+                          usleep(static_cast<useconds_t>(seconds * 1000 * 1000));
+                          trips = roundTrips - start;
+                          stop = true;
+                          for (std::thread &t : threads)
+                          {
+                              t.join();
+                          }
+                          loop.quit();
+                      });
+    loop.loop();
+    timer.join();
+
+    printf("bench=coroecho mode=%s connections=%d block=%zu io_threads=%d round_trips_per_sec=%.0f mib_per_sec=%.1f\n",
+           coroutine ? "coroutine" : "callback", connections, blockSize, ioThreads,
+           trips / seconds, trips * blockSize / seconds / (1024 * 1024));
+}
+
+int main(int argc, char *argv[])
+{
+    int connections = argc > 1 ? atoi(argv[1]) : 16;
+    size_t blockSize = argc > 2 ? atoi(argv[2]) : 4096;
+    int ioThreads = argc > 3 ? atoi(argv[3]) : 2;
+    double seconds = argc > 4 ? atof(argv[4]) : 5;
+
+    runRound(false, connections, blockSize, ioThreads, seconds);
+    runRound(true, connections, blockSize, ioThreads, seconds);
+    return 0;
+}
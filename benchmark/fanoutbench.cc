@@ -0,0 +1,208 @@
+#include "../TcpServer.h"
+#include "../TcpClient.h"
+#include "../EventLoopThread.h"
+#include "../Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * @brief 发布订阅式的广播压测：一个发布者线程把同一条消息发给所有订阅连接
+ *
+ * 服务端有若干个subloop，订阅连接分散在上面；发布者不在任何服务端loop里（客户端loop兼任），
+ * 每批window条消息，所有客户端都收全了再发下一批，统计每秒送达的消息数（消息数×连接数）。
+ * copy：每个连接调用一次send(std::string)，跨线程时每个连接拷一份、投递一个任务，写不完的再拷进outputBuffer_
+ * shared：TcpConnection::broadcast，一份SharedPayload，每个loop投递一个任务，写不完的只留引用
+ *
+ * 用法：./fanoutbench [连接数] [每轮秒数] [消息大小列表] [服务端线程数] [window]
+ */
+
+static const uint16_t kPort = 8026;
+
+using Clock = std::chrono::steady_clock;
+
+static std::vector<int> parseList(const char *arg)
+{
+    std::vector<int> values;
+    const char *p = arg;
+    while (*p)
+    {
+        values.push_back(atoi(p));
+        while (*p && *p != ',')
+        {
+            ++p;
+        }
+        if (*p == ',')
+        {
+            ++p;
+        }
+    }
+    return values;
+}
+
+template <typename Func>
+static void runInLoopAndWait(EventLoop *loop, Func func)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]()
+                    {
+                        func();
+                        done.set_value();
+                    });
+    done.get_future().wait();
+}
+
+struct Publisher
+{
+    std::vector<TcpConnectionPtr> conns; // 服务端的连接，建好以后只在客户端loop里读
+    std::string message;
+    bool shared;
+    int window;
+    int64_t expectedBytes; // 下面几个只在客户端loop里访问
+    int64_t receivedBytes;
+    bool stop;
+    std::atomic<int64_t> delivered;
+
+    Publisher() : shared(false), window(0), expectedBytes(0), receivedBytes(0), stop(false), delivered(0) {}
+
+    void publishBatch()
+    {
+        expectedBytes += static_cast<int64_t>(window) * conns.size() * message.size();
+        for (int i = 0; i < window; ++i)
+        {
+            if (shared)
+            {
+                TcpConnection::broadcast(conns, std::make_shared<const std::string>(message));
+            }
+            else
+            {
+                for (const TcpConnectionPtr &conn : conns)
+                {
+                    conn->send(message);
+                }
+            }
+        }
+    }
+};
+
+static void runCase(EventLoop *clientLoop, int connections, int size, int threads, int window, double seconds, bool shared)
+{
+    Publisher publisher;
+    publisher.message.assign(size, 'm');
+    publisher.shared = shared;
+    publisher.window = window;
+
+    std::mutex mutex;
+    std::vector<TcpConnectionPtr> serverConns;
+    std::promise<EventLoop *> serverReady;
+    std::thread serverThread([&]()
+                             {
+                                 EventLoop loop;
+                                 TcpServer server(&loop, InetAddress(kPort), "fanoutbench");
+                                 server.setThreadNum(threads);
+                                 server.setConnectionCallback([&](const TcpConnectionPtr &conn)
+                                                              {
+                                                                  std::lock_guard<std::mutex> lock(mutex);
+                                                                  if (conn->connected())
+                                                                  {
+                                                                      conn->setAutoCork(true); // 一批消息合成一次write
+                                                                      serverConns.push_back(conn);
+                                                                  }
+                                                              });
+                                 server.start();
+                                 serverReady.set_value(&loop);
+                                 loop.loop();
+                             });
+    EventLoop *serverLoop = serverReady.get_future().get();
+
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    runInLoopAndWait(clientLoop, [&]()
+                     {
+                         for (int i = 0; i < connections; ++i)
+                         {
+                             TcpClient *client = new TcpClient(clientLoop, InetAddress(kPort), "fanoutbench");
+                             client->setMessageCallback([&](const TcpConnectionPtr &, Buffer *buf, Timestamp)
+                                                        {
+                                                            publisher.receivedBytes += buf->readableBytes();
+                                                            buf->retrieveAll();
+                                                            if (publisher.receivedBytes == publisher.expectedBytes && !publisher.stop)
+                                                            {
+                                                                publisher.delivered += static_cast<int64_t>(publisher.window) * publisher.conns.size();
+                                                                publisher.publishBatch();
+                                                            }
+                                                        });
+                             client->connect();
+                             clients.emplace_back(client);
+                         }
+                     });
+
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (static_cast<int>(serverConns.size()) == connections)
+            {
+                break;
+            }
+        }
+        usleep(1000);
+    }
+    runInLoopAndWait(clientLoop, [&]()
+                     {
+                         publisher.conns = serverConns;
+                         publisher.publishBatch();
+                     });
+    usleep(200 * 1000); // 预热
+
+    int64_t delivered0 = publisher.delivered;
+    Clock::time_point start = Clock::now();
+    usleep(static_cast<useconds_t>(seconds * 1000 * 1000));
+    int64_t delivered1 = publisher.delivered;
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // 先停发布，再停服务端，最后关客户端，服务端还在写的时候客户端关掉会收到SIGPIPE
+    runInLoopAndWait(clientLoop, [&]()
+                     {
+                         publisher.stop = true;
+                         publisher.conns.clear();
+                     });
+    serverConns.clear();
+    serverLoop->quit();
+    serverThread.join();
+    runInLoopAndWait(clientLoop, [&]() { clients.clear(); });
+
+    double perSec = (delivered1 - delivered0) / elapsed;
+    printf("bench=fanout mode=%s size=%d connections=%d threads=%d window=%d seconds=%.2f "
+           "deliveries_per_sec=%.0f mib_per_sec=%.1f\n",
+           shared ? "shared" : "copy", size, connections, threads, window, elapsed, perSec,
+           perSec * size / 1024 / 1024);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int connections = argc > 1 ? atoi(argv[1]) : 1000;
+    double seconds = argc > 2 ? atof(argv[2]) : 3;
+    std::vector<int> sizes = parseList(argc > 3 ? argv[3] : "64,4096");
+    int threads = argc > 4 ? atoi(argv[4]) : 2;
+    int window = argc > 5 ? atoi(argv[5]) : 4;
+
+    EventLoopThread clientThread(EventLoopThread::ThreadInitCallback(), "fanoutbench-client");
+    EventLoop *clientLoop = clientThread.startLoop();
+    for (int size : sizes)
+    {
+        runCase(clientLoop, connections, size, threads, window, seconds, false);
+        runCase(clientLoop, connections, size, threads, window, seconds, true);
+    }
+    return 0;
+}
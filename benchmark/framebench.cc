@@ -0,0 +1,244 @@
+#include "../TcpServer.h"
+#include "../TcpClient.h"
+#include "../EventLoopThread.h"
+#include "../LengthFieldCodec.h"
+#include "../Logger.h"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @brief 小帧吞吐量压测：4字节长度头的帧在客户端和回显服务端之间来回
+ *
+ * 每条连接上同时有window个帧在路上，客户端收到一个帧就再发一个，统计每秒收到的帧数。
+ * 两边都开了自动cork，一轮事件循环里的回复合成一次write，测的主要是分帧和编码本身的开销。
+ * codec：LengthFieldCodec，帧直接指向inputBuffer_，头prepend到消息体前面，一次send
+ * codec_crc：同上，再加CRC32C校验
+ * copy：常见的手写做法，retrieveAsString拷出每个帧，发送时拼一个新的std::string
+ *
+ * 用法：./framebench [连接数] [每轮秒数] [帧大小列表] [window]
+ */
+
+static const uint16_t kPort = 8023;
+
+using Clock = std::chrono::steady_clock;
+
+static std::vector<int> parseList(const char *arg)
+{
+    std::vector<int> values;
+    const char *p = arg;
+    while (*p)
+    {
+        values.push_back(atoi(p));
+        while (*p && *p != ',')
+        {
+            ++p;
+        }
+        if (*p == ',')
+        {
+            ++p;
+        }
+    }
+    return values;
+}
+
+template <typename Func>
+static void runInLoopAndWait(EventLoop *loop, Func func)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]()
+                    {
+                        func();
+                        done.set_value();
+                    });
+    done.get_future().wait();
+}
+
+using FrameHandler = std::function<void(const TcpConnectionPtr &, const char *, size_t)>;
+
+// 手写的分帧：每个帧拷成一个std::string
+static void copyDecode(Buffer *buf, const TcpConnectionPtr &conn, const FrameHandler &handler)
+{
+    while (buf->readableBytes() >= 4)
+    {
+        uint32_t be;
+        memcpy(&be, buf->peek(), 4);
+        size_t len = ntohl(be);
+        if (buf->readableBytes() < 4 + len)
+        {
+            break;
+        }
+        buf->retrieve(4);
+        std::string frame = buf->retrieveAsString(len);
+        handler(conn, frame.data(), frame.size());
+    }
+}
+
+static void copySend(const TcpConnectionPtr &conn, const char *data, size_t len)
+{
+    uint32_t be = htonl(static_cast<uint32_t>(len));
+    std::string frame(reinterpret_cast<const char *>(&be), 4);
+    frame.append(data, len);
+    conn->send(frame);
+}
+
+// 一种编解码方式：怎么设置MessageCallback、怎么发一个帧
+struct FrameMode
+{
+    std::string name;
+    bool useCodec;
+    LengthFieldCodec::Options options;
+    std::shared_ptr<LengthFieldCodec> encoder; // 发送只用到encode，两边共用一个
+
+    FrameMode(const std::string &n, bool codec, bool checksum) : name(n), useCodec(codec)
+    {
+        options.checksum = checksum;
+        encoder.reset(new LengthFieldCodec(LengthFieldCodec::FrameCallback(), options));
+    }
+
+    MessageCallback messageCallback(const FrameHandler &handler) const
+    {
+        if (useCodec)
+        {
+            std::shared_ptr<LengthFieldCodec> codec(new LengthFieldCodec(
+                [handler](const TcpConnectionPtr &conn, const char *data, size_t len, Timestamp)
+                { handler(conn, data, len); },
+                options));
+            return [codec](const TcpConnectionPtr &conn, Buffer *buf, Timestamp t)
+            { codec->onMessage(conn, buf, t); };
+        }
+        return [handler](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+        { copyDecode(buf, conn, handler); };
+    }
+
+    void send(const TcpConnectionPtr &conn, const char *data, size_t len) const
+    {
+        if (useCodec)
+        {
+            encoder->send(conn, data, len);
+        }
+        else
+        {
+            copySend(conn, data, len);
+        }
+    }
+};
+
+static void runCase(FrameMode &mode, EventLoop *clientLoop, int connections, int size, int window, double seconds)
+{
+    // 回显服务端
+    std::promise<EventLoop *> serverReady;
+    std::thread serverThread([&]()
+                             {
+                                 EventLoop loop;
+                                 TcpServer server(&loop, InetAddress(kPort), "framebench");
+                                 SocketOptions options;
+                                 options.tcpNoDelay = 1;
+                                 server.setSocketOptions(options);
+                                 server.setConnectionCallback([](const TcpConnectionPtr &conn)
+                                                              {
+                                                                  if (conn->connected())
+                                                                  {
+                                                                      conn->setAutoCork(true);
+                                                                  }
+                                                              });
+                                 server.setMessageCallback(mode.messageCallback(
+                                     [&mode](const TcpConnectionPtr &conn, const char *data, size_t len)
+                                     { mode.send(conn, data, len); }));
+                                 server.start();
+                                 serverReady.set_value(&loop);
+                                 loop.loop();
+                             });
+    EventLoop *serverLoop = serverReady.get_future().get();
+
+    std::atomic<int64_t> frames(0);
+    std::atomic<int> connected(0);
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    std::string payload(size, 'f');
+    runInLoopAndWait(clientLoop, [&]()
+                     {
+                         for (int i = 0; i < connections; ++i)
+                         {
+                             TcpClient *client = new TcpClient(clientLoop, InetAddress(kPort), "framebench");
+                             SocketOptions options;
+                             options.tcpNoDelay = 1;
+                             client->setSocketOptions(options);
+                             client->setConnectionCallback([&](const TcpConnectionPtr &conn)
+                                                           {
+                                                               if (conn->connected())
+                                                               {
+                                                                   ++connected;
+                                                                   conn->setAutoCork(true);
+                                                                   for (int k = 0; k < window; ++k)
+                                                                   {
+                                                                       mode.send(conn, payload.data(), payload.size());
+                                                                   }
+                                                               }
+                                                           });
+                             client->setMessageCallback(mode.messageCallback(
+                                 [&](const TcpConnectionPtr &conn, const char *data, size_t len)
+                                 {
+                                     frames.fetch_add(1, std::memory_order_relaxed);
+                                     mode.send(conn, data, len);
+                                 }));
+                             client->connect();
+                             clients.emplace_back(client);
+                         }
+                     });
+
+    while (connected < connections)
+    {
+        usleep(1000);
+    }
+    usleep(100 * 1000); // 预热
+
+    int64_t frames0 = frames;
+    Clock::time_point start = Clock::now();
+    usleep(static_cast<useconds_t>(seconds * 1000 * 1000));
+    int64_t frames1 = frames;
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    runInLoopAndWait(clientLoop, [&]() { clients.clear(); });
+    serverLoop->quit();
+    serverThread.join();
+
+    double framesPerSec = (frames1 - frames0) / elapsed;
+    printf("bench=frame mode=%s size=%d connections=%d window=%d seconds=%.2f frames_per_sec=%.0f mib_per_sec=%.1f\n",
+           mode.name.c_str(), size, connections, window, elapsed, framesPerSec, framesPerSec * size / 1024 / 1024);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int connections = argc > 1 ? atoi(argv[1]) : 10;
+    double seconds = argc > 2 ? atof(argv[2]) : 3;
+    std::vector<int> sizes = parseList(argc > 3 ? argv[3] : "16,64,256");
+    int window = argc > 4 ? atoi(argv[4]) : 64;
+
+    EventLoopThread clientThread(EventLoopThread::ThreadInitCallback(), "framebench-client");
+    EventLoop *clientLoop = clientThread.startLoop();
+
+    std::vector<FrameMode> modes;
+    modes.emplace_back("codec", true, false);
+    modes.emplace_back("codec_crc", true, true);
+    modes.emplace_back("copy", false, false);
+
+    for (int size : sizes)
+    {
+        for (FrameMode &mode : modes)
+        {
+            runCase(mode, clientLoop, connections, size, window, seconds);
+        }
+    }
+    return 0;
+}
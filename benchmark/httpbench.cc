@@ -0,0 +1,214 @@
+#include "../HttpServer.h"
+#include "../HttpRequest.h"
+#include "../HttpResponse.h"
+#include "../TcpClient.h"
+#include "../EventLoopThread.h"
+#include "../Logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @brief 类似wrk的plaintext压测：GET /plaintext，回复"Hello, World!"
+ *
+ * 客户端每条连接上保持pipeline个请求在路上，收到一个完整的响应就再发一个，统计每秒完成的请求数。
+ * pipeline为1时就是wrk默认的一问一答，16是TechEmpower plaintext测试用的流水线深度。
+ * 请求头和wrk发的差不多大小，响应带Date、Content-Type、Content-Length
+ *
+ * 用法：./httpbench [连接数] [每轮秒数] [pipeline列表] [服务端线程数]
+ */
+
+static const uint16_t kPort = 8024;
+
+using Clock = std::chrono::steady_clock;
+
+static const char kRequest[] =
+    "GET /plaintext HTTP/1.1\r\n"
+    "Host: 127.0.0.1:8024\r\n"
+    "User-Agent: httpbench\r\n"
+    "Accept: text/plain,text/html;q=0.9,application/xhtml+xml;q=0.9,*/*;q=0.8\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+static std::vector<int> parseList(const char *arg)
+{
+    std::vector<int> values;
+    const char *p = arg;
+    while (*p)
+    {
+        values.push_back(atoi(p));
+        while (*p && *p != ',')
+        {
+            ++p;
+        }
+        if (*p == ',')
+        {
+            ++p;
+        }
+    }
+    return values;
+}
+
+template <typename Func>
+static void runInLoopAndWait(EventLoop *loop, Func func)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]()
+                    {
+                        func();
+                        done.set_value();
+                    });
+    done.get_future().wait();
+}
+
+static void onRequest(const HttpRequest &req, HttpResponse *resp)
+{
+    if (req.path() == "/plaintext")
+    {
+        resp->setStatusCode(HttpResponse::k200Ok);
+        resp->setContentType("text/plain");
+        resp->setBody("Hello, World!");
+    }
+    else
+    {
+        resp->setStatusCode(HttpResponse::k404NotFound);
+    }
+}
+
+// 客户端这边只数完整的响应：找到空行，按Content-Length跳过消息体
+static int consumeResponses(Buffer *buf)
+{
+    int n = 0;
+    for (;;)
+    {
+        const char *begin = buf->peek();
+        size_t readable = buf->readableBytes();
+        const char *end = static_cast<const char *>(memmem(begin, readable, "\r\n\r\n", 4));
+        if (end == nullptr)
+        {
+            break;
+        }
+        size_t headerLen = end + 4 - begin;
+        size_t bodyLen = 0;
+        const char *cl = static_cast<const char *>(memmem(begin, headerLen, "Content-Length: ", 16));
+        if (cl)
+        {
+            bodyLen = strtoul(cl + 16, nullptr, 10);
+        }
+        if (readable < headerLen + bodyLen)
+        {
+            break;
+        }
+        buf->retrieve(headerLen + bodyLen);
+        ++n;
+    }
+    return n;
+}
+
+static void runCase(EventLoop *clientLoop, int connections, int pipeline, int serverThreads, double seconds)
+{
+    std::promise<EventLoop *> serverReady;
+    std::thread serverThread([&]()
+                             {
+                                 EventLoop loop;
+                                 HttpServer server(&loop, InetAddress(kPort), "httpbench");
+                                 SocketOptions options;
+                                 options.tcpNoDelay = 1;
+                                 server.tcpServer()->setSocketOptions(options);
+                                 server.setThreadNum(serverThreads);
+                                 server.setHttpCallback(onRequest);
+                                 server.start();
+                                 serverReady.set_value(&loop);
+                                 loop.loop();
+                             });
+    EventLoop *serverLoop = serverReady.get_future().get();
+
+    std::atomic<int64_t> requests(0);
+    std::atomic<int> connected(0);
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    std::string single(kRequest);
+    std::string batch;
+    for (int k = 0; k < pipeline; ++k)
+    {
+        batch += kRequest;
+    }
+    runInLoopAndWait(clientLoop, [&]()
+                     {
+                         for (int i = 0; i < connections; ++i)
+                         {
+                             TcpClient *client = new TcpClient(clientLoop, InetAddress(kPort), "httpbench");
+                             SocketOptions options;
+                             options.tcpNoDelay = 1;
+                             client->setSocketOptions(options);
+                             client->setConnectionCallback([&](const TcpConnectionPtr &conn)
+                                                           {
+                                                               if (conn->connected())
+                                                               {
+                                                                   ++connected;
+                                                                   conn->setAutoCork(true);
+                                                                   conn->send(batch);
+                                                               }
+                                                           });
+                             client->setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                                        {
+                                                            int n = consumeResponses(buf);
+                                                            requests.fetch_add(n, std::memory_order_relaxed);
+                                                            // 完成几个补几个，保持pipeline个请求在路上
+                                                            for (int k = 0; k < n; ++k)
+                                                            {
+                                                                conn->send(single);
+                                                            }
+                                                        });
+                             client->connect();
+                             clients.emplace_back(client);
+                         }
+                     });
+
+    while (connected < connections)
+    {
+        usleep(1000);
+    }
+    usleep(100 * 1000); // 预热
+
+    int64_t requests0 = requests;
+    Clock::time_point start = Clock::now();
+    usleep(static_cast<useconds_t>(seconds * 1000 * 1000));
+    int64_t requests1 = requests;
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    runInLoopAndWait(clientLoop, [&]() { clients.clear(); });
+    serverLoop->quit();
+    serverThread.join();
+
+    printf("bench=http mode=plaintext connections=%d pipeline=%d server_threads=%d seconds=%.2f requests_per_sec=%.0f\n",
+           connections, pipeline, serverThreads, elapsed, (requests1 - requests0) / elapsed);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int connections = argc > 1 ? atoi(argv[1]) : 64;
+    double seconds = argc > 2 ? atof(argv[2]) : 3;
+    std::vector<int> pipelines = parseList(argc > 3 ? argv[3] : "1,16");
+    int serverThreads = argc > 4 ? atoi(argv[4]) : 0;
+
+    Logger::setLogLevel(ERROR); // 连接建立断开的INFO日志不要混进结果里
+
+    EventLoopThread clientThread(EventLoopThread::ThreadInitCallback(), "httpbench-client");
+    EventLoop *clientLoop = clientThread.startLoop();
+
+    for (int pipeline : pipelines)
+    {
+        runCase(clientLoop, connections, pipeline, serverThreads, seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include "../TcpServer.h"
+#include "../TcpClient.h"
+#include "../EventLoopThread.h"
+#include "../Logger.h"
+#include "HdrHistogram.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * @brief 请求/响应延迟压测，结果是HDR直方图的p50/p99/p999
+ *
+ * 每条连接发一个size字节的请求，等服务端原样回完整个响应，记下往返时间，再发下一个（闭环）。
+ * 每个客户端loop一个直方图，结束时合并
+ *
+ * 用法：./latencybench [连接数] [请求大小] [每轮秒数] [服务端subloop数] [客户端loop数]
+ */
+
+static const uint16_t kPort = 8021;
+
+using Clock = std::chrono::steady_clock;
+
+template <typename Func>
+static void runInLoopAndWait(EventLoop *loop, Func func)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]()
+                    {
+                        func();
+                        done.set_value();
+                    });
+    done.get_future().wait();
+}
+
+// 一条连接上的请求状态，只在所属的loop线程里访问
+struct Session
+{
+    size_t received;
+    Clock::time_point sentAt;
+};
+
+// 一个客户端loop，除了connected以外都只在loop线程里访问
+struct ClientLoop
+{
+    EventLoop *loop;
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    HdrHistogram histogram; // 纳秒
+    bool measuring = false;
+    std::atomic<int> connected{0};
+};
+
+int main(int argc, char *argv[])
+{
+    int connections = argc > 1 ? atoi(argv[1]) : 16;
+    int size = argc > 2 ? atoi(argv[2]) : 64;
+    double seconds = argc > 3 ? atof(argv[3]) : 3;
+    int serverThreads = argc > 4 ? atoi(argv[4]) : 2;
+    int clientThreads = argc > 5 ? atoi(argv[5]) : 2;
+
+    std::promise<EventLoop *> serverReady;
+    std::thread serverThread([&]()
+                             {
+                                 EventLoop loop;
+                                 TcpServer server(&loop, InetAddress(kPort), "latency");
+                                 SocketOptions options;
+                                 options.tcpNoDelay = 1;
+                                 server.setSocketOptions(options);
+                                 server.setThreadNum(serverThreads);
+                                 server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                                           { conn->send(buf->retrieveAllAsString()); });
+                                 server.start();
+                                 serverReady.set_value(&loop);
+                                 loop.loop();
+                             });
+    EventLoop *serverLoop = serverReady.get_future().get();
+
+    std::string request(size, 'r');
+    std::vector<std::unique_ptr<EventLoopThread>> threads;
+    std::vector<std::unique_ptr<ClientLoop>> clientLoops;
+    for (int i = 0; i < clientThreads; ++i)
+    {
+        threads.emplace_back(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "latency-client"));
+        clientLoops.emplace_back(new ClientLoop);
+        ClientLoop *cl = clientLoops.back().get();
+        cl->loop = threads.back()->startLoop();
+        int share = connections / clientThreads + (i < connections % clientThreads ? 1 : 0);
+        runInLoopAndWait(cl->loop, [&]()
+                         {
+                             for (int k = 0; k < share; ++k)
+                             {
+                                 std::shared_ptr<Session> session = std::make_shared<Session>();
+                                 TcpClient *client = new TcpClient(cl->loop, InetAddress(kPort), "latency");
+                                 SocketOptions options;
+                                 options.tcpNoDelay = 1;
+                                 client->setSocketOptions(options);
+                                 client->setConnectionCallback([cl, session, request](const TcpConnectionPtr &conn)
+                                                               {
+                                                                   if (conn->connected())
+                                                                   {
+                                                                       ++cl->connected;
+                                                                       session->received = 0;
+                                                                       session->sentAt = Clock::now();
+                                                                       conn->send(request);
+                                                                   }
+                                                               });
+                                 client->setMessageCallback([cl, session, request](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                                            {
+                                                                session->received += buf->readableBytes();
+                                                                buf->retrieveAll();
+                                                                if (session->received < request.size())
+                                                                {
+                                                                    return; // 响应还没收全
+                                                                }
+                                                                Clock::time_point now = Clock::now();
+                                                                if (cl->measuring)
+                                                                {
+                                                                    cl->histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - session->sentAt).count());
+                                                                }
+                                                                session->received = 0;
+                                                                session->sentAt = now;
+                                                                conn->send(request);
+                                                            });
+                                 client->connect();
+                                 cl->clients.emplace_back(client);
+                             }
+                         });
+    }
+
+    for (;;)
+    {
+        int total = 0;
+        for (auto &cl : clientLoops)
+        {
+            total += cl->connected;
+        }
+        if (total >= connections)
+        {
+            break;
+        }
+        usleep(1000);
+    }
+    usleep(100 * 1000); // 预热
+
+    for (auto &cl : clientLoops)
+    {
+        ClientLoop *raw = cl.get();
+        runInLoopAndWait(raw->loop, [raw]() { raw->measuring = true; });
+    }
+    Clock::time_point start = Clock::now();
+    usleep(static_cast<useconds_t>(seconds * 1000 * 1000));
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    HdrHistogram merged;
+    for (auto &cl : clientLoops)
+    {
+        ClientLoop *raw = cl.get();
+        runInLoopAndWait(raw->loop, [raw, &merged]()
+                         {
+                             raw->measuring = false;
+                             merged.merge(raw->histogram);
+                             raw->clients.clear();
+                         });
+    }
+
+    threads.clear();
+    serverLoop->quit();
+    serverThread.join();
+
+    printf("bench=latency connections=%d size=%d server_threads=%d client_threads=%d seconds=%.2f requests=%ld "
+           "requests_per_sec=%.0f mean_us=%.1f p50_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f\n",
+           connections, size, serverThreads, clientThreads, elapsed, merged.count(), merged.count() / elapsed,
+           merged.mean() / 1000, merged.valueAtPercentile(50) / 1000.0, merged.valueAtPercentile(99) / 1000.0,
+           merged.valueAtPercentile(99.9) / 1000.0, merged.max() / 1000.0);
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "../Logger.h"
+#include "../AsyncLogging.h"
+#include "../BinaryLogging.h"
+#include "HdrHistogram.h"
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+
+/**
+ * @brief 多线程同时打日志时，一次LOG_INFO调用本身要多久
+ *
+ * sync：每一行都fwrite+fflush到文件，也就是原来std::endl的做法，每条日志一次write系统调用
+ * async：输出换成AsyncLogging，调用线程只拷贝到内存，后台线程批量写文件
+ * binary：BinaryLogging，调用线程只拷贝站点id、时钟计数和原始参数，不格式化（缓冲区满了会丢）
+ * 每个线程一个直方图，结束后合并，输出每秒调用次数和单次调用延迟的分位数
+ *
+ * 用法：./logbench [线程数] [每个线程的调用次数] [sync|async|binary|all]
+ */
+
+using Clock = std::chrono::steady_clock;
+
+static FILE *syncFile = nullptr;
+
+static void syncOutput(const char *line, size_t len)
+{
+    fwrite(line, 1, len, syncFile);
+    fflush(syncFile);
+}
+
+static void stdoutOutput(const char *line, size_t len)
+{
+    fwrite(line, 1, len, stdout);
+}
+
+static void runCase(const char *mode, int numThreads, int calls)
+{
+    std::vector<HdrHistogram> histograms(numThreads);
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (int i = 0; i < numThreads; ++i)
+    {
+        threads.emplace_back([&histograms, i, calls]()
+                             {
+                                 HdrHistogram &hist = histograms[i];
+                                 for (int n = 0; n < calls; ++n)
+                                 {
+                                     auto begin = Clock::now();
+                                     LOG_INFO("logbench thread=%d seq=%d some payload to make a realistic line length", i, n);
+                                     auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+                                     hist.record(ns);
+                                 }
+                             });
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    HdrHistogram total;
+    for (const HdrHistogram &hist : histograms)
+    {
+        total.merge(hist);
+    }
+    printf("bench=log mode=%s threads=%d calls=%lld calls_per_sec=%.0f p50_ns=%lld p99_ns=%lld p999_ns=%lld max_ns=%lld\n",
+           mode, numThreads, static_cast<long long>(total.count()), total.count() / seconds,
+           static_cast<long long>(total.valueAtPercentile(50)),
+           static_cast<long long>(total.valueAtPercentile(99)),
+           static_cast<long long>(total.valueAtPercentile(99.9)),
+           static_cast<long long>(total.max()));
+    fflush(stdout);
+}
+
+// 删掉临时目录和里面的日志文件
+static void removeDir(const std::string &dir)
+{
+    DIR *d = opendir(dir.c_str());
+    if (d)
+    {
+        while (dirent *entry = readdir(d))
+        {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+            {
+                unlink((dir + "/" + entry->d_name).c_str());
+            }
+        }
+        closedir(d);
+    }
+    rmdir(dir.c_str());
+}
+
+int main(int argc, char *argv[])
+{
+    int numThreads = argc > 1 ? atoi(argv[1]) : 8;
+    int calls = argc > 2 ? atoi(argv[2]) : 200000;
+    std::string mode = argc > 3 ? argv[3] : "all";
+
+    char dirTemplate[] = "/tmp/logbench.XXXXXX";
+    if (mkdtemp(dirTemplate) == nullptr)
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string dir = dirTemplate;
+
+    if (mode == "sync" || mode == "all")
+    {
+        syncFile = fopen((dir + "/sync.log").c_str(), "w");
+        Logger::instance().setOutput(syncOutput);
+        runCase("sync", numThreads, calls);
+        Logger::instance().setOutput(stdoutOutput);
+        fclose(syncFile);
+    }
+
+    if (mode == "async" || mode == "all")
+    {
+        AsyncLogging log(dir + "/async", 1024 * 1024 * 1024);
+        log.start();
+        Logger::instance().setOutput(std::bind(&AsyncLogging::append, &log, std::placeholders::_1, std::placeholders::_2));
+        runCase("async", numThreads, calls);
+        Logger::instance().setOutput(stdoutOutput);
+        log.stop();
+    }
+
+    if (mode == "binary" || mode == "all")
+    {
+        BinaryLogging log(dir + "/binary", 1024 * 1024 * 1024);
+        log.start();
+        runCase("binary", numThreads, calls);
+        log.stop();
+    }
+
+    removeDir(dir);
+    return 0;
+}
@@ -0,0 +1,422 @@
+#include "../Buffer.h"
+#include "../EventLoop.h"
+#include "../EventLoopThread.h"
+#include "../Channel.h"
+#include "../Timestamp.h"
+#include "../Logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+/**
+ * @brief 热路径上各个基础操作单独的开销：每次操作多少纳秒、分配几次内存
+ *
+ * 分配次数靠替换全局的operator new统计，libmymuduo.so里的分配也会算进来。
+ * 每个用例跑的时候把标准输出重定向到/dev/null（库里的日志也打在标准输出上），只有结果行打出来
+ *
+ * 用法：./microbench [用例名里包含的字符串] [迭代次数的倍数]
+ */
+
+static std::atomic<int64_t> g_allocations(0);
+
+void *operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+using Clock = std::chrono::steady_clock;
+
+static const char *g_filter = "";
+static double g_scale = 1;
+
+// 跑body(ops)，body里做ops次操作；跑之前先小规模预热一次
+static void run(const char *name, int64_t ops, const std::function<void(int64_t)> &body)
+{
+    if (strstr(name, g_filter) == nullptr)
+    {
+        return;
+    }
+    ops = static_cast<int64_t>(ops * g_scale);
+    if (ops < 1)
+    {
+        ops = 1;
+    }
+
+    fflush(stdout);
+    int savedStdout = ::dup(STDOUT_FILENO);
+    int devNull = ::open("/dev/null", O_WRONLY);
+    ::dup2(devNull, STDOUT_FILENO);
+
+    body(ops / 10 + 1);
+    int64_t allocs0 = g_allocations.load();
+    Clock::time_point start = Clock::now();
+    body(ops);
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    int64_t allocs = g_allocations.load() - allocs0;
+
+    fflush(stdout);
+    ::dup2(savedStdout, STDOUT_FILENO);
+    ::close(savedStdout);
+    ::close(devNull);
+
+    printf("bench=micro name=%s ops=%ld ns_per_op=%.1f allocs_per_op=%.3f\n",
+           name, ops, ns / ops, static_cast<double>(allocs) / ops);
+    fflush(stdout);
+}
+
+template <typename Func>
+static void runInLoopAndWait(EventLoop *loop, Func func)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]()
+                    {
+                        func();
+                        done.set_value();
+                    });
+    done.get_future().wait();
+}
+
+static void bufferBenches()
+{
+    run("buffer_append_retrieve_64", 10 * 1000 * 1000, [](int64_t ops)
+        {
+            Buffer buf;
+            char data[64] = {0};
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                buf.append(data, sizeof data);
+                buf.retrieve(sizeof data);
+            }
+        });
+
+    // 每次写600读500，可读数据一直往后挪，不停触发makeSpace里的整理（往前搬数据）
+    run("buffer_makespace_compact", 2 * 1000 * 1000, [](int64_t ops)
+        {
+            Buffer buf;
+            char data[600] = {0};
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                buf.append(data, sizeof data);
+                buf.retrieve(500);
+                if (buf.readableBytes() > 4096)
+                {
+                    buf.retrieveAll();
+                }
+            }
+        });
+
+    // 每次从空的Buffer开始写到64KB，测的是扩容
+    run("buffer_grow_64k", 20 * 1000, [](int64_t ops)
+        {
+            char data[1024] = {0};
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                Buffer buf;
+                for (int k = 0; k < 64; ++k)
+                {
+                    buf.append(data, sizeof data);
+                }
+            }
+        });
+
+    run("buffer_retrieve_as_string_128", 5 * 1000 * 1000, [](int64_t ops)
+        {
+            Buffer buf;
+            char data[128] = {0};
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                buf.append(data, sizeof data);
+                std::string s = buf.retrieveAllAsString();
+            }
+        });
+}
+
+// 每次操作：往socketpair的一端写size字节，另一端readFd读出来
+static void readFdBench(const char *name, size_t size)
+{
+    run(name, 500 * 1000, [size](int64_t ops)
+        {
+            int fds[2];
+            ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds);
+            std::vector<char> data(size, 'x');
+            Buffer buf;
+            int savedErrno = 0;
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                ssize_t n = ::write(fds[0], data.data(), data.size());
+                (void)n;
+                buf.readFd(fds[1], &savedErrno);
+                buf.retrieveAll();
+            }
+            ::close(fds[0]);
+            ::close(fds[1]);
+        });
+}
+
+static void loopBenches()
+{
+    // 跨线程投递的吞吐：不停地queueInLoop，等最后一个执行完
+    run("queue_in_loop_throughput", 1000 * 1000, [](int64_t ops)
+        {
+            EventLoopThread thread(EventLoopThread::ThreadInitCallback(), "micro");
+            EventLoop *loop = thread.startLoop();
+            int64_t executed = 0; // 只在loop线程里访问
+            std::promise<void> done;
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                loop->queueInLoop([&executed, &done, ops]()
+                                  {
+                                      if (++executed == ops)
+                                      {
+                                          done.set_value();
+                                      }
+                                  });
+            }
+            done.get_future().wait();
+        });
+
+    // 跨线程投递的延迟：投递一个回调，等它在loop线程里执行完再投下一个（往返）
+    run("queue_in_loop_roundtrip", 50 * 1000, [](int64_t ops)
+        {
+            EventLoopThread thread(EventLoopThread::ThreadInitCallback(), "micro");
+            EventLoop *loop = thread.startLoop();
+            std::atomic<bool> flag(false);
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                flag.store(false, std::memory_order_relaxed);
+                loop->queueInLoop([&flag]() { flag.store(true, std::memory_order_release); });
+                while (!flag.load(std::memory_order_acquire))
+                {
+                    sched_yield();
+                }
+            }
+        });
+
+    // loop线程里自己runInLoop，直接执行
+    run("run_in_loop_same_thread", 10 * 1000 * 1000, [](int64_t ops)
+        {
+            EventLoop loop;
+            int64_t counter = 0;
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                loop.runInLoop([&counter]() { ++counter; });
+            }
+        });
+}
+
+// 已经注册了n个channel的时候，改一个channel关注的事件（一次epoll_ctl）
+static void pollerUpdateBench(const char *name, int n)
+{
+    run(name, 200 * 1000, [n](int64_t ops)
+        {
+            EventLoop loop;
+            std::vector<int> fds;
+            std::vector<std::unique_ptr<Channel>> channels;
+            for (int i = 0; i < n; ++i)
+            {
+                fds.push_back(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+                channels.emplace_back(new Channel(&loop, fds.back()));
+                channels.back()->enableReading();
+            }
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                Channel *channel = channels[i % n].get();
+                if (i & 1)
+                {
+                    channel->disableWriting();
+                }
+                else
+                {
+                    channel->enableWriting();
+                }
+            }
+            for (std::unique_ptr<Channel> &channel : channels)
+            {
+                channel->disableAll();
+                channel->remove();
+            }
+            for (int fd : fds)
+            {
+                ::close(fd);
+            }
+        });
+}
+
+// 注册了n个channel、其中一个一直可读的时候，事件循环转一圈（epoll_wait + 分发）的开销
+static void pollerPollBench(const char *name, int n)
+{
+    run(name, 200 * 1000, [n](int64_t ops)
+        {
+            EventLoop loop;
+            std::vector<int> fds;
+            std::vector<std::unique_ptr<Channel>> channels;
+            for (int i = 0; i < n; ++i)
+            {
+                fds.push_back(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+                channels.emplace_back(new Channel(&loop, fds.back()));
+                channels.back()->enableReading();
+            }
+            uint64_t one = 1;
+            ssize_t written = ::write(fds[0], &one, sizeof one); // 不读出来，LT模式下每轮都会报告
+            (void)written;
+            int64_t rounds = 0;
+            channels[0]->setReadCallback([&](Timestamp)
+                                         {
+                                             if (++rounds == ops)
+                                             {
+                                                 loop.quit();
+                                             }
+                                         });
+            loop.loop();
+            for (std::unique_ptr<Channel> &channel : channels)
+            {
+                channel->disableAll();
+                channel->remove();
+            }
+            for (int fd : fds)
+            {
+                ::close(fd);
+            }
+        });
+}
+
+static void timeAndLogBenches()
+{
+    run("timestamp_now", 10 * 1000 * 1000, [](int64_t ops)
+        {
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                Timestamp t = Timestamp::now();
+                (void)t;
+            }
+        });
+
+    run("timestamp_monotonic", 10 * 1000 * 1000, [](int64_t ops)
+        {
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                Timestamp t = Timestamp::monotonicNow();
+                (void)t;
+            }
+        });
+
+    run("timestamp_to_string", 1000 * 1000, [](int64_t ops)
+        {
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                std::string s = Timestamp::now().toString();
+            }
+        });
+
+    // 日志的写法：同一秒内命中每线程的缓存，只渲染微秒
+    run("timestamp_format", 5 * 1000 * 1000, [](int64_t ops)
+        {
+            char buf[Timestamp::kFormattedSize];
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                Timestamp::now().format(buf, sizeof buf);
+            }
+        });
+
+    // 每次都换一秒，缓存不命中，相当于原来每行都调localtime_r
+    run("timestamp_format_uncached", 1000 * 1000, [](int64_t ops)
+        {
+            char buf[Timestamp::kFormattedSize];
+            int64_t base = Timestamp::now().microSecondsSinceEpoch();
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                Timestamp(base + i * Timestamp::kMicroSecondsPerSecond).format(buf, sizeof buf);
+            }
+        });
+
+    run("log_info", 500 * 1000, [](int64_t ops)
+        {
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                LOG_INFO("microbench log line %ld value=%d", i, 42);
+            }
+        });
+
+    // 二进制日志：只拷贝站点id、时钟计数和参数，后台线程写到/tmp下面，跑完删掉
+    run("log_info_binary", 2 * 1000 * 1000, [](int64_t ops)
+        {
+            char dir[] = "/tmp/microbench.XXXXXX";
+            if (mkdtemp(dir) == nullptr)
+            {
+                return;
+            }
+            std::string basename = std::string(dir) + "/bin";
+            {
+                BinaryLogging log(basename, 1024 * 1024 * 1024);
+                log.start();
+                for (int64_t i = 0; i < ops; ++i)
+                {
+                    LOG_INFO("microbench log line %ld value=%d", i, 42);
+                }
+                log.stop();
+            }
+            std::string cmd = std::string("rm -rf ") + dir;
+            if (system(cmd.c_str()) != 0)
+            {
+                return;
+            }
+        });
+
+    // 门槛调到ERROR以后，LOG_INFO只剩一次原子读和一个分支
+    run("log_info_filtered", 50 * 1000 * 1000, [](int64_t ops)
+        {
+            Logger::setLogLevel(ERROR);
+            for (int64_t i = 0; i < ops; ++i)
+            {
+                LOG_INFO("microbench log line %ld value=%d", i, 42);
+            }
+            Logger::setLogLevel(INFO);
+        });
+}
+
+int main(int argc, char *argv[])
+{
+    g_filter = argc > 1 ? argv[1] : "";
+    g_scale = argc > 2 ? atof(argv[2]) : 1;
+
+    bufferBenches();
+    readFdBench("read_fd_socketpair_64", 64);
+    readFdBench("read_fd_socketpair_4k", 4096);
+    loopBenches();
+    pollerUpdateBench("epoll_update_n10", 10);
+    pollerUpdateBench("epoll_update_n1000", 1000);
+    pollerPollBench("epoll_poll_n10", 10);
+    pollerPollBench("epoll_poll_n1000", 1000);
+    timeAndLogBenches();
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include "../TcpServer.h"
+#include "../WorkStealingPool.h"
+#include "../Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/**
+ * @brief 计算和IO混在一起的压测：同一个subloop上既有耗CPU的重请求，也有只要回一句话的轻请求
+ *
+ * 协议是一行一个请求，"H\n"要算一阵子再回，"L\n"马上回，回复都是一行
+ * 先跑一轮重请求直接在onMessage里算（inline），再跑一轮交给WorkStealingPool算（offload），
+ * 比较两轮轻请求的往返延迟
+ *
+ * 用法：./offloadbench [重请求客户端数] [轻请求客户端数] [计算线程数] [每轮秒数]
+ */
+
+static const uint16_t kPortInline = 8004;
+static const uint16_t kPortOffload = 8005;
+static const int kHeavyIterations = 1000 * 1000; // 一个重请求要算几毫秒
+
+static std::string heavyWork()
+{
+    uint64_t h = 1469598103934665603ULL;
+    for (int i = 0; i < kHeavyIterations; ++i)
+    {
+        h = (h ^ i) * 1099511628211ULL;
+    }
+    char buf[32];
+    snprintf(buf, sizeof buf, "%016lx\n", h);
+    return buf;
+}
+
+static int connectTo(uint16_t port)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    while (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+    {
+        usleep(1000);
+    }
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    return fd;
+}
+
+// 读到n个换行为止
+static bool readLines(int fd, int n)
+{
+    char buf[4096];
+    while (n > 0)
+    {
+        ssize_t len = ::read(fd, buf, sizeof buf);
+        if (len <= 0)
+        {
+            return false;
+        }
+        n -= static_cast<int>(std::count(buf, buf + len, '\n'));
+    }
+    return true;
+}
+
+static void runRound(bool offload, int heavyClients, int lightClients, int workers, double seconds)
+{
+    uint16_t port = offload ? kPortOffload : kPortInline;
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), offload ? "offload" : "inline");
+    server.setThreadNum(1); // 所有连接都在同一个subloop上，才看得出重请求对轻请求的影响
+
+    WorkStealingPool pool("compute");
+    pool.setThreadNum(workers);
+    pool.start();
+
+    server.setMessageCallback([offload, &pool](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                              {
+                                  const char *eol;
+                                  while ((eol = static_cast<const char *>(memchr(buf->peek(), '\n', buf->readableBytes()))) != nullptr)
+                                  {
+                                      bool heavy = buf->peek()[0] == 'H';
+                                      buf->retrieve(eol - buf->peek() + 1);
+                                      // 压测里轻重请求不在同一个连接上，轻请求可以直接回；
+                                      // 同一个连接上混着发的话，轻请求也要走offload才能排在前面的重请求后面
+                                      if (!heavy)
+                                      {
+                                          conn->send("ok\n");
+                                      }
+                                      else if (offload)
+                                      {
+                                          conn->offload(&pool, heavyWork,
+                                                        [](const TcpConnectionPtr &c, const std::string &reply) { c->send(reply); });
+                                      }
+                                      else
+                                      {
+                                          conn->send(heavyWork());
+                                      }
+                                  }
+                              });
+    server.start();
+
+    std::atomic<bool> stop(false);
+    std::atomic<long> heavyDone(0);
+    std::vector<std::vector<double>> latencies(lightClients);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < heavyClients; ++i)
+    {
+        threads.emplace_back([&]()
+                             {
+                                 int fd = connectTo(port);
+                                 const int kDepth = 4; // 每次流水线发4个重请求
+                                 std::string req(kDepth * 2, 'H');
+                                 for (int k = 1; k < kDepth * 2; k += 2)
+                                 {
+                                     req[k] = '\n';
+                                 }
+                                 while (!stop)
+                                 {
+                                     if (::write(fd, req.data(), req.size()) <= 0 || !readLines(fd, kDepth))
+                                     {
+                                         break;
+                                     }
+                                     heavyDone += kDepth;
+                                 }
+                                 ::close(fd);
+                             });
+    }
+    for (int i = 0; i < lightClients; ++i)
+    {
+        threads.emplace_back([&, i]()
+                             {
+                                 int fd = connectTo(port);
+                                 while (!stop)
+                                 {
+                                     auto start = std::chrono::steady_clock::now();
+                                     if (::write(fd, "L\n", 2) != 2 || !readLines(fd, 1))
+                                     {
+                                         break;
+                                     }
+                                     latencies[i].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+                                     usleep(200);
+                                 }
+                                 ::close(fd);
+                             });
+    }
+
+    std::thread timer([&]()
+                      {
+                          usleep(static_cast<useconds_t>(seconds * 1000 * 1000));
+                          stop = true;
+                          for (std::thread &t : threads)
+                          {
+                              t.join();
+                          }
+                          loop.quit();
+                      });
+    loop.loop();
+    timer.join();
+    pool.stop();
+
+    std::vector<double> all;
+    for (const auto &l : latencies)
+    {
+        all.insert(all.end(), l.begin(), l.end());
+    }
+    std::sort(all.begin(), all.end());
+    double p50 = all.empty() ? 0 : all[all.size() / 2];
+    double p99 = all.empty() ? 0 : all[all.size() * 99 / 100];
+    printf("bench=offload mode=%s heavy_clients=%d light_clients=%d workers=%d heavy_per_sec=%.0f light_requests=%zu light_p50_us=%.0f light_p99_us=%.0f\n",
+           offload ? "offload" : "inline", heavyClients, lightClients, workers,
+           heavyDone / seconds, all.size(), p50, p99);
+}
+
+int main(int argc, char *argv[])
+{
+    int heavyClients = argc > 1 ? atoi(argv[1]) : 2;
+    int lightClients = argc > 2 ? atoi(argv[2]) : 8;
+    int workers = argc > 3 ? atoi(argv[3]) : 4;
+    double seconds = argc > 4 ? atof(argv[4]) : 5;
+
+    runRound(false, heavyClients, lightClients, workers, seconds);
+    runRound(true, heavyClients, lightClients, workers, seconds);
+    return 0;
+}
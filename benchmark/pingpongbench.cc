@@ -0,0 +1,197 @@
+#include "../TcpServer.h"
+#include "../TcpClient.h"
+#include "../EventLoopThread.h"
+#include "../Logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * @brief pingpong吞吐量压测，服务端和客户端都用这个库
+ *
+ * 每条连接建立以后客户端先发一个size字节的消息，服务端原样回，客户端收到多少再原样发回去，
+ * 数据在两边之间来回弹；统计客户端每秒收到的字节数。消息大小和连接数各给一组，每个组合跑一轮
+ *
+ * 用法：./pingpongbench [服务端subloop数] [客户端loop数] [每轮秒数] [消息大小列表] [连接数列表]
+ * 例如：./pingpongbench 2 2 3 64,4096,65536 1,10,100
+ */
+
+static const uint16_t kPort = 8020;
+
+using Clock = std::chrono::steady_clock;
+
+static std::vector<int> parseList(const char *arg)
+{
+    std::vector<int> values;
+    const char *p = arg;
+    while (*p)
+    {
+        values.push_back(atoi(p));
+        while (*p && *p != ',')
+        {
+            ++p;
+        }
+        if (*p == ',')
+        {
+            ++p;
+        }
+    }
+    return values;
+}
+
+template <typename Func>
+static void runInLoopAndWait(EventLoop *loop, Func func)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]()
+                    {
+                        func();
+                        done.set_value();
+                    });
+    done.get_future().wait();
+}
+
+// 一个客户端loop上的所有连接，clients只在这个loop线程里访问
+struct ClientLoop
+{
+    EventLoop *loop;
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    std::atomic<int64_t> bytesRead{0};
+    std::atomic<int> connected{0};
+};
+
+static void runCase(const std::vector<ClientLoop *> &clientLoops, int size, int connections, double seconds,
+                    int serverThreads)
+{
+    std::string message(size, 'x');
+    for (size_t i = 0; i < clientLoops.size(); ++i)
+    {
+        ClientLoop *cl = clientLoops[i];
+        cl->bytesRead = 0;
+        cl->connected = 0;
+        int share = connections / static_cast<int>(clientLoops.size()) + (static_cast<int>(i) < connections % static_cast<int>(clientLoops.size()) ? 1 : 0);
+        runInLoopAndWait(cl->loop, [&]()
+                         {
+                             for (int k = 0; k < share; ++k)
+                             {
+                                 TcpClient *client = new TcpClient(cl->loop, InetAddress(kPort), "pingpong");
+                                 SocketOptions options;
+                                 options.tcpNoDelay = 1;
+                                 client->setSocketOptions(options);
+                                 client->setConnectionCallback([cl, message](const TcpConnectionPtr &conn)
+                                                               {
+                                                                   if (conn->connected())
+                                                                   {
+                                                                       ++cl->connected;
+                                                                       conn->send(message);
+                                                                   }
+                                                               });
+                                 client->setMessageCallback([cl](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                                            {
+                                                                cl->bytesRead.fetch_add(buf->readableBytes(), std::memory_order_relaxed);
+                                                                conn->send(buf->retrieveAllAsString());
+                                                            });
+                                 client->connect();
+                                 cl->clients.emplace_back(client);
+                             }
+                         });
+    }
+
+    // 等所有连接都建立好再开始计时
+    for (;;)
+    {
+        int total = 0;
+        for (ClientLoop *cl : clientLoops)
+        {
+            total += cl->connected;
+        }
+        if (total >= connections)
+        {
+            break;
+        }
+        usleep(1000);
+    }
+    usleep(100 * 1000); // 预热
+
+    int64_t bytes0 = 0;
+    for (ClientLoop *cl : clientLoops)
+    {
+        bytes0 += cl->bytesRead;
+    }
+    Clock::time_point start = Clock::now();
+    usleep(static_cast<useconds_t>(seconds * 1000 * 1000));
+    int64_t bytes1 = 0;
+    for (ClientLoop *cl : clientLoops)
+    {
+        bytes1 += cl->bytesRead;
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (ClientLoop *cl : clientLoops)
+    {
+        runInLoopAndWait(cl->loop, [cl]() { cl->clients.clear(); }); // TcpClient析构时关掉连接
+    }
+
+    printf("bench=pingpong size=%d connections=%d server_threads=%d client_threads=%zu seconds=%.2f mib_per_sec=%.1f msgs_per_sec=%.0f\n",
+           size, connections, serverThreads, clientLoops.size(), elapsed,
+           (bytes1 - bytes0) / elapsed / 1024 / 1024, (bytes1 - bytes0) / elapsed / size);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int serverThreads = argc > 1 ? atoi(argv[1]) : 2;
+    int clientThreads = argc > 2 ? atoi(argv[2]) : 2;
+    double seconds = argc > 3 ? atof(argv[3]) : 3;
+    std::vector<int> sizes = parseList(argc > 4 ? argv[4] : "64,4096,65536");
+    std::vector<int> connectionCounts = parseList(argc > 5 ? argv[5] : "1,10,100");
+
+    std::promise<EventLoop *> serverReady;
+    std::thread serverThread([&]()
+                             {
+                                 EventLoop loop;
+                                 TcpServer server(&loop, InetAddress(kPort), "pingpong");
+                                 SocketOptions options;
+                                 options.tcpNoDelay = 1;
+                                 server.setSocketOptions(options);
+                                 server.setThreadNum(serverThreads);
+                                 server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                                           { conn->send(buf->retrieveAllAsString()); });
+                                 server.start();
+                                 serverReady.set_value(&loop);
+                                 loop.loop();
+                             });
+    EventLoop *serverLoop = serverReady.get_future().get();
+
+    std::vector<std::unique_ptr<EventLoopThread>> threads;
+    std::vector<std::unique_ptr<ClientLoop>> clientLoops;
+    std::vector<ClientLoop *> rawLoops;
+    for (int i = 0; i < clientThreads; ++i)
+    {
+        threads.emplace_back(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "pingpong-client"));
+        clientLoops.emplace_back(new ClientLoop);
+        clientLoops.back()->loop = threads.back()->startLoop();
+        rawLoops.push_back(clientLoops.back().get());
+    }
+
+    for (int size : sizes)
+    {
+        for (int connections : connectionCounts)
+        {
+            runCase(rawLoops, size, connections, seconds, serverThreads);
+        }
+    }
+
+    threads.clear();
+    serverLoop->quit();
+    serverThread.join();
+    return 0;
+}
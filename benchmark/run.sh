@@ -0,0 +1,27 @@
+#!/bin/bash
+
+# 在本机回环上跑一遍吞吐、延迟和短连接压测，每个结果一行"bench=... key=value ..."，
+# 保存下来和改动之前的结果比较就能看出有没有退化
+# 用的是项目根目录lib下面刚编出来的libmymuduo.so，先运行一下autobuild.sh或者cmake编译
+# 用法：./run.sh [每轮秒数]
+
+set -e
+
+cd `dirname $0`
+SECONDS_PER_ROUND=${1:-3}
+
+make microbench logbench framebench httpbench httpparsebench wsbench fanoutbench pingpongbench latencybench churnbench CXXFLAGS="-O2 -g -std=c++11 -L../lib -Wl,-rpath,`pwd`/../lib" > /dev/null
+
+# 日志也打在标准输出上，只留下结果行
+./microbench | grep '^bench='
+./logbench 8 100000 | grep '^bench='
+./pingpongbench 2 2 $SECONDS_PER_ROUND 64,4096,65536 1,10,100 | grep '^bench='
+./latencybench 1 64 $SECONDS_PER_ROUND | grep '^bench='
+./latencybench 16 64 $SECONDS_PER_ROUND | grep '^bench='
+./latencybench 16 4096 $SECONDS_PER_ROUND | grep '^bench='
+./framebench 10 $SECONDS_PER_ROUND 16,64,256 | grep '^bench='
+./httpbench 64 $SECONDS_PER_ROUND 1,16 | grep '^bench='
+./httpparsebench | grep '^bench='
+./wsbench 100 $SECONDS_PER_ROUND | grep '^bench='
+./fanoutbench 1000 $SECONDS_PER_ROUND | grep '^bench='
+./churnbench 4 2 $SECONDS_PER_ROUND | grep '^bench='
@@ -0,0 +1,247 @@
+#include "../TcpServer.h"
+#include "../TcpClient.h"
+#include "../UpstreamPool.h"
+#include "../EventLoopThread.h"
+#include "../Logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * @brief 上游连接池和每个请求一条短连接的对比
+ *
+ * 后端是几个本地的TcpServer，按UpstreamPool的默认帧格式原样回响应；
+ * 每个驱动loop同时保持depth个请求在路上，回来一个就再发一个。
+ * pooled：每个loop一个UpstreamPool，请求流水线地发在长连接上；
+ * short：每个请求新建一个TcpClient连过去，后端回完响应就关连接
+ *
+ * 用法：./upstreambench [后端个数] [驱动loop数] [每个loop的并发请求数] [每轮秒数]
+ */
+
+static const uint16_t kBasePort = 8010;
+static const int kConnectionsPerBackend = 2;
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsedUs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+// 一个驱动loop上的请求发送和统计，只在这个loop的线程里访问
+struct Driver
+{
+    Driver(EventLoop *loop, bool pooled, int depth, const std::vector<InetAddress> &backends)
+        : loop(loop), pooled(pooled), depth(depth), backends(backends), nextBackend(0), shortClients(0), measuring(false), stopping(false)
+    {
+        if (pooled)
+        {
+            pool.reset(new UpstreamPool(loop, backends, kConnectionsPerBackend, "upstream"));
+            pool->start();
+        }
+    }
+
+    void begin()
+    {
+        measuring = true;
+        for (int i = 0; i < depth; ++i)
+        {
+            issue();
+        }
+    }
+
+    void finish(Clock::time_point start, bool ok)
+    {
+        if (measuring && ok)
+        {
+            latencies.push_back(elapsedUs(start));
+        }
+        if (!stopping)
+        {
+            issue();
+        }
+    }
+
+    void issue()
+    {
+        Clock::time_point start = Clock::now();
+        if (pooled)
+        {
+            pool->request("ping", [this, start](bool ok, const std::string &) { finish(start, ok); });
+            return;
+        }
+
+        const InetAddress &backend = backends[nextBackend++ % backends.size()];
+        TcpClient *client = new TcpClient(loop, backend, "short");
+        ++shortClients;
+        client->setConnectionCallback([this, client](const TcpConnectionPtr &conn)
+                                      {
+                                          if (conn->connected())
+                                          {
+                                              conn->setTcpNoDelay(true);
+                                              std::string frame;
+                                              UpstreamPool::encodeFrame(1, "ping", &frame);
+                                              conn->send(frame);
+                                          }
+                                          else
+                                          {
+                                              // 还在client自己的回调里，放到本轮的回调里再删
+                                              loop->queueInLoop([this, client]()
+                                                                {
+                                                                    delete client;
+                                                                    --shortClients;
+                                                                });
+                                          }
+                                      });
+        client->setMessageCallback([this, start](const TcpConnectionPtr &, Buffer *buf, Timestamp)
+                                   {
+                                       uint64_t id;
+                                       std::string payload;
+                                       if (UpstreamPool::decodeFrame(buf, &id, &payload) == UpstreamPool::kComplete)
+                                       {
+                                           finish(start, true);
+                                       }
+                                   });
+        client->connect();
+    }
+
+    EventLoop *loop;
+    bool pooled;
+    int depth;
+    std::vector<InetAddress> backends;
+    size_t nextBackend;
+    int shortClients; // 还没关掉的短连接
+    std::unique_ptr<UpstreamPool> pool;
+    bool measuring;
+    bool stopping;
+    std::vector<double> latencies;
+};
+
+template <typename Func>
+static void runInLoopAndWait(EventLoop *loop, Func func)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]()
+                    {
+                        func();
+                        done.set_value();
+                    });
+    done.get_future().wait();
+}
+
+static void runRound(bool pooled, int numBackends, int numLoops, int depth, double seconds)
+{
+    // 后端：每个后端一个TcpServer，都挂在同一个baseloop上，各自一个subloop
+    EventLoop *backendLoop = nullptr;
+    std::promise<EventLoop *> backendReady;
+    std::thread backendThread([&]()
+                              {
+                                  EventLoop loop;
+                                  std::vector<std::unique_ptr<TcpServer>> servers;
+                                  for (int i = 0; i < numBackends; ++i)
+                                  {
+                                      servers.emplace_back(new TcpServer(&loop, InetAddress(kBasePort + i), "backend"));
+                                      TcpServer *server = servers.back().get();
+                                      SocketOptions options;
+                                      options.tcpNoDelay = 1;
+                                      server->setSocketOptions(options);
+                                      server->setThreadNum(1);
+                                      server->setMessageCallback([pooled](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                                                 {
+                                                                     uint64_t id;
+                                                                     std::string payload;
+                                                                     std::string reply;
+                                                                     while (UpstreamPool::decodeFrame(buf, &id, &payload) == UpstreamPool::kComplete)
+                                                                     {
+                                                                         UpstreamPool::encodeFrame(id, payload, &reply);
+                                                                     }
+                                                                     conn->send(reply);
+                                                                     if (!pooled)
+                                                                     {
+                                                                         conn->shutdown(); // 短连接，回完就关
+                                                                     }
+                                                                 });
+                                      server->start();
+                                  }
+                                  backendReady.set_value(&loop);
+                                  loop.loop();
+                              });
+    backendLoop = backendReady.get_future().get();
+
+    std::vector<InetAddress> backends;
+    for (int i = 0; i < numBackends; ++i)
+    {
+        backends.push_back(InetAddress(kBasePort + i));
+    }
+
+    std::vector<std::unique_ptr<EventLoopThread>> threads;
+    std::vector<Driver *> drivers;
+    for (int i = 0; i < numLoops; ++i)
+    {
+        threads.emplace_back(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "driver"));
+        EventLoop *loop = threads.back()->startLoop();
+        Driver *driver = nullptr;
+        runInLoopAndWait(loop, [&]() { driver = new Driver(loop, pooled, depth, backends); });
+        drivers.push_back(driver);
+    }
+    usleep(200 * 1000); // 等连接池连上
+
+    Clock::time_point start = Clock::now();
+    for (Driver *driver : drivers)
+    {
+        driver->loop->runInLoop([driver]() { driver->begin(); });
+    }
+    usleep(static_cast<useconds_t>(seconds * 1000 * 1000));
+    double elapsed = elapsedUs(start) / 1e6;
+
+    std::vector<double> all;
+    for (Driver *driver : drivers)
+    {
+        runInLoopAndWait(driver->loop, [&]()
+                         {
+                             driver->stopping = true;
+                             driver->measuring = false;
+                             all.insert(all.end(), driver->latencies.begin(), driver->latencies.end());
+                         });
+    }
+    for (Driver *driver : drivers)
+    {
+        // 短连接的回调里用着driver，等它们都关掉再删
+        bool idle = false;
+        while (!idle)
+        {
+            usleep(10 * 1000);
+            runInLoopAndWait(driver->loop, [&]() { idle = driver->shortClients == 0; });
+        }
+        runInLoopAndWait(driver->loop, [driver]() { delete driver; });
+    }
+    threads.clear();
+    backendLoop->quit();
+    backendThread.join();
+
+    std::sort(all.begin(), all.end());
+    double p50 = all.empty() ? 0 : all[all.size() / 2];
+    double p99 = all.empty() ? 0 : all[all.size() * 99 / 100];
+    printf("bench=upstream mode=%s backends=%d loops=%d depth=%d requests_per_sec=%.0f p50_us=%.0f p99_us=%.0f\n",
+           pooled ? "pooled" : "short", numBackends, numLoops, depth, all.size() / elapsed, p50, p99);
+}
+
+int main(int argc, char *argv[])
+{
+    int numBackends = argc > 1 ? atoi(argv[1]) : 3;
+    int numLoops = argc > 2 ? atoi(argv[2]) : 2;
+    int depth = argc > 3 ? atoi(argv[3]) : 16;
+    double seconds = argc > 4 ? atof(argv[4]) : 3;
+
+    runRound(true, numBackends, numLoops, depth, seconds);
+    runRound(false, numBackends, numLoops, depth, seconds);
+    return 0;
+}
@@ -0,0 +1,281 @@
+#include "../WebSocketServer.h"
+#include "../TcpClient.h"
+#include "../EventLoopThread.h"
+#include "../Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @brief WebSocket压测
+ *
+ * mode=codec：解掩码和UTF-8校验每种实现的吞吐，负载是纯ASCII和中英混排的文本
+ * mode=broadcast：一个服务端loop给所有客户端连接广播，每批window个消息，客户端全收到了再发下一批，
+ *   服务端连接开了自动cork，一批消息合成一次write，
+ *   统计每秒送达的消息数（消息数×连接数）。
+ *   frame：WebSocketFrame编码一次，sendTo所有连接
+ *   per_client：每个连接调用一次WebSocketServer::send，负载拷进编码Buffer、加帧头各做一遍
+ *
+ * 用法：./wsbench [连接数] [每轮秒数] [消息大小列表] [window]
+ */
+
+static const uint16_t kPort = 8025;
+
+using Clock = std::chrono::steady_clock;
+
+static std::vector<int> parseList(const char *arg)
+{
+    std::vector<int> values;
+    const char *p = arg;
+    while (*p)
+    {
+        values.push_back(atoi(p));
+        while (*p && *p != ',')
+        {
+            ++p;
+        }
+        if (*p == ',')
+        {
+            ++p;
+        }
+    }
+    return values;
+}
+
+template <typename Func>
+static void runInLoopAndWait(EventLoop *loop, Func func)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]()
+                    {
+                        func();
+                        done.set_value();
+                    });
+    done.get_future().wait();
+}
+
+static void codecBench(const char *corpus, const std::string &text)
+{
+    static const char *kImpls[] = {"scalar", "sse2", "avx2"};
+    const char key[4] = {0x12, 0x34, 0x56, 0x78};
+    std::string data(text);
+    for (const char *impl : kImpls)
+    {
+        if (!WebSocket::setImplementation(impl))
+        {
+            continue;
+        }
+        const int iterations = static_cast<int>((256 << 20) / data.size());
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            WebSocket::unmask(&data[0], data.size(), key);
+        }
+        double unmaskSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        bool valid = true;
+        start = Clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            valid &= WebSocket::validUtf8(text.data(), text.size());
+        }
+        double utf8Seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        double mib = static_cast<double>(iterations) * data.size() / 1024 / 1024;
+        printf("bench=ws mode=codec corpus=%s impl=%s size=%zu unmask_mib_per_sec=%.0f utf8_mib_per_sec=%.0f valid=%d\n",
+               corpus, impl, data.size(), mib / unmaskSeconds, mib / utf8Seconds, valid ? 1 : 0);
+        fflush(stdout);
+    }
+}
+
+// 服务端loop里的状态，除了计数都只在服务端loop里访问
+struct Broadcast
+{
+    std::vector<TcpConnectionPtr> conns;
+    std::string payload;
+    bool perClient;
+    int window;
+    int64_t frameBytes;
+    std::atomic<int64_t> expectedBytes; // 到目前为止发出去的所有批次，客户端一共应该收到多少字节
+    std::atomic<int64_t> receivedBytes;
+    std::atomic<bool> stop;
+
+    Broadcast() : perClient(false), window(0), frameBytes(0), expectedBytes(0), receivedBytes(0), stop(false) {}
+
+    void sendBatch()
+    {
+        expectedBytes += static_cast<int64_t>(window) * conns.size() * frameBytes;
+        for (int i = 0; i < window; ++i)
+        {
+            if (perClient)
+            {
+                for (const TcpConnectionPtr &conn : conns)
+                {
+                    WebSocketServer::send(conn, payload, WebSocket::kBinary);
+                }
+            }
+            else
+            {
+                WebSocketFrame frame(payload.data(), payload.size(), WebSocket::kBinary);
+                frame.sendTo(conns);
+            }
+        }
+    }
+};
+
+static void broadcastBench(EventLoop *clientLoop, int connections, int size, int window, double seconds, bool perClient)
+{
+    Broadcast state;
+    state.payload.assign(size, 'b');
+    state.perClient = perClient;
+    state.window = window;
+    state.frameBytes = WebSocketFrame(state.payload.data(), state.payload.size(), WebSocket::kBinary).bytes().size();
+
+    std::promise<EventLoop *> serverReady;
+    std::thread serverThread([&]()
+                             {
+                                 EventLoop loop;
+                                 WebSocketServer server(&loop, InetAddress(kPort), "wsbench");
+                                 SocketOptions options;
+                                 options.tcpNoDelay = 1;
+                                 server.tcpServer()->setSocketOptions(options);
+                                 server.setConnectionCallback([&](const TcpConnectionPtr &conn)
+                                                              {
+                                                                  if (conn->connected())
+                                                                  {
+                                                                      conn->setAutoCork(true); // 一批消息合成一次write
+                                                                      state.conns.push_back(conn);
+                                                                  }
+                                                                  else
+                                                                  {
+                                                                      state.conns.erase(std::remove(state.conns.begin(), state.conns.end(), conn),
+                                                                                        state.conns.end());
+                                                                  }
+                                                              });
+                                 server.start();
+                                 serverReady.set_value(&loop);
+                                 loop.loop();
+                             });
+    EventLoop *serverLoop = serverReady.get_future().get();
+
+    // 客户端：先发握手请求，跳过101的响应头，后面只数字节；一批收全了就让服务端发下一批
+    std::atomic<int> upgraded(0);
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    runInLoopAndWait(clientLoop, [&]()
+                     {
+                         for (int i = 0; i < connections; ++i)
+                         {
+                             TcpClient *client = new TcpClient(clientLoop, InetAddress(kPort), "wsbench");
+                             client->setConnectionCallback([](const TcpConnectionPtr &conn)
+                                                           {
+                                                               if (conn->connected())
+                                                               {
+                                                                   conn->send("GET /bench HTTP/1.1\r\nHost: localhost\r\n"
+                                                                              "Upgrade: websocket\r\nConnection: Upgrade\r\n"
+                                                                              "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                                                              "Sec-WebSocket-Version: 13\r\n\r\n");
+                                                               }
+                                                           });
+                             client->setMessageCallback([&](const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+                                                        {
+                                                            if (!conn->getContext())
+                                                            {
+                                                                const char *end = static_cast<const char *>(
+                                                                    memmem(buf->peek(), buf->readableBytes(), "\r\n\r\n", 4));
+                                                                if (end == nullptr)
+                                                                {
+                                                                    return;
+                                                                }
+                                                                buf->retrieve(end + 4 - buf->peek());
+                                                                conn->setContext(std::make_shared<int>(1));
+                                                                ++upgraded;
+                                                            }
+                                                            if (buf->readableBytes() == 0)
+                                                            {
+                                                                return;
+                                                            }
+                                                            int64_t received = state.receivedBytes += buf->readableBytes();
+                                                            buf->retrieveAll();
+                                                            if (received == state.expectedBytes && !state.stop)
+                                                            {
+                                                                serverLoop->queueInLoop([&state]() { state.sendBatch(); });
+                                                            }
+                                                        });
+                             client->connect();
+                             clients.emplace_back(client);
+                         }
+                     });
+
+    while (upgraded < connections)
+    {
+        usleep(1000);
+    }
+    int registered = 0;
+    while (registered < connections)
+    {
+        runInLoopAndWait(serverLoop, [&]() { registered = static_cast<int>(state.conns.size()); });
+    }
+
+    serverLoop->queueInLoop([&state]() { state.sendBatch(); });
+    usleep(100 * 1000); // 预热
+    int64_t bytes0 = state.receivedBytes;
+    Clock::time_point start = Clock::now();
+    usleep(static_cast<useconds_t>(seconds * 1000 * 1000));
+    int64_t bytes1 = state.receivedBytes;
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    state.stop = true;
+
+    // 先停服务端，客户端关掉以后服务端还在写的话会收到SIGPIPE
+    runInLoopAndWait(serverLoop, [&]() { state.conns.clear(); });
+    serverLoop->quit();
+    serverThread.join();
+    runInLoopAndWait(clientLoop, [&]() { clients.clear(); });
+
+    double messagesPerSec = (bytes1 - bytes0) / static_cast<double>(state.frameBytes) / elapsed;
+    printf("bench=ws mode=broadcast impl=%s size=%d connections=%d window=%d seconds=%.2f "
+           "deliveries_per_sec=%.0f mib_per_sec=%.1f\n",
+           perClient ? "per_client" : "frame", size, connections, window, elapsed, messagesPerSec,
+           (bytes1 - bytes0) / elapsed / 1024 / 1024);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int connections = argc > 1 ? atoi(argv[1]) : 100;
+    double seconds = argc > 2 ? atof(argv[2]) : 3;
+    std::vector<int> sizes = parseList(argc > 3 ? argv[3] : "64,1024,16384");
+    int window = argc > 4 ? atoi(argv[4]) : 16;
+
+    std::string ascii;
+    std::string mixed;
+    while (ascii.size() < 4096)
+    {
+        ascii += "{\"type\":\"update\",\"symbol\":\"ABC\",\"price\":123.45,\"volume\":6789} ";
+        mixed += "价格更新：ABC 123.45，成交量 6789；";
+    }
+    codecBench("ascii", ascii);
+    codecBench("mixed", mixed);
+    if (!WebSocket::setImplementation("avx2"))
+    {
+        WebSocket::setImplementation("sse2");
+    }
+
+    EventLoopThread clientThread(EventLoopThread::ThreadInitCallback(), "wsbench-client");
+    EventLoop *clientLoop = clientThread.startLoop();
+    for (int size : sizes)
+    {
+        broadcastBench(clientLoop, connections, size, window, seconds, false);
+        broadcastBench(clientLoop, connections, size, window, seconds, true);
+    }
+    return 0;
+}
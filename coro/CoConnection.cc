@@ -0,0 +1,202 @@
+#include "CoConnection.h"
+#include "../TcpConnection.h"
+#include "../EventLoop.h"
+#include "../Buffer.h"
+
+#include <algorithm>
+
+CoConnectionPtr CoConnection::attach(const TcpConnectionPtr &conn)
+{
+    CoConnectionPtr coConn = std::make_shared<CoConnection>(conn);
+    std::weak_ptr<CoConnection> weak(coConn);
+
+    // 回调里只持有弱引用：协程先结束的话CoConnection就没了，回调什么也不做
+    conn->setMessageCallback([weak](const TcpConnectionPtr &, Buffer *, Timestamp)
+                             {
+                                 if (CoConnectionPtr c = weak.lock())
+                                 {
+                                     c->handleMessage();
+                                 }
+                             });
+
+    ConnectionCallback connectionCallback = conn->callbacks().connectionCallback;
+    conn->setConnectionCallback([weak, connectionCallback](const TcpConnectionPtr &c)
+                                {
+                                    if (connectionCallback)
+                                    {
+                                        connectionCallback(c);
+                                    }
+                                    CoConnectionPtr coConn = weak.lock();
+                                    if (coConn && !c->connected())
+                                    {
+                                        coConn->handleClose();
+                                    }
+                                });
+
+    WriteCompleteCallback writeCompleteCallback = conn->callbacks().writeCompleteCallback;
+    conn->setWriteCompleteCallback([weak, writeCompleteCallback](const TcpConnectionPtr &c)
+                                   {
+                                       if (writeCompleteCallback)
+                                       {
+                                           writeCompleteCallback(c);
+                                       }
+                                       if (CoConnectionPtr coConn = weak.lock())
+                                       {
+                                           coConn->handleWriteComplete();
+                                       }
+                                   });
+    return coConn;
+}
+
+CoConnection::CoConnection(const TcpConnectionPtr &conn)
+    : conn_(conn),
+      closed_(!conn->connected()),
+      reader_(nullptr),
+      writeHighWaterMark_(64 * 1024)
+{
+}
+
+bool CoConnection::connected() const
+{
+    return !closed_ && conn_->connected();
+}
+
+CoConnection::ReadAwaiter CoConnection::read(size_t n)
+{
+    return ReadAwaiter(this, ReadAwaiter::kExactly, n, std::string());
+}
+
+CoConnection::ReadAwaiter CoConnection::readUntil(const std::string &delim)
+{
+    return ReadAwaiter(this, ReadAwaiter::kUntil, 0, delim);
+}
+
+CoConnection::ReadAwaiter CoConnection::readSome()
+{
+    return ReadAwaiter(this, ReadAwaiter::kSome, 0, std::string());
+}
+
+CoConnection::WriteAwaiter CoConnection::write(std::string data)
+{
+    return WriteAwaiter(this, std::move(data));
+}
+
+void CoConnection::shutdown()
+{
+    conn_->shutdown();
+}
+
+void CoConnection::handleMessage()
+{
+    if (reader_ && reader_->tryRead())
+    {
+        resumeReader();
+    }
+}
+
+void CoConnection::handleWriteComplete()
+{
+    if (writer_)
+    {
+        std::coroutine_handle<> writer = writer_;
+        writer_ = nullptr;
+        writer.resume();
+    }
+}
+
+void CoConnection::handleClose()
+{
+    CoConnectionPtr guard(shared_from_this()); // 协程结束时可能把最后一个引用放掉
+    closed_ = true;
+    if (reader_)
+    {
+        reader_->tryRead(); // 断开了，把剩下的数据交出去
+        resumeReader();
+    }
+    handleWriteComplete(); // 等着发送的协程也要醒过来，write返回false
+}
+
+void CoConnection::resumeReader()
+{
+    CoConnectionPtr guard(shared_from_this());
+    std::coroutine_handle<> handle = reader_->handle_;
+    reader_ = nullptr;
+    handle.resume(); // 就在当前的回调里接着执行协程
+}
+
+bool CoConnection::ReadAwaiter::tryRead()
+{
+    Buffer *buf = conn_->conn_->inputBuffer();
+    const char *begin = buf->peek();
+    size_t readable = buf->readableBytes();
+    switch (mode_)
+    {
+    case kExactly:
+        if (readable >= n_)
+        {
+            result_ = buf->retrieveAsString(n_);
+            return true;
+        }
+        break;
+    case kUntil:
+    {
+        const char *end = begin + readable;
+        const char *pos = std::search(begin, end, delim_.begin(), delim_.end());
+        if (pos != end)
+        {
+            result_ = buf->retrieveAsString(pos - begin + delim_.size());
+            return true;
+        }
+        break;
+    }
+    case kSome:
+        if (readable > 0)
+        {
+            result_ = buf->retrieveAllAsString();
+            return true;
+        }
+        break;
+    }
+
+    if (conn_->closed_)
+    {
+        if (mode_ == kExactly)
+        {
+            result_ = buf->retrieveAllAsString(); // 对端关了，不会再有数据了，剩下多少给多少
+        }
+        return true;
+    }
+    return false;
+}
+
+void CoConnection::ReadAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    handle_ = handle;
+    conn_->reader_ = this;
+}
+
+bool CoConnection::WriteAwaiter::await_ready()
+{
+    if (!conn_->connected())
+    {
+        return true;
+    }
+    conn_->conn_->send(data_);
+    // 还没超过高水位就不用等，继续往下执行
+    return conn_->conn_->pendingOutputBytes() <= conn_->writeHighWaterMark_;
+}
+
+void CoConnection::WriteAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    conn_->writer_ = handle; // 发完（writeComplete）或者断开的时候唤醒
+}
+
+bool CoConnection::WriteAwaiter::await_resume() const
+{
+    return conn_->connected();
+}
+
+void SleepAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    loop_->runAfter(seconds_, [handle]() { handle.resume(); });
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "Task.h"
+#include "../noncopyable.h"
+#include "../Callbacks.h"
+
+#include <coroutine>
+#include <memory>
+#include <string>
+
+class EventLoop;
+class CoConnection;
+using CoConnectionPtr = std::shared_ptr<CoConnection>;
+
+/**
+ * @brief 用协程的方式读写TcpConnection
+ *
+ * 以前协议代码只能写在MessageCallback里，自己在Buffer上维护状态机；现在可以直接写成顺序的代码：
+ *
+ *     Task<> session(CoConnectionPtr conn)
+ *     {
+ *         std::string line = co_await conn->readUntil("\r\n");
+ *         co_await conn->write(reply);
+ *     }
+ *
+ * 协程在连接所属的loop线程里被唤醒，就在TcpConnection的回调里直接接着执行，不会换线程，也不经过任务队列。
+ * 协程里的读写都要在连接所属的loop线程里进行（sleep要传连接所属的loop）
+ */
+class CoConnection : noncopyable, public std::enable_shared_from_this<CoConnection>
+{
+public:
+    // 接管conn的消息回调，并在原来的连接/写完成回调上挂上唤醒协程的逻辑；
+    // 只能在conn所属的loop线程里调用，一般是在TcpServer的连接回调里
+    static CoConnectionPtr attach(const TcpConnectionPtr &conn);
+
+    explicit CoConnection(const TcpConnectionPtr &conn);
+
+    const TcpConnectionPtr &connection() const { return conn_; }
+    bool connected() const;
+
+    class ReadAwaiter;
+    class WriteAwaiter;
+
+    ReadAwaiter read(size_t n);                   // 读满n个字节；连接断开时返回剩下的，可能不足n个
+    ReadAwaiter readUntil(const std::string &delim); // 读到delim为止（包括delim）；断开时返回空串
+    ReadAwaiter readSome();                       // 有多少读多少，至少1个字节；断开时返回空串
+
+    // 发送data，待发送的数据超过高水位时挂起，等发完了再继续（背压），返回连接是否还在
+    WriteAwaiter write(std::string data);
+    void setWriteHighWaterMark(size_t bytes) { writeHighWaterMark_ = bytes; }
+
+    void shutdown();
+
+    class ReadAwaiter
+    {
+    public:
+        enum Mode
+        {
+            kExactly,
+            kUntil,
+            kSome,
+        };
+        ReadAwaiter(CoConnection *conn, Mode mode, size_t n, std::string delim)
+            : conn_(conn), mode_(mode), n_(n), delim_(std::move(delim)) {}
+
+        bool await_ready() { return tryRead(); }
+        void await_suspend(std::coroutine_handle<> handle);
+        std::string await_resume() { return std::move(result_); }
+
+    private:
+        friend class CoConnection;
+        bool tryRead(); // 条件满足（或者连接断开）时取出数据放到result_里，返回true
+
+        CoConnection *conn_;
+        Mode mode_;
+        size_t n_;
+        std::string delim_;
+        std::string result_;
+        std::coroutine_handle<> handle_;
+    };
+
+    class WriteAwaiter
+    {
+    public:
+        WriteAwaiter(CoConnection *conn, std::string data) : conn_(conn), data_(std::move(data)) {}
+
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle);
+        bool await_resume() const;
+
+    private:
+        CoConnection *conn_;
+        std::string data_;
+    };
+
+private:
+    void handleMessage();    // 有新数据了，看看等着读的协程能不能继续
+    void handleWriteComplete();
+    void handleClose();
+    void resumeReader();
+
+    TcpConnectionPtr conn_;
+    bool closed_;
+    ReadAwaiter *reader_;                // 正在等数据的读，同一时间只能有一个
+    std::coroutine_handle<> writer_;     // 正在等发送缓冲区排空的协程
+    size_t writeHighWaterMark_;
+};
+
+// co_await sleep(loop, seconds)，到时间以后在loop线程里继续执行
+class SleepAwaiter
+{
+public:
+    SleepAwaiter(EventLoop *loop, double seconds) : loop_(loop), seconds_(seconds) {}
+
+    bool await_ready() const { return seconds_ <= 0; }
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() const {}
+
+private:
+    EventLoop *loop_;
+    double seconds_;
+};
+
+inline SleepAwaiter sleep(EventLoop *loop, double seconds)
+{
+    return SleepAwaiter(loop, seconds);
+}
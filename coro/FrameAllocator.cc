@@ -0,0 +1,73 @@
+#include "FrameAllocator.h"
+
+#include <new>
+
+struct FreeBlock
+{
+    FreeBlock *next;
+};
+
+// 每个线程一份，线程退出的时候把缓存的块都还给系统
+struct FrameCache
+{
+    static const int kNumClasses = FrameAllocator::kMaxCached / FrameAllocator::kAlignment;
+
+    FreeBlock *heads[kNumClasses] = {};
+    int counts[kNumClasses] = {};
+
+    ~FrameCache()
+    {
+        for (FreeBlock *head : heads)
+        {
+            while (head)
+            {
+                FreeBlock *next = head->next;
+                ::operator delete(head);
+                head = next;
+            }
+        }
+    }
+};
+
+static thread_local FrameCache t_cache;
+
+// 返回-1表示不缓存
+static int sizeClass(size_t size)
+{
+    if (size == 0 || size > FrameAllocator::kMaxCached)
+    {
+        return -1;
+    }
+    return static_cast<int>((size - 1) / FrameAllocator::kAlignment);
+}
+
+void *FrameAllocator::allocate(size_t size)
+{
+    int cls = sizeClass(size);
+    if (cls < 0)
+    {
+        return ::operator new(size);
+    }
+    FreeBlock *block = t_cache.heads[cls];
+    if (block)
+    {
+        t_cache.heads[cls] = block->next;
+        --t_cache.counts[cls];
+        return block;
+    }
+    return ::operator new((cls + 1) * kAlignment); // 按档的大小分配，放回以后同一档的都能用
+}
+
+void FrameAllocator::deallocate(void *ptr, size_t size)
+{
+    int cls = sizeClass(size);
+    if (cls < 0 || t_cache.counts[cls] >= kMaxBlocksPerClass)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+    FreeBlock *block = static_cast<FreeBlock *>(ptr);
+    block->next = t_cache.heads[cls];
+    t_cache.heads[cls] = block;
+    ++t_cache.counts[cls];
+}
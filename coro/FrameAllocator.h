@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * @brief 协程帧的分配器
+ *
+ * 每个线程（也就是每个loop）一份按大小分档的空闲链表，协程结束时帧放回链表，下一个协程直接复用，
+ * 连接上不停co_await的读写不会每次都走malloc。线程之间不共享，不需要加锁；
+ * 每块内存都是单独向系统要的，在别的线程里释放也没有问题，只是会进入那个线程的链表
+ */
+class FrameAllocator
+{
+public:
+    static void *allocate(size_t size);
+    static void deallocate(void *ptr, size_t size);
+
+    static const size_t kAlignment = 64;  // 按64字节分档
+    static const size_t kMaxCached = 4096; // 超过这个大小的帧直接走operator new
+    static const int kMaxBlocksPerClass = 1024; // 每档最多缓存的块数，多了就还给系统
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "FrameAllocator.h"
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+/**
+ * @brief 协程的返回类型
+ *
+ * Task是惰性的，创建以后不会马上执行，被co_await的时候才开始，执行完直接切回等它的协程（对称转移），
+ * 中间不经过任何队列，也不会换线程。最外层的协程用spawn启动。
+ * 所有的协程帧都从FrameAllocator里分配
+ */
+
+// 协程帧的operator new/delete，promise_type继承它就行
+struct FramePromise
+{
+    static void *operator new(size_t size) { return FrameAllocator::allocate(size); }
+    static void operator delete(void *ptr, size_t size) { FrameAllocator::deallocate(ptr, size); }
+};
+
+template <typename T>
+class Task;
+
+// 协程执行完以后切回co_await它的那个协程，没有的话就停在这里
+struct TaskFinalAwaiter
+{
+    bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+    {
+        std::coroutine_handle<> continuation = handle.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+};
+
+struct TaskPromiseBase : FramePromise
+{
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    TaskFinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+
+    std::coroutine_handle<> continuation; // 等这个协程的协程
+    std::exception_ptr exception;
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase
+{
+    Task<T> get_return_object();
+    void return_value(T value) { result.emplace(std::move(value)); }
+    T take()
+    {
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*result);
+    }
+
+    std::optional<T> result;
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase
+{
+    Task<void> get_return_object();
+    void return_void() {}
+    void take()
+    {
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+template <typename T = void>
+class Task
+{
+public:
+    using promise_type = TaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle handle) : handle_(handle) {}
+    Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (handle_)
+            {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task()
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+        }
+    }
+
+    struct Awaiter
+    {
+        Handle handle;
+
+        bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+        {
+            handle.promise().continuation = caller;
+            return handle; // 直接切到被等的协程里开始执行
+        }
+        T await_resume() { return handle.promise().take(); }
+    };
+
+    Awaiter operator co_await() && noexcept { return Awaiter{handle_}; }
+    Awaiter operator co_await() & noexcept { return Awaiter{handle_}; }
+
+private:
+    Handle handle_;
+};
+
+template <typename T>
+inline Task<T> TaskPromise<T>::get_return_object()
+{
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// 自己管理生命周期的协程，spawn用它来跑最外层的Task，执行完自动销毁
+struct DetachedTask
+{
+    struct promise_type : FramePromise
+    {
+        DetachedTask get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); } // 最外层没人接异常
+    };
+};
+
+inline DetachedTask runDetached(Task<void> task)
+{
+    co_await task;
+}
+
+// 在当前线程里马上开始执行task，直到它第一次挂起；之后在唤醒它的loop线程里接着执行
+inline void spawn(Task<void> task)
+{
+    runDetached(std::move(task));
+}
@@ -0,0 +1,732 @@
+#include "CacheServer.h"
+#include "../../RespParser.h"
+#include "../../RespEncoder.h"
+#include "../../Logger.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+
+static const char *kOomError = "OOM command not allowed when used memory > 'maxmemory'";
+
+// 一条命令的回复怎么由它的各个操作的结果拼出来
+enum ReplyKind
+{
+    kEncoded, // 只有一个操作，它编好的回复就是命令的回复（GET、INCR）
+    kArray,   // 每个操作编好的回复依次作为数组的元素（MGET）
+    kSum,     // 各个操作返回的计数加起来（DEL、EXISTS、DBSIZE）
+    kOk,      // 都成功回OK，有一个内存不够就回OOM（SET、MSET、FLUSHALL）
+};
+
+// dispatch按key拆出来的一个操作，key和value指向连接的inputBuffer_
+struct CacheServer::Op
+{
+    OpType type;
+    int shard;
+    StringPiece key;
+    uint64_t hash;
+    StringPiece value;
+    int64_t delta;
+};
+
+// 一条排队等着发的回复
+struct CacheServer::Reply
+{
+    int kind;
+    int waiting; // 还差几个操作的结果，0表示可以发了
+    int64_t sum;
+    bool failed;
+    std::string data;               // kEncoded的回复，或者不访问数据的命令编好的回复
+    std::vector<std::string> parts; // kArray的每个元素
+};
+
+// 每个连接一个，挂在TcpConnection的context上，只在连接所在的loop里访问
+struct CacheServer::Session
+{
+    Session(Worker *w, int64_t connId) : worker(w), id(connId), protocol(2), nextSeq(0), closing(false) {}
+
+    Worker *worker;
+    int64_t id;
+    RespParser parser;
+    int protocol;
+    std::deque<Reply> pending; // 还没发出去的回复，按命令的顺序
+    uint64_t nextSeq;          // 下一个进队列的回复的序号，pending.front()的序号是nextSeq - pending.size()
+    bool closing;              // QUIT或者协议错误，回复都发完就shutdown
+};
+
+// 转发到别的分片的一个操作，key和value拷在批次的arena里
+struct ForwardedOp
+{
+    int type;
+    int protocol;
+    uint32_t conn; // 批次conns里的下标
+    uint32_t part; // 命令里的第几个操作
+    uint64_t seq;  // 回复的序号
+    uint64_t hash;
+    size_t keyOffset;
+    size_t keyLength;
+    size_t valueOffset;
+    size_t valueLength;
+    int64_t delta;
+    int64_t result;     // 下面三个由分片执行以后填
+    size_t replyOffset; // 编好的回复在批次replies里的位置
+    size_t replyLength;
+};
+
+// 一个loop一轮里发往同一个分片的所有操作，执行完原路带着结果回来
+struct CacheServer::Batch
+{
+    Worker *from;
+    std::vector<TcpConnectionPtr> conns;
+    std::vector<ForwardedOp> ops;
+    std::string arena;
+    Buffer replies;
+};
+
+// 一个loop线程：它的分片，和本轮攒着要发往各个分片的批次
+struct CacheServer::Worker
+{
+    Worker(EventLoop *l, int i, int numShards, size_t maxMemory)
+        : loop(l), index(i), shard(maxMemory), outbox(numShards), flushQueued(false) {}
+
+    EventLoop *loop;
+    int index;
+    Shard shard;
+    std::vector<std::shared_ptr<Batch>> outbox; // 下标是目标分片号
+    bool flushQueued;
+};
+
+// 在key所在分片的loop里执行一个操作：GET、INCRBY的回复编进out，DEL、EXISTS、DBSIZE返回计数，SET内存不够返回-1
+static int64_t runOp(Shard &shard, int type, const StringPiece &key, uint64_t hash,
+                     const StringPiece &value, int64_t delta, RespEncoder &out)
+{
+    switch (type)
+    {
+    case CacheServer::kGet:
+    {
+        Item *item = shard.get(key, hash);
+        if (item != nullptr)
+        {
+            out.bulkString(item->valuePiece());
+        }
+        else
+        {
+            out.null();
+        }
+        return 0;
+    }
+    case CacheServer::kSet:
+        return shard.set(key, hash, value) ? 1 : -1;
+    case CacheServer::kDel:
+        return shard.erase(key, hash) ? 1 : 0;
+    case CacheServer::kExists:
+        return shard.get(key, hash) != nullptr ? 1 : 0;
+    case CacheServer::kIncrBy:
+    {
+        int64_t result = 0;
+        const char *error = nullptr;
+        if (shard.incrBy(key, hash, delta, &result, &error))
+        {
+            out.integer(result);
+        }
+        else
+        {
+            out.error(error);
+        }
+        return 0;
+    }
+    case CacheServer::kDbSize:
+        return static_cast<int64_t>(shard.size());
+    case CacheServer::kFlush:
+        shard.clear();
+        return 1;
+    }
+    return 0;
+}
+
+static void applyResult(int kind, int64_t result, bool *failed, int64_t *sum)
+{
+    if (kind == kSum)
+    {
+        *sum += result;
+    }
+    else if (kind == kOk && result < 0)
+    {
+        *failed = true;
+    }
+}
+
+// kSum和kOk的回复在所有操作都完成以后才知道
+static void finishReply(int kind, int64_t sum, bool failed, RespEncoder &out)
+{
+    if (kind == kSum)
+    {
+        out.integer(sum);
+    }
+    else if (kind == kOk)
+    {
+        if (failed)
+        {
+            out.error(kOomError);
+        }
+        else
+        {
+            out.ok();
+        }
+    }
+}
+
+CacheServer::CacheServer(EventLoop *loop,
+                         const InetAddress &listenAddr,
+                         const std::string &name,
+                         int numThreads,
+                         size_t maxMemoryPerShard)
+    : server_(loop, listenAddr, name),
+      numShards_(numThreads > 0 ? numThreads : 1),
+      maxMemoryPerShard_(maxMemoryPerShard),
+      workers_(numShards_),
+      initializedWorkers_(0)
+{
+    server_.setThreadNum(numThreads);
+    server_.setThreadInitcallback(std::bind(&CacheServer::initWorker, this, std::placeholders::_1));
+    SocketOptions options;
+    options.tcpNoDelay = 1; // 请求响应式的小包
+    server_.setSocketOptions(options);
+    server_.setConnectionCallback(std::bind(&CacheServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(std::bind(&CacheServer::onMessage, this,
+                                         std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+CacheServer::~CacheServer() = default;
+
+void CacheServer::start()
+{
+    LOG_INFO("CacheServer starts listening, %d shards\n", numShards_);
+    server_.start();
+}
+
+// 在每个loop线程开始循环之前执行，给它建一个分片；start()等所有loop线程都起来了才返回
+void CacheServer::initWorker(EventLoop *loop)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int index = initializedWorkers_++;
+    workers_[index].reset(new Worker(loop, index, numShards_, maxMemoryPerShard_));
+}
+
+void CacheServer::onConnection(const TcpConnectionPtr &conn)
+{
+    static std::atomic<int64_t> s_nextId(1);
+    if (!conn->connected())
+    {
+        conn->setContext(std::shared_ptr<void>()); // 还没回来的批次结果看到context是空的就丢掉
+        return;
+    }
+    for (const std::unique_ptr<Worker> &worker : workers_)
+    {
+        if (worker->loop == conn->getLoop())
+        {
+            conn->setContext(std::make_shared<Session>(worker.get(), s_nextId++));
+            return;
+        }
+    }
+    LOG_ERROR("CacheServer: connection %s is not on a shard loop\n", conn->name().c_str());
+    conn->shutdown();
+}
+
+void CacheServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    Session *session = static_cast<Session *>(conn->getContext().get());
+    if (session == nullptr || session->closing)
+    {
+        buf->retrieveAll();
+        return;
+    }
+
+    // 本地就能回的回复都编在这里，最后一次send；loop线程里send(Buffer*)会把它清空，每个线程一个一直复用
+    static thread_local Buffer t_output;
+    static thread_local Buffer t_scratch;
+    t_output.retrieveAll();
+
+    RespParser &parser = session->parser;
+    for (;;)
+    {
+        RespParser::Result result = parser.parse(buf);
+        if (result == RespParser::kNeedMore)
+        {
+            break; // 剩下的半条命令留在buf里，下次接着解析
+        }
+        if (result == RespParser::kProtocolError || !parser.isCommand())
+        {
+            t_scratch.retrieveAll();
+            RespEncoder reply(&t_scratch, session->protocol);
+            reply.error(std::string("ERR Protocol error: ") +
+                        (result == RespParser::kProtocolError ? parser.errorMessage() : "expected an array of bulk strings"));
+            deliver(session, t_scratch, &t_output);
+            session->closing = true;
+            buf->retrieveAll();
+            break;
+        }
+        bool more = dispatch(conn, session, parser, &t_output);
+        buf->retrieve(parser.messageBytes());
+        parser.reset();
+        if (!more)
+        {
+            session->closing = true;
+            buf->retrieveAll();
+            break;
+        }
+    }
+    sendReplies(conn, session, &t_output);
+}
+
+static std::string lowercase(const StringPiece &s)
+{
+    std::string result = s.as_string();
+    for (char &c : result)
+    {
+        if (c >= 'A' && c <= 'Z')
+        {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+    }
+    return result;
+}
+
+bool CacheServer::dispatch(const TcpConnectionPtr &conn, Session *session, const RespParser &parser, Buffer *output)
+{
+    static thread_local Buffer t_scratch;
+    static thread_local std::vector<Op> t_ops;
+    t_scratch.retrieveAll();
+    t_ops.clear();
+
+    const StringPiece name = parser.arg(0);
+    const size_t argc = parser.argc();
+    RespEncoder reply(&t_scratch, session->protocol);
+
+    auto addOp = [&](OpType type, const StringPiece &key) -> Op &
+    {
+        Op op;
+        op.type = type;
+        op.key = key;
+        op.hash = hashKey(key.data(), key.size());
+        op.shard = static_cast<int>((op.hash >> 32) % numShards_); // 低位给分片里的哈希表用
+        op.delta = 0;
+        t_ops.push_back(op);
+        return t_ops.back();
+    };
+    auto wrongArity = [&]()
+    {
+        reply.error("ERR wrong number of arguments for '" + lowercase(name) + "' command");
+        deliver(session, t_scratch, output);
+        return true;
+    };
+
+    if (name.equalsIgnoreCase("GET"))
+    {
+        if (argc != 2)
+        {
+            return wrongArity();
+        }
+        addOp(kGet, parser.arg(1));
+        submit(conn, session, kEncoded, t_ops.data(), t_ops.size(), output);
+    }
+    else if (name.equalsIgnoreCase("SET"))
+    {
+        if (argc < 3)
+        {
+            return wrongArity();
+        }
+        if (argc > 3)
+        {
+            reply.error("ERR syntax error"); // EX、NX这些选项不支持
+            deliver(session, t_scratch, output);
+            return true;
+        }
+        addOp(kSet, parser.arg(1)).value = parser.arg(2);
+        submit(conn, session, kOk, t_ops.data(), t_ops.size(), output);
+    }
+    else if (name.equalsIgnoreCase("MGET") || name.equalsIgnoreCase("DEL") || name.equalsIgnoreCase("EXISTS"))
+    {
+        if (argc < 2)
+        {
+            return wrongArity();
+        }
+        bool mget = name.equalsIgnoreCase("MGET");
+        OpType type = mget ? kGet : (name.equalsIgnoreCase("DEL") ? kDel : kExists);
+        for (size_t i = 1; i < argc; ++i)
+        {
+            addOp(type, parser.arg(i));
+        }
+        submit(conn, session, mget ? kArray : kSum, t_ops.data(), t_ops.size(), output);
+    }
+    else if (name.equalsIgnoreCase("MSET"))
+    {
+        if (argc < 3 || argc % 2 == 0)
+        {
+            return wrongArity();
+        }
+        for (size_t i = 1; i < argc; i += 2)
+        {
+            addOp(kSet, parser.arg(i)).value = parser.arg(i + 1);
+        }
+        submit(conn, session, kOk, t_ops.data(), t_ops.size(), output);
+    }
+    else if (name.equalsIgnoreCase("INCR") || name.equalsIgnoreCase("DECR") ||
+             name.equalsIgnoreCase("INCRBY") || name.equalsIgnoreCase("DECRBY"))
+    {
+        bool by = name.size() == 6;
+        if (argc != (by ? 3u : 2u))
+        {
+            return wrongArity();
+        }
+        int64_t delta = 1;
+        if (by && !RespParser::parseInteger(parser.arg(2).data(), parser.arg(2).size(), &delta))
+        {
+            reply.error("ERR value is not an integer or out of range");
+            deliver(session, t_scratch, output);
+            return true;
+        }
+        if (name[0] == 'D' || name[0] == 'd')
+        {
+            if (delta == INT64_MIN)
+            {
+                reply.error("ERR decrement would overflow");
+                deliver(session, t_scratch, output);
+                return true;
+            }
+            delta = -delta;
+        }
+        addOp(kIncrBy, parser.arg(1)).delta = delta;
+        submit(conn, session, kEncoded, t_ops.data(), t_ops.size(), output);
+    }
+    else if (name.equalsIgnoreCase("DBSIZE") || name.equalsIgnoreCase("FLUSHALL") || name.equalsIgnoreCase("FLUSHDB"))
+    {
+        // 每个分片一个操作，DBSIZE加起来，FLUSHALL都清完了再回OK
+        bool dbsize = name.equalsIgnoreCase("DBSIZE");
+        if (dbsize && argc != 1)
+        {
+            return wrongArity();
+        }
+        for (int i = 0; i < numShards_; ++i)
+        {
+            Op op;
+            op.type = dbsize ? kDbSize : kFlush;
+            op.shard = i;
+            op.hash = 0;
+            op.delta = 0;
+            t_ops.push_back(op);
+        }
+        submit(conn, session, dbsize ? kSum : kOk, t_ops.data(), t_ops.size(), output);
+    }
+    else if (name.equalsIgnoreCase("PING"))
+    {
+        if (argc > 2)
+        {
+            return wrongArity();
+        }
+        if (argc == 2)
+        {
+            reply.bulkString(parser.arg(1));
+        }
+        else
+        {
+            reply.simpleString("PONG");
+        }
+        deliver(session, t_scratch, output);
+    }
+    else if (name.equalsIgnoreCase("ECHO"))
+    {
+        if (argc != 2)
+        {
+            return wrongArity();
+        }
+        reply.bulkString(parser.arg(1));
+        deliver(session, t_scratch, output);
+    }
+    else if (name.equalsIgnoreCase("HELLO"))
+    {
+        // HELLO [protover [AUTH username password] [SETNAME clientname]]，后面的选项不检查
+        if (argc >= 2)
+        {
+            int64_t version = 0;
+            if (!RespParser::parseInteger(parser.arg(1).data(), parser.arg(1).size(), &version) ||
+                version < 2 || version > 3)
+            {
+                reply.error("NOPROTO unsupported protocol version");
+                deliver(session, t_scratch, output);
+                return true;
+            }
+            session->protocol = static_cast<int>(version);
+        }
+        RespEncoder hello(&t_scratch, session->protocol); // 回复已经按新的协议编
+        hello.mapHeader(7);
+        hello.bulkString("server");
+        hello.bulkString("mymuduo-cache");
+        hello.bulkString("version");
+        hello.bulkString("1.0.0");
+        hello.bulkString("proto");
+        hello.integer(session->protocol);
+        hello.bulkString("id");
+        hello.integer(session->id);
+        hello.bulkString("mode");
+        hello.bulkString("standalone");
+        hello.bulkString("role");
+        hello.bulkString("master");
+        hello.bulkString("modules");
+        hello.arrayHeader(0);
+        deliver(session, t_scratch, output);
+    }
+    else if (name.equalsIgnoreCase("SELECT"))
+    {
+        if (argc != 2)
+        {
+            return wrongArity();
+        }
+        if (parser.arg(1) == "0")
+        {
+            reply.ok();
+        }
+        else
+        {
+            reply.error("ERR DB index is out of range"); // 只有一个库
+        }
+        deliver(session, t_scratch, output);
+    }
+    else if (name.equalsIgnoreCase("CONFIG") || name.equalsIgnoreCase("COMMAND"))
+    {
+        reply.arrayHeader(0); // redis-benchmark和redis-cli启动时会问，回空就行
+        deliver(session, t_scratch, output);
+    }
+    else if (name.equalsIgnoreCase("QUIT"))
+    {
+        reply.ok();
+        deliver(session, t_scratch, output);
+        return false;
+    }
+    else
+    {
+        std::string shown = name.size() > 128 ? std::string(name.data(), 128) : name.as_string();
+        reply.error("ERR unknown command '" + shown + "'");
+        deliver(session, t_scratch, output);
+    }
+    return true;
+}
+
+void CacheServer::deliver(Session *session, const Buffer &scratch, Buffer *output)
+{
+    if (session->pending.empty())
+    {
+        output->append(scratch.peek(), scratch.readableBytes());
+        return;
+    }
+    session->pending.emplace_back();
+    Reply &reply = session->pending.back();
+    reply.kind = kEncoded;
+    reply.waiting = 0;
+    reply.sum = 0;
+    reply.failed = false;
+    reply.data.assign(scratch.peek(), scratch.readableBytes());
+    ++session->nextSeq;
+}
+
+void CacheServer::submit(const TcpConnectionPtr &conn, Session *session, int kind, const Op *ops, size_t n, Buffer *output)
+{
+    Worker *self = session->worker;
+    bool local = true;
+    for (size_t i = 0; i < n && local; ++i)
+    {
+        local = ops[i].shard == self->index;
+    }
+
+    if (local && session->pending.empty())
+    {
+        // 最常见的情况：前面没有在等的回复，key都在自己的分片上，就地执行，回复直接编进output
+        RespEncoder out(output, session->protocol);
+        if (kind == kArray)
+        {
+            out.arrayHeader(n);
+        }
+        int64_t sum = 0;
+        bool failed = false;
+        for (size_t i = 0; i < n; ++i)
+        {
+            int64_t result = runOp(self->shard, ops[i].type, ops[i].key, ops[i].hash, ops[i].value, ops[i].delta, out);
+            applyResult(kind, result, &failed, &sum);
+        }
+        finishReply(kind, sum, failed, out);
+        return;
+    }
+
+    // 占一个回复的位置，等所有操作的结果都到了再按顺序发
+    static thread_local Buffer t_scratch;
+    const uint64_t seq = session->nextSeq++;
+    session->pending.emplace_back();
+    Reply &reply = session->pending.back();
+    reply.kind = kind;
+    reply.waiting = static_cast<int>(n);
+    reply.sum = 0;
+    reply.failed = false;
+    if (kind == kArray)
+    {
+        reply.parts.resize(n);
+    }
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const Op &op = ops[i];
+        if (op.shard == self->index)
+        {
+            t_scratch.retrieveAll();
+            RespEncoder out(&t_scratch, session->protocol);
+            int64_t result = runOp(self->shard, op.type, op.key, op.hash, op.value, op.delta, out);
+            applyResult(kind, result, &reply.failed, &reply.sum);
+            if (kind == kEncoded)
+            {
+                reply.data.assign(t_scratch.peek(), t_scratch.readableBytes());
+            }
+            else if (kind == kArray)
+            {
+                reply.parts[i].assign(t_scratch.peek(), t_scratch.readableBytes());
+            }
+            --reply.waiting;
+            continue;
+        }
+
+        // 别的分片上的key：key和value拷进发往那个分片的批次，本轮末尾一起发
+        std::shared_ptr<Batch> &batch = self->outbox[op.shard];
+        if (!batch)
+        {
+            batch = std::make_shared<Batch>();
+            batch->from = self;
+        }
+        if (batch->conns.empty() || batch->conns.back() != conn)
+        {
+            batch->conns.push_back(conn);
+        }
+        ForwardedOp forwarded;
+        forwarded.type = op.type;
+        forwarded.protocol = session->protocol;
+        forwarded.conn = static_cast<uint32_t>(batch->conns.size() - 1);
+        forwarded.part = static_cast<uint32_t>(i);
+        forwarded.seq = seq;
+        forwarded.hash = op.hash;
+        forwarded.keyOffset = batch->arena.size();
+        forwarded.keyLength = op.key.size();
+        batch->arena.append(op.key.data(), op.key.size());
+        forwarded.valueOffset = batch->arena.size();
+        forwarded.valueLength = op.value.size();
+        batch->arena.append(op.value.data(), op.value.size());
+        forwarded.delta = op.delta;
+        forwarded.result = 0;
+        forwarded.replyOffset = 0;
+        forwarded.replyLength = 0;
+        batch->ops.push_back(forwarded);
+
+        if (!self->flushQueued)
+        {
+            self->flushQueued = true;
+            self->loop->queueFlush(std::bind(&CacheServer::flushOutbox, this, self));
+        }
+    }
+}
+
+void CacheServer::flushOutbox(Worker *worker)
+{
+    worker->flushQueued = false;
+    for (int i = 0; i < numShards_; ++i)
+    {
+        std::shared_ptr<Batch> batch;
+        batch.swap(worker->outbox[i]);
+        if (batch)
+        {
+            Worker *target = workers_[i].get();
+            target->loop->runInLoop(std::bind(&CacheServer::executeBatch, this, target, batch));
+        }
+    }
+}
+
+void CacheServer::executeBatch(Worker *worker, const std::shared_ptr<Batch> &batch)
+{
+    const char *arena = batch->arena.data();
+    Buffer &replies = batch->replies;
+    for (ForwardedOp &op : batch->ops)
+    {
+        RespEncoder out(&replies, op.protocol);
+        op.replyOffset = replies.readableBytes();
+        op.result = runOp(worker->shard, op.type,
+                          StringPiece(arena + op.keyOffset, op.keyLength), op.hash,
+                          StringPiece(arena + op.valueOffset, op.valueLength), op.delta, out);
+        op.replyLength = replies.readableBytes() - op.replyOffset;
+    }
+    batch->from->loop->runInLoop(std::bind(&CacheServer::completeBatch, this, batch));
+}
+
+void CacheServer::completeBatch(const std::shared_ptr<Batch> &batch)
+{
+    const char *replies = batch->replies.peek();
+    for (const ForwardedOp &op : batch->ops)
+    {
+        Session *session = static_cast<Session *>(batch->conns[op.conn]->getContext().get());
+        if (session == nullptr)
+        {
+            continue; // 连接已经断开了
+        }
+        Reply &reply = session->pending[op.seq - (session->nextSeq - session->pending.size())];
+        applyResult(reply.kind, op.result, &reply.failed, &reply.sum);
+        if (reply.kind == kEncoded)
+        {
+            reply.data.assign(replies + op.replyOffset, op.replyLength);
+        }
+        else if (reply.kind == kArray)
+        {
+            reply.parts[op.part].assign(replies + op.replyOffset, op.replyLength);
+        }
+        --reply.waiting;
+    }
+
+    static thread_local Buffer t_output;
+    for (const TcpConnectionPtr &conn : batch->conns)
+    {
+        Session *session = static_cast<Session *>(conn->getContext().get());
+        if (session != nullptr)
+        {
+            t_output.retrieveAll();
+            sendReplies(conn, session, &t_output);
+        }
+    }
+}
+
+// 把队列前面已经齐了的回复按顺序编到output后面，一次发出去
+void CacheServer::sendReplies(const TcpConnectionPtr &conn, Session *session, Buffer *output)
+{
+    while (!session->pending.empty() && session->pending.front().waiting == 0)
+    {
+        const Reply &reply = session->pending.front();
+        RespEncoder out(output, session->protocol);
+        if (reply.kind == kArray)
+        {
+            out.arrayHeader(reply.parts.size());
+            for (const std::string &part : reply.parts)
+            {
+                output->append(part.data(), part.size());
+            }
+        }
+        else if (reply.kind == kEncoded)
+        {
+            output->append(reply.data.data(), reply.data.size());
+        }
+        else
+        {
+            finishReply(reply.kind, reply.sum, reply.failed, out);
+        }
+        session->pending.pop_front();
+    }
+    if (output->readableBytes() > 0)
+    {
+        conn->send(output);
+    }
+    if (session->closing && session->pending.empty())
+    {
+        conn->shutdown();
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Shard.h"
+#include "../../TcpServer.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class RespParser;
+
+/**
+ * @brief 说Redis协议（RESP2/RESP3）的分片内存缓存，redis-cli、redis-benchmark可以直接连
+ *
+ * 每个subloop拥有一个分片（Shard），key按哈希值路由到分片，分片的数据只有自己的loop线程访问，不加锁。
+ * 连接所在loop自己分片上的key就地执行；别的分片上的key把操作连同key、value拷进发往那个分片的批次里，
+ * 一轮事件循环里本loop所有连接发往同一个分片的操作攒成一批，在本轮末尾（queueFlush）用一次runInLoop投递过去，
+ * 分片执行完把整批的回复编好，再用一次runInLoop送回来。
+ * 一次onMessage把收到的流水线命令全部解析执行完；同一个连接的回复严格按命令顺序发，
+ * 前面有回复还在等别的分片时，后面的回复哪怕是本地的也先排队。
+ *
+ * 支持的命令：GET SET MGET MSET DEL EXISTS INCR DECR INCRBY DECRBY DBSIZE FLUSHALL FLUSHDB
+ * PING ECHO HELLO SELECT QUIT，redis-benchmark启动时发的CONFIG、COMMAND回空数组。
+ * 连接的处理依赖它所在loop的分片，不要在底下的TcpServer上开rebalance或者autoscale
+ */
+class CacheServer : noncopyable
+{
+public:
+    // numThreads个subloop就是numThreads个分片，0表示只有baseloop一个分片；maxMemoryPerShard为0不限内存
+    CacheServer(EventLoop *loop,
+                const InetAddress &listenAddr,
+                const std::string &name,
+                int numThreads,
+                size_t maxMemoryPerShard = 0);
+    ~CacheServer();
+
+    TcpServer *tcpServer() { return &server_; }
+    int numShards() const { return numShards_; }
+
+    void start();
+
+    enum OpType
+    {
+        kGet,
+        kSet,
+        kDel,
+        kExists,
+        kIncrBy,
+        kDbSize,
+        kFlush,
+    };
+
+private:
+    struct Worker;
+    struct Session;
+    struct Reply;
+    struct Op;
+    struct Batch;
+
+    void initWorker(EventLoop *loop);
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    // 执行一条命令，回复编进output或者排进session的回复队列；返回false表示之后不再处理这个连接的命令（QUIT）
+    bool dispatch(const TcpConnectionPtr &conn, Session *session, const RespParser &parser, Buffer *output);
+    // 按key拆好的一条命令：全在本地分片并且前面没有排队的回复时直接编进output，否则占一个回复位置，远端的操作进批次
+    void submit(const TcpConnectionPtr &conn, Session *session, int kind, const Op *ops, size_t n, Buffer *output);
+    // 不访问数据的命令（PING、HELLO之类）的回复编在scratch里，这里按顺序交出去
+    void deliver(Session *session, const Buffer &scratch, Buffer *output);
+
+    void flushOutbox(Worker *worker);                 // 发起的loop里，本轮末尾
+    void executeBatch(Worker *worker, const std::shared_ptr<Batch> &batch); // 分片的loop里
+    void completeBatch(const std::shared_ptr<Batch> &batch);              // 回到发起的loop里
+    void sendReplies(const TcpConnectionPtr &conn, Session *session, Buffer *output);
+
+    TcpServer server_;
+    const int numShards_;
+    const size_t maxMemoryPerShard_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Worker>> workers_; // 下标就是分片号，start()返回以后不再变，不用加锁读
+    int initializedWorkers_;
+};
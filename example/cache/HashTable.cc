@@ -0,0 +1,105 @@
+#include "HashTable.h"
+
+HashTable::HashTable(size_t initialCapacity)
+    : size_(0)
+{
+    size_t capacity = 16;
+    while (capacity < initialCapacity)
+    {
+        capacity <<= 1;
+    }
+    slots_.assign(capacity, Slot{0, nullptr});
+    mask_ = capacity - 1;
+}
+
+size_t HashTable::locate(const StringPiece &key, uint64_t hash) const
+{
+    size_t i = hash & mask_;
+    for (;;)
+    {
+        const Slot &slot = slots_[i];
+        if (slot.item == nullptr)
+        {
+            return i;
+        }
+        if (slot.hash == hash && slot.item->keyLength == key.size() &&
+            memcmp(slot.item->key(), key.data(), key.size()) == 0)
+        {
+            return i;
+        }
+        i = (i + 1) & mask_;
+    }
+}
+
+Item *HashTable::find(const StringPiece &key, uint64_t hash) const
+{
+    return slots_[locate(key, hash)].item;
+}
+
+Item *HashTable::insert(Item *item, uint64_t hash)
+{
+    StringPiece key = item->keyPiece();
+    size_t i = locate(key, hash);
+    Item *old = slots_[i].item;
+    if (old == nullptr)
+    {
+        if ((size_ + 1) * 4 > slots_.size() * 3)
+        {
+            grow();
+            i = locate(key, hash);
+        }
+        slots_[i].hash = hash;
+        ++size_;
+    }
+    slots_[i].item = item;
+    return old;
+}
+
+Item *HashTable::erase(const StringPiece &key, uint64_t hash)
+{
+    size_t i = locate(key, hash);
+    Item *item = slots_[i].item;
+    if (item == nullptr)
+    {
+        return nullptr;
+    }
+    // 后移：后面同一段连续的槽位里，理想位置不在(i, j]之间的往前挪到i，直到碰到空槽位
+    size_t j = i;
+    for (;;)
+    {
+        j = (j + 1) & mask_;
+        if (slots_[j].item == nullptr)
+        {
+            break;
+        }
+        size_t home = slots_[j].hash & mask_;
+        bool between = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (!between)
+        {
+            slots_[i] = slots_[j];
+            i = j;
+        }
+    }
+    slots_[i].item = nullptr;
+    --size_;
+    return item;
+}
+
+void HashTable::grow()
+{
+    std::vector<Slot> old(slots_.size() * 2, Slot{0, nullptr});
+    old.swap(slots_);
+    mask_ = slots_.size() - 1;
+    for (const Slot &slot : old)
+    {
+        if (slot.item != nullptr)
+        {
+            size_t i = slot.hash & mask_;
+            while (slots_[i].item != nullptr)
+            {
+                i = (i + 1) & mask_;
+            }
+            slots_[i] = slot;
+        }
+    }
+}
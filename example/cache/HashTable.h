@@ -0,0 +1,103 @@
+#pragma once
+
+#include "../../noncopyable.h"
+#include "../../StringPiece.h"
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief 一个键值对，头后面紧跟着key和value，整个放在一个slab块里
+ */
+struct Item
+{
+    uint32_t keyLength;
+    uint32_t valueLength;
+
+    char *key() { return reinterpret_cast<char *>(this + 1); }
+    char *value() { return key() + keyLength; }
+    StringPiece keyPiece() { return StringPiece(key(), keyLength); }
+    StringPiece valuePiece() { return StringPiece(value(), valueLength); }
+
+    static size_t bytesFor(size_t keyLength, size_t valueLength) { return sizeof(Item) + keyLength + valueLength; }
+    size_t bytes() const { return bytesFor(keyLength, valueLength); }
+};
+
+// 64位的key哈希，每次取8个字节乘法混合，最后再搅一遍。低位给哈希表定位，高位给分片路由
+inline uint64_t hashKey(const char *data, size_t len)
+{
+    const uint64_t m1 = 0xff51afd7ed558ccdULL;
+    const uint64_t m2 = 0xc4ceb9fe1a85ec53ULL;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ (len * m1);
+    while (len >= 8)
+    {
+        uint64_t k;
+        memcpy(&k, data, 8);
+        h ^= k * m1;
+        h = ((h << 31) | (h >> 33)) * m2;
+        data += 8;
+        len -= 8;
+    }
+    uint64_t k = 0;
+    memcpy(&k, data, len);
+    h ^= k * m1;
+    h ^= h >> 33;
+    h *= m2;
+    h ^= h >> 29;
+    h *= m1;
+    h ^= h >> 32;
+    return h;
+}
+
+/**
+ * @brief 开放寻址（线性探测）的哈希表，key到Item*，只在分片的loop线程里用
+ *
+ * 槽位里存哈希值和Item指针，探测时先比哈希值，相等了才去Item里比key，大多数不命中的槽位不用碰Item的内存。
+ * 容量是2的幂，装载因子超过3/4时翻倍重建；删除用后移（backward shift），不留墓碑，探测长度不会越删越长。
+ * 表只管指针，Item的分配和释放由Shard负责
+ */
+class HashTable : noncopyable
+{
+public:
+    explicit HashTable(size_t initialCapacity = 1024);
+
+    Item *find(const StringPiece &key, uint64_t hash) const;
+    // 放进item，同一个key原来的Item被换下来返回给调用者释放，原来没有返回nullptr
+    Item *insert(Item *item, uint64_t hash);
+    // 从表里摘掉key，返回原来的Item，不存在返回nullptr
+    Item *erase(const StringPiece &key, uint64_t hash);
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return slots_.size(); }
+
+    // 把所有Item交给f（比如逐个释放），然后清空
+    template <typename Func>
+    void clear(Func f)
+    {
+        for (Slot &slot : slots_)
+        {
+            if (slot.item != nullptr)
+            {
+                f(slot.item);
+                slot.item = nullptr;
+            }
+        }
+        size_ = 0;
+    }
+
+private:
+    struct Slot
+    {
+        uint64_t hash;
+        Item *item; // nullptr表示空槽位
+    };
+
+    size_t locate(const StringPiece &key, uint64_t hash) const; // key所在的槽位，不存在时是它应该插入的空槽位
+    void grow();
+
+    std::vector<Slot> slots_;
+    size_t mask_;
+    size_t size_;
+};
@@ -0,0 +1,92 @@
+#include "Shard.h"
+#include "../../RespParser.h"
+
+#include <stdio.h>
+
+Shard::Shard(size_t maxMemory)
+    : slab_(maxMemory)
+{
+}
+
+Shard::~Shard()
+{
+    clear();
+}
+
+Item *Shard::newItem(const StringPiece &key, const StringPiece &value)
+{
+    Item *item = static_cast<Item *>(slab_.allocate(Item::bytesFor(key.size(), value.size())));
+    if (item != nullptr)
+    {
+        item->keyLength = static_cast<uint32_t>(key.size());
+        item->valueLength = static_cast<uint32_t>(value.size());
+        memcpy(item->key(), key.data(), key.size());
+        memcpy(item->value(), value.data(), value.size());
+    }
+    return item;
+}
+
+bool Shard::set(const StringPiece &key, uint64_t hash, const StringPiece &value)
+{
+    Item *old = table_.find(key, hash);
+    if (old != nullptr && slab_.chunkSize(old->bytes()) == slab_.chunkSize(Item::bytesFor(key.size(), value.size())))
+    {
+        // 新值和旧值落在同一级slab里，原地改写，不用重新分配也不用动哈希表
+        old->valueLength = static_cast<uint32_t>(value.size());
+        memcpy(old->value(), value.data(), value.size());
+        return true;
+    }
+    Item *item = newItem(key, value);
+    if (item == nullptr)
+    {
+        return false;
+    }
+    Item *replaced = table_.insert(item, hash);
+    if (replaced != nullptr)
+    {
+        freeItem(replaced);
+    }
+    return true;
+}
+
+bool Shard::erase(const StringPiece &key, uint64_t hash)
+{
+    Item *item = table_.erase(key, hash);
+    if (item == nullptr)
+    {
+        return false;
+    }
+    freeItem(item);
+    return true;
+}
+
+bool Shard::incrBy(const StringPiece &key, uint64_t hash, int64_t delta, int64_t *result, const char **error)
+{
+    int64_t value = 0;
+    Item *item = table_.find(key, hash);
+    if (item != nullptr && !RespParser::parseInteger(item->value(), item->valueLength, &value))
+    {
+        *error = "ERR value is not an integer or out of range";
+        return false;
+    }
+    if ((delta > 0 && value > INT64_MAX - delta) || (delta < 0 && value < INT64_MIN - delta))
+    {
+        *error = "ERR increment or decrement would overflow";
+        return false;
+    }
+    value += delta;
+    char text[24];
+    int len = snprintf(text, sizeof text, "%lld", static_cast<long long>(value));
+    if (!set(key, hash, StringPiece(text, len)))
+    {
+        *error = "OOM command not allowed when used memory > 'maxmemory'";
+        return false;
+    }
+    *result = value;
+    return true;
+}
+
+void Shard::clear()
+{
+    table_.clear([this](Item *item) { freeItem(item); });
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "HashTable.h"
+#include "SlabAllocator.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief 缓存的一个分片：一张开放寻址哈希表加一个slab分配器
+ *
+ * 每个EventLoop一个分片，分片里的数据只有它自己的loop线程访问（shared-nothing），所以这里都不加锁，
+ * 别的loop上的连接要访问这个分片的key，得把操作转发到这个loop里来执行，见CacheServer
+ */
+class Shard : noncopyable
+{
+public:
+    explicit Shard(size_t maxMemory = 0); // 0表示不限制内存
+    ~Shard();
+
+    Item *get(const StringPiece &key, uint64_t hash) const { return table_.find(key, hash); }
+    // 内存超过上限返回false，原来的值不变
+    bool set(const StringPiece &key, uint64_t hash, const StringPiece &value);
+    bool erase(const StringPiece &key, uint64_t hash);
+    // 原来的值不是整数，或者加完溢出了返回false，error是给客户端的错误信息
+    bool incrBy(const StringPiece &key, uint64_t hash, int64_t delta, int64_t *result, const char **error);
+    void clear();
+
+    size_t size() const { return table_.size(); }
+    size_t usedMemory() const { return slab_.usedBytes(); }
+
+private:
+    Item *newItem(const StringPiece &key, const StringPiece &value);
+    void freeItem(Item *item) { slab_.deallocate(item, item->bytes()); }
+
+    HashTable table_;
+    SlabAllocator slab_;
+};
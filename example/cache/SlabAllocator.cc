@@ -0,0 +1,135 @@
+#include "SlabAllocator.h"
+
+#include <stdlib.h>
+
+static const size_t kAlignment = 8;
+
+SlabAllocator::SlabAllocator(size_t limitBytes, size_t pageBytes, size_t minChunk, double factor)
+    : limitBytes_(limitBytes),
+      pageBytes_(pageBytes),
+      largeBytes_(0),
+      usedBytes_(0)
+{
+    size_t size = minChunk;
+    while (size <= pageBytes_ / 2)
+    {
+        SlabClass slab;
+        slab.chunkSize = size;
+        slab.freeList = nullptr;
+        slab.cursor = nullptr;
+        slab.end = nullptr;
+        classes_.push_back(slab);
+        size_t next = static_cast<size_t>(size * factor);
+        size = (next + kAlignment - 1) / kAlignment * kAlignment;
+    }
+    // 最大一级正好是半页，一页至少切两块
+    SlabClass last;
+    last.chunkSize = pageBytes_ / 2;
+    last.freeList = nullptr;
+    last.cursor = nullptr;
+    last.end = nullptr;
+    if (classes_.empty() || classes_.back().chunkSize < last.chunkSize)
+    {
+        classes_.push_back(last);
+    }
+}
+
+SlabAllocator::~SlabAllocator()
+{
+    for (char *page : pages_)
+    {
+        ::free(page);
+    }
+}
+
+int SlabAllocator::classFor(size_t bytes) const
+{
+    // 级数不多（默认四十几级），二分查找
+    int lo = 0;
+    int hi = static_cast<int>(classes_.size());
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (classes_[mid].chunkSize < bytes)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo < static_cast<int>(classes_.size()) ? lo : -1;
+}
+
+size_t SlabAllocator::chunkSize(size_t bytes) const
+{
+    int id = classFor(bytes);
+    return id < 0 ? bytes : classes_[id].chunkSize;
+}
+
+void *SlabAllocator::allocate(size_t bytes)
+{
+    int id = classFor(bytes);
+    if (id < 0)
+    {
+        if (limitBytes_ > 0 && reservedBytes() + bytes > limitBytes_)
+        {
+            return nullptr;
+        }
+        void *p = ::malloc(bytes);
+        if (p != nullptr)
+        {
+            largeBytes_ += bytes;
+            usedBytes_ += bytes;
+        }
+        return p;
+    }
+
+    SlabClass &slab = classes_[id];
+    void *p = nullptr;
+    if (slab.freeList != nullptr)
+    {
+        p = slab.freeList;
+        slab.freeList = slab.freeList->next;
+    }
+    else
+    {
+        if (slab.cursor == nullptr || static_cast<size_t>(slab.end - slab.cursor) < slab.chunkSize)
+        {
+            if (limitBytes_ > 0 && reservedBytes() + pageBytes_ > limitBytes_)
+            {
+                return nullptr;
+            }
+            char *page = static_cast<char *>(::malloc(pageBytes_));
+            if (page == nullptr)
+            {
+                return nullptr;
+            }
+            pages_.push_back(page);
+            slab.cursor = page;
+            slab.end = page + pageBytes_;
+        }
+        p = slab.cursor;
+        slab.cursor += slab.chunkSize;
+    }
+    usedBytes_ += slab.chunkSize;
+    return p;
+}
+
+void SlabAllocator::deallocate(void *p, size_t bytes)
+{
+    int id = classFor(bytes);
+    if (id < 0)
+    {
+        ::free(p);
+        largeBytes_ -= bytes;
+        usedBytes_ -= bytes;
+        return;
+    }
+    SlabClass &slab = classes_[id];
+    FreeChunk *chunk = static_cast<FreeChunk *>(p);
+    chunk->next = slab.freeList;
+    slab.freeList = chunk;
+    usedBytes_ -= slab.chunkSize;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "../../noncopyable.h"
+
+#include <vector>
+#include <stddef.h>
+
+/**
+ * @brief memcached式的slab分配器，每个分片一个，只在分片的loop线程里用，不加锁
+ *
+ * 块大小从minChunk开始按factor递增分成若干级，每级从pageBytes大的页里切固定大小的块，
+ * 释放的块挂在本级的空闲链表上，下次同级分配直接拿，不还给malloc，也不会有外部碎片。
+ * 超过最大一级的（比页还大的值）直接malloc。
+ * limitBytes不为0时，页和大块加起来不能超过它，超过了allocate返回nullptr，由调用者回OOM
+ */
+class SlabAllocator : noncopyable
+{
+public:
+    explicit SlabAllocator(size_t limitBytes = 0, size_t pageBytes = 1024 * 1024,
+                           size_t minChunk = 64, double factor = 1.25);
+    ~SlabAllocator();
+
+    void *allocate(size_t bytes);
+    void deallocate(void *p, size_t bytes); // bytes要和allocate时一样
+
+    // 分配bytes实际占用的块大小；新旧大小落在同一级时可以原地改写，不用重新分配
+    size_t chunkSize(size_t bytes) const;
+
+    size_t usedBytes() const { return usedBytes_; }     // 正在用的块加起来多大
+    size_t reservedBytes() const { return pages_.size() * pageBytes_ + largeBytes_; } // 从系统拿了多少
+
+private:
+    struct FreeChunk
+    {
+        FreeChunk *next;
+    };
+    struct SlabClass
+    {
+        size_t chunkSize;
+        FreeChunk *freeList;
+        char *cursor; // 当前页里还没切过的部分
+        char *end;
+    };
+
+    int classFor(size_t bytes) const; // 超过最大一级返回-1
+
+    const size_t limitBytes_;
+    const size_t pageBytes_;
+    std::vector<SlabClass> classes_;
+    std::vector<char *> pages_;
+    size_t largeBytes_;
+    size_t usedBytes_;
+};
@@ -0,0 +1,377 @@
+#include "CacheServer.h"
+#include "../../TcpClient.h"
+#include "../../EventLoopThread.h"
+#include "../../RespParser.h"
+#include "../../RespEncoder.h"
+#include "../../Logger.h"
+#include "../../benchmark/HdrHistogram.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @brief redis-benchmark式的GET/SET压测，-h -p -c -n -P -d -r -t的意思和redis-benchmark一样
+ *
+ * 默认在本进程里起一个CacheServer（-s个分片），走回环地址压；给了-p就去压外面的服务器，
+ * 可以拿同样的参数压真正的redis比较。每个连接一次发-P条命令，收齐了再发下一批（闭环），
+ * key是key:加[0, -r)里的随机数，value是-d个字节，先跑SET再跑GET，GET基本都能命中。
+ * 每条命令的延迟从它所在的那一批发出去算到它的回复解析完，每个客户端loop一个直方图，结束时合并
+ *
+ * 用法：./cachebench [-h 主机] [-p 端口] [-c 连接数] [-n 每项请求数] [-P 流水线深度列表]
+ *                    [-d 值大小] [-r key空间] [-t set,get] [-s 服务端分片数] [-T 客户端线程数]
+ */
+
+static const uint16_t kPort = 8027;
+
+using Clock = std::chrono::steady_clock;
+
+template <typename Func>
+static void runInLoopAndWait(EventLoop *loop, Func func)
+{
+    std::promise<void> done;
+    loop->runInLoop([&]()
+                    {
+                        func();
+                        done.set_value();
+                    });
+    done.get_future().wait();
+}
+
+static std::vector<int> parseList(const char *arg)
+{
+    std::vector<int> values;
+    const char *p = arg;
+    while (*p)
+    {
+        values.push_back(atoi(p));
+        while (*p && *p != ',')
+        {
+            ++p;
+        }
+        if (*p == ',')
+        {
+            ++p;
+        }
+    }
+    return values;
+}
+
+struct Options
+{
+    std::string host = "127.0.0.1";
+    uint16_t port = 0; // 0表示在本进程里起服务器
+    int clients = 50;
+    int requests = 200000;
+    std::vector<int> pipelines = {1, 16};
+    int dataSize = 3;
+    int keyspace = 100000;
+    std::vector<std::string> tests = {"set", "get"};
+    int shards = 2;
+    int clientThreads = 1;
+};
+
+// 一项测试（一种命令、一个流水线深度）里所有客户端共享的状态
+struct Run
+{
+    bool set = false;
+    int pipeline = 1;
+    int dataSize = 3;
+    int keyspace = 1;
+    std::atomic<int64_t> issued{0};    // 已经分出去的请求数，到了requests就不再发
+    std::atomic<int64_t> completed{0}; // 收到回复的请求数
+    std::atomic<int64_t> errors{0};
+    int64_t requests = 0;
+};
+
+// 一条连接，只在所属的loop线程里访问
+struct Client
+{
+    std::unique_ptr<TcpClient> tcp;
+    RespParser parser;
+    int outstanding = 0;
+    Clock::time_point sentAt;
+};
+
+// 一个客户端loop，除了connected以外都只在loop线程里访问
+struct ClientLoop
+{
+    EventLoop *loop = nullptr;
+    std::vector<std::unique_ptr<Client>> clients;
+    HdrHistogram histogram; // 纳秒
+    std::mt19937 random{12345};
+    Buffer request;
+    std::string value;
+    std::atomic<int> connected{0};
+};
+
+// 从总数里领一批请求编好发出去，领不到（都分完了）就不发
+static void sendBatch(ClientLoop *cl, Client *client, Run *run)
+{
+    int64_t first = run->issued.fetch_add(run->pipeline);
+    int count = static_cast<int>(std::min<int64_t>(run->pipeline, run->requests - first));
+    if (count <= 0)
+    {
+        return;
+    }
+    std::uniform_int_distribution<int> pick(0, run->keyspace - 1);
+    cl->request.retrieveAll();
+    char key[32];
+    for (int i = 0; i < count; ++i)
+    {
+        int len = snprintf(key, sizeof key, "key:%012d", pick(cl->random));
+        if (run->set)
+        {
+            RespEncoder::command(&cl->request, {"SET", StringPiece(key, len), cl->value});
+        }
+        else
+        {
+            RespEncoder::command(&cl->request, {"GET", StringPiece(key, len)});
+        }
+    }
+    client->outstanding = count;
+    client->sentAt = Clock::now();
+    client->tcp->connection()->send(&cl->request);
+}
+
+static void onReply(ClientLoop *cl, Client *client, Run *run, Buffer *buf)
+{
+    int done = 0;
+    while (client->parser.parse(buf) == RespParser::kComplete)
+    {
+        char type = static_cast<char>(client->parser.root().type);
+        if (type == RespParser::kError || type == RespParser::kBulkError)
+        {
+            ++run->errors;
+        }
+        buf->retrieve(client->parser.messageBytes());
+        client->parser.reset();
+        ++done;
+    }
+    if (done == 0)
+    {
+        return;
+    }
+    int64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - client->sentAt).count();
+    for (int i = 0; i < done; ++i)
+    {
+        cl->histogram.record(latency);
+    }
+    run->completed += done;
+    client->outstanding -= done;
+    if (client->outstanding == 0)
+    {
+        sendBatch(cl, client, run);
+    }
+}
+
+static void runTest(const Options &options, const std::vector<std::unique_ptr<ClientLoop>> &loops,
+                    const std::string &test, int pipeline, Run *run)
+{
+    run->set = test == "set";
+    run->pipeline = pipeline;
+    run->dataSize = options.dataSize;
+    run->keyspace = options.keyspace;
+    run->requests = options.requests;
+    run->issued = 0;
+    run->completed = 0;
+    run->errors = 0;
+
+    for (auto &cl : loops)
+    {
+        ClientLoop *raw = cl.get();
+        runInLoopAndWait(raw->loop, [raw, &options]()
+                         {
+                             raw->histogram = HdrHistogram();
+                             raw->value.assign(options.dataSize, 'x');
+                         });
+    }
+
+    Clock::time_point start = Clock::now();
+    for (auto &cl : loops)
+    {
+        ClientLoop *raw = cl.get();
+        raw->loop->runInLoop([raw, run]()
+                             {
+                                 for (auto &client : raw->clients)
+                                 {
+                                     sendBatch(raw, client.get(), run);
+                                 }
+                             });
+    }
+    while (run->completed < run->requests)
+    {
+        usleep(200);
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    HdrHistogram merged;
+    for (auto &cl : loops)
+    {
+        ClientLoop *raw = cl.get();
+        runInLoopAndWait(raw->loop, [raw, &merged]() { merged.merge(raw->histogram); });
+    }
+
+    std::string name = test;
+    for (char &c : name)
+    {
+        c = static_cast<char>(toupper(c));
+    }
+    printf("bench=cache test=%s clients=%d pipeline=%d datasize=%d keyspace=%d shards=%d client_threads=%d "
+           "requests=%ld seconds=%.2f requests_per_sec=%.0f p50_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f errors=%ld\n",
+           name.c_str(), options.clients, pipeline, options.dataSize, options.keyspace,
+           options.port == 0 ? options.shards : 0, options.clientThreads, static_cast<long>(run->requests),
+           elapsed, run->requests / elapsed, merged.valueAtPercentile(50) / 1000.0,
+           merged.valueAtPercentile(99) / 1000.0, merged.valueAtPercentile(99.9) / 1000.0,
+           merged.max() / 1000.0, static_cast<long>(run->errors.load()));
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:c:n:P:d:r:t:s:T:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'h': options.host = optarg; break;
+        case 'p': options.port = static_cast<uint16_t>(atoi(optarg)); break;
+        case 'c': options.clients = atoi(optarg); break;
+        case 'n': options.requests = atoi(optarg); break;
+        case 'P': options.pipelines = parseList(optarg); break;
+        case 'd': options.dataSize = atoi(optarg); break;
+        case 'r': options.keyspace = atoi(optarg); break;
+        case 't':
+        {
+            options.tests.clear();
+            std::string list = optarg;
+            size_t pos = 0;
+            while (pos <= list.size())
+            {
+                size_t comma = list.find(',', pos);
+                if (comma == std::string::npos)
+                {
+                    comma = list.size();
+                }
+                std::string test = list.substr(pos, comma - pos);
+                for (char &c : test)
+                {
+                    c = static_cast<char>(tolower(c));
+                }
+                if (test == "set" || test == "get")
+                {
+                    options.tests.push_back(test);
+                }
+                pos = comma + 1;
+            }
+            break;
+        }
+        case 's': options.shards = atoi(optarg); break;
+        case 'T': options.clientThreads = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-h host] [-p port] [-c clients] [-n requests] [-P pipelines] "
+                            "[-d datasize] [-r keyspace] [-t set,get] [-s shards] [-T client threads]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // 没给端口就在本进程里起一个CacheServer
+    EventLoop *serverLoop = nullptr;
+    std::thread serverThread;
+    uint16_t port = options.port;
+    if (port == 0)
+    {
+        port = kPort;
+        std::promise<EventLoop *> serverReady;
+        serverThread = std::thread([&]()
+                                   {
+                                       EventLoop loop;
+                                       CacheServer server(&loop, InetAddress(kPort), "cachebench", options.shards);
+                                       server.start();
+                                       serverReady.set_value(&loop);
+                                       loop.loop();
+                                   });
+        serverLoop = serverReady.get_future().get();
+    }
+
+    Run run; // 每项测试开始前重置；上一项的回复都收齐了才开始下一项，客户端不会看到一半的状态
+    std::vector<std::unique_ptr<EventLoopThread>> threads;
+    std::vector<std::unique_ptr<ClientLoop>> loops;
+    for (int i = 0; i < options.clientThreads; ++i)
+    {
+        threads.emplace_back(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "cachebench-client"));
+        loops.emplace_back(new ClientLoop);
+        ClientLoop *cl = loops.back().get();
+        cl->loop = threads.back()->startLoop();
+        cl->random.seed(12345 + i);
+        int share = options.clients / options.clientThreads + (i < options.clients % options.clientThreads ? 1 : 0);
+        runInLoopAndWait(cl->loop, [&]()
+                         {
+                             for (int k = 0; k < share; ++k)
+                             {
+                                 Client *client = new Client;
+                                 client->tcp.reset(new TcpClient(cl->loop, InetAddress(port, options.host), "cachebench"));
+                                 SocketOptions socketOptions;
+                                 socketOptions.tcpNoDelay = 1;
+                                 client->tcp->setSocketOptions(socketOptions);
+                                 client->tcp->setConnectionCallback([cl](const TcpConnectionPtr &conn)
+                                                                    {
+                                                                        if (conn->connected())
+                                                                        {
+                                                                            ++cl->connected;
+                                                                        }
+                                                                    });
+                                 client->tcp->setMessageCallback([cl, client, &run](const TcpConnectionPtr &, Buffer *buf, Timestamp)
+                                                                 { onReply(cl, client, &run, buf); });
+                                 client->tcp->connect();
+                                 cl->clients.emplace_back(client);
+                             }
+                         });
+    }
+    for (;;)
+    {
+        int total = 0;
+        for (auto &cl : loops)
+        {
+            total += cl->connected;
+        }
+        if (total >= options.clients)
+        {
+            break;
+        }
+        usleep(1000);
+    }
+
+    for (int pipeline : options.pipelines)
+    {
+        for (const std::string &test : options.tests)
+        {
+            runTest(options, loops, test, pipeline, &run);
+        }
+    }
+
+    // 先停服务端，客户端关掉以后服务端还在写的话会收到SIGPIPE
+    if (serverLoop != nullptr)
+    {
+        serverLoop->quit();
+        serverThread.join();
+    }
+    for (auto &cl : loops)
+    {
+        ClientLoop *raw = cl.get();
+        runInLoopAndWait(raw->loop, [raw]() { raw->clients.clear(); });
+    }
+    threads.clear();
+    return 0;
+}
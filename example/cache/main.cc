@@ -0,0 +1,22 @@
+#include "CacheServer.h"
+#include "../../Logger.h"
+
+#include <stdlib.h>
+
+/**
+ * @brief 分片内存缓存服务器，可以用redis-cli、redis-benchmark或者同目录下的cachebench测
+ *
+ * 用法：./cacheserver [端口] [线程数（分片数）] [每个分片的内存上限MB，0不限]
+ */
+int main(int argc, char *argv[])
+{
+    uint16_t port = static_cast<uint16_t>(argc > 1 ? atoi(argv[1]) : 6380);
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+    size_t maxMemoryMB = argc > 3 ? static_cast<size_t>(atol(argv[3])) : 0;
+
+    EventLoop loop;
+    CacheServer server(&loop, InetAddress(port), "CacheServer", threads, maxMemoryMB * 1024 * 1024);
+    server.start();
+    loop.loop();
+    return 0;
+}
@@ -0,0 +1,190 @@
+#include "../WebSocketServer.h"
+#include "../EventLoop.h"
+#include "../Logger.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/**
+ * @brief 握手完成的WebSocket连接迁到别的subloop、原来的loop退出以后，ping要照样发，断开时不能碰已经没了的loop
+ *
+ * 服务端两个subloop，ping间隔100ms；客户端收到ping就回pong。
+ * 收到几个ping以后retire连接所在的loop（连接迁走，loop线程退出），再看之后的ping还在不在、连接有没有被当成空闲断开。
+ * 失败时退出码非0，配合-fsanitize=address跑可以查出断开时访问已经析构的loop
+ */
+
+static const uint16_t kPort = 8031;
+static const double kPingInterval = 0.1;
+
+static std::atomic<int> g_pings(0);
+static std::atomic<bool> g_closed(false);
+static int g_failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+    if (!ok)
+    {
+        ++g_failures;
+    }
+}
+
+static bool readFull(int fd, char *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        ssize_t n = ::read(fd, buf + got, len - got);
+        if (n <= 0)
+        {
+            return false;
+        }
+        got += n;
+    }
+    return true;
+}
+
+// 握手，然后一直读帧：ping回pong（客户端的帧要带掩码），读到EOF或者关闭帧就结束
+static void runClient(int fd)
+{
+    const char request[] = "GET / HTTP/1.1\r\n"
+                           "Host: 127.0.0.1\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                           "Sec-WebSocket-Version: 13\r\n\r\n";
+    ::write(fd, request, sizeof request - 1);
+    std::string response;
+    char c;
+    while (response.find("\r\n\r\n") == std::string::npos && ::read(fd, &c, 1) == 1)
+    {
+        response.push_back(c);
+    }
+    if (response.compare(0, 12, "HTTP/1.1 101") != 0)
+    {
+        g_closed = true;
+        return;
+    }
+
+    char header[2];
+    while (readFull(fd, header, 2))
+    {
+        int opcode = header[0] & 0x0f;
+        size_t len = header[1] & 0x7f; // 服务端发的都是小的控制帧
+        char payload[125];
+        if (len > sizeof payload || !readFull(fd, payload, len) || opcode == 0x8)
+        {
+            break;
+        }
+        if (opcode == 0x9)
+        {
+            ++g_pings;
+            char pong[6 + sizeof payload] = {static_cast<char>(0x8a), static_cast<char>(0x80 | len), 1, 2, 3, 4};
+            for (size_t i = 0; i < len; ++i)
+            {
+                pong[6 + i] = payload[i] ^ pong[2 + i % 4];
+            }
+            ::write(fd, pong, 6 + len);
+        }
+    }
+    g_closed = true;
+}
+
+int main()
+{
+    EventLoop loop;
+    WebSocketServer server(&loop, InetAddress(kPort), "wsmigrate");
+    server.setThreadNum(2);
+    server.setPingInterval(kPingInterval);
+
+    std::mutex mutex;
+    std::vector<EventLoop *> subLoops;
+    server.tcpServer()->setThreadInitcallback([&](EventLoop *ioLoop)
+                                              {
+                                                  std::lock_guard<std::mutex> lock(mutex);
+                                                  subLoops.push_back(ioLoop);
+                                              });
+    TcpConnectionPtr conn;
+    std::atomic<int> disconnects(0);
+    server.setConnectionCallback([&](const TcpConnectionPtr &c)
+                                 {
+                                     if (c->connected())
+                                     {
+                                         loop.runInLoop([&, c]() { conn = c; });
+                                     }
+                                     else
+                                     {
+                                         ++disconnects;
+                                     }
+                                 });
+    server.start();
+
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (::connect(fd, (sockaddr *)&addr, sizeof addr) < 0)
+    {
+        perror("connect");
+        return 1;
+    }
+    std::thread client(runClient, fd);
+
+    EventLoop *oldLoop = nullptr;
+    int pingsBeforeMigration = 0;
+    // 先收几个ping，再把连接所在的loop退掉
+    loop.runAfter(kPingInterval * 3.5, [&]()
+                  {
+                      check(conn != nullptr, "handshake completed");
+                      if (!conn)
+                      {
+                          loop.quit();
+                          return;
+                      }
+                      pingsBeforeMigration = g_pings;
+                      check(pingsBeforeMigration >= 2, "pings before migration");
+                      oldLoop = conn->getLoop();
+                      server.tcpServer()->retireLoop(oldLoop, TcpServer::kMigrateConnections);
+                  });
+    // 原来的loop早就退出了，这段时间里应该又发了好几个ping
+    loop.runAfter(kPingInterval * 12, [&]()
+                  {
+                      if (!conn)
+                      {
+                          return;
+                      }
+                      EventLoop *other = nullptr;
+                      {
+                          std::lock_guard<std::mutex> lock(mutex);
+                          other = subLoops[0] == oldLoop ? subLoops[1] : subLoops[0];
+                      }
+                      check(conn->getLoop() == other, "connection migrated to the other loop");
+                      check(conn->connected() && !g_closed, "connection still open");
+                      check(g_pings - pingsBeforeMigration >= 4, "pings continue after the old loop exited");
+                      check(disconnects == 0, "no disconnect while migrating");
+                      ::shutdown(fd, SHUT_WR); // 断开走的是新loop，要能取消baseloop上的ping定时器
+                  });
+    loop.runAfter(kPingInterval * 15, [&]()
+                  {
+                      check(disconnects == 1, "disconnect delivered once");
+                      conn.reset();
+                      loop.quit();
+                  });
+    loop.loop();
+
+    client.join();
+    ::close(fd);
+    printf("%s\n", g_failures == 0 ? "all passed" : "FAILED");
+    return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,385 @@
+#include "../BinaryLogging.h"
+#include "../Logger.h"
+#include "../Timestamp.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief 把BinaryLogging写的二进制日志还原成文本，格式和Logger的文本日志一样
+ *
+ * 按文件里的顺序读记录：站点登记下来，每个时钟换算点之后的一批日志按时间排好序再输出
+ * （后台线程是一个线程一个线程地读的，同一批里不同线程的日志在文件里不是按时间排的）
+ *
+ * 用法：./logdecode 文件...   结果打到标准输出
+ */
+
+struct Site
+{
+    int level = 0;
+    int line = 0;
+    std::string file;
+    std::string fmt;
+    std::string types;
+};
+
+struct Arg
+{
+    char type;
+    int64_t i;
+    uint64_t u;
+    double d;
+    std::string s;
+};
+
+struct Line
+{
+    int64_t micros;
+    uint64_t ticks;
+    size_t order; // 时间相同的保持文件里的顺序
+    std::string text;
+};
+
+// 从文件内容里按顺序读数据，读过头了就标记失败
+class Reader
+{
+public:
+    Reader(const char *data, size_t len) : data_(data), len_(len), pos_(0), failed_(false) {}
+
+    template <typename T>
+    T pod()
+    {
+        T value = T();
+        if (remaining() < sizeof value)
+        {
+            failed_ = true;
+            pos_ = len_;
+            return value;
+        }
+        memcpy(&value, data_ + pos_, sizeof value);
+        pos_ += sizeof value;
+        return value;
+    }
+    std::string bytes(size_t n)
+    {
+        if (remaining() < n)
+        {
+            failed_ = true;
+            pos_ = len_;
+            return std::string();
+        }
+        std::string s(data_ + pos_, n);
+        pos_ += n;
+        return s;
+    }
+    std::string string16() { return bytes(pod<uint16_t>()); }
+
+    size_t remaining() const { return len_ - pos_; }
+    bool failed() const { return failed_; }
+
+private:
+    const char *data_;
+    size_t len_;
+    size_t pos_;
+    bool failed_;
+};
+
+static const char *levelName(int level)
+{
+    switch (level)
+    {
+    case DEBUG:
+        return "[DEBUG]";
+    case INFO:
+        return "[INFO]";
+    case ERROR:
+        return "[ERROR]";
+    case FATAL:
+        return "[FATAL]";
+    default:
+        return "";
+    }
+}
+
+// 按一个printf转换说明（已经去掉了长度修饰符）和记下来的参数渲染
+static void appendConversion(std::string &out, const std::string &spec, char conv, bool wide, const Arg *arg)
+{
+    char buf[4096];
+    int n = 0;
+    std::string f = spec;
+    if (arg == nullptr)
+    {
+        out += "<missing>";
+        return;
+    }
+    int64_t asInt = arg->type == 'd' ? static_cast<int64_t>(arg->d) : (arg->type == 'u' || arg->type == 'p') ? static_cast<int64_t>(arg->u) : arg->i;
+    switch (conv)
+    {
+    case 'd':
+    case 'i':
+        if (wide)
+        {
+            f.insert(f.size() - 1, "ll");
+            n = snprintf(buf, sizeof buf, f.c_str(), static_cast<long long>(asInt));
+        }
+        else
+        {
+            n = snprintf(buf, sizeof buf, f.c_str(), static_cast<int>(asInt));
+        }
+        break;
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+        if (wide)
+        {
+            f.insert(f.size() - 1, "ll");
+            n = snprintf(buf, sizeof buf, f.c_str(), static_cast<unsigned long long>(asInt));
+        }
+        else
+        {
+            n = snprintf(buf, sizeof buf, f.c_str(), static_cast<unsigned>(asInt));
+        }
+        break;
+    case 'c':
+        n = snprintf(buf, sizeof buf, f.c_str(), static_cast<int>(asInt));
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        n = snprintf(buf, sizeof buf, f.c_str(), arg->type == 'd' ? arg->d : static_cast<double>(asInt));
+        break;
+    case 's':
+        n = snprintf(buf, sizeof buf, f.c_str(), arg->type == 's' ? arg->s.c_str() : "<non-string>");
+        break;
+    case 'p':
+        n = snprintf(buf, sizeof buf, f.c_str(), reinterpret_cast<void *>(static_cast<uintptr_t>(asInt)));
+        break;
+    default:
+        out += spec;
+        return;
+    }
+    if (n > 0)
+    {
+        out.append(buf, std::min<size_t>(n, sizeof buf - 1));
+    }
+}
+
+static std::string render(const std::string &fmt, const std::vector<Arg> &args)
+{
+    std::string out;
+    size_t next = 0;
+    for (size_t i = 0; i < fmt.size(); ++i)
+    {
+        if (fmt[i] != '%')
+        {
+            out.push_back(fmt[i]);
+            continue;
+        }
+        if (i + 1 < fmt.size() && fmt[i + 1] == '%')
+        {
+            out.push_back('%');
+            ++i;
+            continue;
+        }
+        // %[标志][宽度][.精度][长度修饰符]转换字符，长度修饰符去掉，按记下来的类型重新决定
+        std::string spec = "%";
+        size_t j = i + 1;
+        while (j < fmt.size() && strchr("-+ #0", fmt[j]))
+        {
+            spec.push_back(fmt[j++]);
+        }
+        while (j < fmt.size() && (isdigit(static_cast<unsigned char>(fmt[j])) || fmt[j] == '.'))
+        {
+            spec.push_back(fmt[j++]);
+        }
+        bool wide = false;
+        while (j < fmt.size() && strchr("hlLqjzt", fmt[j]))
+        {
+            wide = wide || fmt[j] != 'h';
+            ++j;
+        }
+        if (j >= fmt.size())
+        {
+            out += spec;
+            break;
+        }
+        char conv = fmt[j];
+        spec.push_back(conv);
+        appendConversion(out, spec, conv, wide, next < args.size() ? &args[next] : nullptr);
+        ++next;
+        i = j;
+    }
+    return out;
+}
+
+static void flushLines(std::vector<Line> &lines)
+{
+    std::sort(lines.begin(), lines.end(), [](const Line &a, const Line &b)
+              { return a.ticks != b.ticks ? a.ticks < b.ticks : a.order < b.order; });
+    for (const Line &line : lines)
+    {
+        fwrite(line.text.data(), 1, line.text.size(), stdout);
+    }
+    lines.clear();
+}
+
+static bool decodeFile(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == nullptr)
+    {
+        perror(path);
+        return false;
+    }
+    std::string content;
+    char chunk[64 * 1024];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof chunk, fp)) > 0)
+    {
+        content.append(chunk, n);
+    }
+    fclose(fp);
+
+    if (content.size() < sizeof BinaryLogging::kMagic ||
+        memcmp(content.data(), BinaryLogging::kMagic, sizeof BinaryLogging::kMagic) != 0)
+    {
+        fprintf(stderr, "%s: not a binary log\n", path);
+        return false;
+    }
+
+    Reader reader(content.data() + sizeof BinaryLogging::kMagic, content.size() - sizeof BinaryLogging::kMagic);
+    std::vector<Site> sites;
+    uint64_t anchorTicks = 0;
+    int64_t anchorMicros = 0;
+    double ticksPerMicro = 1;
+    std::vector<Line> lines;
+    size_t order = 0;
+
+    auto toMicros = [&](uint64_t ticks)
+    {
+        return anchorMicros + static_cast<int64_t>(static_cast<int64_t>(ticks - anchorTicks) / ticksPerMicro);
+    };
+    auto makeLine = [&](int level, uint64_t ticks, const std::string &msg)
+    {
+        char timebuf[Timestamp::kFormattedSize];
+        int64_t micros = toMicros(ticks);
+        Timestamp(micros).format(timebuf, sizeof timebuf);
+        Line line = {micros, ticks, order++, std::string(levelName(level)) + timebuf + " : " + msg + "\n"};
+        lines.push_back(std::move(line));
+    };
+
+    while (reader.remaining() > 0 && !reader.failed())
+    {
+        char type = reader.pod<char>();
+        if (type == BinaryLogging::kSiteRecord)
+        {
+            uint32_t id = reader.pod<uint32_t>();
+            Site site;
+            site.level = reader.pod<uint8_t>();
+            site.line = reader.pod<uint32_t>();
+            site.file = reader.string16();
+            site.fmt = reader.string16();
+            site.types = reader.bytes(reader.pod<uint8_t>());
+            if (id >= sites.size())
+            {
+                sites.resize(id + 1);
+            }
+            sites[id] = site;
+        }
+        else if (type == BinaryLogging::kAnchorRecord)
+        {
+            flushLines(lines);
+            anchorTicks = reader.pod<uint64_t>();
+            anchorMicros = reader.pod<int64_t>();
+            ticksPerMicro = reader.pod<double>();
+        }
+        else if (type == BinaryLogging::kDropRecord)
+        {
+            int32_t tid = reader.pod<int32_t>();
+            uint64_t dropped = reader.pod<uint64_t>();
+            char msg[128];
+            snprintf(msg, sizeof msg, "logdecode: thread %d dropped %llu messages, staging buffer full",
+                     tid, static_cast<unsigned long long>(dropped));
+            makeLine(ERROR, anchorTicks, msg);
+        }
+        else if (type == BinaryLogging::kChunkRecord)
+        {
+            reader.pod<int32_t>(); // tid，文本格式里没有
+            uint32_t bytes = reader.pod<uint32_t>();
+            std::string entries = reader.bytes(bytes);
+            Reader entryReader(entries.data(), entries.size());
+            while (entryReader.remaining() > 0 && !entryReader.failed())
+            {
+                BinaryLogging::EntryHeader header = entryReader.pod<BinaryLogging::EntryHeader>();
+                if (header.site >= sites.size() || header.size < sizeof header)
+                {
+                    fprintf(stderr, "%s: corrupt entry (site %u)\n", path, header.site);
+                    return false;
+                }
+                std::string argBytes = entryReader.bytes(header.size - sizeof header);
+                Reader argReader(argBytes.data(), argBytes.size());
+                const Site &site = sites[header.site];
+                std::vector<Arg> args;
+                for (char t : site.types)
+                {
+                    Arg arg = {t, 0, 0, 0, std::string()};
+                    if (t == 'i')
+                    {
+                        arg.i = argReader.pod<int64_t>();
+                    }
+                    else if (t == 'u' || t == 'p')
+                    {
+                        arg.u = argReader.pod<uint64_t>();
+                    }
+                    else if (t == 'd')
+                    {
+                        arg.d = argReader.pod<double>();
+                    }
+                    else if (t == 's')
+                    {
+                        arg.s = argReader.bytes(argReader.pod<uint32_t>());
+                    }
+                    args.push_back(std::move(arg));
+                }
+                makeLine(site.level, header.ticks, render(site.fmt, args));
+            }
+        }
+        else
+        {
+            fprintf(stderr, "%s: unknown record type 0x%02x\n", path, static_cast<unsigned char>(type));
+            return false;
+        }
+    }
+    flushLines(lines);
+    if (reader.failed())
+    {
+        fprintf(stderr, "%s: truncated file\n", path);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s binary_log_file...\n", argv[0]);
+        return 1;
+    }
+    bool ok = true;
+    for (int i = 1; i < argc; ++i)
+    {
+        ok = decodeFile(argv[i]) && ok;
+    }
+    return ok ? 0 : 1;
+}